@@ -6,6 +6,8 @@
 
 void FArgParser::AddArg(const FString& ArgName, bool bRequired, EType ValidateType)
 {
+	SANDBOX_LLM_SCOPE(ESandBoxMemoryTag::ArgParser);
+
 	if (!ensureAlwaysMsgf(!bIsValid.IsSet(), TEXT("すでにパース済みです。引数情報を変更するには一度リセットしてください。")))
 	{
 		return;
@@ -17,10 +19,12 @@ void FArgParser::AddArg(const FString& ArgName, bool bRequired, EType ValidateTy
 	}
 
 	ArgInfos.Add(ArgName, FArgInfo{ValidateType, bRequired});
+	UpdateMemoryUsage();
 }
 
-bool FArgParser::Parse(const FString& Command)
+bool FArgParser::Parse(const TCHAR* Command)
 {
+	SANDBOX_LLM_SCOPE(ESandBoxMemoryTag::ArgParser);
 	bIsValid.Reset();
 
 	bool bSuccess = true;
@@ -37,10 +41,11 @@ bool FArgParser::Parse(const FString& Command)
 
 	if (!bSuccess)
 	{
-		UE_LOG(LogTemp, Error, TEXT("コマンド %s のパースに失敗しました"), *Command);
+		UE_LOG(LogTemp, Error, TEXT("コマンド %s のパースに失敗しました"), Command);
 	}
 
 	bIsValid = bSuccess;
+	UpdateMemoryUsage();
 	return bIsValid.GetValue();
 }
 
@@ -48,6 +53,21 @@ void FArgParser::Reset()
 {
 	bIsValid.Reset();
 	ArgInfos.Reset();
+	UpdateMemoryUsage();
+}
+
+void FArgParser::UpdateMemoryUsage()
+{
+	SIZE_T Bytes = ArgInfos.GetAllocatedSize();
+	for (const auto& ArgElem : ArgInfos)
+	{
+		Bytes += ArgElem.Key.GetAllocatedSize();
+		if (ArgElem.Value.IsParsed())
+		{
+			Bytes += ArgElem.Value.GetParsedValue().GetAllocatedSize();
+		}
+	}
+	MemoryUsage.Set(Bytes);
 }
 
 bool FArgParser::IsExistValue(const FString& ArgName) const
@@ -146,7 +166,7 @@ bool FArgParser::GetValue(const FString& ArgName, bool& Value) const
 {
 	if (IsValidArg(ArgName, EType::Bool))
 	{
-		Value = ArgInfos[ArgName].GetParsedValue().ToUpper() == TEXT("TRUE");
+		Value = FCString::Stricmp(*ArgInfos[ArgName].GetParsedValue(), TEXT("TRUE")) == 0;
 		return true;
 	}
 	else
@@ -180,47 +200,50 @@ FArgParser::FArgInfo::FArgInfo(EType ValidateType, bool bRequired)
 {
 }
 
-bool FArgParser::FArgInfo::Parse(const FString& ArgName, const FString& Command)
+bool FArgParser::FArgInfo::Parse(const FString& ArgName, const TCHAR* Command)
 {
-	if (!RegexData.IsValid())
-	{
-		RegexData = MakeShareable(new FRegexData());
-	}
+	// ワーカースレッドで実行するコマンドから同時にパースされても一度だけ作成されるよう、関数内のstatic変数の初期化で作成する
+	static const bool bRegexDataCreated = (RegexData = MakeShareable(new FRegexData())).IsValid();
 
 	if (!ensureAlways(!ParsedValue.IsSet()))
 	{
 		return false;
 	}
 
-	// 引数の値が入っている文字列を取得
-	const FString SearchArgName = FString::Printf(TEXT(" %s"), *ArgName);
-	const int32 Index = Command.Find(SearchArgName);
-	FString LeftStr, RightStr;
-	if (Command.Split(ArgName, &LeftStr, &RightStr))
+	// 引数の値が入っている位置をコマンド文字列の中から探す。引数ごとに残りの文字列をコピーしない
+	const TCHAR* ArgPosition = FCString::Stristr(Command, *ArgName);
+	if (ArgPosition != nullptr)
 	{
-		// 引数の値が入った文字列の先頭の空白を取り除く
-		const int32 RightChopCount = FCString::Strspn(*RightStr, TEXT(" \r\n\t"));
-		RightStr.RightChopInline(RightChopCount);
+		// 引数の値が入った位置の先頭の空白を読み飛ばす
+		const TCHAR* Value = ArgPosition + ArgName.Len();
+		Value += FCString::Strspn(Value, TEXT(" \r\n\t"));
 
 		// 引数の値を取り出す
 		// ""でくくられている場合はその間を値として取り出す
 		// くくられていなければ空白するまでの間を取り出す
+		if (*Value == TEXT('"'))
+		{
+			const TCHAR* QuotationEnd = FCString::Strchr(Value + 1, TEXT('"'));
+			if (QuotationEnd != nullptr && QuotationEnd > Value + 1)
+			{
+				ParsedValue = FString(static_cast<int32>(QuotationEnd - (Value + 1)), Value + 1);
+				return ValidateArgType(ArgName, ParsedValue.GetValue(), ValidateType);
+			}
+		}
 
-		FRegexMatcher QuotationMatch(RegexData->QuotationValuePattern, RightStr);
-		FRegexMatcher NoQuotationMatch(RegexData->NoQuotationPattern, RightStr);
-		if (QuotationMatch.FindNext())
+		const TCHAR* ValueEnd = Value;
+		while (*ValueEnd != TEXT('\0') && !FChar::IsWhitespace(*ValueEnd))
 		{
-			ParsedValue = QuotationMatch.GetCaptureGroup(1);
-			return ValidateArgType(ArgName, ParsedValue.GetValue(), ValidateType);
+			++ValueEnd;
 		}
-		else if (NoQuotationMatch.FindNext())
+		if (ValueEnd > Value)
 		{
-			ParsedValue = NoQuotationMatch.GetCaptureGroup(1);
+			ParsedValue = FString(static_cast<int32>(ValueEnd - Value), Value);
 			return ValidateArgType(ArgName, ParsedValue.GetValue(), ValidateType);
 		}
 		else
 		{
-			UE_LOG(LogTemp, Error, TEXT("引数 %s をパースできませんでした。コマンド:%s"), *ArgName, *Command);
+			UE_LOG(LogTemp, Error, TEXT("引数 %s をパースできませんでした。コマンド:%s"), *ArgName, Command);
 			return false;
 		}
 	}
@@ -229,7 +252,7 @@ bool FArgParser::FArgInfo::Parse(const FString& ArgName, const FString& Command)
 		// 見つからなかった場合、必須引数であればエラーとする
 		if (bRequired)
 		{
-			UE_LOG(LogTemp, Error, TEXT("必須引数 %s が存在しません。コマンド:%s"), *ArgName, *Command);
+			UE_LOG(LogTemp, Error, TEXT("必須引数 %s が存在しません。コマンド:%s"), *ArgName, Command);
 			return false;
 		}
 		else
@@ -267,11 +290,11 @@ bool FArgParser::FArgInfo::ValidateArgType(const FString& ArgName, const FString
 	case EType::String:
 		return true;
 	case EType::Bool:
-		if (ArgValue.ToUpper() == TEXT("TRUE"))
+		if (FCString::Stricmp(*ArgValue, TEXT("TRUE")) == 0)
 		{
 			return true;
 		}
-		else if (ArgValue.ToUpper() == TEXT("FALSE"))
+		else if (FCString::Stricmp(*ArgValue, TEXT("FALSE")) == 0)
 		{
 			return true;
 		}
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "SandBoxMemoryTracker.h"
 
 /**
  * PythonのArgumentParserのようにコマンド引数をパースするクラス
@@ -67,7 +68,15 @@ public:
 	 * @param Command パース対象コマンド文字列
 	 * @return パースに成功した場合trueを返します
 	 */
-	bool Parse(const FString& Command);
+	bool Parse(const FString& Command) { return Parse(*Command); }
+
+	/**
+	 * @brief 引数パース
+	 *		　 フレームアロケーターなどFString以外で組み立てたコマンド文字列をコピーせずにパースします。
+	 * @param Command パース対象コマンド文字列。nullptr不可
+	 * @return パースに成功した場合trueを返します
+	 */
+	bool Parse(const TCHAR* Command);
 
 
 	/**
@@ -113,7 +122,7 @@ private:
 		 * @param Command パース対象のコマンド文字列
 		 * @return 
 		 */
-		bool Parse(const FString& ArgName, const FString& Command);
+		bool Parse(const FString& ArgName, const TCHAR* Command);
 
 		/**
 		 * @brief パース処理実行済みかどうか
@@ -147,19 +156,11 @@ private:
 		{
 		public:
 			FRegexData() :
-				QuotationValuePattern(TEXT("^\"([^\"]+)\"")),
-				NoQuotationPattern(TEXT("^(\\S+)")),
 				FloatPattern(TEXT("^([+-]?\\d+\\.?[\\d]*)$")),
 				IntegerPattern(TEXT("^([+-]?\\d+)$"))
 			{
 			}
 
-			// 引数の値が入っている文字列から""でくくられている値を抽出するパターン
-			const FRegexPattern QuotationValuePattern;
-
-			// 引数の値が入っている文字列から空白までの間の値を抽出するパターン
-			const FRegexPattern NoQuotationPattern;
-
 			// 浮動小数マッチパターン
 			const FRegexPattern FloatPattern;
 
@@ -203,6 +204,12 @@ private:
 		}
 	}
 
+	/**
+	 * @brief 引数情報とパースした文字列の使用量をFSandBoxMemoryTrackerに報告します
+	 */
+	void UpdateMemoryUsage();
+
 	TMap<FString, FArgInfo> ArgInfos;
 	TOptional<bool> bIsValid;
+	FSandBoxMemoryUsage MemoryUsage{ESandBoxMemoryTag::ArgParser};
 };
@@ -0,0 +1,55 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "AssetPreloader.h"
+
+void FAssetPreloader::Start(const TArray<FSoftObjectPath>& Paths)
+{
+	TArray<FSoftObjectPath> ValidPaths;
+	for (const FSoftObjectPath& Path : Paths)
+	{
+		if (Path.IsValid())
+		{
+			ValidPaths.AddUnique(Path);
+		}
+	}
+
+	StartSec = FPlatformTime::Seconds();
+	bCompleted = false;
+
+	if (ValidPaths.Num() == 0)
+	{
+		HandleCompleted();
+		return;
+	}
+
+	// マップのロードと並行して読み込めるよう優先度を上げておく
+	Handle = StreamableManager.RequestAsyncLoad(ValidPaths, FStreamableDelegate::CreateRaw(this, &FAssetPreloader::HandleCompleted), FStreamableManager::AsyncLoadHighPriority);
+	if (!Handle.IsValid())
+	{
+		ensureAlwaysMsgf(false, TEXT("アセットの非同期ロードを開始できませんでした"));
+		HandleCompleted();
+	}
+}
+
+double FAssetPreloader::GetElapsedMs() const
+{
+	const double EndSec = bCompleted ? CompletedSec : FPlatformTime::Seconds();
+	return (EndSec - StartSec) * 1000.0;
+}
+
+void FAssetPreloader::HandleCompleted()
+{
+	CompletedSec = FPlatformTime::Seconds();
+	bCompleted = true;
+
+	int32 NumLoaded = 0;
+	int32 NumRequested = 0;
+	if (Handle.IsValid())
+	{
+		Handle->GetLoadedCount(NumLoaded, NumRequested);
+	}
+	UE_LOG(LogTemp, Log, TEXT("AssetPreload Completed Loaded:%d/%d Ms:%.2f"), NumLoaded, NumRequested, GetElapsedMs());
+
+	CompletedDelegate.Broadcast();
+}
@@ -0,0 +1,47 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/StreamableManager.h"
+
+/**
+ * @brief 起動時にアセットを非同期ロードして保持するクラス
+ *		　ロードしたアセットはハンドルで保持するため、このクラスが破棄されるまでアンロードされません。
+ *		　初回スポーン時の同期ロードによるヒッチを避けるために使用します。
+ */
+class FAssetPreloader final
+{
+public:
+	/**
+	 * @brief 非同期ロードを開始します
+	 * @param Paths ロードするアセット
+	 */
+	void Start(const TArray<FSoftObjectPath>& Paths);
+
+	/**
+	 * @brief 全てのアセットのロードが完了しているか
+	 */
+	bool IsCompleted() const { return bCompleted; }
+
+	/**
+	 * @brief ロード完了時に呼び出されるデリゲート
+	 *		　登録時に完了済みであれば呼び出されないため、先にIsCompletedを確認してください。
+	 */
+	FSimpleMulticastDelegate& OnCompleted() { return CompletedDelegate; }
+
+	/**
+	 * @brief 開始から完了までにかかった時間。完了していなければ現在までの経過時間を返します
+	 */
+	double GetElapsedMs() const;
+
+private:
+	void HandleCompleted();
+
+	FStreamableManager StreamableManager;
+	TSharedPtr<FStreamableHandle> Handle;
+	FSimpleMulticastDelegate CompletedDelegate;
+	double StartSec = 0.0;
+	double CompletedSec = 0.0;
+	bool bCompleted = false;
+};
@@ -0,0 +1,257 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Containers/List.h"
+#include "JobScheduler.h"
+
+/**
+ * @brief キーごとにバックグラウンドの計算結果を保持するキャッシュ
+ *		　同じキーで要求すると
+ *		　・計算済みであればキャッシュした結果を返す(ヒット)
+ *		　・計算中であればその計算の完了を待つ(合流)
+ *		　・どちらでもなければFJobSchedulerに計算を投入する(ミス)
+ *		　ため、同じ入力の重い計算が重複して実行されません。
+ *		　結果の合計サイズか件数が上限を超えると、最も長く使われていない結果から破棄します。
+ *		　全ての関数はどのスレッドからでも呼び出せます。
+ *
+ * 使用例
+
+TAsyncResultCache<int32, TArray<float>> Cache(TEXT("HeightField"), Scheduler, 64 * 1024 * 1024, 256);
+TSharedFuture<TAsyncResultCache<int32, TArray<float>>::FValuePtr> Result = Cache.GetOrCompute(Seed, EJobPriority::Normal, [Seed]() { return GenerateHeightField(Seed); });
+
+ */
+template<typename KeyType, typename ValueType>
+class TAsyncResultCache final
+{
+public:
+	using FValuePtr = TSharedPtr<const ValueType, ESPMode::ThreadSafe>;
+	using FResult = TSharedFuture<FValuePtr>;
+
+	/**
+	 * @param InName 統計の出力に使う名前
+	 * @param InScheduler 計算を実行するスケジューラー。キャッシュより長く存在する必要があります
+	 * @param InMaxBytes 保持する結果の合計サイズの上限
+	 * @param InMaxEntries 保持する結果の件数の上限
+	 * @param InGetValueSize 結果のサイズを求める関数。省略時はsizeof(ValueType)
+	 */
+	TAsyncResultCache(const FString& InName, FJobScheduler& InScheduler, SIZE_T InMaxBytes, int32 InMaxEntries, TFunction<SIZE_T(const ValueType&)> InGetValueSize = nullptr)
+		: Name(InName)
+		, Scheduler(InScheduler)
+		, MaxBytes(InMaxBytes)
+		, MaxEntries(InMaxEntries)
+		, GetValueSize(MoveTemp(InGetValueSize))
+	{
+	}
+
+	/**
+	 * @brief 計算中のジョブの完了を待ってから破棄します
+	 */
+	~TAsyncResultCache()
+	{
+		TArray<FJobScheduler::FJobHandle> Jobs;
+		{
+			FScopeLock ScopeLock(&Lock);
+			for (const TPair<KeyType, FEntry>& Pair : Entries)
+			{
+				if (Pair.Value.Job.IsValid())
+				{
+					Jobs.Add(Pair.Value.Job.ToSharedRef());
+				}
+			}
+			Jobs.Append(OrphanedJobs);
+		}
+		for (const FJobScheduler::FJobHandle& Job : Jobs)
+		{
+			Scheduler.Wait(Job);
+		}
+	}
+
+	/**
+	 * @brief キーに対応する結果を取得します。なければComputeをスケジューラーで実行します
+	 * @param Key キー
+	 * @param Priority 計算する場合の優先度
+	 * @param Compute 結果を計算する関数。ワーカースレッドで実行されます
+	 * @return 結果。計算中であれば完了後に有効になります
+	 */
+	FResult GetOrCompute(const KeyType& Key, EJobPriority Priority, TFunction<ValueType()> Compute)
+	{
+		FScopeLock ScopeLock(&Lock);
+
+		if (FEntry* Entry = Entries.Find(Key))
+		{
+			if (Entry->bReady)
+			{
+				++Stats.NumHits;
+				LruList.RemoveNode(Entry->LruNode, false);
+				LruList.AddHead(Entry->LruNode);
+			}
+			else
+			{
+				++Stats.NumJoins;
+			}
+			return Entry->Result;
+		}
+
+		++Stats.NumMisses;
+		TSharedRef<TPromise<FValuePtr>, ESPMode::ThreadSafe> Promise = MakeShared<TPromise<FValuePtr>, ESPMode::ThreadSafe>();
+		FEntry& Entry = Entries.Add(Key);
+		Entry.Result = Promise->GetFuture().Share();
+		Entry.Generation = ++Generation;
+
+		const uint64 EntryGeneration = Entry.Generation;
+		Entry.Job = Scheduler.Submit(Priority, 0.0f, [this, Key, EntryGeneration, Promise, Compute]()
+		{
+			const double StartSec = FPlatformTime::Seconds();
+			const FValuePtr Value = MakeShared<const ValueType, ESPMode::ThreadSafe>(Compute());
+			OnComputed(Key, EntryGeneration, Value, FPlatformTime::Seconds() - StartSec);
+
+			// 待っている側の継続処理でキャッシュを触ってもデッドロックしないよう、ロックの外で完了させる
+			Promise->SetValue(Value);
+		});
+		return Entry.Result;
+	}
+
+	/**
+	 * @brief キーの結果を破棄します
+	 *		　計算中であれば、その計算を待っている要求には結果を返しますがキャッシュには残しません。
+	 */
+	void Invalidate(const KeyType& Key)
+	{
+		FScopeLock ScopeLock(&Lock);
+		if (FEntry* Entry = Entries.Find(Key))
+		{
+			++Stats.NumInvalidations;
+			RemoveEntry(Key, *Entry);
+		}
+	}
+
+	/**
+	 * @brief 全ての結果を破棄します
+	 */
+	void InvalidateAll()
+	{
+		FScopeLock ScopeLock(&Lock);
+		Stats.NumInvalidations += Entries.Num();
+		TArray<KeyType> Keys;
+		Entries.GetKeys(Keys);
+		for (const KeyType& Key : Keys)
+		{
+			RemoveEntry(Key, Entries[Key]);
+		}
+	}
+
+	/**
+	 * @brief ヒット・合流・ミス・破棄の数と使用量をログに出力します
+	 */
+	void DumpStats() const
+	{
+		FScopeLock ScopeLock(&Lock);
+		const int32 NumRequests = Stats.NumHits + Stats.NumJoins + Stats.NumMisses;
+		UE_LOG(LogTemp, Log, TEXT("AsyncResultCache %s Entries:%d/%d KB:%.1f/%.1f Requests:%d Hits:%d Joins:%d Misses:%d HitRate:%.1f%% Evictions:%d Invalidations:%d AvgComputeMs:%.3f"),
+			*Name, Entries.Num(), MaxEntries, TotalBytes / 1024.0, MaxBytes / 1024.0, NumRequests, Stats.NumHits, Stats.NumJoins, Stats.NumMisses,
+			NumRequests > 0 ? (Stats.NumHits + Stats.NumJoins) * 100.0 / NumRequests : 0.0, Stats.NumEvictions, Stats.NumInvalidations,
+			Stats.NumComputed > 0 ? Stats.TotalComputeSec * 1000.0 / Stats.NumComputed : 0.0);
+	}
+
+	void ResetStats()
+	{
+		FScopeLock ScopeLock(&Lock);
+		Stats = FStats();
+	}
+
+	/**
+	 * @brief 保持している結果とキャッシュの管理に使っているメモリの量
+	 */
+	SIZE_T GetAllocatedSize() const
+	{
+		FScopeLock ScopeLock(&Lock);
+		return TotalBytes + Entries.GetAllocatedSize() + LruList.Num() * sizeof(typename TDoubleLinkedList<KeyType>::TDoubleLinkedListNode) + OrphanedJobs.GetAllocatedSize();
+	}
+
+private:
+	struct FEntry
+	{
+		FResult Result;
+		// 計算中のみ有効
+		TSharedPtr<FJobScheduler::FJobState, ESPMode::ThreadSafe> Job;
+		// 計算が終わってから有効
+		typename TDoubleLinkedList<KeyType>::TDoubleLinkedListNode* LruNode = nullptr;
+		SIZE_T Size = 0;
+		uint64 Generation = 0;
+		bool bReady = false;
+	};
+
+	struct FStats
+	{
+		int32 NumHits = 0;
+		int32 NumJoins = 0;
+		int32 NumMisses = 0;
+		int32 NumEvictions = 0;
+		int32 NumInvalidations = 0;
+		int32 NumComputed = 0;
+		double TotalComputeSec = 0.0;
+	};
+
+	void OnComputed(const KeyType& Key, uint64 EntryGeneration, const FValuePtr& Value, double ComputeSec)
+	{
+		FScopeLock ScopeLock(&Lock);
+		++Stats.NumComputed;
+		Stats.TotalComputeSec += ComputeSec;
+
+		// 計算中に破棄された場合はキャッシュしない
+		FEntry* Entry = Entries.Find(Key);
+		if (Entry == nullptr || Entry->Generation != EntryGeneration)
+		{
+			return;
+		}
+
+		Entry->bReady = true;
+		Entry->Job.Reset();
+		Entry->Size = GetValueSize ? GetValueSize(*Value) : sizeof(ValueType);
+		TotalBytes += Entry->Size;
+		LruList.AddHead(Key);
+		Entry->LruNode = LruList.GetHead();
+
+		// 計算中のものは破棄できないので、計算済みのものだけを古い順に破棄する
+		while ((TotalBytes > MaxBytes || LruList.Num() > MaxEntries) && LruList.Num() > 1)
+		{
+			const KeyType EvictKey = LruList.GetTail()->GetValue();
+			++Stats.NumEvictions;
+			RemoveEntry(EvictKey, Entries[EvictKey]);
+		}
+	}
+
+	void RemoveEntry(const KeyType& Key, FEntry& Entry)
+	{
+		if (Entry.bReady)
+		{
+			TotalBytes -= Entry.Size;
+			LruList.RemoveNode(Entry.LruNode);
+		}
+		else if (Entry.Job.IsValid())
+		{
+			// 破棄時に完了を待つため残しておく
+			OrphanedJobs.RemoveAll([](const FJobScheduler::FJobHandle& Job) { return Job->IsDone(); });
+			OrphanedJobs.Add(Entry.Job.ToSharedRef());
+		}
+		Entries.Remove(Key);
+	}
+
+	const FString Name;
+	FJobScheduler& Scheduler;
+	const SIZE_T MaxBytes;
+	const int32 MaxEntries;
+	const TFunction<SIZE_T(const ValueType&)> GetValueSize;
+
+	mutable FCriticalSection Lock;
+	TMap<KeyType, FEntry> Entries;
+	// 先頭が最も最近使われた結果
+	TDoubleLinkedList<KeyType> LruList;
+	TArray<FJobScheduler::FJobHandle> OrphanedJobs;
+	SIZE_T TotalBytes = 0;
+	uint64 Generation = 0;
+	FStats Stats;
+};
@@ -3,11 +3,54 @@
 
 #include "AsyncSample.h"
 
+namespace AsyncSampleInternal
+{
+	constexpr int32 HeightFieldSize = 128;
+
+	/**
+	 * @brief シードから地形の高さデータを生成します。数ミリ秒かかる重い処理の例
+	 */
+	TArray<float> GenerateHeightField(int32 Seed)
+	{
+		constexpr int32 NumOctaves = 6;
+		FRandomStream Random(Seed);
+		FVector2D Offsets[NumOctaves];
+		for (FVector2D& Offset : Offsets)
+		{
+			Offset = FVector2D(Random.FRandRange(0.0f, 1000.0f), Random.FRandRange(0.0f, 1000.0f));
+		}
+
+		TArray<float> Heights;
+		Heights.SetNumUninitialized(HeightFieldSize * HeightFieldSize);
+		for (int32 Y = 0; Y < HeightFieldSize; ++Y)
+		{
+			for (int32 X = 0; X < HeightFieldSize; ++X)
+			{
+				float Height = 0.0f;
+				float Frequency = 0.02f;
+				float Amplitude = 1.0f;
+				for (const FVector2D& Offset : Offsets)
+				{
+					Height += Amplitude * FMath::Sin((X + Offset.X) * Frequency) * FMath::Cos((Y + Offset.Y) * Frequency);
+					Frequency *= 2.0f;
+					Amplitude *= 0.5f;
+				}
+				Heights[Y * HeightFieldSize + X] = Height;
+			}
+		}
+		return Heights;
+	}
+}
+
 class FAsyncSample::FSampleAsyncTask final : public FNonAbandonableTask
 {
 public:
-	explicit FSampleAsyncTask(float SleepSec)
+	/**
+	 * @param WrapperBytes このタスクを持つラッパーのサイズ。タスクはラッパーごとヒープに確保される
+	 */
+	explicit FSampleAsyncTask(float SleepSec, SIZE_T WrapperBytes = sizeof(FAsyncTask<FSampleAsyncTask>))
 		: SleepSec(SleepSec)
+		, MemoryUsage(ESandBoxMemoryTag::AsyncSample, WrapperBytes)
 	{
 	}
 
@@ -16,8 +59,10 @@ public:
 		UE_LOG(LogTemp, Log, TEXT("~FSampleAsyncTask"));
 	}
 
+	// CheckAsyncTaskBehaviourで開始と終了を見るためのログなので、SandBoxLogが無効でも出力されるUE_LOGを使う
 	void DoWork()
 	{
+		SANDBOX_LLM_SCOPE(ESandBoxMemoryTag::AsyncSample);
 		UE_LOG(LogTemp, Log, TEXT("Start at %s"), *FDateTime::Now().ToString());
 		FPlatformProcess::Sleep(SleepSec);
 		UE_LOG(LogTemp, Log, TEXT("Stop at %s"), *FDateTime::Now().ToString());
@@ -32,11 +77,13 @@ private:
 	friend class FAutoDeleteAsyncTask<FSampleAsyncTask>;
 	friend class FAsyncTask<FSampleAsyncTask>;
 	const float SleepSec;
+	FSandBoxMemoryUsage MemoryUsage;
 };
 
 void FAsyncSample::StartAutoDeleteAsync(float WaitSec)
 {
-	FAutoDeleteAsyncTask<FSampleAsyncTask>* Task = new FAutoDeleteAsyncTask<FSampleAsyncTask>(WaitSec);
+	SANDBOX_LLM_SCOPE(ESandBoxMemoryTag::AsyncSample);
+	FAutoDeleteAsyncTask<FSampleAsyncTask>* Task = new FAutoDeleteAsyncTask<FSampleAsyncTask>(WaitSec, sizeof(FAutoDeleteAsyncTask<FSampleAsyncTask>));
 	Task->StartBackgroundTask();
 
 	// Memo:
@@ -47,6 +94,7 @@ void FAsyncSample::StartAutoDeleteAsync(float WaitSec)
 void FAsyncSample::StartAsyncTask(float WaitSec)
 {
 	CancelAsyncTask();
+	SANDBOX_LLM_SCOPE(ESandBoxMemoryTag::AsyncSample);
 	AsyncTask = MakeShareable(new FAsyncTask<FSampleAsyncTask>(WaitSec));
 	AsyncTask->StartBackgroundTask();
 }
@@ -160,11 +208,187 @@ void FAsyncSample::CheckCrash()
 	Task.Reset();
 }
 
+void FAsyncSample::CheckSchedulerBehaviour(FJobScheduler& Scheduler)
+{
+	using FJobHandle = FJobScheduler::FJobHandle;
+
+	// ワーカー数+3の長いジョブを低優先度で投入する
+	// GThreadPoolであれば後から投入したジョブはこれらの完了を待つことになる
+	UE_LOG(LogTemp, Log, TEXT("Check Scheduler Behaviour Workers:%d"), Scheduler.GetNumWorkers());
+	const double StartSec = FPlatformTime::Seconds();
+	TArray<FJobHandle> BulkJobs;
+	for (int32 i = 0; i < Scheduler.GetNumWorkers() + 3; ++i)
+	{
+		BulkJobs.Add(Scheduler.Submit(EJobPriority::Low, 0.0f, []() { FPlatformProcess::Sleep(0.5f); }));
+	}
+
+	// 締め切り付きの急ぎのジョブは専用のワーカーですぐに開始される
+	// Waitは開始前のジョブをこのスレッドで実行してしまうため、完了するまでポーリングしてワーカーで実行されることを確認する
+	double CriticalDoneSec = 0.0;
+	bool bCriticalOnWorker = false;
+	const FJobHandle CriticalJob = Scheduler.Submit(EJobPriority::Critical, 0.1f, [&CriticalDoneSec, &bCriticalOnWorker]()
+	{
+		FPlatformProcess::Sleep(0.01f);
+		bCriticalOnWorker = !IsInGameThread();
+		CriticalDoneSec = FPlatformTime::Seconds();
+	});
+	while (!CriticalJob->IsDone())
+	{
+		FPlatformProcess::Sleep(0.001f);
+	}
+	UE_LOG(LogTemp, Log, TEXT("Critical job done in %.1fms OnWorker:%d DeadlineMissed:%d"), (CriticalDoneSec - StartSec) * 1000.0, bCriticalOnWorker, CriticalJob->IsDeadlineMissed());
+
+	// スコープを抜けるとラムダの参照先がなくなるので完了を待つ。低優先度のジョブもワーカーで実行させる
+	for (const FJobHandle& Job : BulkJobs)
+	{
+		while (!Job->IsDone())
+		{
+			FPlatformProcess::Sleep(0.001f);
+		}
+	}
+	UE_LOG(LogTemp, Log, TEXT("Bulk jobs done in %.1fms"), (FPlatformTime::Seconds() - StartSec) * 1000.0);
+	Scheduler.DumpStats();
+}
+
+void FAsyncSample::StartSchedulerLoad(FJobScheduler& Scheduler, int32 NumBulkJobs, int32 NumCriticalJobs, float DeadlineMs, int32 NumFrames)
+{
+	if (LoadFramesLeft > 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("計測中です"));
+		return;
+	}
+
+	Scheduler.ResetStats();
+	for (int32 i = 0; i < NumBulkJobs; ++i)
+	{
+		Scheduler.Submit(EJobPriority::Low, 0.0f, []() { FPlatformProcess::Sleep(0.02f); });
+	}
+
+	LoadScheduler = &Scheduler;
+	LoadNumCriticalJobs = NumCriticalJobs;
+	LoadDeadlineMs = DeadlineMs;
+	LoadFramesLeft = NumFrames;
+}
+
+void FAsyncSample::StartCachedGeneration(FJobScheduler& Scheduler, int32 NumRequests, int32 NumSeeds)
+{
+	if (PendingHeightFields.Num() > 0)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("計測中です"));
+		return;
+	}
+
+	// 上限は高さデータ64個分
+	if (!HeightFieldCache.IsValid())
+	{
+		constexpr SIZE_T HeightFieldBytes = AsyncSampleInternal::HeightFieldSize * AsyncSampleInternal::HeightFieldSize * sizeof(float);
+		HeightFieldCache = MakeUnique<FHeightFieldCache>(TEXT("HeightField"), Scheduler, HeightFieldBytes * 64, 256,
+			[](const TArray<float>& Heights) { return Heights.GetAllocatedSize(); });
+	}
+
+	FRandomStream Random(FPlatformTime::Cycles());
+	GenerationStartSec = FPlatformTime::Seconds();
+	for (int32 i = 0; i < NumRequests; ++i)
+	{
+		const int32 Seed = Random.RandHelper(FMath::Max(NumSeeds, 1));
+		PendingHeightFields.Add(HeightFieldCache->GetOrCompute(Seed, EJobPriority::Normal, [Seed]()
+		{
+			return AsyncSampleInternal::GenerateHeightField(Seed);
+		}));
+	}
+}
+
+void FAsyncSample::DumpResultCache() const
+{
+	if (HeightFieldCache.IsValid())
+	{
+		HeightFieldCache->DumpStats();
+	}
+}
+
+void FAsyncSample::InvalidateResultCache(TOptional<int32> Seed)
+{
+	if (!HeightFieldCache.IsValid())
+	{
+		return;
+	}
+
+	if (Seed.IsSet())
+	{
+		HeightFieldCache->Invalidate(Seed.GetValue());
+	}
+	else
+	{
+		HeightFieldCache->InvalidateAll();
+	}
+}
+
+void FAsyncSample::ReleaseScheduler()
+{
+	// キャッシュは計算中のジョブの完了を待ってから破棄される
+	PendingHeightFields.Reset();
+	HeightFieldCache.Reset();
+	LoadFrameJobs.Reset();
+	LoadScheduler = nullptr;
+	LoadFramesLeft = 0;
+	UpdateMemoryUsage();
+}
+
 void FAsyncSample::Update(float Deltatime)
 {
+	// キャッシュはワーカースレッドで結果が追加されるため、毎フレーム使用量を取り直す
+	UpdateMemoryUsage();
+
+	const bool bHeightFieldsReady = !PendingHeightFields.ContainsByPredicate([](const FHeightFieldCache::FResult& Result) { return !Result.IsReady(); });
+	if (PendingHeightFields.Num() > 0 && bHeightFieldsReady)
+	{
+		UE_LOG(LogTemp, Log, TEXT("CachedGeneration Requests:%d ElapsedMs:%.3f"), PendingHeightFields.Num(), (FPlatformTime::Seconds() - GenerationStartSec) * 1000.0);
+		PendingHeightFields.Reset();
+		HeightFieldCache->DumpStats();
+	}
+
 	if (AsyncTask.IsValid() && AsyncTask->IsDone())
 	{
 		UE_LOG(LogTemp, Log, TEXT("Task is done."));
 		AsyncTask.Reset();
 	}
+
+	if (LoadFramesLeft > 0)
+	{
+		// 前のフレームで投入したジョブの結果がこのフレームで必要になる想定
+		for (const FJobScheduler::FJobHandle& Job : LoadFrameJobs)
+		{
+			LoadScheduler->Wait(Job);
+		}
+		LoadFrameJobs.Reset();
+
+		if (--LoadFramesLeft == 0)
+		{
+			LoadScheduler->DumpStats();
+			LoadScheduler = nullptr;
+			return;
+		}
+
+		for (int32 i = 0; i < LoadNumCriticalJobs; ++i)
+		{
+			LoadFrameJobs.Add(LoadScheduler->Submit(EJobPriority::Critical, LoadDeadlineMs / 1000.0f, []()
+			{
+				// 0.5ms程度の計算
+				const double EndSec = FPlatformTime::Seconds() + 0.0005;
+				while (FPlatformTime::Seconds() < EndSec)
+				{
+				}
+			}));
+		}
+	}
+}
+
+void FAsyncSample::UpdateMemoryUsage()
+{
+	SIZE_T Bytes = sizeof(FAsyncSample) + LoadFrameJobs.GetAllocatedSize() + PendingHeightFields.GetAllocatedSize();
+	if (HeightFieldCache.IsValid())
+	{
+		Bytes += sizeof(FHeightFieldCache) + HeightFieldCache->GetAllocatedSize();
+	}
+	MemoryUsage.Set(Bytes);
 }
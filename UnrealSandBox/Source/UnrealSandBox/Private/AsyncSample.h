@@ -3,6 +3,9 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "AsyncResultCache.h"
+#include "JobScheduler.h"
+#include "SandBoxMemoryTracker.h"
 
 
 class FAsyncSample final
@@ -14,10 +17,69 @@ public:
 	void CancelAsyncTask();
 	void CheckAsyncTaskBehaviour();
 	void CheckCrash();
+
+	/**
+	 * @brief FJobSchedulerの挙動チェック
+	 *		　ワーカー数より多い低優先度のジョブで埋めた後に締め切り付きの急ぎのジョブを投入し、先に完了することを確認します。
+	 */
+	void CheckSchedulerBehaviour(FJobScheduler& Scheduler);
+
+	/**
+	 * @brief 低優先度のジョブを大量に投入した状態で、毎フレーム急ぎのジョブを投入してフレームの終わりに完了を待ちます
+	 *		　指定フレーム数が経過したらスケジューラーの統計をログに出力します。
+	 * @param NumBulkJobs 最初に投入する低優先度のジョブ数
+	 * @param NumCriticalJobs 毎フレーム投入する急ぎのジョブ数
+	 * @param DeadlineMs 急ぎのジョブの締め切り
+	 * @param NumFrames 計測フレーム数
+	 */
+	void StartSchedulerLoad(FJobScheduler& Scheduler, int32 NumBulkJobs, int32 NumCriticalJobs, float DeadlineMs, int32 NumFrames);
+
+	/**
+	 * @brief 結果キャッシュを使って地形の高さデータを生成します
+	 *		　シードをランダムに選んで要求し、全ての結果が揃ったら経過時間とキャッシュの統計をログに出力します。
+	 *		　同じシードの要求は計算済みの結果を返すか、計算中の要求に合流します。
+	 * @param NumRequests 要求数
+	 * @param NumSeeds シードの種類数。要求数より小さいほどヒットしやすい
+	 */
+	void StartCachedGeneration(FJobScheduler& Scheduler, int32 NumRequests, int32 NumSeeds);
+
+	/**
+	 * @brief 結果キャッシュの統計をログに出力します
+	 */
+	void DumpResultCache() const;
+
+	/**
+	 * @brief 結果キャッシュを破棄します
+	 * @param Seed 指定した場合はそのシードの結果のみ破棄します
+	 */
+	void InvalidateResultCache(TOptional<int32> Seed);
+
+	/**
+	 * @brief スケジューラーを使う処理を終了します。スケジューラーを破棄する前に呼び出してください
+	 */
+	void ReleaseScheduler();
 	
 	void Update(float Deltatime);
 
 private:
+	/**
+	 * @brief 持っている配列と結果キャッシュの使用量を報告します
+	 */
+	void UpdateMemoryUsage();
+
 	class FSampleAsyncTask;
 	TSharedPtr<FAsyncTask<FSampleAsyncTask>> AsyncTask;
+
+	FJobScheduler* LoadScheduler = nullptr;
+	TArray<FJobScheduler::FJobHandle> LoadFrameJobs;
+	int32 LoadNumCriticalJobs = 0;
+	float LoadDeadlineMs = 0.0f;
+	int32 LoadFramesLeft = 0;
+
+	using FHeightFieldCache = TAsyncResultCache<int32, TArray<float>>;
+	TUniquePtr<FHeightFieldCache> HeightFieldCache;
+	TArray<FHeightFieldCache::FResult> PendingHeightFields;
+	double GenerationStartSec = 0.0;
+
+	FSandBoxMemoryUsage MemoryUsage{ESandBoxMemoryTag::AsyncSample};
 };
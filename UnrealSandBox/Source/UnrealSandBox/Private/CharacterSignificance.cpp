@@ -0,0 +1,213 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CharacterSignificance.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "UnrealSandBox/UnrealSandBoxCharacter.h"
+
+namespace CharacterSignificanceInternal
+{
+	const TCHAR* GetBucketName(FCharacterSignificance::EBucket Bucket)
+	{
+		switch (Bucket)
+		{
+		case FCharacterSignificance::EBucket::Near:
+			return TEXT("Near");
+		case FCharacterSignificance::EBucket::Mid:
+			return TEXT("Mid");
+		case FCharacterSignificance::EBucket::Far:
+			return TEXT("Far");
+		case FCharacterSignificance::EBucket::Hidden:
+			return TEXT("Hidden");
+		default:
+			ensureAlwaysMsgf(false, TEXT("不正なバケットです"));
+			return TEXT("Invalid");
+		}
+	}
+}
+
+FCharacterSignificance::FCharacterSignificance()
+{
+	FBucketSettings& Mid = GetBucketSettings(EBucket::Mid);
+	Mid.TickInterval = 1.0f / 30.0f;
+	Mid.bEnableUpdateRateOptimizations = true;
+	Mid.AnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered;
+
+	FBucketSettings& Far = GetBucketSettings(EBucket::Far);
+	Far.TickInterval = 0.1f;
+	Far.bEnableUpdateRateOptimizations = true;
+	Far.AnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered;
+	Far.bCheapMovement = true;
+
+	FBucketSettings& Hidden = GetBucketSettings(EBucket::Hidden);
+	Hidden.TickInterval = 0.25f;
+	Hidden.bEnableUpdateRateOptimizations = true;
+	Hidden.AnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickMontagesWhenNotRendered;
+	Hidden.bCheapMovement = true;
+}
+
+void FCharacterSignificance::Update(float DeltaTime, const TArray<FVector>& ViewerLocations, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters, bool bCanUseVisibility)
+{
+	if (DeltaTime > SMALL_NUMBER)
+	{
+		SmoothedFrameRate = FMath::Lerp(SmoothedFrameRate, 1.0f / DeltaTime, 0.05f);
+	}
+
+	TimeUntilUpdate -= DeltaTime;
+	if (!bEnabled || TimeUntilUpdate > 0.0f)
+	{
+		return;
+	}
+	TimeUntilUpdate = UpdateInterval;
+
+	FMemory::Memzero(BucketCounts);
+
+	for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& WeakCharacter : Characters)
+	{
+		AUnrealSandBoxCharacter* Character = WeakCharacter.Get();
+		if (Character == nullptr)
+		{
+			continue;
+		}
+
+		EBucket* CurrentBucket = CurrentBuckets.Find(Character);
+		if (CurrentBucket != nullptr)
+		{
+			// 今のバケットの設定でこのフレームにアニメーションが更新されたかを記録する
+			++NumPoseTickSamples[static_cast<int32>(*CurrentBucket)];
+			NumPoseTicked[static_cast<int32>(*CurrentBucket)] += Character->GetMesh()->PoseTickedThisFrame() ? 1 : 0;
+		}
+
+		const EBucket Bucket = ComputeBucket(*Character, ViewerLocations, bCanUseVisibility);
+		++BucketCounts[static_cast<int32>(Bucket)];
+
+		if (CurrentBucket == nullptr || *CurrentBucket != Bucket)
+		{
+			Apply(*Character, Bucket);
+			CurrentBuckets.Add(Character, Bucket);
+		}
+	}
+
+	// 削除されたキャラクターの情報を捨てる
+	for (auto It = CurrentBuckets.CreateIterator(); It; ++It)
+	{
+		if (It.Key().ResolveObjectPtr() == nullptr)
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void FCharacterSignificance::SetEnabled(bool bInEnabled, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters)
+{
+	bEnabled = bInEnabled;
+	TimeUntilUpdate = 0.0f;
+
+	if (!bEnabled)
+	{
+		for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& WeakCharacter : Characters)
+		{
+			if (AUnrealSandBoxCharacter* Character = WeakCharacter.Get())
+			{
+				Apply(*Character, EBucket::Near);
+			}
+		}
+		CurrentBuckets.Reset();
+		FMemory::Memzero(BucketCounts);
+		FMemory::Memzero(NumPoseTickSamples);
+		FMemory::Memzero(NumPoseTicked);
+	}
+}
+
+void FCharacterSignificance::DumpReport() const
+{
+	UE_LOG(LogTemp, Log, TEXT("CharacterSignificance Enabled:%d FrameRate:%.1f"), bEnabled, SmoothedFrameRate);
+
+	float TotalSavedTicksPerSec = 0.0f;
+	float TotalSavedPoseTicksPerSec = 0.0f;
+	for (int32 BucketIndex = 0; BucketIndex < static_cast<int32>(EBucket::Num); ++BucketIndex)
+	{
+		const FBucketSettings& Settings = BucketSettings[BucketIndex];
+
+		// アクターと移動コンポーネントの2つのTickがフレームレートからTick間隔の頻度に下がる
+		const float TickRate = Settings.TickInterval > 0.0f ? FMath::Min(1.0f / Settings.TickInterval, SmoothedFrameRate) : SmoothedFrameRate;
+		const float SavedTicksPerSec = BucketCounts[BucketIndex] * 2.0f * (SmoothedFrameRate - TickRate);
+		TotalSavedTicksPerSec += SavedTicksPerSec;
+
+		// アニメーションはサンプルしたフレームのうちポーズを更新した割合から、フレーム毎に更新する場合との差を求める
+		const float PoseTickRatio = NumPoseTickSamples[BucketIndex] > 0 ? static_cast<float>(NumPoseTicked[BucketIndex]) / NumPoseTickSamples[BucketIndex] : 1.0f;
+		const float SavedPoseTicksPerSec = BucketCounts[BucketIndex] * SmoothedFrameRate * (1.0f - PoseTickRatio);
+		TotalSavedPoseTicksPerSec += SavedPoseTicksPerSec;
+
+		UE_LOG(LogTemp, Log, TEXT("  %-6s Characters:%4d TickInterval:%.3f URO:%d AnimTick:%d CheapMovement:%d SavedTicksPerSec:%.0f PoseTickRatio:%.2f (Samples:%d) SavedPoseTicksPerSec:%.0f"),
+			CharacterSignificanceInternal::GetBucketName(static_cast<EBucket>(BucketIndex)), BucketCounts[BucketIndex],
+			Settings.TickInterval, Settings.bEnableUpdateRateOptimizations, static_cast<int32>(Settings.AnimTickOption), Settings.bCheapMovement, SavedTicksPerSec,
+			PoseTickRatio, NumPoseTickSamples[BucketIndex], SavedPoseTicksPerSec);
+	}
+	UE_LOG(LogTemp, Log, TEXT("  Total SavedTicksPerSec:%.0f SavedPoseTicksPerSec:%.0f"), TotalSavedTicksPerSec, TotalSavedPoseTicksPerSec);
+}
+
+FCharacterSignificance::EBucket FCharacterSignificance::ComputeBucket(const AUnrealSandBoxCharacter& Character, const TArray<FVector>& ViewerLocations, bool bCanUseVisibility) const
+{
+	// ローカルで操作しているキャラクターは常にフルレート
+	if (Character.IsLocallyControlled())
+	{
+		return EBucket::Near;
+	}
+
+	const FVector Location = Character.GetActorLocation();
+	float MinDistanceSq = MAX_FLT;
+	for (const FVector& ViewerLocation : ViewerLocations)
+	{
+		MinDistanceSq = FMath::Min(MinDistanceSq, FVector::DistSquared(ViewerLocation, Location));
+	}
+
+	if (MinDistanceSq < FMath::Square(NearDistance))
+	{
+		return EBucket::Near;
+	}
+	else if (bCanUseVisibility && !Character.WasRecentlyRendered(HiddenTolerance))
+	{
+		return EBucket::Hidden;
+	}
+	else if (MinDistanceSq < FMath::Square(MidDistance))
+	{
+		return EBucket::Mid;
+	}
+	else
+	{
+		return EBucket::Far;
+	}
+}
+
+void FCharacterSignificance::Apply(AUnrealSandBoxCharacter& Character, EBucket Bucket)
+{
+	const FBucketSettings& Settings = GetBucketSettings(Bucket);
+	const AUnrealSandBoxCharacter* Defaults = Character.GetClass()->GetDefaultObject<AUnrealSandBoxCharacter>();
+
+	Character.SetActorTickInterval(FMath::Max(Settings.TickInterval, Defaults->PrimaryActorTick.TickInterval));
+
+	// ローカルで操作しているキャラクターの移動はフレーム毎に行わないと操作感が悪くなる
+	UCharacterMovementComponent* Movement = Character.GetCharacterMovement();
+	const UCharacterMovementComponent* DefaultMovement = Defaults->GetCharacterMovement();
+	const float DefaultMovementTickInterval = DefaultMovement->PrimaryComponentTick.TickInterval;
+	Movement->SetComponentTickInterval(Character.IsLocallyControlled() ? DefaultMovementTickInterval : FMath::Max(Settings.TickInterval, DefaultMovementTickInterval));
+
+	// プレイヤーが操作していないポーンのみ移動を簡略化する
+	const bool bCheapMovement = Settings.bCheapMovement && !Character.IsPlayerControlled();
+	Movement->bAlwaysCheckFloor = bCheapMovement ? false : DefaultMovement->bAlwaysCheckFloor;
+	Movement->bUseFlatBaseForFloorChecks = bCheapMovement ? true : DefaultMovement->bUseFlatBaseForFloorChecks;
+	Movement->bEnablePhysicsInteraction = bCheapMovement ? false : DefaultMovement->bEnablePhysicsInteraction;
+	if (Character.GetLocalRole() == ROLE_SimulatedProxy)
+	{
+		Movement->NetworkSmoothingMode = Settings.bCheapMovement ? ENetworkSmoothingMode::Disabled : DefaultMovement->NetworkSmoothingMode;
+	}
+
+	USkeletalMeshComponent* Mesh = Character.GetMesh();
+	const USkeletalMeshComponent* DefaultMesh = Defaults->GetMesh();
+	Mesh->bEnableUpdateRateOptimizations = Settings.bEnableUpdateRateOptimizations || DefaultMesh->bEnableUpdateRateOptimizations;
+	// 列挙子は負荷の高い順に並んでいるので、メッシュ本来の設定より負荷が高くならないよう大きい方を使う
+	Mesh->VisibilityBasedAnimTickOption = Bucket == EBucket::Near ? DefaultMesh->VisibilityBasedAnimTickOption :
+		FMath::Max(Settings.AnimTickOption, DefaultMesh->VisibilityBasedAnimTickOption);
+}
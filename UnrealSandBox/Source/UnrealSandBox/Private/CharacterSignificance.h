@@ -0,0 +1,112 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SkinnedMeshComponent.h"
+#include "UObject/ObjectKey.h"
+
+class AUnrealSandBoxCharacter;
+
+/**
+ * @brief キャラクターを視点からの距離と描画状況でバケット分けし、バケットごとにTick頻度を落とすクラス
+ *		　・アクターと移動コンポーネントのTick間隔
+ *		　・アニメーションのUpdateRateOptimizationと非表示時のTick設定
+ *		　・所持していないポーンのカメラブームのコリジョンテストとTick
+ *		　・遠くのAIポーンの移動の簡略化(床チェック、物理インタラクション、ネットワークスムージング)
+ *		　を切り替えます。
+ */
+class FCharacterSignificance final
+{
+public:
+
+	/**
+	 * @brief 重要度のバケット
+	 */
+	enum class EBucket : uint8
+	{
+		// 近くにいる、またはローカルで操作中。フルレートで更新する
+		Near,
+		// 中距離
+		Mid,
+		// 遠距離
+		Far,
+		// 描画されていない
+		Hidden,
+
+		Num
+	};
+
+	/**
+	 * @brief バケットごとの設定
+	 */
+	struct FBucketSettings
+	{
+		// アクターと移動コンポーネントのTick間隔(秒)。0でフレーム毎
+		float TickInterval = 0.0f;
+		// アニメーションのUpdateRateOptimizationを有効にするか
+		bool bEnableUpdateRateOptimizations = false;
+		// 描画されていないときのアニメーションTick設定。メッシュ本来の設定より負荷の高い設定は使われません
+		EVisibilityBasedAnimTickOption AnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered;
+		// 移動を簡略化するか(プレイヤーが操作していないポーンのみ)
+		bool bCheapMovement = false;
+	};
+
+	FCharacterSignificance();
+
+	/**
+	 * @brief 一定間隔でバケットを再計算し、変化したキャラクターに設定を適用します
+	 * @param DeltaTime 経過時間
+	 * @param ViewerLocations 視点位置
+	 * @param Characters 対象のキャラクター
+	 * @param bCanUseVisibility 描画状況を判定に使うか。専用サーバーでは描画しないためfalseにします
+	 */
+	void Update(float DeltaTime, const TArray<FVector>& ViewerLocations, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters, bool bCanUseVisibility);
+
+	/**
+	 * @brief 有効/無効を切り替えます。無効にすると全キャラクターをNearの設定に戻します
+	 */
+	void SetEnabled(bool bInEnabled, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters);
+
+	bool IsEnabled() const { return bEnabled; }
+
+	/**
+	 * @brief バケットごとのキャラクター数と削減できたTick数の見積もり、計測したアニメーションの更新率をログに出力します
+	 */
+	void DumpReport() const;
+
+	/**
+	 * @brief バケットの設定を取得します
+	 */
+	FBucketSettings& GetBucketSettings(EBucket Bucket) { return BucketSettings[static_cast<int32>(Bucket)]; }
+
+	// これより近ければNear
+	float NearDistance = 1500.0f;
+
+	// これより近ければMid。遠ければFar
+	float MidDistance = 4000.0f;
+
+	// 描画されなくなってからHiddenとみなすまでの時間
+	float HiddenTolerance = 0.5f;
+
+	// バケットの再計算間隔(秒)
+	float UpdateInterval = 0.25f;
+
+private:
+	EBucket ComputeBucket(const AUnrealSandBoxCharacter& Character, const TArray<FVector>& ViewerLocations, bool bCanUseVisibility) const;
+	void Apply(AUnrealSandBoxCharacter& Character, EBucket Bucket);
+
+	FBucketSettings BucketSettings[static_cast<int32>(EBucket::Num)];
+	TMap<TObjectKey<AUnrealSandBoxCharacter>, EBucket> CurrentBuckets;
+	int32 BucketCounts[static_cast<int32>(EBucket::Num)] = {};
+
+	// バケットの再計算のたびに、そのフレームでポーズを更新したかをバケットごとに数える
+	int32 NumPoseTickSamples[static_cast<int32>(EBucket::Num)] = {};
+	int32 NumPoseTicked[static_cast<int32>(EBucket::Num)] = {};
+
+	bool bEnabled = true;
+	float TimeUntilUpdate = 0.0f;
+
+	// レポート用に平滑化したフレームレート
+	float SmoothedFrameRate = 60.0f;
+};
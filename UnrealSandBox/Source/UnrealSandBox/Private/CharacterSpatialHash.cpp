@@ -0,0 +1,321 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CharacterSpatialHash.h"
+#include "CoreGlobals.h"
+#include "Math/VectorRegister.h"
+
+//---------------------------------------------------------------------------------
+// FGrid
+//---------------------------------------------------------------------------------
+FCharacterSpatialHash::FGrid::FGrid(float InCellSize)
+	: CellSize(InCellSize)
+	, InvCellSize(1.0f / InCellSize)
+{
+	ensureAlwaysMsgf(InCellSize > 0.0f, TEXT("セルの大きさは正の値にしてください"));
+}
+
+FIntPoint FCharacterSpatialHash::FGrid::GetCellCoord(const FVector& Location) const
+{
+	return FIntPoint(FMath::FloorToInt(Location.X * InvCellSize), FMath::FloorToInt(Location.Y * InvCellSize));
+}
+
+template<typename FuncType>
+void FCharacterSpatialHash::FGrid::ForEachCell(const FVector& Min, const FVector& Max, FuncType Func) const
+{
+	const FIntPoint MinCoord = GetCellCoord(Min);
+	const FIntPoint MaxCoord = GetCellCoord(Max);
+	const int64 NumCoords = static_cast<int64>(MaxCoord.X - MinCoord.X + 1) * (MaxCoord.Y - MinCoord.Y + 1);
+
+	// 範囲が広いときはマップを引くより全セルを見たほうが速い
+	if (NumCoords > Cells.Num())
+	{
+		for (const FCell& Cell : Cells)
+		{
+			Func(Cell);
+		}
+		return;
+	}
+
+	for (int32 Y = MinCoord.Y; Y <= MaxCoord.Y; ++Y)
+	{
+		for (int32 X = MinCoord.X; X <= MaxCoord.X; ++X)
+		{
+			if (const int32* CellIndex = CellLookup.Find(FIntPoint(X, Y)))
+			{
+				Func(Cells[*CellIndex]);
+			}
+		}
+	}
+}
+
+void FCharacterSpatialHash::FGrid::QueryRadius(const FVector& Center, float Radius, TArray<FHit>& OutHits) const
+{
+	OutHits.Reset();
+
+	const float RadiusSq = FMath::Square(Radius);
+	const VectorRegister CenterX = VectorSetFloat1(Center.X);
+	const VectorRegister CenterY = VectorSetFloat1(Center.Y);
+	const VectorRegister CenterZ = VectorSetFloat1(Center.Z);
+	const VectorRegister RadiusSqV = VectorSetFloat1(RadiusSq);
+
+	ForEachCell(Center - FVector(Radius), Center + FVector(Radius), [&](const FCell& Cell)
+	{
+		const int32 Num = Cell.Ids.Num();
+		int32 Index = 0;
+
+		// 4件ずつ距離を求め、半径内のレーンだけ結果に加える
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			const VectorRegister DX = VectorSubtract(VectorLoad(Cell.X.GetData() + Index), CenterX);
+			const VectorRegister DY = VectorSubtract(VectorLoad(Cell.Y.GetData() + Index), CenterY);
+			const VectorRegister DZ = VectorSubtract(VectorLoad(Cell.Z.GetData() + Index), CenterZ);
+			const VectorRegister DistSq = VectorMultiplyAdd(DZ, DZ, VectorMultiplyAdd(DY, DY, VectorMultiply(DX, DX)));
+
+			uint32 Mask = static_cast<uint32>(VectorMaskBits(VectorCompareLE(DistSq, RadiusSqV)));
+			while (Mask != 0)
+			{
+				const int32 Lane = Index + static_cast<int32>(FMath::CountTrailingZeros(Mask));
+				Mask &= Mask - 1;
+				const FVector Location(Cell.X[Lane], Cell.Y[Lane], Cell.Z[Lane]);
+				OutHits.Add(FHit{Cell.Ids[Lane], Location, FVector::DistSquared(Location, Center)});
+			}
+		}
+
+		for (; Index < Num; ++Index)
+		{
+			const FVector Location(Cell.X[Index], Cell.Y[Index], Cell.Z[Index]);
+			const float DistSq = FVector::DistSquared(Location, Center);
+			if (DistSq <= RadiusSq)
+			{
+				OutHits.Add(FHit{Cell.Ids[Index], Location, DistSq});
+			}
+		}
+	});
+}
+
+void FCharacterSpatialHash::FGrid::QueryBox(const FBox& Box, TArray<FHit>& OutHits) const
+{
+	OutHits.Reset();
+
+	const FVector Center = Box.GetCenter();
+	const VectorRegister MinX = VectorSetFloat1(Box.Min.X);
+	const VectorRegister MinY = VectorSetFloat1(Box.Min.Y);
+	const VectorRegister MinZ = VectorSetFloat1(Box.Min.Z);
+	const VectorRegister MaxX = VectorSetFloat1(Box.Max.X);
+	const VectorRegister MaxY = VectorSetFloat1(Box.Max.Y);
+	const VectorRegister MaxZ = VectorSetFloat1(Box.Max.Z);
+
+	ForEachCell(Box.Min, Box.Max, [&](const FCell& Cell)
+	{
+		const int32 Num = Cell.Ids.Num();
+		int32 Index = 0;
+
+		for (; Index + 4 <= Num; Index += 4)
+		{
+			const VectorRegister X = VectorLoad(Cell.X.GetData() + Index);
+			const VectorRegister Y = VectorLoad(Cell.Y.GetData() + Index);
+			const VectorRegister Z = VectorLoad(Cell.Z.GetData() + Index);
+			const VectorRegister InX = VectorBitwiseAnd(VectorCompareGE(X, MinX), VectorCompareLE(X, MaxX));
+			const VectorRegister InY = VectorBitwiseAnd(VectorCompareGE(Y, MinY), VectorCompareLE(Y, MaxY));
+			const VectorRegister InZ = VectorBitwiseAnd(VectorCompareGE(Z, MinZ), VectorCompareLE(Z, MaxZ));
+
+			uint32 Mask = static_cast<uint32>(VectorMaskBits(VectorBitwiseAnd(InX, VectorBitwiseAnd(InY, InZ))));
+			while (Mask != 0)
+			{
+				const int32 Lane = Index + static_cast<int32>(FMath::CountTrailingZeros(Mask));
+				Mask &= Mask - 1;
+				const FVector Location(Cell.X[Lane], Cell.Y[Lane], Cell.Z[Lane]);
+				OutHits.Add(FHit{Cell.Ids[Lane], Location, FVector::DistSquared(Location, Center)});
+			}
+		}
+
+		for (; Index < Num; ++Index)
+		{
+			const FVector Location(Cell.X[Index], Cell.Y[Index], Cell.Z[Index]);
+			if (Box.IsInsideOrOn(Location))
+			{
+				OutHits.Add(FHit{Cell.Ids[Index], Location, FVector::DistSquared(Location, Center)});
+			}
+		}
+	});
+}
+
+void FCharacterSpatialHash::FGrid::QueryNearest(const FVector& Center, int32 K, float MaxRadius, TArray<FHit>& OutHits) const
+{
+	OutHits.Reset();
+	if (K <= 0 || NumEntries == 0)
+	{
+		return;
+	}
+
+	// 半径内にK件以上あれば、半径外のエントリがそれより近いことはない
+	float Radius = FMath::Min(CellSize, MaxRadius);
+	while (true)
+	{
+		QueryRadius(Center, Radius, OutHits);
+		if (OutHits.Num() >= K || Radius >= MaxRadius)
+		{
+			break;
+		}
+		Radius = FMath::Min(Radius * 2.0f, MaxRadius);
+	}
+
+	OutHits.Sort([](const FHit& A, const FHit& B) { return A.DistanceSquared < B.DistanceSquared; });
+	if (OutHits.Num() > K)
+	{
+		OutHits.SetNum(K, false);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// FCharacterSpatialHash
+//---------------------------------------------------------------------------------
+FCharacterSpatialHash::FCharacterSpatialHash(float CellSize)
+	: Grid(CellSize)
+{
+}
+
+int32 FCharacterSpatialHash::Add(AActor* Actor, const FVector& Location)
+{
+	int32 Id;
+	if (FreeIds.Num() > 0)
+	{
+		Id = FreeIds.Pop(false);
+		Entries[Id] = FEntry();
+	}
+	else
+	{
+		Id = Entries.AddDefaulted();
+	}
+	Entries[Id].Actor = Actor;
+
+	AddToCell(Id, Location);
+	++Grid.NumEntries;
+	bSnapshotDirty = true;
+	return Id;
+}
+
+void FCharacterSpatialHash::Remove(int32 Id)
+{
+	if (!ensureAlways(Entries.IsValidIndex(Id) && Entries[Id].CellIndex != INDEX_NONE))
+	{
+		return;
+	}
+
+	RemoveFromCell(Id);
+	Entries[Id] = FEntry();
+	FreeIds.Add(Id);
+	--Grid.NumEntries;
+	bSnapshotDirty = true;
+}
+
+void FCharacterSpatialHash::Update(int32 Id, const FVector& Location)
+{
+	if (!Entries.IsValidIndex(Id) || Entries[Id].CellIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	++Stats.NumUpdates;
+	bSnapshotDirty = true;
+
+	// 同じセル内の移動であれば位置を書き換えるだけ
+	FEntry& Entry = Entries[Id];
+	const int32* CellIndex = Grid.CellLookup.Find(Grid.GetCellCoord(Location));
+	if (CellIndex != nullptr && *CellIndex == Entry.CellIndex)
+	{
+		FGrid::FCell& Cell = Grid.Cells[Entry.CellIndex];
+		Cell.X[Entry.IndexInCell] = Location.X;
+		Cell.Y[Entry.IndexInCell] = Location.Y;
+		Cell.Z[Entry.IndexInCell] = Location.Z;
+		return;
+	}
+
+	++Stats.NumCellChanges;
+	RemoveFromCell(Id);
+	AddToCell(Id, Location);
+}
+
+AActor* FCharacterSpatialHash::GetActor(int32 Id) const
+{
+	return Entries.IsValidIndex(Id) ? Entries[Id].Actor.Get() : nullptr;
+}
+
+FCharacterSpatialHash::FSnapshot FCharacterSpatialHash::GetSnapshot()
+{
+	// 移動のたびに作り直すと全セルのコピーが何度も走るため、作り直すのは1フレームに1回まで
+	if (!Snapshot.IsValid() || (bSnapshotDirty && SnapshotFrame != GFrameCounter))
+	{
+		Snapshot = MakeShared<const FGrid, ESPMode::ThreadSafe>(Grid);
+		SnapshotFrame = GFrameCounter;
+		bSnapshotDirty = false;
+		++Stats.NumSnapshots;
+	}
+	return Snapshot.ToSharedRef();
+}
+
+void FCharacterSpatialHash::ResetStats()
+{
+	Stats = FStats();
+}
+
+void FCharacterSpatialHash::DumpStats() const
+{
+	int32 NumOccupiedCells = 0;
+	int32 MaxPerCell = 0;
+	for (const FGrid::FCell& Cell : Grid.Cells)
+	{
+		NumOccupiedCells += Cell.Ids.Num() > 0 ? 1 : 0;
+		MaxPerCell = FMath::Max(MaxPerCell, Cell.Ids.Num());
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("CharacterSpatialHash Entries:%d CellSize:%.0f Cells:%d Occupied:%d MaxPerCell:%d AvgPerOccupiedCell:%.1f Updates:%d CellChanges:%d Snapshots:%d"),
+		Grid.Num(), Grid.GetCellSize(), Grid.GetNumCells(), NumOccupiedCells, MaxPerCell,
+		NumOccupiedCells > 0 ? static_cast<float>(Grid.Num()) / NumOccupiedCells : 0.0f,
+		Stats.NumUpdates, Stats.NumCellChanges, Stats.NumSnapshots);
+}
+
+void FCharacterSpatialHash::AddToCell(int32 Id, const FVector& Location)
+{
+	const FIntPoint Coord = Grid.GetCellCoord(Location);
+	int32 CellIndex;
+	if (const int32* Found = Grid.CellLookup.Find(Coord))
+	{
+		CellIndex = *Found;
+	}
+	else
+	{
+		// 空になったセルも再利用するため削除しない
+		CellIndex = Grid.Cells.AddDefaulted();
+		Grid.CellLookup.Add(Coord, CellIndex);
+	}
+
+	FGrid::FCell& Cell = Grid.Cells[CellIndex];
+	FEntry& Entry = Entries[Id];
+	Entry.CellIndex = CellIndex;
+	Entry.IndexInCell = Cell.Ids.Add(Id);
+	Cell.X.Add(Location.X);
+	Cell.Y.Add(Location.Y);
+	Cell.Z.Add(Location.Z);
+}
+
+void FCharacterSpatialHash::RemoveFromCell(int32 Id)
+{
+	FEntry& Entry = Entries[Id];
+	FGrid::FCell& Cell = Grid.Cells[Entry.CellIndex];
+	const int32 Index = Entry.IndexInCell;
+
+	// 末尾の要素を詰めるので、そのエントリの位置を更新する
+	Cell.X.RemoveAtSwap(Index, 1, false);
+	Cell.Y.RemoveAtSwap(Index, 1, false);
+	Cell.Z.RemoveAtSwap(Index, 1, false);
+	Cell.Ids.RemoveAtSwap(Index, 1, false);
+	if (Cell.Ids.IsValidIndex(Index))
+	{
+		Entries[Cell.Ids[Index]].IndexInCell = Index;
+	}
+
+	Entry.CellIndex = INDEX_NONE;
+	Entry.IndexInCell = INDEX_NONE;
+}
@@ -0,0 +1,158 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * @brief キャラクターの位置をXY平面の一様グリッドで管理し、近傍検索を行うクラス
+ *		　セルごとに位置をX・Y・Zの配列で連続して持ち、距離の判定は4件ずつSIMDで行います。
+ *		　位置の更新は同じセル内なら配列の書き換えのみ、セルをまたいだときだけ移動します。
+ *		　ワーカースレッドからは読み取り専用のスナップショットを取得して検索します。
+ *		　ゲームスレッドでのみ更新してください。
+ */
+class FCharacterSpatialHash final
+{
+public:
+	/**
+	 * @brief 検索結果
+	 */
+	struct FHit
+	{
+		// Addで返されたID
+		int32 Id;
+		FVector Location;
+		float DistanceSquared;
+	};
+
+	/**
+	 * @brief セルの配列と検索処理
+	 *		　スナップショットはこのクラスのコピーで、作成後は変更されないため複数スレッドから同時に検索できます。
+	 */
+	class FGrid final
+	{
+	public:
+		explicit FGrid(float InCellSize);
+
+		/**
+		 * @brief 中心から半径以内のエントリを検索します
+		 * @param OutHits 結果。呼び出し時にクリアされます。順序は不定です
+		 */
+		void QueryRadius(const FVector& Center, float Radius, TArray<FHit>& OutHits) const;
+
+		/**
+		 * @brief ボックス内のエントリを検索します。DistanceSquaredはボックスの中心からの距離です
+		 * @param OutHits 結果。呼び出し時にクリアされます。順序は不定です
+		 */
+		void QueryBox(const FBox& Box, TArray<FHit>& OutHits) const;
+
+		/**
+		 * @brief 中心から近い順にK件検索します
+		 *		　セルの大きさから半径を倍にしながらK件見つかるまで半径検索を繰り返します。
+		 * @param MaxRadius これより遠いエントリは対象外
+		 * @param OutHits 結果。近い順に並びます。呼び出し時にクリアされます
+		 */
+		void QueryNearest(const FVector& Center, int32 K, float MaxRadius, TArray<FHit>& OutHits) const;
+
+		int32 Num() const { return NumEntries; }
+		int32 GetNumCells() const { return Cells.Num(); }
+		float GetCellSize() const { return CellSize; }
+
+	private:
+		friend class FCharacterSpatialHash;
+
+		/**
+		 * @brief セル。同じインデックスの要素が1つのエントリ
+		 */
+		struct FCell
+		{
+			TArray<float> X;
+			TArray<float> Y;
+			TArray<float> Z;
+			TArray<int32> Ids;
+		};
+
+		FIntPoint GetCellCoord(const FVector& Location) const;
+
+		/**
+		 * @brief 範囲に重なるセルを列挙します。範囲がセル数より広ければ全セルを列挙します
+		 */
+		template<typename FuncType>
+		void ForEachCell(const FVector& Min, const FVector& Max, FuncType Func) const;
+
+		float CellSize;
+		float InvCellSize;
+		TMap<FIntPoint, int32> CellLookup;
+		TArray<FCell> Cells;
+		int32 NumEntries = 0;
+	};
+
+	using FSnapshot = TSharedRef<const FGrid, ESPMode::ThreadSafe>;
+
+	explicit FCharacterSpatialHash(float CellSize = 1000.0f);
+
+	/**
+	 * @brief エントリを追加します
+	 * @return 更新・削除に使うID
+	 */
+	int32 Add(AActor* Actor, const FVector& Location);
+
+	void Remove(int32 Id);
+
+	/**
+	 * @brief 位置を更新します。移動のたびに呼び出します
+	 */
+	void Update(int32 Id, const FVector& Location);
+
+	/**
+	 * @brief エントリのアクターを取得します。ゲームスレッドでのみ呼び出してください
+	 */
+	AActor* GetActor(int32 Id) const;
+
+	/**
+	 * @brief ゲームスレッドで検索する場合に使用します
+	 */
+	const FGrid& GetGrid() const { return Grid; }
+
+	/**
+	 * @brief ワーカースレッドで検索するための読み取り専用のスナップショットを取得します
+	 *		　前回の取得から変更がなければ同じものを返します。
+	 *		　作り直すのは1フレームに1回までなので、同じフレーム内で取得後に行った更新は次のフレームまで反映されません
+	 */
+	FSnapshot GetSnapshot();
+
+	int32 Num() const { return Grid.Num(); }
+
+	void ResetStats();
+	void DumpStats() const;
+
+private:
+	/**
+	 * @brief エントリの格納場所
+	 */
+	struct FEntry
+	{
+		TWeakObjectPtr<AActor> Actor;
+		int32 CellIndex = INDEX_NONE;
+		int32 IndexInCell = INDEX_NONE;
+	};
+
+	struct FStats
+	{
+		int32 NumUpdates = 0;
+		int32 NumCellChanges = 0;
+		int32 NumSnapshots = 0;
+	};
+
+	void AddToCell(int32 Id, const FVector& Location);
+	void RemoveFromCell(int32 Id);
+
+	FGrid Grid;
+	TArray<FEntry> Entries;
+	TArray<int32> FreeIds;
+	TSharedPtr<const FGrid, ESPMode::ThreadSafe> Snapshot;
+	// スナップショットを作成したフレームと、それ以降に変更があったか
+	uint64 SnapshotFrame = 0;
+	bool bSnapshotDirty = false;
+	FStats Stats;
+};
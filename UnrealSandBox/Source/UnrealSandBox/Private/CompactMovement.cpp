@@ -0,0 +1,235 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CompactMovement.h"
+#include "Engine/NetSerialization.h"
+
+namespace SandBoxCompactMovementInternal
+{
+	/**
+	 * @brief 符号付きの値を、0に近いほど少ないバイト数で送ります
+	 *		　セルの番号はワールドの原点付近では小さいため、ほとんどの場合1バイトで済みます。
+	 */
+	void SerializeSigned(FArchive& Ar, int16& Value)
+	{
+		// 負の値を奇数、正の値を偶数に割り当てる
+		uint32 Encoded = Ar.IsSaving() ? ((static_cast<uint32>(Value) << 1) ^ static_cast<uint32>(Value >> 15)) & 0xFFFF : 0;
+		Ar.SerializeIntPacked(Encoded);
+		if (Ar.IsLoading())
+		{
+			Value = static_cast<int16>((Encoded >> 1) ^ (0u - (Encoded & 1)));
+		}
+	}
+
+	int16 QuantizeCell(float Value)
+	{
+		return static_cast<int16>(FMath::Clamp(FMath::FloorToInt(Value / SandBoxCompactMovement::CellSize), static_cast<int32>(MIN_int16), static_cast<int32>(MAX_int16)));
+	}
+
+	uint16 QuantizeOffset(float Value, int16 Cell)
+	{
+		const float Offset = Value - Cell * SandBoxCompactMovement::CellSize;
+		return static_cast<uint16>(FMath::Clamp(FMath::RoundToInt(Offset * SandBoxCompactMovement::OffsetScale), 0, static_cast<int32>(MAX_uint16)));
+	}
+
+	int16 QuantizeVelocity(float Value)
+	{
+		return static_cast<int16>(FMath::Clamp(FMath::RoundToInt(Value), static_cast<int32>(MIN_int16), static_cast<int32>(MAX_int16)));
+	}
+
+	float Dequantize(int16 Cell, uint16 Offset)
+	{
+		return Cell * SandBoxCompactMovement::CellSize + Offset / SandBoxCompactMovement::OffsetScale;
+	}
+
+	/**
+	 * @brief 差分で送るフィールド
+	 */
+	enum EField : uint8
+	{
+		Field_Cell = 1 << 0,
+		Field_OffsetX = 1 << 1,
+		Field_OffsetY = 1 << 2,
+		Field_OffsetZ = 1 << 3,
+		Field_Yaw = 1 << 4,
+		Field_Velocity = 1 << 5,
+		Field_All = (1 << 6) - 1,
+	};
+	constexpr uint32 NumFieldBits = 6;
+
+	uint8 GetChangedFields(const FSandBoxMovementState& Base, const FSandBoxMovementState& State)
+	{
+		uint8 Fields = 0;
+		Fields |= (State.CellX != Base.CellX || State.CellY != Base.CellY || State.CellZ != Base.CellZ) ? Field_Cell : 0;
+		Fields |= State.OffsetX != Base.OffsetX ? Field_OffsetX : 0;
+		Fields |= State.OffsetY != Base.OffsetY ? Field_OffsetY : 0;
+		Fields |= State.OffsetZ != Base.OffsetZ ? Field_OffsetZ : 0;
+		Fields |= State.Yaw != Base.Yaw ? Field_Yaw : 0;
+		Fields |= (State.VelocityX != Base.VelocityX || State.VelocityY != Base.VelocityY || State.VelocityZ != Base.VelocityZ) ? Field_Velocity : 0;
+		return Fields;
+	}
+
+	void SerializeFields(FArchive& Ar, FSandBoxMovementState& State, uint8 Fields)
+	{
+		if (Fields & Field_Cell)
+		{
+			SerializeSigned(Ar, State.CellX);
+			SerializeSigned(Ar, State.CellY);
+			SerializeSigned(Ar, State.CellZ);
+		}
+		if (Fields & Field_OffsetX)
+		{
+			Ar << State.OffsetX;
+		}
+		if (Fields & Field_OffsetY)
+		{
+			Ar << State.OffsetY;
+		}
+		if (Fields & Field_OffsetZ)
+		{
+			Ar << State.OffsetZ;
+		}
+		if (Fields & Field_Yaw)
+		{
+			Ar << State.Yaw;
+		}
+		if (Fields & Field_Velocity)
+		{
+			// 止まっていることが多いので、ゼロかどうかを先に1bitで送る
+			uint8 bMoving = (State.VelocityX != 0 || State.VelocityY != 0 || State.VelocityZ != 0) ? 1 : 0;
+			Ar.SerializeBits(&bMoving, 1);
+			if (bMoving)
+			{
+				Ar << State.VelocityX << State.VelocityY << State.VelocityZ;
+			}
+			else if (Ar.IsLoading())
+			{
+				State.VelocityX = State.VelocityY = State.VelocityZ = 0;
+			}
+		}
+	}
+
+	/**
+	 * @brief 接続ごとに保持される、送信した状態
+	 *		　エンジンは受け取りが確認できなかった場合、確認済みの送信時の状態を基準に戻します。
+	 */
+	class FDeltaBaseState final : public INetDeltaBaseState
+	{
+	public:
+		explicit FDeltaBaseState(const FSandBoxMovementState& InState) : State(InState) {}
+
+		virtual bool IsStateEqual(INetDeltaBaseState* Other) override
+		{
+			const FSandBoxMovementState& OtherState = static_cast<const FDeltaBaseState*>(Other)->State;
+			return State == OtherState && State.Sequence == OtherState.Sequence;
+		}
+
+		const FSandBoxMovementState State;
+	};
+}
+
+bool FSandBoxMovementState::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	using namespace SandBoxCompactMovementInternal;
+
+	SerializeFields(Ar, *this, Field_All);
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
+
+bool FSandBoxMovementState::NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms)
+{
+	using namespace SandBoxCompactMovementInternal;
+
+	if (DeltaParms.Writer != nullptr)
+	{
+		FBitWriter& Writer = *DeltaParms.Writer;
+		const FDeltaBaseState* Base = static_cast<const FDeltaBaseState*>(DeltaParms.OldState);
+		if (Base != nullptr && Base->State == *this)
+		{
+			// 確認済みの状態から変わっていなければ何も送らない
+			return false;
+		}
+
+		// 番号は全接続で共通に振る。同じ番号の基準を持つクライアントは同じ状態を持っている
+		++Sequence;
+		*DeltaParms.NewState = MakeShared<FDeltaBaseState>(*this);
+
+		uint8 bHasBase = Base != nullptr ? 1 : 0;
+		Writer.SerializeBits(&bHasBase, 1);
+		uint8 BaseSequence = bHasBase ? Base->State.Sequence : 0;
+		if (bHasBase)
+		{
+			Writer << BaseSequence;
+		}
+		Writer << Sequence;
+
+		uint8 Fields = bHasBase ? GetChangedFields(Base->State, *this) : static_cast<uint8>(Field_All);
+		Writer.SerializeBits(&Fields, NumFieldBits);
+		SerializeFields(Writer, *this, Fields);
+		return true;
+	}
+	else if (DeltaParms.Reader != nullptr)
+	{
+		FBitReader& Reader = *DeltaParms.Reader;
+		uint8 bHasBase = 0;
+		Reader.SerializeBits(&bHasBase, 1);
+		uint8 BaseSequence = 0;
+		if (bHasBase)
+		{
+			Reader << BaseSequence;
+		}
+		uint8 NewSequence = 0;
+		Reader << NewSequence;
+
+		uint8 Fields = 0;
+		Reader.SerializeBits(&Fields, NumFieldBits);
+
+		// 読み捨てる場合もビットを消費するため、いったん別の値に読み込む
+		FSandBoxMovementState Received = *this;
+		SerializeFields(Reader, Received, Fields);
+		if (Reader.IsError())
+		{
+			return false;
+		}
+
+		// 持っていない状態を基準にした差分は適用しない。エンジンが基準を戻した後の送信で追いつく
+		if (!bHasBase || BaseSequence == Sequence)
+		{
+			*this = Received;
+			Sequence = NewSequence;
+		}
+		return true;
+	}
+	return false;
+}
+
+void SandBoxCompactMovement::Pack(const FVector& Location, float Yaw, const FVector& Velocity, FSandBoxMovementState& OutState)
+{
+	static_assert(CellSize * OffsetScale <= MAX_uint16 + 1, "セル内のオフセットが16bitに収まりません");
+	using namespace SandBoxCompactMovementInternal;
+
+	OutState.CellX = QuantizeCell(Location.X);
+	OutState.CellY = QuantizeCell(Location.Y);
+	OutState.CellZ = QuantizeCell(Location.Z);
+
+	OutState.OffsetX = QuantizeOffset(Location.X, OutState.CellX);
+	OutState.OffsetY = QuantizeOffset(Location.Y, OutState.CellY);
+	OutState.OffsetZ = QuantizeOffset(Location.Z, OutState.CellZ);
+	OutState.Yaw = FRotator::CompressAxisToShort(Yaw);
+
+	OutState.VelocityX = QuantizeVelocity(Velocity.X);
+	OutState.VelocityY = QuantizeVelocity(Velocity.Y);
+	OutState.VelocityZ = QuantizeVelocity(Velocity.Z);
+}
+
+void SandBoxCompactMovement::Unpack(const FSandBoxMovementState& State, FVector& OutLocation, float& OutYaw, FVector& OutVelocity)
+{
+	using namespace SandBoxCompactMovementInternal;
+
+	OutLocation.X = Dequantize(State.CellX, State.OffsetX);
+	OutLocation.Y = Dequantize(State.CellY, State.OffsetY);
+	OutLocation.Z = Dequantize(State.CellZ, State.OffsetZ);
+	OutYaw = FRotator::DecompressAxisFromShort(State.Yaw);
+	OutVelocity = FVector(State.VelocityX, State.VelocityY, State.VelocityZ);
+}
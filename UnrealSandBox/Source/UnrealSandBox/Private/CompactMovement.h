@@ -0,0 +1,91 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CompactMovement.generated.h"
+
+struct FNetDeltaSerializeInfo;
+
+/**
+ * @brief 量子化した移動状態
+ *		　ワールドをSandBoxCompactMovement::CellSize単位のセルに分け、
+ *		　・キャラクターがいるセルの番号
+ *		　・セル内の位置を1/SandBoxCompactMovement::OffsetScale単位で量子化したオフセット
+ *		　・16bitのヨー(キャラクターはヨーだけ回転するため、ピッチとロールは送らない)
+ *		　・1cm/s単位の速度
+ *		　を1つのプロパティとして持ちます。
+ *		　セルとオフセットを別のプロパティにすると、パケットロス時にプロパティごとに再送されるため、
+ *		　クライアントが新しいオフセットを古いセルと組み合わせてしまい、最大でセル1つ分ワープします。
+ *
+ *		　接続ごとに相手が受け取りを確認した状態を基準にして、変化したフィールドだけを送ります。
+ *		　セルはセルをまたいだときだけ送ります。基準にした状態の番号を一緒に送り、
+ *		　クライアントが持っている状態と異なる基準の差分(基準を送ったパケットが失われた場合)は適用しません。
+ *		　失われたパケットはエンジンが基準を確認済みの状態に戻すため、次の送信で追いつきます。
+ */
+USTRUCT()
+struct FSandBoxMovementState
+{
+	GENERATED_BODY()
+
+	int16 CellX = 0;
+	int16 CellY = 0;
+	int16 CellZ = 0;
+
+	uint16 OffsetX = 0;
+	uint16 OffsetY = 0;
+	uint16 OffsetZ = 0;
+	uint16 Yaw = 0;
+
+	int16 VelocityX = 0;
+	int16 VelocityY = 0;
+	int16 VelocityZ = 0;
+
+	// サーバー: 送信した状態に振る番号。クライアント: 最後に適用した状態の番号。比較・量子化の対象外
+	uint8 Sequence = 0;
+
+	/**
+	 * @brief 全フィールドを送ります
+	 */
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	/**
+	 * @brief 接続ごとに確認済みの状態との差分を送ります
+	 */
+	bool NetDeltaSerialize(FNetDeltaSerializeInfo& DeltaParms);
+
+	bool operator==(const FSandBoxMovementState& Other) const
+	{
+		return CellX == Other.CellX && CellY == Other.CellY && CellZ == Other.CellZ &&
+			OffsetX == Other.OffsetX && OffsetY == Other.OffsetY && OffsetZ == Other.OffsetZ && Yaw == Other.Yaw &&
+			VelocityX == Other.VelocityX && VelocityY == Other.VelocityY && VelocityZ == Other.VelocityZ;
+	}
+};
+
+template<>
+struct TStructOpsTypeTraits<FSandBoxMovementState> : public TStructOpsTypeTraitsBase2<FSandBoxMovementState>
+{
+	enum
+	{
+		WithNetSerializer = true,
+		WithNetDeltaSerializer = true,
+		WithIdenticalViaEquality = true,
+	};
+};
+
+/**
+ * @brief 移動状態の量子化と復元
+ *		　差分は接続ごとに相手が受け取りを確認した状態を基準に作り、基準が一致しない差分は適用しないため、
+ *		　クライアントが復元する状態は必ずサーバーのある時点の状態と一致します。
+ */
+namespace SandBoxCompactMovement
+{
+	// セルの大きさ(cm)
+	constexpr float CellSize = 2048.0f;
+
+	// セル内のオフセットの分解能(1cmあたりの段階数)。CellSize * OffsetScaleが16bitに収まる必要がある
+	constexpr float OffsetScale = 32.0f;
+
+	void Pack(const FVector& Location, float Yaw, const FVector& Velocity, FSandBoxMovementState& OutState);
+	void Unpack(const FSandBoxMovementState& State, FVector& OutLocation, float& OutYaw, FVector& OutVelocity);
+}
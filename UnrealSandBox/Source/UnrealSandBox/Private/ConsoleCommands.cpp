@@ -2,7 +2,23 @@
 
 
 #include "ConsoleCommands.h"
+#include "ArgParser.h"
+#include "GameFramework/PlayerController.h"
+#include "JobScheduler.h"
+#include "LoadGenerator.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "MovementIntentBatch.h"
 #include "SampleSubSystem.h"
+#include "SandBoxBotDriver.h"
+#include "SandBoxCommandRegistry.h"
+#include "SandBoxFrameAllocator.h"
+#include "SandBoxLog.h"
+#include "SandBoxMemoryTracker.h"
+#include "SandBoxScopedTimer.h"
+#include "SandBoxTelemetry.h"
+#include "SandBoxWorldSubSystem.h"
+#include "UnrealSandBox/UnrealSandBoxGameMode.h"
 
 namespace ConsoleCommandsInternal
 {
@@ -34,14 +50,79 @@ namespace ConsoleCommandsInternal
 			return nullptr;
 		}
 	}
+
+	USandBoxWorldSubSystem* GetSandBoxWorldSubSystem()
+	{
+		UWorld* World = GetAnyGameWorld();
+		if (World != nullptr)
+		{
+			return World->GetSubsystem<USandBoxWorldSubSystem>();
+		}
+		else
+		{
+			return nullptr;
+		}
+	}
+
+	AUnrealSandBoxGameMode* GetSandBoxGameMode()
+	{
+		UWorld* World = GetAnyGameWorld();
+		if (World != nullptr)
+		{
+			return World->GetAuthGameMode<AUnrealSandBoxGameMode>();
+		}
+		else
+		{
+			return nullptr;
+		}
+	}
+
+	// コンソールで分割された引数を結合してFArgParserでパースする
+	// 結合した文字列はパースの間だけ使うので、呼び出したスレッドのフレームアロケーターに置いてスコープを抜けたら戻す
+	bool ParseArgs(FArgParser& ArgParser, const TCHAR* CommandName, const TArray<FString>& Args)
+	{
+		FSandBoxFrameAllocator::FScope FrameScope;
+
+		int32 Length = FCString::Strlen(CommandName);
+		for (const FString& Arg : Args)
+		{
+			Length += 1 + Arg.Len();
+		}
+
+		TSandBoxFrameArray<TCHAR> Command;
+		Command.Reserve(Length + 1);
+		Command.Append(CommandName, FCString::Strlen(CommandName));
+		for (const FString& Arg : Args)
+		{
+			Command.Add(TEXT(' '));
+			Command.Append(*Arg, Arg.Len());
+		}
+		Command.Add(TEXT('\0'));
+		return ArgParser.Parse(Command.GetData());
+	}
+
+	// "1000,10000"のようなカンマ区切りの整数リストを取得する
+	TArray<int32> ParseIntList(const FString& Value)
+	{
+		TArray<FString> Elements;
+		Value.ParseIntoArray(Elements, TEXT(","));
+
+		TArray<int32> Result;
+		for (const FString& Element : Elements)
+		{
+			Result.Add(FCString::Atoi(*Element));
+		}
+		return Result;
+	}
 }
 
 void RegisterSandBoxConsoleCommand()
 {
-	IConsoleManager::Get().RegisterConsoleCommand(
+	FSandBoxCommandRegistry::Get().Register(
 		TEXT("StartAutoDeleteAsyncSample"),
 		TEXT("StartAutoDeleteAsyncSample WaitSec"),
-		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
 		{
 			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
 			if (Args.Num() == 1 && SubSystem != nullptr)
@@ -49,14 +130,14 @@ void RegisterSandBoxConsoleCommand()
 				const float WaitSec = FCString::Atof(*Args[0]);
 				SubSystem->StartAutoDeleteAsyncSample(WaitSec);
 			}
-		}),
-		ECVF_Default
+		}
 	);
 
-	IConsoleManager::Get().RegisterConsoleCommand(
+	FSandBoxCommandRegistry::Get().Register(
 		TEXT("StartAsyncSample"),
 		TEXT("StartAsyncSample WaitSec"),
-		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
 		{
 			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
 			if (Args.Num() == 1 && SubSystem != nullptr)
@@ -64,40 +145,1295 @@ void RegisterSandBoxConsoleCommand()
 				const float WaitSec = FCString::Atof(*Args[0]);
 				SubSystem->StartAsyncSample(WaitSec);
 			}
-		}),
-		ECVF_Default
+		}
 	);
 
-	IConsoleManager::Get().RegisterConsoleCommand(
+	FSandBoxCommandRegistry::Get().Register(
 		TEXT("CancelAsyncSample"),
 		TEXT("CancelAsyncSample"),
-		FConsoleCommandDelegate::CreateLambda([]()
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
 		{
 			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
 			SubSystem->CancelAsyncSample();
-		}),
-		ECVF_Default
+		}
 	);
 
-	IConsoleManager::Get().RegisterConsoleCommand(
+	FSandBoxCommandRegistry::Get().Register(
 		TEXT("CheckAsyncTaskBehaviour"),
 		TEXT("CheckAsyncTaskBehaviour"),
-		FConsoleCommandDelegate::CreateLambda([]()
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
 		{
 			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
 			SubSystem->CheckAsyncTaskBehaviour();
-		}),
-		ECVF_Default
+		}
 	);
 
-	IConsoleManager::Get().RegisterConsoleCommand(
+	FSandBoxCommandRegistry::Get().Register(
 		TEXT("CheckAsyncCrash"),
 		TEXT("CheckAsyncCrash"),
-		FConsoleCommandDelegate::CreateLambda([]()
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
 		{
 			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
 			SubSystem->CheckAsyncCrash();
-		}),
-		ECVF_Default
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SpawnCrowd"),
+		TEXT("SpawnCrowd -num Count [-radius Radius]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-num"), true, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-radius"), false, FArgParser::EType::Float);
+
+			int32 Count = 0;
+			if (SubSystem != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SpawnCrowd"), Args) && ArgParser.GetValue(TEXT("-num"), Count))
+			{
+				float Radius = 5000.0f;
+				if (ArgParser.IsExistValue(TEXT("-radius")))
+				{
+					ArgParser.GetValue(TEXT("-radius"), Radius);
+				}
+
+				// プレイヤーの足元を中心に配置する
+				FVector Center = FVector::ZeroVector;
+				const APlayerController* PlayerController = SubSystem->GetWorld()->GetFirstPlayerController();
+				if (PlayerController != nullptr && PlayerController->GetPawn() != nullptr)
+				{
+					const APawn* Pawn = PlayerController->GetPawn();
+					Center = Pawn->GetActorLocation() - FVector(0.0f, 0.0f, Pawn->GetSimpleCollisionHalfHeight());
+				}
+				SubSystem->SpawnCrowd(Count, Center, Radius);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("ClearCrowd"),
+		TEXT("ClearCrowd"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			if (SubSystem != nullptr)
+			{
+				SubSystem->ClearCrowd();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("CrowdBenchmark"),
+		TEXT("CrowdBenchmark [-agents 1000,10000,50000] [-frames NumFrames]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-agents"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-frames"), false, FArgParser::EType::Integer);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("CrowdBenchmark"), Args))
+			{
+				return;
+			}
+
+			FString AgentCounts = TEXT("1000,10000,50000,100000");
+			int32 NumFrames = 120;
+			if (ArgParser.IsExistValue(TEXT("-agents")))
+			{
+				ArgParser.GetValue(TEXT("-agents"), AgentCounts);
+			}
+			if (ArgParser.IsExistValue(TEXT("-frames")))
+			{
+				ArgParser.GetValue(TEXT("-frames"), NumFrames);
+			}
+			USandBoxWorldSubSystem::RunCrowdBenchmark(ConsoleCommandsInternal::ParseIntList(AgentCounts), NumFrames);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("MovementIntentBenchmark"),
+		TEXT("MovementIntentBenchmark [-pawns 1000,10000] [-iterations NumIterations]"),
+		ESandBoxCommandAffinity::SerialQueue,
+		TEXT("Benchmark"),
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-pawns"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-iterations"), false, FArgParser::EType::Integer);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("MovementIntentBenchmark"), Args))
+			{
+				return;
+			}
+
+			FString PawnCounts = TEXT("1000,10000");
+			int32 NumIterations = 1000;
+			if (ArgParser.IsExistValue(TEXT("-pawns")))
+			{
+				ArgParser.GetValue(TEXT("-pawns"), PawnCounts);
+			}
+			if (ArgParser.IsExistValue(TEXT("-iterations")))
+			{
+				ArgParser.GetValue(TEXT("-iterations"), NumIterations);
+			}
+			FMovementIntentBatch::RunBenchmark(ConsoleCommandsInternal::ParseIntList(PawnCounts), NumIterations);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SignificanceReport"),
+		TEXT("SignificanceReport"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			if (SubSystem != nullptr)
+			{
+				SubSystem->DumpSignificance();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SetSignificanceEnabled"),
+		TEXT("SetSignificanceEnabled true/false"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			if (Args.Num() == 1 && SubSystem != nullptr)
+			{
+				SubSystem->SetSignificanceEnabled(Args[0].ToBool());
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("AnimBenchmark"),
+		TEXT("AnimBenchmark -num Count [-frames NumFrames] [-native true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-num"), true, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-frames"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-native"), false, FArgParser::EType::Bool);
+
+			int32 Count = 0;
+			if (SubSystem != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("AnimBenchmark"), Args) && ArgParser.GetValue(TEXT("-num"), Count))
+			{
+				int32 NumFrames = 300;
+				bool bNative = false;
+				if (ArgParser.IsExistValue(TEXT("-frames")))
+				{
+					ArgParser.GetValue(TEXT("-frames"), NumFrames);
+				}
+				if (ArgParser.IsExistValue(TEXT("-native")))
+				{
+					ArgParser.GetValue(TEXT("-native"), bNative);
+				}
+				SubSystem->StartAnimBenchmark(Count, NumFrames, bNative);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("PawnPoolStats"),
+		TEXT("PawnPoolStats"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			AUnrealSandBoxGameMode* GameMode = ConsoleCommandsInternal::GetSandBoxGameMode();
+			if (GameMode != nullptr)
+			{
+				GameMode->DumpPawnPoolStats();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SpawnBotWave"),
+		TEXT("SpawnBotWave -num Count"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			AUnrealSandBoxGameMode* GameMode = ConsoleCommandsInternal::GetSandBoxGameMode();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-num"), true, FArgParser::EType::Integer);
+
+			int32 Count = 0;
+			if (GameMode != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SpawnBotWave"), Args) && ArgParser.GetValue(TEXT("-num"), Count))
+			{
+				GameMode->SpawnBotWave(Count);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("ReleaseBotWave"),
+		TEXT("ReleaseBotWave"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			AUnrealSandBoxGameMode* GameMode = ConsoleCommandsInternal::GetSandBoxGameMode();
+			if (GameMode != nullptr)
+			{
+				GameMode->ReleaseBotWave();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("CameraRigReport"),
+		TEXT("CameraRigReport"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			if (SubSystem != nullptr)
+			{
+				SubSystem->DumpCameraRigs();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("FloorQueryBenchmark"),
+		TEXT("FloorQueryBenchmark -num Count [-frames NumFrames] [-async true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-num"), true, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-frames"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-async"), false, FArgParser::EType::Bool);
+
+			int32 Count = 0;
+			if (SubSystem != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("FloorQueryBenchmark"), Args) && ArgParser.GetValue(TEXT("-num"), Count))
+			{
+				int32 NumFrames = 300;
+				bool bAsync = true;
+				if (ArgParser.IsExistValue(TEXT("-frames")))
+				{
+					ArgParser.GetValue(TEXT("-frames"), NumFrames);
+				}
+				if (ArgParser.IsExistValue(TEXT("-async")))
+				{
+					ArgParser.GetValue(TEXT("-async"), bAsync);
+				}
+				SubSystem->StartFloorQueryBenchmark(Count, NumFrames, bAsync);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("PathBenchmark"),
+		TEXT("PathBenchmark -bots Count [-frames NumFrames] [-cache true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-bots"), true, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-frames"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-cache"), false, FArgParser::EType::Bool);
+
+			int32 NumBots = 0;
+			if (SubSystem != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("PathBenchmark"), Args) && ArgParser.GetValue(TEXT("-bots"), NumBots))
+			{
+				int32 NumFrames = 300;
+				bool bUseCache = true;
+				if (ArgParser.IsExistValue(TEXT("-frames")))
+				{
+					ArgParser.GetValue(TEXT("-frames"), NumFrames);
+				}
+				if (ArgParser.IsExistValue(TEXT("-cache")))
+				{
+					ArgParser.GetValue(TEXT("-cache"), bUseCache);
+				}
+				SubSystem->StartPathBenchmark(NumBots, NumFrames, bUseCache);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("CompactMovement"),
+		TEXT("CompactMovement -enable true/false"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-enable"), true, FArgParser::EType::Bool);
+
+			bool bEnable = false;
+			if (SubSystem != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("CompactMovement"), Args) && ArgParser.GetValue(TEXT("-enable"), bEnable))
+			{
+				SubSystem->SetCompactMovementEnabled(bEnable);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("NetMovementRate"),
+		TEXT("NetMovementRate -enable true/false"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-enable"), true, FArgParser::EType::Bool);
+
+			bool bEnable = false;
+			if (SubSystem != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("NetMovementRate"), Args) && ArgParser.GetValue(TEXT("-enable"), bEnable))
+			{
+				SubSystem->SetNetMovementRateEnabled(bEnable);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("NetMovementReport"),
+		TEXT("NetMovementReport [-frames NumFrames]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-frames"), false, FArgParser::EType::Integer);
+
+			if (SubSystem != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("NetMovementReport"), Args))
+			{
+				int32 NumFrames = 0;
+				if (ArgParser.IsExistValue(TEXT("-frames")))
+				{
+					ArgParser.GetValue(TEXT("-frames"), NumFrames);
+				}
+				SubSystem->StartNetMovementReport(NumFrames);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("NetTickReport"),
+		TEXT("NetTickReport [-reset true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-reset"), false, FArgParser::EType::Bool);
+
+			if (SubSystem != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("NetTickReport"), Args))
+			{
+				bool bReset = false;
+				if (ArgParser.IsExistValue(TEXT("-reset")))
+				{
+					ArgParser.GetValue(TEXT("-reset"), bReset);
+				}
+				SubSystem->DumpNetTick(bReset);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("LoadGenStart"),
+		TEXT("LoadGenStart -clients Count [-pattern Circle/Zigzag/Random] [-address 127.0.0.1:7777] [-fps MaxFPS] [-compareallocs true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-clients"), true, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-pattern"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-address"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-fps"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-compareallocs"), false, FArgParser::EType::Bool);
+
+			FLoadGenerator::FSettings Settings;
+			if (SubSystem != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("LoadGenStart"), Args) && ArgParser.GetValue(TEXT("-clients"), Settings.NumClients))
+			{
+				// 接続先の指定がなければこのプロセスが待ち受けているポートに接続する
+				Settings.Address = FString::Printf(TEXT("127.0.0.1:%d"), ConsoleCommandsInternal::GetAnyGameWorld()->URL.Port);
+				if (ArgParser.IsExistValue(TEXT("-address")))
+				{
+					ArgParser.GetValue(TEXT("-address"), Settings.Address);
+				}
+				if (ArgParser.IsExistValue(TEXT("-pattern")))
+				{
+					ArgParser.GetValue(TEXT("-pattern"), Settings.Pattern);
+				}
+				if (ArgParser.IsExistValue(TEXT("-fps")))
+				{
+					ArgParser.GetValue(TEXT("-fps"), Settings.MaxFPS);
+				}
+				if (ArgParser.IsExistValue(TEXT("-compareallocs")))
+				{
+					ArgParser.GetValue(TEXT("-compareallocs"), Settings.bCompareHeapAllocs);
+				}
+
+				FSandBoxBotDriver::EPattern Pattern;
+				if (!FSandBoxBotDriver::ParsePattern(Settings.Pattern, Pattern))
+				{
+					UE_LOG(LogTemp, Warning, TEXT("不明な入力パターンです:%s"), *Settings.Pattern);
+					return;
+				}
+				SubSystem->GetLoadGenerator()->Start(Settings);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("LoadGenStop"),
+		TEXT("LoadGenStop"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			if (USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem())
+			{
+				SubSystem->GetLoadGenerator()->Stop();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("LoadGenReport"),
+		TEXT("LoadGenReport"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			if (USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem())
+			{
+				SubSystem->GetLoadGenerator()->DumpReport();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SpatialHashQuery"),
+		TEXT("SpatialHashQuery [-radius Radius] [-k NumNearest]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-radius"), false, FArgParser::EType::Float);
+			ArgParser.AddArg(TEXT("-k"), false, FArgParser::EType::Integer);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SpatialHashQuery"), Args))
+			{
+				return;
+			}
+
+			float Radius = 2500.0f;
+			int32 K = 0;
+			if (ArgParser.IsExistValue(TEXT("-radius")))
+			{
+				ArgParser.GetValue(TEXT("-radius"), Radius);
+			}
+			if (ArgParser.IsExistValue(TEXT("-k")))
+			{
+				ArgParser.GetValue(TEXT("-k"), K);
+			}
+
+			// プレイヤーの位置を中心に検索する
+			FVector Center = FVector::ZeroVector;
+			const APlayerController* PlayerController = SubSystem->GetWorld()->GetFirstPlayerController();
+			if (PlayerController != nullptr && PlayerController->GetPawn() != nullptr)
+			{
+				Center = PlayerController->GetPawn()->GetActorLocation();
+			}
+			SubSystem->DumpCharactersAround(Center, Radius, K);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SpatialHashBenchmark"),
+		TEXT("SpatialHashBenchmark [-counts 1000,10000,50000] [-queries NumQueries] [-radius Radius] [-actors true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-counts"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-queries"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-radius"), false, FArgParser::EType::Float);
+			ArgParser.AddArg(TEXT("-actors"), false, FArgParser::EType::Bool);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SpatialHashBenchmark"), Args))
+			{
+				return;
+			}
+
+			FString Counts = TEXT("1000,10000,50000");
+			int32 NumQueries = 1000;
+			float Radius = 2000.0f;
+			bool bSpawnActors = true;
+			if (ArgParser.IsExistValue(TEXT("-counts")))
+			{
+				ArgParser.GetValue(TEXT("-counts"), Counts);
+			}
+			if (ArgParser.IsExistValue(TEXT("-queries")))
+			{
+				ArgParser.GetValue(TEXT("-queries"), NumQueries);
+			}
+			if (ArgParser.IsExistValue(TEXT("-radius")))
+			{
+				ArgParser.GetValue(TEXT("-radius"), Radius);
+			}
+			if (ArgParser.IsExistValue(TEXT("-actors")))
+			{
+				ArgParser.GetValue(TEXT("-actors"), bSpawnActors);
+			}
+			SubSystem->RunSpatialHashBenchmark(ConsoleCommandsInternal::ParseIntList(Counts), NumQueries, Radius, bSpawnActors);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SandBoxLogStats"),
+		TEXT("SandBoxLogStats"),
+		ESandBoxCommandAffinity::AnyThread,
+		[](const TArray<FString>&)
+		{
+			FSandBoxLog::Get().DumpStats();
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SandBoxLogDecode"),
+		TEXT("SandBoxLogDecode [-file Path] [-out Path]"),
+		ESandBoxCommandAffinity::SerialQueue,
+		TEXT("SandBoxLogFile"),
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-file"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-out"), false, FArgParser::EType::String);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SandBoxLogDecode"), Args))
+			{
+				return;
+			}
+
+			// 省略時は書き出し中のファイルを変換する。まだ回収されていないレコードは含まれない
+			FString InPath = FSandBoxLog::Get().GetFilePath();
+			if (ArgParser.IsExistValue(TEXT("-file")))
+			{
+				ArgParser.GetValue(TEXT("-file"), InPath);
+			}
+			FString OutPath = FPaths::ChangeExtension(InPath, TEXT("txt"));
+			if (ArgParser.IsExistValue(TEXT("-out")))
+			{
+				ArgParser.GetValue(TEXT("-out"), OutPath);
+			}
+			FSandBoxLog::Decode(InPath, OutPath);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SandBoxLogBenchmark"),
+		TEXT("SandBoxLogBenchmark [-calls NumCallsPerThread] [-threads NumThreads]"),
+		ESandBoxCommandAffinity::SerialQueue,
+		TEXT("Benchmark"),
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-calls"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-threads"), false, FArgParser::EType::Integer);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SandBoxLogBenchmark"), Args))
+			{
+				return;
+			}
+
+			int32 NumCalls = 10000;
+			int32 NumThreads = 1;
+			if (ArgParser.IsExistValue(TEXT("-calls")))
+			{
+				ArgParser.GetValue(TEXT("-calls"), NumCalls);
+			}
+			if (ArgParser.IsExistValue(TEXT("-threads")))
+			{
+				ArgParser.GetValue(TEXT("-threads"), NumThreads);
+			}
+			FSandBoxLog::RunBenchmark(NumCalls, NumThreads);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("CheckSchedulerBehaviour"),
+		TEXT("CheckSchedulerBehaviour"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			if (USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem())
+			{
+				SubSystem->CheckSchedulerBehaviour();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SchedulerLoad"),
+		TEXT("SchedulerLoad [-bulk NumBulkJobs] [-critical NumCriticalJobsPerFrame] [-deadline DeadlineMs] [-frames NumFrames]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-bulk"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-critical"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-deadline"), false, FArgParser::EType::Float);
+			ArgParser.AddArg(TEXT("-frames"), false, FArgParser::EType::Integer);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SchedulerLoad"), Args))
+			{
+				return;
+			}
+
+			int32 NumBulkJobs = 200;
+			int32 NumCriticalJobs = 8;
+			float DeadlineMs = 16.0f;
+			int32 NumFrames = 300;
+			if (ArgParser.IsExistValue(TEXT("-bulk")))
+			{
+				ArgParser.GetValue(TEXT("-bulk"), NumBulkJobs);
+			}
+			if (ArgParser.IsExistValue(TEXT("-critical")))
+			{
+				ArgParser.GetValue(TEXT("-critical"), NumCriticalJobs);
+			}
+			if (ArgParser.IsExistValue(TEXT("-deadline")))
+			{
+				ArgParser.GetValue(TEXT("-deadline"), DeadlineMs);
+			}
+			if (ArgParser.IsExistValue(TEXT("-frames")))
+			{
+				ArgParser.GetValue(TEXT("-frames"), NumFrames);
+			}
+			SubSystem->StartSchedulerLoad(NumBulkJobs, NumCriticalJobs, DeadlineMs, NumFrames);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SchedulerStats"),
+		TEXT("SchedulerStats [-reset true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-reset"), false, FArgParser::EType::Bool);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SchedulerStats"), Args))
+			{
+				return;
+			}
+
+			bool bReset = false;
+			if (ArgParser.IsExistValue(TEXT("-reset")))
+			{
+				ArgParser.GetValue(TEXT("-reset"), bReset);
+			}
+			SubSystem->GetJobScheduler()->DumpStats();
+			if (bReset)
+			{
+				SubSystem->GetJobScheduler()->ResetStats();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("CachedGeneration"),
+		TEXT("CachedGeneration [-requests NumRequests] [-seeds NumSeeds]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-requests"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-seeds"), false, FArgParser::EType::Integer);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("CachedGeneration"), Args))
+			{
+				return;
+			}
+
+			int32 NumRequests = 256;
+			int32 NumSeeds = 32;
+			if (ArgParser.IsExistValue(TEXT("-requests")))
+			{
+				ArgParser.GetValue(TEXT("-requests"), NumRequests);
+			}
+			if (ArgParser.IsExistValue(TEXT("-seeds")))
+			{
+				ArgParser.GetValue(TEXT("-seeds"), NumSeeds);
+			}
+			SubSystem->StartCachedGeneration(NumRequests, NumSeeds);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("ResultCacheStats"),
+		TEXT("ResultCacheStats"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			if (USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem())
+			{
+				SubSystem->DumpResultCache();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("ResultCacheInvalidate"),
+		TEXT("ResultCacheInvalidate [-seed Seed]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-seed"), false, FArgParser::EType::Integer);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("ResultCacheInvalidate"), Args))
+			{
+				return;
+			}
+
+			// 省略時は全て破棄する
+			TOptional<int32> Seed;
+			int32 SeedValue = 0;
+			if (ArgParser.IsExistValue(TEXT("-seed")) && ArgParser.GetValue(TEXT("-seed"), SeedValue))
+			{
+				Seed = SeedValue;
+			}
+			SubSystem->InvalidateResultCache(Seed);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("MemoryReport"),
+		TEXT("MemoryReport"),
+		ESandBoxCommandAffinity::AnyThread,
+		[](const TArray<FString>&)
+		{
+			FSandBoxMemoryTracker::DumpReport();
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("MemoryResetPeaks"),
+		TEXT("MemoryResetPeaks"),
+		ESandBoxCommandAffinity::AnyThread,
+		[](const TArray<FString>&)
+		{
+			FSandBoxMemoryTracker::ResetPeaks();
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("TelemetryStart"),
+		TEXT("TelemetryStart [-name Name] [-slots NumSlots]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-name"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-slots"), false, FArgParser::EType::Integer);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("TelemetryStart"), Args))
+			{
+				return;
+			}
+
+			FString Name;
+			if (ArgParser.IsExistValue(TEXT("-name")))
+			{
+				ArgParser.GetValue(TEXT("-name"), Name);
+			}
+			int32 NumSlots = 4096;
+			if (ArgParser.IsExistValue(TEXT("-slots")))
+			{
+				ArgParser.GetValue(TEXT("-slots"), NumSlots);
+			}
+			SubSystem->StartTelemetry(Name, NumSlots);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("TelemetryStop"),
+		TEXT("TelemetryStop"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			if (USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem())
+			{
+				SubSystem->StopTelemetry();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("TelemetryStats"),
+		TEXT("TelemetryStats"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
+			if (SubSystem != nullptr && SubSystem->GetTelemetry() != nullptr)
+			{
+				SubSystem->GetTelemetry()->DumpStats();
+			}
+			else
+			{
+				UE_LOG(LogTemp, Log, TEXT("SandBoxTelemetry is not running"));
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("TelemetryBenchmark"),
+		TEXT("TelemetryBenchmark [-count NumSamples]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USampleSubSystem* SubSystem = ConsoleCommandsInternal::GetSampleSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-count"), false, FArgParser::EType::Integer);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("TelemetryBenchmark"), Args))
+			{
+				return;
+			}
+
+			if (SubSystem->GetTelemetry() == nullptr)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("TelemetryStartで開始してから実行してください"));
+				return;
+			}
+
+			int32 NumSamples = 100000;
+			if (ArgParser.IsExistValue(TEXT("-count")))
+			{
+				ArgParser.GetValue(TEXT("-count"), NumSamples);
+			}
+			SubSystem->GetTelemetry()->RunBenchmark(NumSamples);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SnapshotSave"),
+		TEXT("SnapshotSave [-path Path] [-compress true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-path"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-compress"), false, FArgParser::EType::Bool);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SnapshotSave"), Args))
+			{
+				return;
+			}
+
+			FString Path;
+			bool bCompress = true;
+			if (ArgParser.IsExistValue(TEXT("-path")))
+			{
+				ArgParser.GetValue(TEXT("-path"), Path);
+			}
+			if (ArgParser.IsExistValue(TEXT("-compress")))
+			{
+				ArgParser.GetValue(TEXT("-compress"), bCompress);
+			}
+			SubSystem->SaveSnapshot(Path, bCompress);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SnapshotLoad"),
+		TEXT("SnapshotLoad [-path Path] [-batch CharactersPerFrame]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-path"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-batch"), false, FArgParser::EType::Integer);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SnapshotLoad"), Args))
+			{
+				return;
+			}
+
+			FString Path;
+			if (ArgParser.IsExistValue(TEXT("-path")))
+			{
+				ArgParser.GetValue(TEXT("-path"), Path);
+			}
+			if (ArgParser.IsExistValue(TEXT("-batch")))
+			{
+				ArgParser.GetValue(TEXT("-batch"), SubSystem->SnapshotRestoreBatchSize);
+			}
+			SubSystem->LoadSnapshot(Path);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SnapshotBenchmark"),
+		TEXT("SnapshotBenchmark [-num Count] [-compress true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-num"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-compress"), false, FArgParser::EType::Bool);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("SnapshotBenchmark"), Args))
+			{
+				return;
+			}
+
+			int32 Count = 10000;
+			bool bCompress = true;
+			if (ArgParser.IsExistValue(TEXT("-num")))
+			{
+				ArgParser.GetValue(TEXT("-num"), Count);
+			}
+			if (ArgParser.IsExistValue(TEXT("-compress")))
+			{
+				ArgParser.GetValue(TEXT("-compress"), bCompress);
+			}
+			SubSystem->StartSnapshotBenchmark(Count, bCompress);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("SnapshotStats"),
+		TEXT("SnapshotStats"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>&)
+		{
+			if (USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem())
+			{
+				SubSystem->DumpSnapshotStats();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("CommandBatch"),
+		TEXT("CommandBatch [-file Path] [-commands \"Command1 Args;Command2 Args\"] [-budgetMs GameThreadBudgetMs]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-file"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-commands"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-budgetMs"), false, FArgParser::EType::Float);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("CommandBatch"), Args))
+			{
+				return;
+			}
+
+			FSandBoxCommandRegistry& Registry = FSandBoxCommandRegistry::Get();
+			if (ArgParser.IsExistValue(TEXT("-budgetMs")))
+			{
+				ArgParser.GetValue(TEXT("-budgetMs"), Registry.GameThreadBudgetMs);
+			}
+
+			// ファイルは1行に1コマンド、-commandsは;区切り
+			TArray<FString> Lines;
+			if (ArgParser.IsExistValue(TEXT("-file")))
+			{
+				FString Path;
+				ArgParser.GetValue(TEXT("-file"), Path);
+				if (!FFileHelper::LoadFileToStringArray(Lines, *Path))
+				{
+					UE_LOG(LogTemp, Error, TEXT("ファイルを読み込めませんでした: %s"), *Path);
+					return;
+				}
+			}
+			if (ArgParser.IsExistValue(TEXT("-commands")))
+			{
+				FString Commands;
+				ArgParser.GetValue(TEXT("-commands"), Commands);
+				TArray<FString> CommandLines;
+				Commands.ParseIntoArray(CommandLines, TEXT(";"));
+				Lines.Append(CommandLines);
+			}
+			Registry.SubmitBatch(Lines);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("CommandQueueStats"),
+		TEXT("CommandQueueStats [-reset true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-reset"), false, FArgParser::EType::Bool);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("CommandQueueStats"), Args))
+			{
+				return;
+			}
+
+			bool bReset = false;
+			if (ArgParser.IsExistValue(TEXT("-reset")))
+			{
+				ArgParser.GetValue(TEXT("-reset"), bReset);
+			}
+			FSandBoxCommandRegistry::Get().DumpStats();
+			if (bReset)
+			{
+				FSandBoxCommandRegistry::Get().ResetStats();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("FrameAllocatorStats"),
+		TEXT("FrameAllocatorStats [-reset true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-reset"), false, FArgParser::EType::Bool);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("FrameAllocatorStats"), Args))
+			{
+				return;
+			}
+
+			bool bReset = false;
+			if (ArgParser.IsExistValue(TEXT("-reset")))
+			{
+				ArgParser.GetValue(TEXT("-reset"), bReset);
+			}
+			FSandBoxFrameAllocator::Get().DumpStats();
+			if (bReset)
+			{
+				FSandBoxFrameAllocator::Get().ResetStats();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("FrameAllocatorBenchmark"),
+		TEXT("FrameAllocatorBenchmark [-arrays NumArraysPerFrame] [-elements NumElements] [-frames NumFrames]"),
+		ESandBoxCommandAffinity::SerialQueue,
+		TEXT("Benchmark"),
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-arrays"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-elements"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-frames"), false, FArgParser::EType::Integer);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("FrameAllocatorBenchmark"), Args))
+			{
+				return;
+			}
+
+			int32 NumArrays = 1000;
+			int32 NumElements = 64;
+			int32 NumFrames = 100;
+			if (ArgParser.IsExistValue(TEXT("-arrays")))
+			{
+				ArgParser.GetValue(TEXT("-arrays"), NumArrays);
+			}
+			if (ArgParser.IsExistValue(TEXT("-elements")))
+			{
+				ArgParser.GetValue(TEXT("-elements"), NumElements);
+			}
+			if (ArgParser.IsExistValue(TEXT("-frames")))
+			{
+				ArgParser.GetValue(TEXT("-frames"), NumFrames);
+			}
+			FSandBoxFrameAllocator::RunBenchmark(NumArrays, NumElements, NumFrames);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("ScopedTimerReport"),
+		TEXT("ScopedTimerReport [-reset true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-reset"), false, FArgParser::EType::Bool);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("ScopedTimerReport"), Args))
+			{
+				return;
+			}
+
+			bool bReset = false;
+			if (ArgParser.IsExistValue(TEXT("-reset")))
+			{
+				ArgParser.GetValue(TEXT("-reset"), bReset);
+			}
+			FSandBoxScopedTimers::Get().DumpReport();
+			if (bReset)
+			{
+				FSandBoxScopedTimers::Get().ResetStats();
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("ScopedTimerEnable"),
+		TEXT("ScopedTimerEnable -category Character/CharacterInput/GameMode/All [-enable true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-category"), true, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-enable"), false, FArgParser::EType::Bool);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("ScopedTimerEnable"), Args))
+			{
+				return;
+			}
+
+			FString CategoryName;
+			ArgParser.GetValue(TEXT("-category"), CategoryName);
+			bool bEnable = true;
+			if (ArgParser.IsExistValue(TEXT("-enable")))
+			{
+				ArgParser.GetValue(TEXT("-enable"), bEnable);
+			}
+
+			if (CategoryName.Equals(TEXT("All"), ESearchCase::IgnoreCase))
+			{
+				for (int32 Index = 0; Index < static_cast<int32>(ESandBoxTimerCategory::Num); ++Index)
+				{
+					FSandBoxScopedTimers::SetCategoryEnabled(static_cast<ESandBoxTimerCategory>(Index), bEnable);
+				}
+			}
+			else
+			{
+				ESandBoxTimerCategory Category;
+				if (!FSandBoxScopedTimers::FindCategory(CategoryName, Category))
+				{
+					UE_LOG(LogTemp, Error, TEXT("カテゴリが不正です: %s"), *CategoryName);
+					return;
+				}
+				FSandBoxScopedTimers::SetCategoryEnabled(Category, bEnable);
+			}
+			UE_LOG(LogTemp, Log, TEXT("ScopedTimerEnable Category:%s Enable:%d Compiled:%d"), *CategoryName, bEnable, SANDBOX_ENABLE_SCOPED_TIMERS);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("ScopedTimerBenchmark"),
+		TEXT("ScopedTimerBenchmark [-iterations NumIterations]"),
+		ESandBoxCommandAffinity::SerialQueue,
+		TEXT("Benchmark"),
+		[](const TArray<FString>& Args)
+		{
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-iterations"), false, FArgParser::EType::Integer);
+			if (!ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("ScopedTimerBenchmark"), Args))
+			{
+				return;
+			}
+
+			int32 NumIterations = 1000000;
+			if (ArgParser.IsExistValue(TEXT("-iterations")))
+			{
+				ArgParser.GetValue(TEXT("-iterations"), NumIterations);
+			}
+			FSandBoxScopedTimers::RunBenchmark(NumIterations);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("FixedStep"),
+		TEXT("FixedStep -enable true/false [-hz StepHz] [-maxSubSteps MaxSubSteps] [-batchSize BatchSize]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-enable"), true, FArgParser::EType::Bool);
+			ArgParser.AddArg(TEXT("-hz"), false, FArgParser::EType::Float);
+			ArgParser.AddArg(TEXT("-maxSubSteps"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-batchSize"), false, FArgParser::EType::Integer);
+
+			bool bEnable = false;
+			if (SubSystem != nullptr && ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("FixedStep"), Args) && ArgParser.GetValue(TEXT("-enable"), bEnable))
+			{
+				float StepHz = 30.0f;
+				int32 MaxSubSteps = 4;
+				int32 BatchSize = 32;
+				if (ArgParser.IsExistValue(TEXT("-hz")))
+				{
+					ArgParser.GetValue(TEXT("-hz"), StepHz);
+				}
+				if (ArgParser.IsExistValue(TEXT("-maxSubSteps")))
+				{
+					ArgParser.GetValue(TEXT("-maxSubSteps"), MaxSubSteps);
+				}
+				if (ArgParser.IsExistValue(TEXT("-batchSize")))
+				{
+					ArgParser.GetValue(TEXT("-batchSize"), BatchSize);
+				}
+				SubSystem->SetFixedStepEnabled(bEnable, StepHz, MaxSubSteps, BatchSize);
+			}
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("FixedStepStats"),
+		TEXT("FixedStepStats [-reset true/false]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-reset"), false, FArgParser::EType::Bool);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("FixedStepStats"), Args))
+			{
+				return;
+			}
+
+			bool bReset = false;
+			if (ArgParser.IsExistValue(TEXT("-reset")))
+			{
+				ArgParser.GetValue(TEXT("-reset"), bReset);
+			}
+			SubSystem->DumpFixedStep(bReset);
+		}
+	);
+
+	FSandBoxCommandRegistry::Get().Register(
+		TEXT("FixedStepBenchmark"),
+		TEXT("FixedStepBenchmark [-count NumCharacters] [-threads 1,2,4,8] [-steps NumSteps]"),
+		ESandBoxCommandAffinity::GameThread,
+		[](const TArray<FString>& Args)
+		{
+			USandBoxWorldSubSystem* SubSystem = ConsoleCommandsInternal::GetSandBoxWorldSubSystem();
+			FArgParser ArgParser;
+			ArgParser.AddArg(TEXT("-count"), false, FArgParser::EType::Integer);
+			ArgParser.AddArg(TEXT("-threads"), false, FArgParser::EType::String);
+			ArgParser.AddArg(TEXT("-steps"), false, FArgParser::EType::Integer);
+			if (SubSystem == nullptr || !ConsoleCommandsInternal::ParseArgs(ArgParser, TEXT("FixedStepBenchmark"), Args))
+			{
+				return;
+			}
+
+			int32 Count = 1000;
+			FString ThreadCounts;
+			int32 NumSteps = 60;
+			if (ArgParser.IsExistValue(TEXT("-count")))
+			{
+				ArgParser.GetValue(TEXT("-count"), Count);
+			}
+			if (ArgParser.IsExistValue(TEXT("-threads")))
+			{
+				ArgParser.GetValue(TEXT("-threads"), ThreadCounts);
+			}
+			if (ArgParser.IsExistValue(TEXT("-steps")))
+			{
+				ArgParser.GetValue(TEXT("-steps"), NumSteps);
+			}
+			SubSystem->RunFixedStepBenchmark(Count, ThreadCounts.IsEmpty() ? TArray<int32>() : ConsoleCommandsInternal::ParseIntList(ThreadCounts), NumSteps);
+		}
 	);
 }
@@ -0,0 +1,278 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "CrowdSimulation.h"
+#include "Async/ParallelFor.h"
+#include "Components/CapsuleComponent.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "PhysicsEngine/PhysicsSettings.h"
+
+/*static*/
+FCrowdSimulation::FParams FCrowdSimulation::MakeParamsFromCharacter(const ACharacter& Character)
+{
+	FParams Result;
+
+	if (const UCharacterMovementComponent* Movement = Character.GetCharacterMovement())
+	{
+		Result.MaxWalkSpeed = Movement->MaxWalkSpeed;
+		Result.MaxAcceleration = Movement->MaxAcceleration;
+		Result.RotationRateYaw = Movement->RotationRate.Yaw;
+		Result.JumpZVelocity = Movement->JumpZVelocity;
+		Result.AirControl = Movement->AirControl;
+		// CDOはワールドを持たないためGetGravityZではなくプロジェクト設定の重力を使う
+		Result.GravityZ = UPhysicsSettings::Get()->DefaultGravityZ * Movement->GravityScale;
+	}
+
+	if (const UCapsuleComponent* Capsule = Character.GetCapsuleComponent())
+	{
+		Result.CapsuleRadius = Capsule->GetUnscaledCapsuleRadius();
+		Result.CapsuleHalfHeight = Capsule->GetUnscaledCapsuleHalfHeight();
+	}
+
+	return Result;
+}
+
+FCrowdSimulation::FCrowdSimulation(const FParams& InParams)
+	: Params(InParams)
+{
+}
+
+void FCrowdSimulation::AddAgents(int32 Count, const FVector& Center, float Radius, int32 Seed)
+{
+	const int32 NewNum = Num() + Count;
+	Positions.Reserve(NewNum);
+	Velocities.Reserve(NewNum);
+	Yaws.Reserve(NewNum);
+	Goals.Reserve(NewNum);
+	WanderCenters.Reserve(NewNum);
+	WanderRadii.Reserve(NewNum);
+	RandomStreams.Reserve(NewNum);
+	Flags.Reserve(NewNum);
+
+	// カプセルの中心を地面からHalfHeight分持ち上げた位置に置く
+	const FVector GroundCenter(Center.X, Center.Y, Center.Z + Params.CapsuleHalfHeight);
+
+	FRandomStream SpawnStream(Seed);
+	for (int32 i = 0; i < Count; ++i)
+	{
+		const FVector2D Offset = FVector2D(SpawnStream.VRand()).GetSafeNormal() * Radius * FMath::Sqrt(SpawnStream.FRand());
+		const int32 Index = Positions.Add(GroundCenter + FVector(Offset, 0.0f));
+		Velocities.Add(FVector::ZeroVector);
+		Yaws.Add(SpawnStream.FRandRange(-180.0f, 180.0f));
+		WanderCenters.Add(GroundCenter);
+		WanderRadii.Add(Radius);
+		RandomStreams.Add(FRandomStream(Seed + Index + 1));
+		Flags.Add(0);
+		Goals.Add(FVector::ZeroVector);
+		Goals[Index] = PickGoal(Index);
+	}
+}
+
+void FCrowdSimulation::Reset()
+{
+	Positions.Reset();
+	Velocities.Reset();
+	Yaws.Reset();
+	Goals.Reset();
+	WanderCenters.Reset();
+	WanderRadii.Reset();
+	RandomStreams.Reset();
+	Flags.Reset();
+	NumPromoted = 0;
+}
+
+void FCrowdSimulation::Serialize(FArchive& Ar)
+{
+	// SoAの配列ごとにまとめて読み書きする
+	Positions.BulkSerialize(Ar);
+	Velocities.BulkSerialize(Ar);
+	Yaws.BulkSerialize(Ar);
+	Goals.BulkSerialize(Ar);
+	WanderCenters.BulkSerialize(Ar);
+	WanderRadii.BulkSerialize(Ar);
+	Flags.BulkSerialize(Ar);
+
+	// 乱数は現在のシードから続ける
+	TArray<int32> Seeds;
+	if (Ar.IsSaving())
+	{
+		Seeds.SetNumUninitialized(RandomStreams.Num());
+		for (int32 Index = 0; Index < RandomStreams.Num(); ++Index)
+		{
+			Seeds[Index] = RandomStreams[Index].GetCurrentSeed();
+		}
+	}
+	Seeds.BulkSerialize(Ar);
+
+	if (Ar.IsLoading())
+	{
+		RandomStreams.Reset(Seeds.Num());
+		for (const int32 Seed : Seeds)
+		{
+			RandomStreams.Add(FRandomStream(Seed));
+		}
+
+		for (uint8& AgentFlags : Flags)
+		{
+			AgentFlags &= ~EAgentFlag::Promoted;
+		}
+		NumPromoted = 0;
+
+		if (!ensureAlwaysMsgf(Velocities.Num() == Positions.Num() && Yaws.Num() == Positions.Num() && Goals.Num() == Positions.Num() && WanderCenters.Num() == Positions.Num()
+			&& WanderRadii.Num() == Positions.Num() && Flags.Num() == Positions.Num() && RandomStreams.Num() == Positions.Num(), TEXT("エージェントの配列の長さが一致しません")))
+		{
+			Reset();
+		}
+	}
+}
+
+void FCrowdSimulation::Update(float DeltaTime, const TArray<FVector>& ViewerLocations, float PromoteDistance)
+{
+	const float PromoteDistanceSq = PromoteDistance > 0.0f ? FMath::Square(PromoteDistance) : -1.0f;
+	const int32 NumBatches = FMath::DivideAndRoundUp(Num(), BatchSize);
+
+	// バッチ間で書き込む要素は重ならないためロック不要
+	ParallelFor(NumBatches, [this, DeltaTime, &ViewerLocations, PromoteDistanceSq](int32 BatchIndex)
+	{
+		const int32 Begin = BatchIndex * BatchSize;
+		const int32 End = FMath::Min(Begin + BatchSize, Num());
+		UpdateRange(Begin, End, DeltaTime, ViewerLocations, PromoteDistanceSq);
+	});
+}
+
+void FCrowdSimulation::UpdateRange(int32 Begin, int32 End, float DeltaTime, const TArray<FVector>& ViewerLocations, float PromoteDistanceSq)
+{
+	const float MaxSpeedSq = FMath::Square(Params.MaxWalkSpeed);
+
+	for (int32 Index = Begin; Index < End; ++Index)
+	{
+		uint8& AgentFlags = Flags[Index];
+		if (AgentFlags & EAgentFlag::Promoted)
+		{
+			continue;
+		}
+
+		FVector& Position = Positions[Index];
+		FVector& Velocity = Velocities[Index];
+		const bool bInAir = (AgentFlags & EAgentFlag::InAir) != 0;
+
+		// 目的地に向かって加速する。空中ではAirControlの割合しか制御できない
+		FVector ToGoal = Goals[Index] - Position;
+		ToGoal.Z = 0.0f;
+		if (ToGoal.SizeSquared() < FMath::Square(Params.AcceptanceRadius))
+		{
+			Goals[Index] = PickGoal(Index);
+			ToGoal = Goals[Index] - Position;
+			ToGoal.Z = 0.0f;
+		}
+
+		const float Control = bInAir ? Params.AirControl : 1.0f;
+		const FVector Acceleration = ToGoal.GetSafeNormal2D() * Params.MaxAcceleration * Control;
+		Velocity.X += Acceleration.X * DeltaTime;
+		Velocity.Y += Acceleration.Y * DeltaTime;
+
+		const float SpeedSq2D = Velocity.SizeSquared2D();
+		if (SpeedSq2D > MaxSpeedSq)
+		{
+			const float Scale = Params.MaxWalkSpeed * FMath::InvSqrt(SpeedSq2D);
+			Velocity.X *= Scale;
+			Velocity.Y *= Scale;
+		}
+
+		// bOrientRotationToMovementと同じく移動方向へRotationRateで向く
+		if (SpeedSq2D > KINDA_SMALL_NUMBER)
+		{
+			const float DesiredYaw = FMath::RadiansToDegrees(FMath::Atan2(Velocity.Y, Velocity.X));
+			Yaws[Index] = FMath::FixedTurn(Yaws[Index], DesiredYaw, Params.RotationRateYaw * DeltaTime);
+		}
+
+		// ジャンプと着地
+		const float GroundZ = WanderCenters[Index].Z;
+		if (bInAir)
+		{
+			Velocity.Z += Params.GravityZ * DeltaTime;
+			if (Position.Z + Velocity.Z * DeltaTime <= GroundZ)
+			{
+				Position.Z = GroundZ;
+				Velocity.Z = 0.0f;
+				AgentFlags &= ~EAgentFlag::InAir;
+			}
+		}
+		else if (RandomStreams[Index].FRand() < Params.JumpChancePerSec * DeltaTime)
+		{
+			Velocity.Z = Params.JumpZVelocity;
+			AgentFlags |= EAgentFlag::InAir;
+		}
+
+		Position += Velocity * DeltaTime;
+
+		// 昇格判定
+		AgentFlags &= ~EAgentFlag::NearViewer;
+		if (PromoteDistanceSq < 0.0f)
+		{
+			continue;
+		}
+		for (const FVector& ViewerLocation : ViewerLocations)
+		{
+			if (FVector::DistSquared(ViewerLocation, Position) < PromoteDistanceSq)
+			{
+				AgentFlags |= EAgentFlag::NearViewer;
+				break;
+			}
+		}
+	}
+}
+
+void FCrowdSimulation::GetPromotionCandidates(TArray<int32>& OutIndices) const
+{
+	OutIndices.Reset();
+	for (int32 Index = 0; Index < Num(); ++Index)
+	{
+		if ((Flags[Index] & (EAgentFlag::NearViewer | EAgentFlag::Promoted)) == EAgentFlag::NearViewer)
+		{
+			OutIndices.Add(Index);
+		}
+	}
+}
+
+void FCrowdSimulation::MarkPromoted(int32 Index)
+{
+	if (ensureAlways(!IsPromoted(Index)))
+	{
+		Flags[Index] = EAgentFlag::Promoted;
+		++NumPromoted;
+	}
+}
+
+void FCrowdSimulation::Demote(int32 Index, const FVector& Position, const FVector& Velocity, float Yaw)
+{
+	if (ensureAlways(IsPromoted(Index)))
+	{
+		Positions[Index] = Position;
+		Velocities[Index] = Velocity;
+		Yaws[Index] = Yaw;
+		Flags[Index] = Position.Z > WanderCenters[Index].Z + KINDA_SMALL_NUMBER ? uint8(EAgentFlag::InAir) : uint8(0);
+		--NumPromoted;
+	}
+}
+
+FVector FCrowdSimulation::GetDesiredDirection(int32 Index, const FVector& CurrentPosition)
+{
+	FVector ToGoal = Goals[Index] - CurrentPosition;
+	ToGoal.Z = 0.0f;
+	if (ToGoal.SizeSquared() < FMath::Square(Params.AcceptanceRadius))
+	{
+		Goals[Index] = PickGoal(Index);
+		ToGoal = Goals[Index] - CurrentPosition;
+		ToGoal.Z = 0.0f;
+	}
+	return ToGoal.GetSafeNormal2D();
+}
+
+FVector FCrowdSimulation::PickGoal(int32 Index)
+{
+	FRandomStream& Stream = RandomStreams[Index];
+	const FVector2D Offset = FVector2D(Stream.VRand()).GetSafeNormal() * WanderRadii[Index] * FMath::Sqrt(Stream.FRand());
+	return WanderCenters[Index] + FVector(Offset, 0.0f);
+}
@@ -0,0 +1,145 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class ACharacter;
+
+/**
+ * @brief アクターを持たない軽量な群衆シミュレーション
+ *		　位置・速度・向き(Yaw)をSoA(Structure of Arrays)で保持し、ParallelForでバッチ単位に並列更新します。
+ *		　遠くのエージェントはここで動かし、プレイヤーの近くに来たエージェントのみアクターへ昇格させる想定です。
+ *
+ * 使用例
+
+FCrowdSimulation Crowd(FCrowdSimulation::MakeParamsFromCharacter(*GetDefault<AUnrealSandBoxCharacter>()));
+Crowd.AddAgents(10000, FVector::ZeroVector, 5000.0f);
+
+// 毎フレーム
+Crowd.Update(DeltaTime, ViewerLocations);
+
+ */
+class FCrowdSimulation final
+{
+public:
+
+	/**
+	 * @brief 移動パラメータ
+	 *		　キャラクターのコンストラクタで設定している値をMakeParamsFromCharacterで取り込みます
+	 */
+	struct FParams
+	{
+		float MaxWalkSpeed = 600.0f;
+		float MaxAcceleration = 2048.0f;
+		float RotationRateYaw = 540.0f;
+		float JumpZVelocity = 600.0f;
+		float AirControl = 0.2f;
+		float GravityZ = -980.0f;
+		float CapsuleRadius = 42.0f;
+		float CapsuleHalfHeight = 96.0f;
+
+		// 目的地到達とみなす距離
+		float AcceptanceRadius = 100.0f;
+
+		// 1秒あたりにジャンプする確率
+		float JumpChancePerSec = 0.05f;
+	};
+
+	/**
+	 * @brief キャラクター(CDO可)に設定されている移動パラメータとカプセルサイズから群衆用のパラメータを作成します
+	 * @param Character パラメータ取得元のキャラクター
+	 */
+	static FParams MakeParamsFromCharacter(const ACharacter& Character);
+
+	explicit FCrowdSimulation(const FParams& InParams);
+
+	/**
+	 * @brief エージェントを追加します
+	 *		　Centerを中心とした半径Radiusの円内にランダムに配置し、同じ円内を歩き回ります。
+	 * @param Count 追加数
+	 * @param Center 配置の中心。Zは地面の高さとして扱います
+	 * @param Radius 配置と徘徊の半径
+	 * @param Seed 乱数シード
+	 */
+	void AddAgents(int32 Count, const FVector& Center, float Radius, int32 Seed = 0);
+
+	/**
+	 * @brief 全エージェントを削除します
+	 */
+	void Reset();
+
+	/**
+	 * @brief 全エージェントの状態を保存・復元します
+	 *		　復元したエージェントは昇格していない状態になります。昇格中のアクターは呼び出し側で先に戻してください。
+	 */
+	void Serialize(FArchive& Ar);
+
+	/**
+	 * @brief 昇格していない全エージェントを並列に更新します
+	 * @param DeltaTime 経過時間
+	 * @param ViewerLocations 昇格判定に使う視点位置
+	 * @param PromoteDistance この距離以内に入ったエージェントを昇格候補とします。0以下で判定しません
+	 */
+	void Update(float DeltaTime, const TArray<FVector>& ViewerLocations = TArray<FVector>(), float PromoteDistance = 0.0f);
+
+	/**
+	 * @brief 直近のUpdateで昇格候補になったエージェントのインデックスを取得します
+	 */
+	void GetPromotionCandidates(TArray<int32>& OutIndices) const;
+
+	/**
+	 * @brief エージェントをアクターへ昇格させたことを記録します。昇格中はシミュレーション対象外になります。
+	 */
+	void MarkPromoted(int32 Index);
+
+	/**
+	 * @brief アクターから状態を書き戻してシミュレーションへ戻します
+	 */
+	void Demote(int32 Index, const FVector& Position, const FVector& Velocity, float Yaw);
+
+	/**
+	 * @brief 昇格中のアクターを目的地へ向かわせるための移動方向を取得します。目的地に到達していれば次の目的地を選びます。
+	 */
+	FVector GetDesiredDirection(int32 Index, const FVector& CurrentPosition);
+
+	int32 Num() const { return Positions.Num(); }
+	int32 GetNumPromoted() const { return NumPromoted; }
+	const FParams& GetParams() const { return Params; }
+
+	const FVector& GetPosition(int32 Index) const { return Positions[Index]; }
+	const FVector& GetVelocity(int32 Index) const { return Velocities[Index]; }
+	float GetYaw(int32 Index) const { return Yaws[Index]; }
+	bool IsPromoted(int32 Index) const { return (Flags[Index] & EAgentFlag::Promoted) != 0; }
+
+	/**
+	 * @brief 1バッチで更新するエージェント数
+	 */
+	static constexpr int32 BatchSize = 1024;
+
+private:
+	// エージェントの状態フラグ
+	enum EAgentFlag : uint8
+	{
+		InAir = 1 << 0,
+		Promoted = 1 << 1,
+		NearViewer = 1 << 2,
+	};
+
+	void UpdateRange(int32 Begin, int32 End, float DeltaTime, const TArray<FVector>& ViewerLocations, float PromoteDistanceSq);
+	FVector PickGoal(int32 Index);
+
+	FParams Params;
+
+	// SoA。同じインデックスが同じエージェントを表す
+	TArray<FVector> Positions;
+	TArray<FVector> Velocities;
+	TArray<float> Yaws;
+	TArray<FVector> Goals;
+	TArray<FVector> WanderCenters;
+	TArray<float> WanderRadii;
+	TArray<FRandomStream> RandomStreams;
+	TArray<uint8> Flags;
+
+	int32 NumPromoted = 0;
+};
@@ -0,0 +1,560 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FixedStepSimulation.h"
+#include "Async/ParallelFor.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "Components/CapsuleComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/WorldSettings.h"
+#include "UnrealSandBox/UnrealSandBoxCharacter.h"
+
+namespace FixedStepSimulationInternal
+{
+	// UCharacterMovementComponentと同じく床から少し浮かせておき、水平のスイープが床に当たらないようにする
+	constexpr float FloorOffset = 2.15f;
+
+	// 壁に当たったときに離しておく距離
+	constexpr float PullBackDistance = 0.1f;
+
+	FCollisionObjectQueryParams MakeObjectQueryParams()
+	{
+		// 他のキャラクター(Pawn)とはぶつけない。並列に動かすキャラクター同士が互いの位置に依存しないようにする
+		FCollisionObjectQueryParams ObjectQueryParams;
+		ObjectQueryParams.AddObjectTypesToQuery(ECC_WorldStatic);
+		ObjectQueryParams.AddObjectTypesToQuery(ECC_WorldDynamic);
+		return ObjectQueryParams;
+	}
+
+	/**
+	 * @brief 水平方向にスイープします
+	 * @return 移動を妨げるものに当たったか。最初からめり込んでいる場合もtrueを返す
+	 */
+	bool SweepHorizontal(const UWorld& World, const FVector& Start, const FVector& Delta, const FCollisionShape& Shape, const FCollisionQueryParams& QueryParams, FHitResult& OutHit)
+	{
+		static const FCollisionObjectQueryParams ObjectQueryParams = MakeObjectQueryParams();
+		return World.SweepSingleByObjectType(OutHit, Start, Start + Delta, FQuat::Identity, ObjectQueryParams, Shape, QueryParams);
+	}
+
+	/**
+	 * @brief 真下へ線で床を調べます
+	 * @return 歩ける床が見つかったか
+	 */
+	bool TraceFloor(const UWorld& World, const FVector& Start, float Distance, float WalkableFloorZ, const FCollisionQueryParams& QueryParams, FHitResult& OutHit)
+	{
+		static const FCollisionObjectQueryParams ObjectQueryParams = MakeObjectQueryParams();
+		return World.LineTraceSingleByObjectType(OutHit, Start, Start - FVector(0.0f, 0.0f, Distance), ObjectQueryParams, QueryParams)
+			&& !OutHit.bStartPenetrating && OutHit.ImpactNormal.Z >= WalkableFloorZ;
+	}
+}
+
+/*static*/
+TSharedRef<FFixedStepSimulation> FFixedStepSimulation::CreateFromCommandLine()
+{
+	TSharedRef<FFixedStepSimulation> Simulation = MakeShareable(new FFixedStepSimulation());
+
+	FSettings CommandLineSettings;
+	if (FParse::Value(FCommandLine::Get(), TEXT("SandBoxFixedStepHz="), CommandLineSettings.StepHz))
+	{
+		FParse::Value(FCommandLine::Get(), TEXT("SandBoxFixedStepMaxSubSteps="), CommandLineSettings.MaxSubSteps);
+		FParse::Value(FCommandLine::Get(), TEXT("SandBoxFixedStepBatchSize="), CommandLineSettings.BatchSize);
+		Simulation->SetEnabled(true, CommandLineSettings);
+	}
+	return Simulation;
+}
+
+FFixedStepSimulation::~FFixedStepSimulation()
+{
+	for (FEntry& Entry : Entries)
+	{
+		ReleaseCharacter(Entry);
+	}
+}
+
+void FFixedStepSimulation::SetEnabled(bool bInEnabled, const FSettings& InSettings)
+{
+	Settings = InSettings;
+	Settings.StepHz = FMath::Max(Settings.StepHz, 1.0f);
+	Settings.MaxSubSteps = FMath::Max(Settings.MaxSubSteps, 1);
+	Settings.BatchSize = FMath::Max(Settings.BatchSize, 1);
+
+	if (bEnabled && !bInEnabled)
+	{
+		for (FEntry& Entry : Entries)
+		{
+			ReleaseCharacter(Entry);
+		}
+	}
+	if (bEnabled != bInEnabled)
+	{
+		AccumulatedSec = 0.0;
+	}
+	bEnabled = bInEnabled;
+
+	UE_LOG(LogTemp, Log, TEXT("FixedStepSimulation Enabled:%d StepHz:%.1f MaxSubSteps:%d BatchSize:%d"), bEnabled, Settings.StepHz, Settings.MaxSubSteps, Settings.BatchSize);
+}
+
+void FFixedStepSimulation::AddCharacter(AUnrealSandBoxCharacter* Character)
+{
+	const bool bExists = Entries.ContainsByPredicate([Character](const FEntry& Entry)
+	{
+		return Entry.Character == Character;
+	});
+	if (!bExists)
+	{
+		Entries.Add(FEntry{Character});
+	}
+}
+
+void FFixedStepSimulation::RemoveCharacter(AUnrealSandBoxCharacter* Character)
+{
+	// 登録順を保つため詰めて削除する
+	const int32 Index = Entries.IndexOfByPredicate([Character](const FEntry& Entry)
+	{
+		return Entry.Character == Character;
+	});
+	if (Index != INDEX_NONE)
+	{
+		ReleaseCharacter(Entries[Index]);
+		Entries.RemoveAt(Index);
+	}
+}
+
+void FFixedStepSimulation::Tick(UWorld& World, float DeltaTime)
+{
+	if (!bEnabled || World.GetNetMode() == NM_Client)
+	{
+		return;
+	}
+
+	// 遅れている分は複数ステップ進めて追いつく。追いつけないほど遅れた分は捨てて、ステップが増え続けないようにする
+	const double StepSec = 1.0 / Settings.StepHz;
+	AccumulatedSec += DeltaTime;
+	int32 NumSteps = FMath::FloorToInt(AccumulatedSec / StepSec);
+	if (NumSteps > Settings.MaxSubSteps)
+	{
+		const double DroppedSec = (NumSteps - Settings.MaxSubSteps) * StepSec;
+		AccumulatedSec -= DroppedSec;
+		Stats.DroppedSec += DroppedSec;
+		++Stats.NumClampedFrames;
+		NumSteps = Settings.MaxSubSteps;
+	}
+	AccumulatedSec -= NumSteps * StepSec;
+	++Stats.NumFrames;
+
+	// ステップを進めないフレームの移動入力は貯めたままにして次のステップで使う
+	if (NumSteps == 0)
+	{
+		return;
+	}
+
+	const double StartSec = FPlatformTime::Seconds();
+	Gather();
+	const double GatherEndSec = FPlatformTime::Seconds();
+	StepBodies(World, Bodies, FMath::DivideAndRoundUp(Bodies.Num(), Settings.BatchSize), NumSteps, static_cast<float>(StepSec));
+	const double StepEndSec = FPlatformTime::Seconds();
+	Apply(World);
+	const double EndSec = FPlatformTime::Seconds();
+
+	++Stats.NumSteppedFrames;
+	Stats.NumSteps += NumSteps;
+	Stats.NumCharacterSteps += static_cast<uint64>(NumSteps) * Bodies.Num();
+	Stats.NumCatchUpFrames += NumSteps > 1 ? 1 : 0;
+	Stats.MaxStepsPerFrame = FMath::Max(Stats.MaxStepsPerFrame, NumSteps);
+	Stats.GatherSec += GatherEndSec - StartSec;
+	Stats.StepSec += StepEndSec - GatherEndSec;
+	Stats.ApplySec += EndSec - StepEndSec;
+	Stats.MaxFrameSec = FMath::Max(Stats.MaxFrameSec, EndSec - StartSec);
+}
+
+void FFixedStepSimulation::DumpStats() const
+{
+	int32 NumDriven = 0;
+	for (const FEntry& Entry : Entries)
+	{
+		NumDriven += Entry.bDriven ? 1 : 0;
+	}
+
+	const int32 NumCores = FPlatformMisc::NumberOfCores();
+	const uint64 NumFrames = FMath::Max<uint64>(Stats.NumFrames, 1);
+	const uint64 NumSteppedFrames = FMath::Max<uint64>(Stats.NumSteppedFrames, 1);
+	const uint64 NumSteps = FMath::Max<uint64>(Stats.NumSteps, 1);
+	const double SimSec = FMath::Max(Stats.GatherSec + Stats.StepSec + Stats.ApplySec, 0.000001);
+	const double StepSec = FMath::Max(Stats.StepSec, 0.000001);
+
+	UE_LOG(LogTemp, Log, TEXT("FixedStepSimulation Enabled:%d StepHz:%.1f MaxSubSteps:%d BatchSize:%d Characters:%d Driven:%d Cores:%d LogicalCores:%d ParallelThreads:%d"),
+		bEnabled, Settings.StepHz, Settings.MaxSubSteps, Settings.BatchSize, Entries.Num(), NumDriven,
+		NumCores, FPlatformMisc::NumberOfCoresIncludingHyperthreads(), GetNumParallelThreads());
+	UE_LOG(LogTemp, Log, TEXT("  Frames:%llu Steps:%llu StepsPerFrame:%.2f MaxStepsPerFrame:%d CatchUpFrames:%llu ClampedFrames:%llu DroppedSec:%.3f"),
+		Stats.NumFrames, Stats.NumSteps, static_cast<double>(Stats.NumSteps) / NumFrames, Stats.MaxStepsPerFrame, Stats.NumCatchUpFrames, Stats.NumClampedFrames, Stats.DroppedSec);
+	// 集めて書き戻すのはステップ数によらずフレームに1回
+	UE_LOG(LogTemp, Log, TEXT("  GatherMsPerFrame:%.3f ApplyMsPerFrame:%.3f StepMsPerStep:%.3f MaxFrameMs:%.3f"),
+		Stats.GatherSec * 1000.0 / NumSteppedFrames, Stats.ApplySec * 1000.0 / NumSteppedFrames, Stats.StepSec * 1000.0 / NumSteps, Stats.MaxFrameSec * 1000.0);
+
+	// 集めて書き戻す時間を含めて、シミュレーションだけを続けた場合に1秒あたりに進められるステップ数
+	UE_LOG(LogTemp, Log, TEXT("  SimStepsPerSec:%.1f CharacterStepsPerSec:%.0f CharacterStepsPerSecPerCore:%.0f"),
+		Stats.NumSteps / SimSec, Stats.NumCharacterSteps / StepSec, Stats.NumCharacterSteps / StepSec / FMath::Max(NumCores, 1));
+}
+
+void FFixedStepSimulation::ResetStats()
+{
+	Stats = FStats();
+}
+
+void FFixedStepSimulation::RunScalingBenchmark(UWorld& World, const TArray<int32>& ThreadCounts, int32 NumSteps)
+{
+	if (World.GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("FixedStepBenchmarkはサーバーでのみ実行できます"));
+		return;
+	}
+
+	// 移動を引き継いでいるかに関わらず、引き継げるキャラクターの状態を複製する
+	// 入力はキャラクターごとに異なる方向へ歩かせる
+	TArray<FBody> SourceBodies;
+	for (const FEntry& Entry : Entries)
+	{
+		const AUnrealSandBoxCharacter* Character = Entry.Character.Get();
+		if (Character != nullptr && CanDrive(*Character))
+		{
+			FBody& Body = SourceBodies.AddDefaulted_GetRef();
+			InitBody(*Character, Body);
+			const float Angle = SourceBodies.Num() * 2.39996f;
+			Body.Input = FVector2D(FMath::Cos(Angle), FMath::Sin(Angle));
+		}
+	}
+
+	NumSteps = FMath::Max(NumSteps, 1);
+	const float StepSec = 1.0f / Settings.StepHz;
+	const int32 NumCores = FPlatformMisc::NumberOfCores();
+	UE_LOG(LogTemp, Log, TEXT("FixedStepBenchmark Characters:%d Steps:%d StepHz:%.1f Cores:%d LogicalCores:%d ParallelThreads:%d"),
+		SourceBodies.Num(), NumSteps, Settings.StepHz, NumCores, FPlatformMisc::NumberOfCoresIncludingHyperthreads(), GetNumParallelThreads());
+	if (SourceBodies.Num() == 0)
+	{
+		return;
+	}
+
+	double BaseStepsPerSec = 0.0;
+	int32 BaseNumBatches = 1;
+	for (const int32 ThreadCount : ThreadCounts)
+	{
+		const int32 NumBatches = FMath::Clamp(ThreadCount, 1, SourceBodies.Num());
+
+		// 初回のクエリのキャッシュなどの影響を除くため1ステップ進めてから計測する
+		TArray<FBody> WorkBodies = SourceBodies;
+		StepBodies(World, WorkBodies, NumBatches, 1, StepSec);
+
+		const double StartSec = FPlatformTime::Seconds();
+		StepBodies(World, WorkBodies, NumBatches, NumSteps, StepSec);
+		const double ElapsedSec = FMath::Max(FPlatformTime::Seconds() - StartSec, 0.000001);
+
+		// 最初のスレッド数を基準に何倍になったかを出す
+		const double StepsPerSec = NumSteps / ElapsedSec;
+		if (BaseStepsPerSec <= 0.0)
+		{
+			BaseStepsPerSec = StepsPerSec;
+			BaseNumBatches = NumBatches;
+		}
+		const double Speedup = StepsPerSec / BaseStepsPerSec;
+		UE_LOG(LogTemp, Log, TEXT("  Threads:%d Ms:%.2f StepsPerSec:%.1f CharacterStepsPerSec:%.0f Speedup:%.2f Efficiency:%.2f"),
+			NumBatches, ElapsedSec * 1000.0, StepsPerSec, StepsPerSec * SourceBodies.Num(), Speedup, Speedup * BaseNumBatches / NumBatches);
+	}
+}
+
+/*static*/
+int32 FFixedStepSimulation::GetNumParallelThreads()
+{
+	// ParallelForはゲームスレッドも処理に加わる
+	return FTaskGraphInterface::Get().GetNumWorkerThreads() + 1;
+}
+
+/*static*/
+bool FFixedStepSimulation::CanDrive(const AUnrealSandBoxCharacter& Character)
+{
+	const UCharacterMovementComponent* Movement = Character.GetCharacterMovement();
+	if (Movement == nullptr || !Character.HasAuthority() || Character.IsPlayerControlled() || Character.IsInPawnPool())
+	{
+		return false;
+	}
+
+	// 泳ぎや飛行、移動を止めている状態は移動コンポーネントに任せる
+	return Movement->MovementMode == MOVE_Walking || Movement->MovementMode == MOVE_NavWalking || Movement->MovementMode == MOVE_Falling;
+}
+
+/*static*/
+void FFixedStepSimulation::AcquireCharacter(FEntry& Entry)
+{
+	Entry.Character->GetCharacterMovement()->SetComponentTickEnabled(false);
+	Entry.bDriven = true;
+}
+
+/*static*/
+void FFixedStepSimulation::ReleaseCharacter(FEntry& Entry)
+{
+	if (!Entry.bDriven)
+	{
+		return;
+	}
+	Entry.bDriven = false;
+
+	// プールに戻ったキャラクターはプール側でTickを止めている
+	AUnrealSandBoxCharacter* Character = Entry.Character.Get();
+	if (Character != nullptr && !Character->IsInPawnPool())
+	{
+		Character->GetCharacterMovement()->SetComponentTickEnabled(true);
+	}
+}
+
+/*static*/
+void FFixedStepSimulation::InitBody(const AUnrealSandBoxCharacter& Character, FBody& OutBody)
+{
+	const UCharacterMovementComponent* Movement = Character.GetCharacterMovement();
+	const UCapsuleComponent* Capsule = Character.GetCapsuleComponent();
+
+	OutBody.Position = Character.GetActorLocation();
+	OutBody.Velocity = Movement->Velocity;
+	OutBody.Yaw = Character.GetActorRotation().Yaw;
+	OutBody.bInAir = Movement->IsFalling();
+	OutBody.GroundMode = Movement->GetGroundMovementMode();
+	OutBody.Input = FVector2D::ZeroVector;
+
+	OutBody.MaxWalkSpeed = Movement->MaxWalkSpeed;
+	OutBody.MaxAcceleration = Movement->GetMaxAcceleration();
+	OutBody.BrakingDeceleration = Movement->BrakingDecelerationWalking;
+	OutBody.GroundFriction = Movement->GroundFriction;
+	OutBody.AirControl = Movement->AirControl;
+	OutBody.GravityZ = Movement->GetGravityZ();
+	OutBody.RotationRateYaw = Movement->RotationRate.Yaw;
+	OutBody.bOrientRotationToMovement = Movement->bOrientRotationToMovement;
+	OutBody.WalkableFloorZ = Movement->GetWalkableFloorZ();
+	OutBody.MaxStepHeight = Movement->MaxStepHeight;
+	OutBody.CapsuleRadius = Capsule->GetScaledCapsuleRadius();
+	OutBody.CapsuleHalfHeight = Capsule->GetScaledCapsuleHalfHeight();
+
+	static const FName TraceTag(TEXT("FixedStepSimulation"));
+	OutBody.QueryParams = FCollisionQueryParams(TraceTag, false, &Character);
+}
+
+void FFixedStepSimulation::Gather()
+{
+	Bodies.Reset();
+	BodyEntryIndices.Reset();
+
+	for (int32 EntryIndex = 0; EntryIndex < Entries.Num(); ++EntryIndex)
+	{
+		FEntry& Entry = Entries[EntryIndex];
+		AUnrealSandBoxCharacter* Character = Entry.Character.Get();
+		if (Character == nullptr)
+		{
+			continue;
+		}
+
+		// 所持するコントローラーや移動モードが変わったキャラクターを引き継ぐ・戻す
+		const bool bCanDrive = CanDrive(*Character);
+		if (bCanDrive && !Entry.bDriven)
+		{
+			AcquireCharacter(Entry);
+		}
+		else if (!bCanDrive && Entry.bDriven)
+		{
+			ReleaseCharacter(Entry);
+		}
+		if (!Entry.bDriven)
+		{
+			continue;
+		}
+
+		FBody& Body = Bodies.AddDefaulted_GetRef();
+		InitBody(*Character, Body);
+		BodyEntryIndices.Add(EntryIndex);
+
+		// 移動コンポーネントのTickの代わりにAddMovementInputで貯まった入力を取り出す
+		UCharacterMovementComponent* Movement = Character->GetCharacterMovement();
+		const FVector Input = Movement->ConsumeInputVector().GetClampedToMaxSize2D(1.0f);
+		Body.Input = FVector2D(Input.X, Input.Y);
+
+		// ジャンプは押されたときに1回だけ行う
+		if (Character->bPressedJump)
+		{
+			if (!Body.bInAir)
+			{
+				Body.Velocity.Z = Movement->JumpZVelocity;
+				Body.bInAir = true;
+			}
+			Character->bPressedJump = false;
+		}
+	}
+}
+
+/*static*/
+void FFixedStepSimulation::StepBodies(const UWorld& World, TArray<FBody>& InOutBodies, int32 NumBatches, int32 NumSteps, float StepSec)
+{
+	// キャラクター同士は独立しているため、バッチごとに全ステップをまとめて進める。バッチ間で書き込む要素は重ならないためロック不要
+	const int32 NumBodies = InOutBodies.Num();
+	const int32 BatchSize = FMath::DivideAndRoundUp(NumBodies, FMath::Max(NumBatches, 1));
+	ParallelFor(FMath::DivideAndRoundUp(NumBodies, FMath::Max(BatchSize, 1)), [&World, &InOutBodies, NumBodies, BatchSize, NumSteps, StepSec](int32 BatchIndex)
+	{
+		const int32 Begin = BatchIndex * BatchSize;
+		const int32 End = FMath::Min(Begin + BatchSize, NumBodies);
+		for (int32 Index = Begin; Index < End; ++Index)
+		{
+			for (int32 Step = 0; Step < NumSteps; ++Step)
+			{
+				StepBody(World, InOutBodies[Index], StepSec);
+			}
+		}
+	}, NumBatches <= 1);
+}
+
+/*static*/
+void FFixedStepSimulation::StepBody(const UWorld& World, FBody& Body, float StepSec)
+{
+	using namespace FixedStepSimulationInternal;
+
+	// UCharacterMovementComponent::CalcVelocityを簡略化した速度の更新
+	FVector Velocity2D(Body.Velocity.X, Body.Velocity.Y, 0.0f);
+	const float InputSize = FMath::Min(Body.Input.Size(), 1.0f);
+	const FVector InputDirection = InputSize > KINDA_SMALL_NUMBER ? FVector(Body.Input / InputSize, 0.0f) : FVector::ZeroVector;
+	if (Body.bInAir)
+	{
+		// 空中ではAirControlの割合しか制御できない
+		Velocity2D += InputDirection * (Body.MaxAcceleration * Body.AirControl * InputSize * StepSec);
+		Velocity2D = Velocity2D.GetClampedToMaxSize(Body.MaxWalkSpeed);
+		Body.Velocity.Z += Body.GravityZ * StepSec;
+	}
+	else if (InputSize > KINDA_SMALL_NUMBER)
+	{
+		// 摩擦の分だけ速度の向きを入力の方向へ寄せてから加速する
+		const float Speed = Velocity2D.Size();
+		Velocity2D -= (Velocity2D - InputDirection * Speed) * FMath::Min(StepSec * Body.GroundFriction, 1.0f);
+		Velocity2D += InputDirection * (Body.MaxAcceleration * InputSize * StepSec);
+		Velocity2D = Velocity2D.GetClampedToMaxSize(Body.MaxWalkSpeed * InputSize);
+		Body.Velocity.Z = 0.0f;
+	}
+	else
+	{
+		// 入力がなければ摩擦と制動で止める。向きが反転したら止まったとみなす
+		const FVector OldVelocity2D = Velocity2D;
+		Velocity2D -= (Velocity2D * Body.GroundFriction + Velocity2D.GetSafeNormal() * Body.BrakingDeceleration) * StepSec;
+		if ((Velocity2D | OldVelocity2D) <= 0.0f)
+		{
+			Velocity2D = FVector::ZeroVector;
+		}
+		Body.Velocity.Z = 0.0f;
+	}
+	Body.Velocity.X = Velocity2D.X;
+	Body.Velocity.Y = Velocity2D.Y;
+
+	// 水平移動。段差の高さより上の部分だけでスイープし、低い段差は床判定で乗り越える
+	const FVector Delta = Velocity2D * StepSec;
+	if (!Delta.IsNearlyZero())
+	{
+		const float SweepHalfHeight = FMath::Max(Body.CapsuleHalfHeight - Body.MaxStepHeight * 0.5f, Body.CapsuleRadius);
+		const FVector SweepOffset(0.0f, 0.0f, Body.CapsuleHalfHeight - SweepHalfHeight);
+		const FCollisionShape Shape = FCollisionShape::MakeCapsule(Body.CapsuleRadius, SweepHalfHeight);
+
+		FHitResult Hit;
+		if (!SweepHorizontal(World, Body.Position + SweepOffset, Delta, Shape, Body.QueryParams, Hit))
+		{
+			Body.Position += Delta;
+		}
+		else if (Hit.bStartPenetrating)
+		{
+			// めり込んでいるときはこのステップでは動かず、押し出すだけにする
+			Body.Position += Hit.Normal.GetSafeNormal2D() * (Hit.PenetrationDepth + PullBackDistance);
+		}
+		else
+		{
+			// 当たった面の手前で止め、残りを面に沿って1回だけ滑らせる
+			const FVector Normal2D = Hit.Normal.GetSafeNormal2D();
+			Body.Position += Delta * Hit.Time - Delta.GetSafeNormal() * PullBackDistance;
+			Body.Velocity = FVector::VectorPlaneProject(Body.Velocity, Normal2D);
+
+			const FVector Slide = FVector::VectorPlaneProject(Delta * (1.0f - Hit.Time), Normal2D);
+			if (!Slide.IsNearlyZero())
+			{
+				if (!SweepHorizontal(World, Body.Position + SweepOffset, Slide, Shape, Body.QueryParams, Hit))
+				{
+					Body.Position += Slide;
+				}
+				else if (!Hit.bStartPenetrating)
+				{
+					Body.Position += Slide * Hit.Time - Slide.GetSafeNormal() * PullBackDistance;
+				}
+			}
+		}
+	}
+
+	// 床判定
+	FHitResult FloorHit;
+	if (!Body.bInAir)
+	{
+		// 段差の高さまで下を調べ、床がなければ落下を始める
+		if (TraceFloor(World, Body.Position, Body.CapsuleHalfHeight + Body.MaxStepHeight + FloorOffset, Body.WalkableFloorZ, Body.QueryParams, FloorHit))
+		{
+			Body.Position.Z = FloorHit.ImpactPoint.Z + Body.CapsuleHalfHeight + FloorOffset;
+		}
+		else
+		{
+			Body.bInAir = true;
+		}
+	}
+	else
+	{
+		// 下降中のみ着地を調べる。上昇中は天井とぶつけない
+		const float DeltaZ = Body.Velocity.Z * StepSec;
+		if (DeltaZ <= 0.0f && TraceFloor(World, Body.Position, Body.CapsuleHalfHeight + FloorOffset - DeltaZ, Body.WalkableFloorZ, Body.QueryParams, FloorHit))
+		{
+			Body.Position.Z = FloorHit.ImpactPoint.Z + Body.CapsuleHalfHeight + FloorOffset;
+			Body.Velocity.Z = 0.0f;
+			Body.bInAir = false;
+		}
+		else
+		{
+			Body.Position.Z += DeltaZ;
+		}
+	}
+
+	// bOrientRotationToMovementと同じく移動方向へRotationRateで向く
+	if (Body.bOrientRotationToMovement && Body.Velocity.SizeSquared2D() > KINDA_SMALL_NUMBER)
+	{
+		const float DesiredYaw = FMath::RadiansToDegrees(FMath::Atan2(Body.Velocity.Y, Body.Velocity.X));
+		Body.Yaw = FMath::FixedTurn(Body.Yaw, DesiredYaw, Body.RotationRateYaw * StepSec);
+	}
+}
+
+void FFixedStepSimulation::Apply(UWorld& World)
+{
+	const AWorldSettings* WorldSettings = World.GetWorldSettings();
+	const bool bCheckKillZ = WorldSettings != nullptr && WorldSettings->bEnableWorldBoundsChecks;
+
+	// 書き戻しはどのバッチが先に終わったかによらず登録順に行う
+	TArray<AUnrealSandBoxCharacter*, TInlineAllocator<16>> FellOutCharacters;
+	for (int32 BodyIndex = 0; BodyIndex < Bodies.Num(); ++BodyIndex)
+	{
+		AUnrealSandBoxCharacter* Character = Entries[BodyEntryIndices[BodyIndex]].Character.Get();
+		const FBody& Body = Bodies[BodyIndex];
+		UCharacterMovementComponent* Movement = Character->GetCharacterMovement();
+
+		Character->SetActorLocationAndRotation(Body.Position, FRotator(0.0f, Body.Yaw, 0.0f));
+		Movement->Velocity = Body.Velocity;
+		const EMovementMode MovementMode = Body.bInAir ? MOVE_Falling : Body.GroundMode.GetValue();
+		if (Movement->MovementMode != MovementMode)
+		{
+			Movement->SetMovementMode(MovementMode);
+		}
+		Movement->UpdateComponentVelocity();
+
+		if (bCheckKillZ && Body.Position.Z < WorldSettings->KillZ)
+		{
+			FellOutCharacters.Add(Character);
+		}
+	}
+
+	// 落下したキャラクターはプールに戻されて登録が解除されるため、書き戻しが終わってから通知する
+	for (AUnrealSandBoxCharacter* Character : FellOutCharacters)
+	{
+		Character->CheckStillInWorld();
+	}
+}
@@ -0,0 +1,203 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CollisionQueryParams.h"
+#include "Engine/EngineTypes.h"
+
+class AUnrealSandBoxCharacter;
+
+/**
+ * @brief ヘッドレスサーバー向けに、プレイヤーが操作していないキャラクターの移動を固定タイムステップで並列に進めるクラス
+ *		　通常は各キャラクターの移動コンポーネントが自分のTickで可変のDeltaTimeを使って順に移動するため、
+ *		　フレームレートによって結果が変わり、キャラクター数に比例してゲームスレッドの時間が伸びます。
+ *		　有効にすると対象のキャラクターの移動コンポーネントのTickを止め、毎フレーム
+ *		　・経過時間を貯めてStepSecごとに1ステップ進める。遅れているときは1フレームで複数ステップ進めて追いつき、MaxSubStepsを超えた分は捨てる
+ *		　・ゲームスレッドで位置・速度・移動入力を集め、キャラクターをBatchSizeずつのバッチに分けてParallelForで全ステップ分を進める
+ *		　・結果はバッチの完了順ではなく登録順にゲームスレッドでアクターへ書き戻す
+ *		　を行います。キャラクター同士は互いを参照せず(Pawnとはぶつからない)、ワールドの静的・動的なジオメトリとのみ衝突します。
+ *		　プレイヤーが操作するキャラクターはクライアントの移動と一致させる必要があるため対象にしません。
+ *		　サーバー(スタンドアロン含む)でのみ動作します。
+ */
+class FFixedStepSimulation final
+{
+public:
+	struct FSettings
+	{
+		// 1秒あたりのステップ数
+		float StepHz = 30.0f;
+		// 1フレームに進める最大ステップ数。超えた分の経過時間は捨てる
+		int32 MaxSubSteps = 4;
+		// 1バッチで進めるキャラクター数
+		int32 BatchSize = 32;
+	};
+
+	/**
+	 * @brief -SandBoxFixedStepHz=で起動したときにその設定で有効にしたものを作成します。指定がなければ無効のものを作成します
+	 *		　-SandBoxFixedStepMaxSubSteps=、-SandBoxFixedStepBatchSize=も指定できます。
+	 */
+	static TSharedRef<FFixedStepSimulation> CreateFromCommandLine();
+
+	FFixedStepSimulation() = default;
+
+	/**
+	 * @brief 移動を引き継いでいるキャラクターを全て戻します
+	 */
+	~FFixedStepSimulation();
+
+	/**
+	 * @brief 有効/無効を切り替えます。無効にすると移動を引き継いでいるキャラクターの移動コンポーネントのTickを戻します
+	 */
+	void SetEnabled(bool bInEnabled, const FSettings& InSettings);
+
+	bool IsEnabled() const { return bEnabled; }
+	const FSettings& GetSettings() const { return Settings; }
+
+	/**
+	 * @brief キャラクターを登録します。登録順に書き戻すため、同じ順で生成すれば結果の適用順も同じになります
+	 */
+	void AddCharacter(AUnrealSandBoxCharacter* Character);
+
+	/**
+	 * @brief キャラクターの登録を解除し、移動を引き継いでいれば移動コンポーネントのTickを戻します
+	 */
+	void RemoveCharacter(AUnrealSandBoxCharacter* Character);
+
+	/**
+	 * @brief 経過時間に応じたステップ数だけ移動を進めます。USandBoxWorldSubSystemのTickで呼び出します
+	 */
+	void Tick(UWorld& World, float DeltaTime);
+
+	/**
+	 * @brief ステップ数・追いつきの回数・捨てた時間と、CPUのコア数に対する1秒あたりのステップ数をログに出力します
+	 */
+	void DumpStats() const;
+
+	void ResetStats();
+
+	/**
+	 * @brief 並列に進めるスレッド数ごとに、1秒あたりに進められるステップ数を計測してログに出力します
+	 *		　登録済みのキャラクターの現在の状態を複製して進めるため、アクターは動きません。
+	 * @param ThreadCounts 計測するスレッド数。キャラクターをこの数のバッチに分けて進める
+	 * @param NumSteps スレッド数ごとに進めるステップ数
+	 */
+	void RunScalingBenchmark(UWorld& World, const TArray<int32>& ThreadCounts, int32 NumSteps);
+
+	/**
+	 * @brief ParallelForで使えるスレッド数。タスクグラフのワーカーとゲームスレッド
+	 */
+	static int32 GetNumParallelThreads();
+
+private:
+	/**
+	 * @brief 1キャラクターの移動の状態と、移動コンポーネントから取得したパラメータ
+	 */
+	struct FBody
+	{
+		FVector Position;
+		FVector Velocity;
+		float Yaw;
+		bool bInAir;
+		// 着地したときに戻す移動モード。MOVE_WalkingかMOVE_NavWalking
+		TEnumAsByte<EMovementMode> GroundMode;
+
+		// 水平方向の入力。大きさは1以下。フレーム内の全ステップで同じ値を使う
+		FVector2D Input;
+
+		float MaxWalkSpeed;
+		float MaxAcceleration;
+		float BrakingDeceleration;
+		float GroundFriction;
+		float AirControl;
+		float GravityZ;
+		float RotationRateYaw;
+		bool bOrientRotationToMovement;
+		float WalkableFloorZ;
+		float MaxStepHeight;
+		float CapsuleRadius;
+		float CapsuleHalfHeight;
+
+		// 自分自身を除くクエリのパラメータ。アクターのコンポーネントを辿るためゲームスレッドで作る
+		FCollisionQueryParams QueryParams;
+	};
+
+	struct FEntry
+	{
+		TWeakObjectPtr<AUnrealSandBoxCharacter> Character;
+		// 移動コンポーネントのTickを止めてこのクラスで動かしているか
+		bool bDriven = false;
+	};
+
+	struct FStats
+	{
+		uint64 NumFrames = 0;
+		// 1ステップ以上進めたフレーム数
+		uint64 NumSteppedFrames = 0;
+		uint64 NumSteps = 0;
+		uint64 NumCharacterSteps = 0;
+		// 1フレームで2ステップ以上進めたフレーム数
+		uint64 NumCatchUpFrames = 0;
+		// MaxSubStepsを超えて経過時間を捨てたフレーム数
+		uint64 NumClampedFrames = 0;
+		int32 MaxStepsPerFrame = 0;
+		double DroppedSec = 0.0;
+		double GatherSec = 0.0;
+		double StepSec = 0.0;
+		double ApplySec = 0.0;
+		double MaxFrameSec = 0.0;
+	};
+
+	/**
+	 * @brief 移動を引き継ぐ対象か
+	 */
+	static bool CanDrive(const AUnrealSandBoxCharacter& Character);
+
+	/**
+	 * @brief 移動コンポーネントのTickを止めて移動を引き継ぎます
+	 */
+	static void AcquireCharacter(FEntry& Entry);
+
+	/**
+	 * @brief 移動コンポーネントのTickを戻します
+	 */
+	static void ReleaseCharacter(FEntry& Entry);
+
+	/**
+	 * @brief キャラクターの状態と移動コンポーネントのパラメータを取得します。移動入力は取得しません
+	 */
+	static void InitBody(const AUnrealSandBoxCharacter& Character, FBody& OutBody);
+
+	/**
+	 * @brief 移動を引き継いでいるキャラクターの状態と移動入力をBodiesに集めます
+	 */
+	void Gather();
+
+	/**
+	 * @brief Bodiesをバッチに分けて並列にステップを進めます
+	 * @param NumBatches バッチ数。1であれば呼び出したスレッドで進める
+	 */
+	static void StepBodies(const UWorld& World, TArray<FBody>& InOutBodies, int32 NumBatches, int32 NumSteps, float StepSec);
+
+	/**
+	 * @brief 1キャラクターを1ステップ進めます。ワーカースレッドから呼び出されます
+	 */
+	static void StepBody(const UWorld& World, FBody& Body, float StepSec);
+
+	/**
+	 * @brief Bodiesを登録順にアクターへ書き戻します
+	 */
+	void Apply(UWorld& World);
+
+	bool bEnabled = false;
+	FSettings Settings;
+
+	TArray<FEntry> Entries;
+	double AccumulatedSec = 0.0;
+
+	// 毎フレーム使い回す作業領域。同じインデックスが同じ要素を表す
+	TArray<FBody> Bodies;
+	TArray<int32> BodyEntryIndices;
+
+	FStats Stats;
+};
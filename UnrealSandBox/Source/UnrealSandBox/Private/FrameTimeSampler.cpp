@@ -0,0 +1,86 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "FrameTimeSampler.h"
+#include "CoreGlobals.h"
+
+void FFrameTimeSampler::Start(const FString& InLabel, int32 InNumFrames, int32 InNumWarmupFrames, TFunction<void()> InOnFinished)
+{
+	Label = InLabel;
+	NumFrames = FMath::Max(InNumFrames, 1);
+	NumWarmupFrames = FMath::Max(InNumWarmupFrames, 0);
+	LastFrameSec = 0.0;
+	FrameTimesMs.Reset(NumFrames);
+	GameThreadTimesMs.Reset(NumFrames);
+	OnFinished = MoveTemp(InOnFinished);
+	bRunning = true;
+}
+
+void FFrameTimeSampler::Tick()
+{
+	if (!bRunning)
+	{
+		return;
+	}
+
+	const double NowSec = FPlatformTime::Seconds();
+	const double FrameTimeMs = (NowSec - LastFrameSec) * 1000.0;
+	const bool bHasPreviousFrame = LastFrameSec > 0.0;
+	LastFrameSec = NowSec;
+
+	if (!bHasPreviousFrame)
+	{
+		return;
+	}
+
+	if (NumWarmupFrames > 0)
+	{
+		--NumWarmupFrames;
+		return;
+	}
+
+	FrameTimesMs.Add(FrameTimeMs);
+	// GGameThreadTimeは前のフレームでゲームスレッドが処理していた時間。レンダリングスレッドやGPUの待ちを含まない
+	GameThreadTimesMs.Add(FPlatformTime::ToMilliseconds(GGameThreadTime));
+	if (FrameTimesMs.Num() >= NumFrames)
+	{
+		Finish();
+	}
+}
+
+void FFrameTimeSampler::Finish()
+{
+	bRunning = false;
+
+	TArray<double> Sorted = FrameTimesMs;
+	Sorted.Sort();
+	TArray<double> SortedGameThread = GameThreadTimesMs;
+	SortedGameThread.Sort();
+
+	double TotalMs = 0.0;
+	for (const double FrameTimeMs : Sorted)
+	{
+		TotalMs += FrameTimeMs;
+	}
+	double TotalGameThreadMs = 0.0;
+	for (const double GameThreadTimeMs : SortedGameThread)
+	{
+		TotalGameThreadMs += GameThreadTimeMs;
+	}
+
+	const int32 Num = Sorted.Num();
+	const int32 P95Index = FMath::Min(Num * 95 / 100, Num - 1);
+	UE_LOG(LogTemp, Log, TEXT("%s Frames:%d AvgMs:%.3f P50Ms:%.3f P95Ms:%.3f MaxMs:%.3f CPU:%.1f%%"),
+		*Label, Num, TotalMs / Num, Sorted[Num / 2], Sorted[P95Index], Sorted.Last(),
+		FPlatformTime::GetCPUTime().CPUTimePct);
+	UE_LOG(LogTemp, Log, TEXT("%s GameThread AvgMs:%.3f P50Ms:%.3f P95Ms:%.3f MaxMs:%.3f"),
+		*Label, TotalGameThreadMs / Num, SortedGameThread[Num / 2], SortedGameThread[P95Index], SortedGameThread.Last());
+
+	// コールバック内で再度Startされてもよいように退避してから呼び出す
+	TFunction<void()> Callback = MoveTemp(OnFinished);
+	OnFinished = nullptr;
+	if (Callback)
+	{
+		Callback();
+	}
+}
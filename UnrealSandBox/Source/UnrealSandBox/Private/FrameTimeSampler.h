@@ -0,0 +1,44 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * @brief 指定フレーム数のフレーム時間を計測してログに出力するクラス
+ *		　毎フレームTickを呼び出すと、前回のTickからの経過時間をフレーム時間として記録します。
+ *		　-nullrhiのヘッドレス実行ではGPU待ちがないため、フレーム時間がほぼゲームスレッドの時間になります。
+ *		　描画ありの実行でも比較できるよう、エンジンが計測したゲームスレッドの時間も合わせて記録します。
+ */
+class FFrameTimeSampler final
+{
+public:
+
+	/**
+	 * @brief 計測を開始します。計測中であれば前回の計測は破棄されます
+	 * @param InLabel ログに出力するラベル
+	 * @param InNumFrames 計測フレーム数
+	 * @param InNumWarmupFrames 計測前に読み捨てるフレーム数
+	 * @param InOnFinished 計測完了時に呼び出す処理
+	 */
+	void Start(const FString& InLabel, int32 InNumFrames, int32 InNumWarmupFrames = 10, TFunction<void()> InOnFinished = nullptr);
+
+	/**
+	 * @brief 毎フレーム呼び出します
+	 */
+	void Tick();
+
+	bool IsRunning() const { return bRunning; }
+
+private:
+	void Finish();
+
+	FString Label;
+	int32 NumFrames = 0;
+	int32 NumWarmupFrames = 0;
+	double LastFrameSec = 0.0;
+	TArray<double> FrameTimesMs;
+	TArray<double> GameThreadTimesMs;
+	TFunction<void()> OnFinished;
+	bool bRunning = false;
+};
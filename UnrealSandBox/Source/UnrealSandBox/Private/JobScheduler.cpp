@@ -0,0 +1,334 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "JobScheduler.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "SandBoxLog.h"
+
+namespace JobSchedulerInternal
+{
+	const TCHAR* GetPriorityName(EJobPriority Priority)
+	{
+		switch (Priority)
+		{
+		case EJobPriority::Critical:
+			return TEXT("Critical");
+		case EJobPriority::High:
+			return TEXT("High");
+		case EJobPriority::Normal:
+			return TEXT("Normal");
+		case EJobPriority::Low:
+			return TEXT("Low");
+		default:
+			return TEXT("Invalid");
+		}
+	}
+}
+
+/**
+ * @brief ワーカースレッド
+ */
+class FJobScheduler::FWorker final : public FRunnable
+{
+public:
+	FWorker(FJobScheduler& InScheduler, int32 Index, bool bInReserved)
+		: Scheduler(InScheduler)
+		, bReserved(bInReserved)
+		, WakeEvent(FPlatformProcess::GetSynchEventFromPool())
+	{
+		Thread.Reset(FRunnableThread::Create(this, *FString::Printf(TEXT("SandBoxJobWorker%d"), Index), 0, TPri_Normal));
+	}
+
+	virtual ~FWorker() override
+	{
+		Thread->WaitForCompletion();
+		Thread.Reset();
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	}
+
+	virtual uint32 Run() override
+	{
+		Scheduler.WorkerLoop(*this);
+		return 0;
+	}
+
+	FJobScheduler& Scheduler;
+	const bool bReserved;
+	FEvent* WakeEvent;
+	TUniquePtr<FRunnableThread> Thread;
+};
+
+//---------------------------------------------------------------------------------
+// FJobScheduler
+//---------------------------------------------------------------------------------
+/*static*/
+FJobScheduler::FSettings FJobScheduler::MakeDefaultSettings()
+{
+	// ゲームスレッド・描画スレッドとGThreadPoolの分を残す
+	FSettings DefaultSettings;
+	DefaultSettings.NumWorkers = FMath::Clamp(FPlatformMisc::NumberOfCoresIncludingHyperthreads() / 2, 2, 8);
+	return DefaultSettings;
+}
+
+FJobScheduler::FJobScheduler(const FSettings& InSettings)
+	: Settings(InSettings)
+{
+	ensureAlwaysMsgf(Settings.NumWorkers > Settings.NumReservedWorkers, TEXT("優先度を問わないワーカーが1つ以上必要です"));
+	Settings.NumWorkers = FMath::Max(Settings.NumWorkers, 1);
+	Settings.NumReservedWorkers = FMath::Clamp(Settings.NumReservedWorkers, 0, Settings.NumWorkers - 1);
+
+	for (int32 Index = 0; Index < Settings.NumWorkers; ++Index)
+	{
+		Workers.Add(MakeUnique<FWorker>(*this, Index, Index < Settings.NumReservedWorkers));
+	}
+
+	FScopeLock ScopeLock(&Lock);
+	UpdateAllocatedSize();
+}
+
+FJobScheduler::~FJobScheduler()
+{
+	{
+		FScopeLock ScopeLock(&Lock);
+		bStopping = true;
+	}
+	for (const TUniquePtr<FWorker>& Worker : Workers)
+	{
+		Worker->WakeEvent->Trigger();
+	}
+	Workers.Reset();
+
+	// Waitで待っているスレッドがあれば完了させる
+	while (PendingJobs.Num() > 0)
+	{
+		TUniquePtr<FJob> Job = PopJob(false, FPlatformTime::Seconds());
+		RunJob(*Job, FPlatformTime::Seconds(), true);
+	}
+}
+
+FJobScheduler::FJobHandle FJobScheduler::Submit(EJobPriority Priority, float DeadlineSec, TUniqueFunction<void()> Work)
+{
+	TSharedRef<FJobState, ESPMode::ThreadSafe> State = MakeShared<FJobState, ESPMode::ThreadSafe>();
+
+	TUniquePtr<FJob> Job = MakeUnique<FJob>();
+	Job->Priority = Priority;
+	Job->SubmitSec = FPlatformTime::Seconds();
+	Job->DeadlineSec = DeadlineSec > 0.0f ? Job->SubmitSec + DeadlineSec : 0.0;
+	Job->Work = MoveTemp(Work);
+	Job->State = State;
+
+	FScopeLock ScopeLock(&Lock);
+	Job->Id = NextJobId++;
+	State->Id = Job->Id;
+
+	FStats& PriorityStats = Stats[static_cast<int32>(Priority)];
+	++PriorityStats.NumSubmitted;
+	PriorityStats.NumWithDeadline += Job->DeadlineSec > 0.0 ? 1 : 0;
+
+	PendingJobs.Add(MoveTemp(Job));
+	NumOutstandingJobs.fetch_add(1, std::memory_order_relaxed);
+	UpdateAllocatedSize();
+	WakeWorker(Priority <= EJobPriority::High);
+	return State;
+}
+
+void FJobScheduler::Wait(const FJobHandle& Handle)
+{
+	if (Handle->IsDone())
+	{
+		return;
+	}
+
+	// 開始前であれば横取りしてこのスレッドで実行する
+	TUniquePtr<FJob> Job;
+	{
+		FScopeLock ScopeLock(&Lock);
+		const int32 Index = PendingJobs.IndexOfByPredicate([&Handle](const TUniquePtr<FJob>& Pending) { return Pending->Id == Handle->Id; });
+		if (Index != INDEX_NONE)
+		{
+			Job = MoveTemp(PendingJobs[Index]);
+			PendingJobs.RemoveAtSwap(Index, 1, false);
+			++NumRunningJobs;
+			UpdateAllocatedSize();
+		}
+	}
+	if (Job.IsValid())
+	{
+		RunJob(*Job, FPlatformTime::Seconds(), true);
+		return;
+	}
+
+	// 実行中なので完了を待つ
+	while (!Handle->IsDone())
+	{
+		FPlatformProcess::YieldThread();
+	}
+}
+
+void FJobScheduler::DumpStats() const
+{
+	FScopeLock ScopeLock(&Lock);
+	UE_LOG(LogTemp, Log, TEXT("JobScheduler Workers:%d Reserved:%d AgingIntervalSec:%.3f Pending:%d Running:%d"),
+		Settings.NumWorkers, Settings.NumReservedWorkers, Settings.AgingIntervalSec, PendingJobs.Num(), NumRunningJobs);
+	for (int32 Index = 0; Index < static_cast<int32>(EJobPriority::Num); ++Index)
+	{
+		const FStats& PriorityStats = Stats[Index];
+		const int32 NumCompleted = FMath::Max(PriorityStats.NumCompleted, 1);
+		UE_LOG(LogTemp, Log, TEXT("  %-8s Submitted:%d Completed:%d Inlined:%d Aged:%d AvgWaitMs:%.3f MaxWaitMs:%.3f AvgRunMs:%.3f Deadlines:%d Missed:%d MaxLatenessMs:%.3f"),
+			JobSchedulerInternal::GetPriorityName(static_cast<EJobPriority>(Index)), PriorityStats.NumSubmitted, PriorityStats.NumCompleted,
+			PriorityStats.NumInlined, PriorityStats.NumAged, PriorityStats.TotalWaitSec * 1000.0 / NumCompleted, PriorityStats.MaxWaitSec * 1000.0,
+			PriorityStats.TotalRunSec * 1000.0 / NumCompleted, PriorityStats.NumWithDeadline, PriorityStats.NumMissed, PriorityStats.MaxLatenessSec * 1000.0);
+	}
+}
+
+void FJobScheduler::ResetStats()
+{
+	FScopeLock ScopeLock(&Lock);
+	for (FStats& PriorityStats : Stats)
+	{
+		PriorityStats = FStats();
+	}
+}
+
+TUniquePtr<FJobScheduler::FJob> FJobScheduler::PopJob(bool bReservedWorker, double NowSec)
+{
+	int32 BestIndex = INDEX_NONE;
+	int32 BestPriority = MAX_int32;
+	for (int32 Index = 0; Index < PendingJobs.Num(); ++Index)
+	{
+		const FJob& Job = *PendingJobs[Index];
+		// 専用のワーカーは待ち時間で優先度が上がったジョブは拾わず、投入時の優先度で判定する
+		if (bReservedWorker && Job.Priority > EJobPriority::High)
+		{
+			continue;
+		}
+		const int32 Priority = GetEffectivePriority(Job, NowSec);
+		if (BestIndex == INDEX_NONE || Priority < BestPriority)
+		{
+			BestIndex = Index;
+			BestPriority = Priority;
+			continue;
+		}
+		if (Priority > BestPriority)
+		{
+			continue;
+		}
+
+		// 同じ優先度であれば締め切りの早いもの、締め切りがなければ先に投入したもの
+		const FJob& Best = *PendingJobs[BestIndex];
+		const bool bHasDeadline = Job.DeadlineSec > 0.0;
+		const bool bBestHasDeadline = Best.DeadlineSec > 0.0;
+		if (bHasDeadline != bBestHasDeadline)
+		{
+			if (bHasDeadline)
+			{
+				BestIndex = Index;
+			}
+		}
+		else if (bHasDeadline ? Job.DeadlineSec < Best.DeadlineSec : Job.Id < Best.Id)
+		{
+			BestIndex = Index;
+		}
+	}
+
+	if (BestIndex == INDEX_NONE)
+	{
+		return nullptr;
+	}
+
+	TUniquePtr<FJob> Job = MoveTemp(PendingJobs[BestIndex]);
+	PendingJobs.RemoveAtSwap(BestIndex, 1, false);
+	UpdateAllocatedSize();
+	Stats[static_cast<int32>(Job->Priority)].NumAged += BestPriority < static_cast<int32>(Job->Priority) ? 1 : 0;
+	++NumRunningJobs;
+	return Job;
+}
+
+int32 FJobScheduler::GetEffectivePriority(const FJob& Job, double NowSec) const
+{
+	const int32 NumAgingSteps = Settings.AgingIntervalSec > 0.0f ? FMath::FloorToInt((NowSec - Job.SubmitSec) / Settings.AgingIntervalSec) : 0;
+	return FMath::Max(static_cast<int32>(Job.Priority) - NumAgingSteps, 0);
+}
+
+void FJobScheduler::WakeWorker(bool bHighPriority)
+{
+	// 専用のワーカーは優先度の高いジョブのために残しておく
+	const int32 Index = IdleWorkers.IndexOfByPredicate([bHighPriority](const FWorker* Worker) { return bHighPriority || !Worker->bReserved; });
+	if (Index != INDEX_NONE)
+	{
+		FWorker* Worker = IdleWorkers[Index];
+		IdleWorkers.RemoveAtSwap(Index, 1, false);
+		Worker->WakeEvent->Trigger();
+	}
+}
+
+void FJobScheduler::UpdateAllocatedSize()
+{
+	const SIZE_T Bytes = Workers.GetAllocatedSize() + Workers.Num() * sizeof(FWorker) + IdleWorkers.GetAllocatedSize() +
+		PendingJobs.GetAllocatedSize() + PendingJobs.Num() * sizeof(FJob);
+	AllocatedBytes.store(Bytes, std::memory_order_relaxed);
+}
+
+void FJobScheduler::RunJob(FJob& Job, double StartSec, bool bInlined)
+{
+	Job.Work();
+	const double EndSec = FPlatformTime::Seconds();
+
+	const bool bMissed = Job.DeadlineSec > 0.0 && EndSec > Job.DeadlineSec;
+	if (bMissed)
+	{
+		SANDBOX_LOG(TEXT("JobScheduler DeadlineMissed Id:%llu Priority:%d LatenessMs:%.3f"), Job.Id, static_cast<int32>(Job.Priority), (EndSec - Job.DeadlineSec) * 1000.0);
+	}
+
+	{
+		FScopeLock ScopeLock(&Lock);
+		FStats& PriorityStats = Stats[static_cast<int32>(Job.Priority)];
+		++PriorityStats.NumCompleted;
+		PriorityStats.NumInlined += bInlined ? 1 : 0;
+		PriorityStats.TotalWaitSec += StartSec - Job.SubmitSec;
+		PriorityStats.MaxWaitSec = FMath::Max(PriorityStats.MaxWaitSec, StartSec - Job.SubmitSec);
+		PriorityStats.TotalRunSec += EndSec - StartSec;
+		if (bMissed)
+		{
+			++PriorityStats.NumMissed;
+			PriorityStats.MaxLatenessSec = FMath::Max(PriorityStats.MaxLatenessSec, EndSec - Job.DeadlineSec);
+		}
+		--NumRunningJobs;
+		NumOutstandingJobs.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	Job.State->bDeadlineMissed = bMissed;
+	Job.State->bDone.store(true, std::memory_order_release);
+}
+
+void FJobScheduler::WorkerLoop(FWorker& Worker)
+{
+	while (true)
+	{
+		TUniquePtr<FJob> Job;
+		{
+			FScopeLock ScopeLock(&Lock);
+			if (bStopping)
+			{
+				return;
+			}
+			Job = PopJob(Worker.bReserved, FPlatformTime::Seconds());
+			if (!Job.IsValid())
+			{
+				IdleWorkers.AddUnique(&Worker);
+			}
+		}
+
+		if (Job.IsValid())
+		{
+			RunJob(*Job, FPlatformTime::Seconds(), false);
+			continue;
+		}
+
+		Worker.WakeEvent->Wait();
+
+		FScopeLock ScopeLock(&Lock);
+		IdleWorkers.Remove(&Worker);
+	}
+}
@@ -0,0 +1,188 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * @brief ジョブの優先度。値が小さいほど優先されます
+ */
+enum class EJobPriority : uint8
+{
+	// フレーム内に結果が必要な処理
+	Critical,
+	High,
+	Normal,
+	// まとめて投入するバッチ処理など
+	Low,
+	Num
+};
+
+/**
+ * @brief 優先度と締め切りを考慮してバックグラウンドのジョブを実行するスケジューラー
+ *		　GThreadPoolは投入順に実行するため、長いジョブが溜まっていると後から投入した急ぎのジョブが待たされます。
+ *		　このスケジューラーは専用のワーカースレッドを持ち、空いたワーカーが次のジョブを次の順で選びます。
+ *		　・優先度の高いもの。待ち時間がAgingIntervalSecを超えるごとに1段階ずつ優先度を上げ、低優先度のジョブが実行されないままになるのを防ぐ
+ *		　　優先度の引き上げは専用でないワーカーが選ぶ順番にだけ使い、専用のワーカーは投入時の優先度がHigh以上のジョブだけを実行する
+ *		　・同じ優先度の中では締め切りの早いもの。締め切りのないジョブはその後ろに投入順で並ぶ
+ *		　また、一部のワーカーはHigh以上のジョブ専用にしておき、低優先度のジョブで全ワーカーが埋まっていても急ぎのジョブをすぐ開始できるようにします。
+ *		　フレーム内に結果が必要な場合はWaitを呼び出すと、まだ開始していないジョブは呼び出したスレッドで実行します。
+ *		　締め切りに間に合わなかったジョブは優先度ごとに集計します。
+ */
+class FJobScheduler final
+{
+public:
+	struct FSettings
+	{
+		// ワーカースレッド数
+		int32 NumWorkers = 4;
+		// High以上のジョブ専用のワーカースレッド数。NumWorkersに含む
+		int32 NumReservedWorkers = 1;
+		// この時間待つごとに優先度を1段階上げる
+		float AgingIntervalSec = 0.1f;
+	};
+
+	/**
+	 * @brief ジョブの完了状態
+	 */
+	class FJobState final
+	{
+	public:
+		bool IsDone() const { return bDone.load(std::memory_order_acquire); }
+
+		/**
+		 * @brief 締め切りに間に合わなかったか。完了後に有効です
+		 */
+		bool IsDeadlineMissed() const { return bDeadlineMissed; }
+
+	private:
+		friend class FJobScheduler;
+		uint64 Id = 0;
+		bool bDeadlineMissed = false;
+		std::atomic<bool> bDone{false};
+	};
+
+	using FJobHandle = TSharedRef<FJobState, ESPMode::ThreadSafe>;
+
+	/**
+	 * @brief CPUのコア数からワーカー数を決めた設定を返します
+	 */
+	static FSettings MakeDefaultSettings();
+
+	explicit FJobScheduler(const FSettings& InSettings = MakeDefaultSettings());
+
+	/**
+	 * @brief 実行待ちのジョブは全てこのスレッドで実行してからワーカーを停止します
+	 */
+	~FJobScheduler();
+
+	/**
+	 * @brief ジョブを投入します
+	 * @param Priority 優先度
+	 * @param DeadlineSec 投入からこの秒数以内に完了させたい場合に指定します。0以下であれば締め切りなし
+	 * @param Work ワーカースレッドで実行する処理
+	 * @return 完了の確認・待機に使うハンドル
+	 */
+	FJobHandle Submit(EJobPriority Priority, float DeadlineSec, TUniqueFunction<void()> Work);
+
+	/**
+	 * @brief ジョブの完了を待ちます
+	 *		　まだ開始していなければ呼び出したスレッドで実行します。
+	 */
+	void Wait(const FJobHandle& Handle);
+
+	/**
+	 * @brief 実行待ちと実行中のジョブ数。ロックを取らずに読めるので毎フレーム呼び出せます
+	 */
+	int32 GetNumPendingJobs() const { return NumOutstandingJobs.load(std::memory_order_relaxed); }
+
+	int32 GetNumWorkers() const { return Workers.Num(); }
+
+	/**
+	 * @brief ワーカーと実行待ちのジョブが使っているメモリの量。ロックを取らずに読めます
+	 *		　ジョブの処理がキャプチャした値のうち、TUniqueFunctionの外に確保されたものは含みません。
+	 */
+	SIZE_T GetAllocatedSize() const { return AllocatedBytes.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief 優先度ごとの待ち時間・実行時間・締め切り超過数をログに出力します
+	 */
+	void DumpStats() const;
+
+	void ResetStats();
+
+private:
+	class FWorker;
+
+	struct FJob
+	{
+		uint64 Id;
+		EJobPriority Priority;
+		double SubmitSec;
+		// 0であれば締め切りなし
+		double DeadlineSec;
+		TUniqueFunction<void()> Work;
+		TSharedPtr<FJobState, ESPMode::ThreadSafe> State;
+	};
+
+	struct FStats
+	{
+		int32 NumSubmitted = 0;
+		int32 NumCompleted = 0;
+		// Waitで呼び出し元が実行した数
+		int32 NumInlined = 0;
+		// 優先度を上げてから実行した数
+		int32 NumAged = 0;
+		int32 NumWithDeadline = 0;
+		int32 NumMissed = 0;
+		double TotalWaitSec = 0.0;
+		double MaxWaitSec = 0.0;
+		double TotalRunSec = 0.0;
+		double MaxLatenessSec = 0.0;
+	};
+
+	/**
+	 * @brief 次に実行するジョブを取り出します。Lockを取った状態で呼び出します
+	 * @param bReservedWorker High以上専用のワーカーか
+	 */
+	TUniquePtr<FJob> PopJob(bool bReservedWorker, double NowSec);
+
+	/**
+	 * @brief 待ち時間による優先度の引き上げを反映した優先度
+	 */
+	int32 GetEffectivePriority(const FJob& Job, double NowSec) const;
+
+	/**
+	 * @brief 待機中のワーカーを1つ起こします。Lockを取った状態で呼び出します
+	 */
+	void WakeWorker(bool bHighPriority);
+
+	void RunJob(FJob& Job, double StartSec, bool bInlined);
+
+	/**
+	 * @brief AllocatedBytesを更新します。PendingJobsを変更したらLockを取った状態で呼び出します
+	 */
+	void UpdateAllocatedSize();
+
+	/**
+	 * @brief ワーカースレッドの処理
+	 */
+	void WorkerLoop(FWorker& Worker);
+
+	FSettings Settings;
+	TArray<TUniquePtr<FWorker>> Workers;
+
+	mutable FCriticalSection Lock;
+	// 実行待ちのジョブ。選ぶたびに全件を見るが、ジョブ数が数千程度までなら問題にならない
+	TArray<TUniquePtr<FJob>> PendingJobs;
+	TArray<FWorker*> IdleWorkers;
+	int32 NumRunningJobs = 0;
+	uint64 NextJobId = 1;
+	FStats Stats[static_cast<int32>(EJobPriority::Num)];
+	bool bStopping = false;
+
+	std::atomic<SIZE_T> AllocatedBytes{0};
+	// PendingJobs.Num() + NumRunningJobsと同じ値。Submitで増やし、RunJobの完了で減らす
+	std::atomic<int32> NumOutstandingJobs{0};
+};
@@ -0,0 +1,233 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LoadGenerator.h"
+#include "Misc/App.h"
+#include "Misc/Paths.h"
+#include "SandBoxFrameAllocator.h"
+
+FLoadGenerator::~FLoadGenerator()
+{
+	Stop();
+}
+
+bool FLoadGenerator::Start(const FSettings& InSettings)
+{
+	if (IsRunning())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("負荷試験のクライアントは起動中です"));
+		return false;
+	}
+
+	Settings = InSettings;
+	ServerStats = FServerStats();
+	ServerStats.StartSec = FPlatformTime::Seconds();
+
+	// クッキングしていないビルドではエディタの実行ファイルにプロジェクトを渡す必要がある
+	const FString ExecutablePath = FPlatformProcess::ExecutablePath();
+	const FString ProjectArg = FPlatformProperties::RequiresCookedData() ? FString() : FString::Printf(TEXT("\"%s\" "), *FPaths::ConvertRelativePathToFull(FPaths::GetProjectFilePath()));
+
+	for (int32 Index = 0; Index < Settings.NumClients; ++Index)
+	{
+		FClient Client;
+		Client.Id = Index;
+		if (!FPlatformProcess::CreatePipe(Client.ReadPipe, Client.WritePipe))
+		{
+			UE_LOG(LogTemp, Warning, TEXT("パイプを作成できませんでした"));
+			break;
+		}
+
+		// ログはボットの統計(LogTemp Display)以外を出さないようにしてパイプの読み取り量を抑える
+		const FString Params = FString::Printf(
+			TEXT("%s%s -game -nullrhi -nosound -unattended -stdout -LogCmds=\"Global Warning, LogTemp Display\" -ExecCmds=\"t.MaxFPS %d\" -SandBoxBot -SandBoxBotId=%d -SandBoxBotPattern=%s"),
+			*ProjectArg, *Settings.Address, Settings.MaxFPS, Index, *Settings.Pattern);
+
+		Client.Proc = FPlatformProcess::CreateProc(*ExecutablePath, *Params, false, true, true, nullptr, 0, nullptr, Client.WritePipe);
+		if (!Client.Proc.IsValid())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("クライアントを起動できませんでした:%s %s"), *ExecutablePath, *Params);
+			FPlatformProcess::ClosePipe(Client.ReadPipe, Client.WritePipe);
+			break;
+		}
+		Clients.Add(MoveTemp(Client));
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("LoadGen Started Clients:%d Address:%s Pattern:%s MaxFPS:%d"), Clients.Num(), *Settings.Address, *Settings.Pattern, Settings.MaxFPS);
+	return Clients.Num() > 0;
+}
+
+void FLoadGenerator::Stop()
+{
+	for (FClient& Client : Clients)
+	{
+		if (FPlatformProcess::IsProcRunning(Client.Proc))
+		{
+			FPlatformProcess::TerminateProc(Client.Proc, true);
+		}
+		FPlatformProcess::CloseProc(Client.Proc);
+		FPlatformProcess::ClosePipe(Client.ReadPipe, Client.WritePipe);
+	}
+
+	if (Clients.Num() > 0)
+	{
+		UE_LOG(LogTemp, Log, TEXT("LoadGen Stopped Clients:%d"), Clients.Num());
+	}
+	Clients.Reset();
+}
+
+void FLoadGenerator::Tick(float DeltaTime)
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+
+	// 専用サーバーはフレームレート上限まで待機するので、待機時間を除いた時間をTick時間とする
+	const double WorkMs = FMath::Max(FApp::GetDeltaTime() - FApp::GetIdleTime(), 0.0) * 1000.0;
+	++ServerStats.NumFrames;
+	ServerStats.WorkMsTotal += WorkMs;
+	ServerStats.WorkMsMax = FMath::Max(ServerStats.WorkMsMax, WorkMs);
+
+	// 読まないとパイプが詰まってクライアントが止まる
+	for (FClient& Client : Clients)
+	{
+		ReadOutput(Client);
+		Client.bRunning = FPlatformProcess::IsProcRunning(Client.Proc);
+	}
+}
+
+void FLoadGenerator::DumpReport() const
+{
+	int32 NumRunning = 0;
+	int32 NumConnected = 0;
+	int32 NumReporting = 0;
+	float RttMsTotal = 0.0f;
+	float RttMsMax = 0.0f;
+	float CpuPctTotal = 0.0f;
+	float CpuPctMax = 0.0f;
+	float FrameMsTotal = 0.0f;
+	for (const FClient& Client : Clients)
+	{
+		NumRunning += Client.bRunning ? 1 : 0;
+		if (!Client.bHasStats)
+		{
+			continue;
+		}
+
+		++NumReporting;
+		CpuPctTotal += Client.CpuPct;
+		CpuPctMax = FMath::Max(CpuPctMax, Client.CpuPct);
+		FrameMsTotal += Client.FrameMs;
+		if (Client.bConnected)
+		{
+			++NumConnected;
+			RttMsTotal += Client.RttMs;
+			RttMsMax = FMath::Max(RttMsMax, Client.RttMs);
+		}
+	}
+
+	const FCPUTime ServerCPUTime = FPlatformTime::GetCPUTime();
+	UE_LOG(LogTemp, Log, TEXT("LoadGen Clients:%d Running:%d Reporting:%d Connected:%d Pattern:%s ElapsedSec:%.1f"),
+		Clients.Num(), NumRunning, NumReporting, NumConnected, *Settings.Pattern, FPlatformTime::Seconds() - ServerStats.StartSec);
+	UE_LOG(LogTemp, Log, TEXT("  Server TickMs Avg:%.2f Max:%.2f CPU:%.1f%%"),
+		ServerStats.NumFrames > 0 ? ServerStats.WorkMsTotal / ServerStats.NumFrames : 0.0, ServerStats.WorkMsMax, ServerCPUTime.CPUTimePctRelative);
+	UE_LOG(LogTemp, Log, TEXT("  Client RttMs Avg:%.2f Max:%.2f CpuPct Avg:%.2f Max:%.2f FrameMs Avg:%.2f"),
+		NumConnected > 0 ? RttMsTotal / NumConnected : 0.0f, RttMsMax,
+		NumReporting > 0 ? CpuPctTotal / NumReporting : 0.0f, CpuPctMax,
+		NumReporting > 0 ? FrameMsTotal / NumReporting : 0.0f);
+
+	// 一時データをヒープから確保せずに済んだ数と、バッファが足りずヒープに戻った数
+	const FSandBoxFrameAllocator::FStats FrameStats = FSandBoxFrameAllocator::Get().GetStats();
+	const double NumFrameStatFrames = static_cast<double>(FMath::Max<uint64>(FrameStats.NumFrames, 1));
+	UE_LOG(LogTemp, Log, TEXT("  Server FrameAllocator AllocsPerFrame:%.1f OverflowsPerFrame:%.2f HighWaterKB:%.1f"),
+		FrameStats.NumAllocs / NumFrameStatFrames, FrameStats.NumOverflows / NumFrameStatFrames, FrameStats.HighWaterBytes / 1024.0);
+
+	// 出力の行の切り出しで、同じ出力をフレームアロケーターなしで処理したときと使ったときに計測したヒープの確保数
+	const double NumServerFrames = static_cast<double>(FMath::Max(ServerStats.NumFrames, 1));
+	if (Settings.bCompareHeapAllocs)
+	{
+		UE_LOG(LogTemp, Log, TEXT("  Server OutputLines PerFrame:%.2f HeapAllocsPerFrame Before:%.2f After:%.2f"),
+			ServerStats.NumOutputLines / NumServerFrames, ServerStats.NumOutputHeapAllocsWithoutFrameAllocator / NumServerFrames, ServerStats.NumOutputHeapAllocs / NumServerFrames);
+	}
+	else
+	{
+		UE_LOG(LogTemp, Log, TEXT("  Server OutputLines PerFrame:%.2f HeapAllocsPerFrame After:%.2f (LoadGenStart -compareallocs trueで比較)"),
+			ServerStats.NumOutputLines / NumServerFrames, ServerStats.NumOutputHeapAllocs / NumServerFrames);
+	}
+}
+
+SIZE_T FLoadGenerator::GetAllocatedSize() const
+{
+	SIZE_T Bytes = Settings.Address.GetAllocatedSize() + Settings.Pattern.GetAllocatedSize() + Clients.GetAllocatedSize();
+	for (const FClient& Client : Clients)
+	{
+		Bytes += Client.PendingOutput.GetAllocatedSize();
+	}
+	return Bytes;
+}
+
+void FLoadGenerator::ReadOutput(FClient& Client)
+{
+	Client.PendingOutput += FPlatformProcess::ReadPipe(Client.ReadPipe);
+
+	FSandBoxFrameAllocator& FrameAllocator = FSandBoxFrameAllocator::Get();
+
+	// 比較する場合は、同じ出力を先にフレームアロケーターなしで処理してヒープの確保数を数える
+	if (Settings.bCompareHeapAllocs)
+	{
+		FSandBoxFrameAllocator::FHeapScope HeapScope;
+		const uint64 NumHeapAllocsBefore = FrameAllocator.GetNumHeapAllocsOnCurrentThread();
+		ProcessLines(Client, nullptr);
+		const uint64 NumHeapAllocsAfter = FrameAllocator.GetNumHeapAllocsOnCurrentThread();
+		// 途中でResetStatsされた場合は数えない
+		ServerStats.NumOutputHeapAllocsWithoutFrameAllocator += NumHeapAllocsAfter >= NumHeapAllocsBefore ? NumHeapAllocsAfter - NumHeapAllocsBefore : 0;
+	}
+
+	int32 NumConsumed = 0;
+	{
+		// クライアントのログは毎フレーム何行も届くため、行のコピーはフレームアロケーターから確保して呼び出しごとに戻す
+		FSandBoxFrameAllocator::FScope FrameScope;
+		const uint64 NumHeapAllocsBefore = FrameAllocator.GetNumHeapAllocsOnCurrentThread();
+		NumConsumed = ProcessLines(Client, &ServerStats.NumOutputLines);
+		const uint64 NumHeapAllocsAfter = FrameAllocator.GetNumHeapAllocsOnCurrentThread();
+		ServerStats.NumOutputHeapAllocs += NumHeapAllocsAfter >= NumHeapAllocsBefore ? NumHeapAllocsAfter - NumHeapAllocsBefore : 0;
+	}
+	Client.PendingOutput.RemoveAt(0, NumConsumed, false);
+}
+
+/*static*/
+int32 FLoadGenerator::ProcessLines(FClient& Client, uint64* OutNumLines)
+{
+	// 改行までを1行として処理し、残りは次回に回す
+	const TCHAR* Output = *Client.PendingOutput;
+	int32 LineStart = 0;
+	while (const TCHAR* NewLine = FCString::Strchr(Output + LineStart, TEXT('\n')))
+	{
+		const int32 LineEnd = static_cast<int32>(NewLine - Output);
+		TSandBoxFrameArray<TCHAR> Line;
+		Line.SetNumUninitialized(LineEnd - LineStart + 1);
+		FMemory::Memcpy(Line.GetData(), Output + LineStart, (LineEnd - LineStart) * sizeof(TCHAR));
+		Line[LineEnd - LineStart] = TEXT('\0');
+		LineStart = LineEnd + 1;
+		if (OutNumLines != nullptr)
+		{
+			++*OutNumLines;
+		}
+		if (FCString::Strstr(Line.GetData(), TEXT("SandBoxBotStats")) != nullptr)
+		{
+			ParseStats(Line.GetData(), Client);
+		}
+	}
+	return LineStart;
+}
+
+void FLoadGenerator::ParseStats(const TCHAR* Line, FClient& Client)
+{
+	int32 Connected = 0;
+	FParse::Value(Line, TEXT("Connected="), Connected);
+	FParse::Value(Line, TEXT("RttMs="), Client.RttMs);
+	FParse::Value(Line, TEXT("CpuPct="), Client.CpuPct);
+	FParse::Value(Line, TEXT("FrameMs="), Client.FrameMs);
+	Client.bConnected = Connected != 0;
+	Client.bHasStats = true;
+}
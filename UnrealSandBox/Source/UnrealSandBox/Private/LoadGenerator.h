@@ -0,0 +1,116 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * @brief ローカルの専用サーバーに負荷試験用のクライアントを複数接続するクラス
+ *		　同じ実行ファイルを-game -nullrhi -SandBoxBotで別プロセスとして起動し、ループバックで接続させます。
+ *		　GPU・ネットワークがない環境でも1台で動作します。
+ *		　クライアントの標準出力からFSandBoxBotDriverの統計を読み取り、サーバーのTick時間と合わせて集計します。
+ */
+class FLoadGenerator final
+{
+public:
+	/**
+	 * @brief 起動設定
+	 */
+	struct FSettings
+	{
+		// 起動するクライアント数
+		int32 NumClients = 1;
+		// 接続先。"127.0.0.1:7777"の形式
+		FString Address;
+		// 入力パターン。FSandBoxBotDriver::EPatternの名前
+		FString Pattern = TEXT("Random");
+		// クライアントのフレームレート上限。クライアントが多いとサーバーのCPUを奪うため抑える
+		int32 MaxFPS = 30;
+		// 出力の読み取りを毎フレームフレームアロケーターなしでも実行し、ヒープの確保数を比較するか
+		// 同じ出力を2回処理するため、サーバーのTick時間はその分増える
+		bool bCompareHeapAllocs = false;
+	};
+
+	~FLoadGenerator();
+
+	/**
+	 * @brief クライアントを起動します。起動中であれば何もしません
+	 * @return 1つ以上起動できたか
+	 */
+	bool Start(const FSettings& InSettings);
+
+	/**
+	 * @brief 全クライアントを終了します
+	 */
+	void Stop();
+
+	/**
+	 * @brief 毎フレーム呼び出します。クライアントの出力の読み取りとサーバーのTick時間の集計を行います
+	 */
+	void Tick(float DeltaTime);
+
+	/**
+	 * @brief クライアントのRTT・CPU使用率とサーバーのTick時間をログに出力します
+	 */
+	void DumpReport() const;
+
+	bool IsRunning() const { return Clients.Num() > 0; }
+
+	/**
+	 * @brief 起動したクライアントの管理と、読み取り途中の出力に使っているメモリの量
+	 */
+	SIZE_T GetAllocatedSize() const;
+
+private:
+	/**
+	 * @brief 起動したクライアント
+	 */
+	struct FClient
+	{
+		int32 Id = 0;
+		FProcHandle Proc;
+		void* ReadPipe = nullptr;
+		void* WritePipe = nullptr;
+		FString PendingOutput;
+
+		// プロセスが動いているか。Tickで更新する
+		bool bRunning = true;
+
+		// 最後に受け取った統計
+		bool bHasStats = false;
+		bool bConnected = false;
+		float RttMs = 0.0f;
+		float CpuPct = 0.0f;
+		float FrameMs = 0.0f;
+	};
+
+	/**
+	 * @brief サーバーのTick時間の集計
+	 */
+	struct FServerStats
+	{
+		int32 NumFrames = 0;
+		double WorkMsTotal = 0.0;
+		double WorkMsMax = 0.0;
+		double StartSec = 0.0;
+		// クライアントの出力から切り出した行数
+		uint64 NumOutputLines = 0;
+		// 出力の読み取り中にヒープから確保した数。フレームアロケーターを使った場合と、使わずに同じ出力を処理した場合
+		uint64 NumOutputHeapAllocs = 0;
+		uint64 NumOutputHeapAllocsWithoutFrameAllocator = 0;
+	};
+
+	void ReadOutput(FClient& Client);
+
+	/**
+	 * @brief 読み取り済みの出力を行ごとに処理します。PendingOutputは変更しません
+	 * @param OutNumLines 処理した行数を加算する。nullptrであれば数えない
+	 * @return 処理した文字数。残りは次回に回す
+	 */
+	static int32 ProcessLines(FClient& Client, uint64* OutNumLines);
+	static void ParseStats(const TCHAR* Line, FClient& Client);
+
+	FSettings Settings;
+	TArray<FClient> Clients;
+	FServerStats ServerStats;
+};
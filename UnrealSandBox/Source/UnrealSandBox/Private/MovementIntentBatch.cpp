@@ -0,0 +1,263 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "MovementIntentBatch.h"
+#include "GameFramework/Controller.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PawnMovementComponent.h"
+
+FMovementIntentBatch::FMovementIntentBatch()
+{
+	TickFunction.Batch = this;
+	TickFunction.TickGroup = TG_PrePhysics;
+	TickFunction.bCanEverTick = true;
+	TickFunction.bStartWithTickEnabled = true;
+}
+
+FMovementIntentBatch::~FMovementIntentBatch()
+{
+	UnregisterTickFunction();
+}
+
+int32 FMovementIntentBatch::Register(APawn* Pawn, UObject* Owner)
+{
+	check(Pawn != nullptr);
+
+	// ティック関数は最初のポーンが登録されたときにワールドへ登録する
+	if (!TickFunction.IsTickFunctionRegistered())
+	{
+		TickFunctionOwner = Owner;
+		TickFunction.RegisterTickFunction(Pawn->GetWorld()->PersistentLevel);
+	}
+
+	int32 Slot;
+	if (FreeSlots.Num() > 0)
+	{
+		Slot = FreeSlots.Pop(false);
+		Pawns[Slot] = Pawn;
+		Forwards[Slot] = 0.0f;
+		Rights[Slot] = 0.0f;
+	}
+	else
+	{
+		Slot = Pawns.Add(Pawn);
+		Forwards.Add(0.0f);
+		Rights.Add(0.0f);
+	}
+
+	// 移動コンポーネントはバッチ処理の結果を使うので後にTickさせる
+	if (UPawnMovementComponent* MovementComponent = Pawn->GetMovementComponent())
+	{
+		MovementComponent->PrimaryComponentTick.AddPrerequisite(Owner, TickFunction);
+	}
+	AddControllerPrerequisite(Pawn->GetController());
+
+	return Slot;
+}
+
+void FMovementIntentBatch::Unregister(int32 Slot)
+{
+	if (!ensureAlways(Pawns.IsValidIndex(Slot)))
+	{
+		return;
+	}
+
+	if (APawn* Pawn = Pawns[Slot].Get())
+	{
+		if (UPawnMovementComponent* MovementComponent = Pawn->GetMovementComponent())
+		{
+			MovementComponent->PrimaryComponentTick.RemovePrerequisite(TickFunctionOwner.Get(), TickFunction);
+		}
+		RemoveControllerPrerequisite(Pawn->GetController());
+	}
+
+	Pawns[Slot].Reset();
+	Forwards[Slot] = 0.0f;
+	Rights[Slot] = 0.0f;
+	FreeSlots.Add(Slot);
+}
+
+void FMovementIntentBatch::AddControllerPrerequisite(AController* Controller)
+{
+	if (Controller != nullptr)
+	{
+		TickFunction.AddPrerequisite(Controller, Controller->PrimaryActorTick);
+	}
+}
+
+void FMovementIntentBatch::RemoveControllerPrerequisite(AController* Controller)
+{
+	if (Controller != nullptr)
+	{
+		TickFunction.RemovePrerequisite(Controller, Controller->PrimaryActorTick);
+	}
+}
+
+bool FMovementIntentBatch::AddInput(int32 Slot, float Forward, float Right)
+{
+	if (LastResolvedFrame == GFrameCounter || !Pawns.IsValidIndex(Slot))
+	{
+		return false;
+	}
+
+	Forwards[Slot] += Forward;
+	Rights[Slot] += Right;
+	return true;
+}
+
+void FMovementIntentBatch::Resolve()
+{
+	LastResolvedFrame = GFrameCounter;
+
+	// 入力のあるポーンだけを連続した配列に集める
+	PendingSlots.Reset();
+	PendingYaws.Reset();
+	PendingForwards.Reset();
+	PendingRights.Reset();
+	for (int32 Slot = 0; Slot < Pawns.Num(); ++Slot)
+	{
+		if (Forwards[Slot] == 0.0f && Rights[Slot] == 0.0f)
+		{
+			continue;
+		}
+
+		const APawn* Pawn = Pawns[Slot].Get();
+		const AController* Controller = Pawn != nullptr ? Pawn->GetController() : nullptr;
+		if (Controller != nullptr)
+		{
+			PendingSlots.Add(Slot);
+			PendingYaws.Add(Controller->GetControlRotation().Yaw);
+			PendingForwards.Add(Forwards[Slot]);
+			PendingRights.Add(Rights[Slot]);
+		}
+
+		Forwards[Slot] = 0.0f;
+		Rights[Slot] = 0.0f;
+	}
+
+	const int32 NumPending = PendingSlots.Num();
+	DirectionsX.SetNumUninitialized(NumPending, false);
+	DirectionsY.SetNumUninitialized(NumPending, false);
+	ComputeDirections(PendingYaws.GetData(), PendingForwards.GetData(), PendingRights.GetData(), NumPending, DirectionsX.GetData(), DirectionsY.GetData());
+
+	// 前後と左右の入力は合成済みなのでAddMovementInputは1回だけ呼ぶ
+	for (int32 i = 0; i < NumPending; ++i)
+	{
+		Pawns[PendingSlots[i]]->AddMovementInput(FVector(DirectionsX[i], DirectionsY[i], 0.0f));
+	}
+}
+
+void FMovementIntentBatch::UnregisterTickFunction()
+{
+	if (TickFunction.IsTickFunctionRegistered())
+	{
+		TickFunction.UnRegisterTickFunction();
+	}
+}
+
+/*static*/
+FVector FMovementIntentBatch::ComputeDirection(float Yaw, float Forward, float Right)
+{
+	// Yawのみの回転行列のX軸は(cos, sin, 0)、Y軸は(-sin, cos, 0)
+	float Sin, Cos;
+	FMath::SinCos(&Sin, &Cos, FMath::DegreesToRadians(Yaw));
+	return FVector(Cos * Forward - Sin * Right, Sin * Forward + Cos * Right, 0.0f);
+}
+
+/*static*/
+void FMovementIntentBatch::ComputeDirections(const float* Yaws, const float* Forwards, const float* Rights, int32 Num, float* OutDirectionsX, float* OutDirectionsY)
+{
+	const VectorRegister DegreesToRadians = MakeVectorRegister(PI / 180.0f, PI / 180.0f, PI / 180.0f, PI / 180.0f);
+
+	int32 Index = 0;
+	for (; Index + 4 <= Num; Index += 4)
+	{
+		const VectorRegister Angles = VectorMultiply(VectorLoad(Yaws + Index), DegreesToRadians);
+		VectorRegister Sin, Cos;
+		VectorSinCos(&Sin, &Cos, &Angles);
+
+		const VectorRegister Forward = VectorLoad(Forwards + Index);
+		const VectorRegister Right = VectorLoad(Rights + Index);
+
+		// X = Cos * Forward - Sin * Right, Y = Sin * Forward + Cos * Right
+		VectorStore(VectorSubtract(VectorMultiply(Cos, Forward), VectorMultiply(Sin, Right)), OutDirectionsX + Index);
+		VectorStore(VectorMultiplyAdd(Sin, Forward, VectorMultiply(Cos, Right)), OutDirectionsY + Index);
+	}
+
+	// 4要素に満たない残り
+	for (; Index < Num; ++Index)
+	{
+		const FVector Direction = ComputeDirection(Yaws[Index], Forwards[Index], Rights[Index]);
+		OutDirectionsX[Index] = Direction.X;
+		OutDirectionsY[Index] = Direction.Y;
+	}
+}
+
+/*static*/
+void FMovementIntentBatch::RunBenchmark(const TArray<int32>& PawnCounts, int32 NumIterations)
+{
+	for (const int32 PawnCount : PawnCounts)
+	{
+		TArray<float> Yaws, Forwards, Rights, DirectionsX, DirectionsY;
+		Yaws.SetNumUninitialized(PawnCount);
+		Forwards.SetNumUninitialized(PawnCount);
+		Rights.SetNumUninitialized(PawnCount);
+		DirectionsX.SetNumUninitialized(PawnCount);
+		DirectionsY.SetNumUninitialized(PawnCount);
+
+		FRandomStream Stream(PawnCount);
+		for (int32 i = 0; i < PawnCount; ++i)
+		{
+			Yaws[i] = Stream.FRandRange(-180.0f, 180.0f);
+			Forwards[i] = Stream.FRandRange(-1.0f, 1.0f);
+			Rights[i] = Stream.FRandRange(-1.0f, 1.0f);
+		}
+
+		// 最適化で計算が消されないよう結果を足し合わせてログに出す
+		FVector LegacySum = FVector::ZeroVector;
+		const double LegacyStartSec = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+		{
+			for (int32 i = 0; i < PawnCount; ++i)
+			{
+				// AUnrealSandBoxCharacter::MoveForward/MoveRightの以前の計算
+				const FRotator YawRotation(0, Yaws[i], 0);
+				LegacySum += FRotationMatrix(YawRotation).GetUnitAxis(EAxis::X) * Forwards[i];
+				const FRotator YawRotationRight(0, Yaws[i], 0);
+				LegacySum += FRotationMatrix(YawRotationRight).GetUnitAxis(EAxis::Y) * Rights[i];
+			}
+		}
+		const double LegacySec = FPlatformTime::Seconds() - LegacyStartSec;
+
+		FVector BatchSum = FVector::ZeroVector;
+		const double BatchStartSec = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; ++Iteration)
+		{
+			ComputeDirections(Yaws.GetData(), Forwards.GetData(), Rights.GetData(), PawnCount, DirectionsX.GetData(), DirectionsY.GetData());
+			for (int32 i = 0; i < PawnCount; ++i)
+			{
+				BatchSum.X += DirectionsX[i];
+				BatchSum.Y += DirectionsY[i];
+			}
+		}
+		const double BatchSec = FPlatformTime::Seconds() - BatchStartSec;
+
+		const double Divisor = FMath::Max(NumIterations, 1);
+		UE_LOG(LogTemp, Log, TEXT("MovementIntentBenchmark Pawns:%d LegacyUs:%.2f BatchUs:%.2f Speedup:%.2fx (Check %s / %s)"),
+			PawnCount, LegacySec * 1000000.0 / Divisor, BatchSec * 1000000.0 / Divisor, LegacySec / FMath::Max(BatchSec, SMALL_NUMBER),
+			*LegacySum.ToString(), *BatchSum.ToString());
+	}
+}
+
+//---------------------------------------------------------------------------------
+// FBatchTickFunction
+//---------------------------------------------------------------------------------
+void FMovementIntentBatch::FBatchTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	Batch->Resolve();
+}
+
+FString FMovementIntentBatch::FBatchTickFunction::DiagnosticMessage()
+{
+	return TEXT("FMovementIntentBatch::FBatchTickFunction");
+}
@@ -0,0 +1,118 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+
+class AController;
+class APawn;
+
+/**
+ * @brief ポーンの移動入力をフレーム単位にまとめて処理するクラス
+ *		　MoveForward/MoveRightの入力を移動意図(前後・左右の入力量)として貯めておき、
+ *		　コントローラーのTick後・移動コンポーネントのTick前に全ポーン分の移動方向をまとめて計算します。
+ *		　軸ごとにFRotationMatrixを作る代わりに、Yawのsin/cosを1回だけSIMDでまとめて求めます。
+ */
+class FMovementIntentBatch final
+{
+public:
+	FMovementIntentBatch();
+	~FMovementIntentBatch();
+
+	/**
+	 * @brief ポーンを登録します
+	 *		　ポーンの移動コンポーネントがバッチ処理の後にTickするよう前提条件を設定します。
+	 * @param Pawn 登録するポーン
+	 * @param Owner ティック関数の前提条件に使うバッチの所有者
+	 * @return 移動意図を書き込むスロット
+	 */
+	int32 Register(APawn* Pawn, UObject* Owner);
+
+	/**
+	 * @brief ポーンの登録を解除します
+	 */
+	void Unregister(int32 Slot);
+
+	/**
+	 * @brief コントローラーのTickの後にバッチ処理が行われるよう前提条件を追加/削除します
+	 */
+	void AddControllerPrerequisite(AController* Controller);
+	void RemoveControllerPrerequisite(AController* Controller);
+
+	/**
+	 * @brief 移動意図を加算します
+	 * @param Slot Registerで取得したスロット
+	 * @param Forward 前後の入力量
+	 * @param Right 左右の入力量
+	 * @return 今フレームのバッチ処理が終わっていて受け付けられなかった場合falseを返します。その場合は呼び出し側で直接適用してください。
+	 */
+	bool AddInput(int32 Slot, float Forward, float Right);
+
+	/**
+	 * @brief 貯まっている移動意図をまとめて移動入力に変換します
+	 */
+	void Resolve();
+
+	/**
+	 * @brief ティック関数をワールドから外します
+	 */
+	void UnregisterTickFunction();
+
+	/**
+	 * @brief 1ポーン分の移動方向を計算します
+	 * @param Yaw コントロール回転のYaw(度)
+	 * @param Forward 前後の入力量
+	 * @param Right 左右の入力量
+	 */
+	static FVector ComputeDirection(float Yaw, float Forward, float Right);
+
+	/**
+	 * @brief 複数ポーン分の移動方向をまとめて計算します。4要素ずつSIMDで処理します
+	 * @param Yaws コントロール回転のYaw(度)
+	 * @param Forwards 前後の入力量
+	 * @param Rights 左右の入力量
+	 * @param Num 要素数
+	 * @param OutDirectionsX 移動方向のX成分
+	 * @param OutDirectionsY 移動方向のY成分
+	 */
+	static void ComputeDirections(const float* Yaws, const float* Forwards, const float* Rights, int32 Num, float* OutDirectionsX, float* OutDirectionsY);
+
+	/**
+	 * @brief 従来の軸ごとにFRotationMatrixを作る方法とバッチ計算の時間を比較してログに出力します
+	 * @param PawnCounts 計測するポーン数
+	 * @param NumIterations 計測回数
+	 */
+	static void RunBenchmark(const TArray<int32>& PawnCounts, int32 NumIterations);
+
+private:
+	/**
+	 * @brief TG_PrePhysicsでバッチ処理を行うティック関数
+	 */
+	struct FBatchTickFunction final : public FTickFunction
+	{
+		FMovementIntentBatch* Batch = nullptr;
+
+		virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+		virtual FString DiagnosticMessage() override;
+	};
+
+	FBatchTickFunction TickFunction;
+	TWeakObjectPtr<UObject> TickFunctionOwner;
+
+	// スロットごとのデータ。同じインデックスが同じポーンを表す
+	TArray<TWeakObjectPtr<APawn>> Pawns;
+	TArray<float> Forwards;
+	TArray<float> Rights;
+	TArray<int32> FreeSlots;
+
+	// Resolveでまとめて計算するための作業領域
+	TArray<int32> PendingSlots;
+	TArray<float> PendingYaws;
+	TArray<float> PendingForwards;
+	TArray<float> PendingRights;
+	TArray<float> DirectionsX;
+	TArray<float> DirectionsY;
+
+	uint64 LastResolvedFrame = 0;
+};
@@ -0,0 +1,151 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "NetMovementRate.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "SandBoxReplicationGraph.h"
+#include "UnrealSandBox/UnrealSandBoxCharacter.h"
+
+namespace NetMovementRateInternal
+{
+	const TCHAR* GetTierName(FNetMovementRate::ETier Tier)
+	{
+		switch (Tier)
+		{
+		case FNetMovementRate::ETier::Near:
+			return TEXT("Near");
+		case FNetMovementRate::ETier::Mid:
+			return TEXT("Mid");
+		case FNetMovementRate::ETier::Far:
+			return TEXT("Far");
+		default:
+			ensureAlwaysMsgf(false, TEXT("不正な段階です"));
+			return TEXT("Invalid");
+		}
+	}
+}
+
+void FNetMovementRate::Update(float DeltaTime, UWorld& World, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters)
+{
+	TimeUntilUpdate -= DeltaTime;
+	if (!bEnabled || TimeUntilUpdate > 0.0f)
+	{
+		return;
+	}
+	TimeUntilUpdate = UpdateInterval;
+
+	// 専用サーバーでは視点がないので、各プレイヤーのポーンの位置を使う
+	Viewers.Reset();
+	for (FConstPlayerControllerIterator It = World.GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (PlayerController != nullptr && PlayerController->GetPawn() != nullptr)
+		{
+			Viewers.Emplace(PlayerController->GetPawn()->GetActorLocation(), PlayerController->GetPawn());
+		}
+	}
+
+	FMemory::Memzero(TierCounts);
+
+	for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& WeakCharacter : Characters)
+	{
+		AUnrealSandBoxCharacter* Character = WeakCharacter.Get();
+		if (Character == nullptr)
+		{
+			continue;
+		}
+
+		const ETier Tier = ComputeTier(*Character);
+		++TierCounts[static_cast<int32>(Tier)];
+
+		ETier* CurrentTier = CurrentTiers.Find(Character);
+		if (CurrentTier == nullptr || *CurrentTier != Tier)
+		{
+			Apply(*Character, Tier);
+			CurrentTiers.Add(Character, Tier);
+		}
+	}
+
+	// 削除されたキャラクターを取り除く
+	for (auto It = CurrentTiers.CreateIterator(); It; ++It)
+	{
+		if (It.Key().ResolveObjectPtr() == nullptr)
+		{
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void FNetMovementRate::SetEnabled(bool bInEnabled, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters)
+{
+	bEnabled = bInEnabled;
+	if (!bEnabled)
+	{
+		for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& WeakCharacter : Characters)
+		{
+			if (AUnrealSandBoxCharacter* Character = WeakCharacter.Get())
+			{
+				Apply(*Character, ETier::Near);
+			}
+		}
+		CurrentTiers.Reset();
+		FMemory::Memzero(TierCounts);
+	}
+	TimeUntilUpdate = 0.0f;
+}
+
+void FNetMovementRate::DumpReport() const
+{
+	UE_LOG(LogTemp, Log, TEXT("NetMovementRate Enabled:%d"), bEnabled);
+	for (int32 TierIndex = 0; TierIndex < static_cast<int32>(ETier::Num); ++TierIndex)
+	{
+		const ETier Tier = static_cast<ETier>(TierIndex);
+		const float Frequency = Tier == ETier::Mid ? MidNetUpdateFrequency : Tier == ETier::Far ? FarNetUpdateFrequency : 0.0f;
+		UE_LOG(LogTemp, Log, TEXT("  %-4s Characters:%4d NetUpdateFrequency:%s"),
+			NetMovementRateInternal::GetTierName(Tier), TierCounts[TierIndex], Frequency > 0.0f ? *FString::SanitizeFloat(Frequency) : TEXT("Default"));
+	}
+}
+
+FNetMovementRate::ETier FNetMovementRate::ComputeTier(const AUnrealSandBoxCharacter& Character) const
+{
+	const FVector Location = Character.GetActorLocation();
+	float MinDistanceSq = MAX_FLT;
+	for (const TPair<FVector, const APawn*>& Viewer : Viewers)
+	{
+		// 自分のポーンは自分のクライアントへ別経路で補正が送られるので距離に含めない
+		if (Viewer.Value != &Character)
+		{
+			MinDistanceSq = FMath::Min(MinDistanceSq, FVector::DistSquared(Viewer.Key, Location));
+		}
+	}
+
+	if (MinDistanceSq < FMath::Square(NearDistance))
+	{
+		return ETier::Near;
+	}
+	else if (MinDistanceSq < FMath::Square(MidDistance))
+	{
+		return ETier::Mid;
+	}
+	return ETier::Far;
+}
+
+void FNetMovementRate::Apply(AUnrealSandBoxCharacter& Character, ETier Tier) const
+{
+	const AUnrealSandBoxCharacter* Defaults = Character.GetClass()->GetDefaultObject<AUnrealSandBoxCharacter>();
+
+	float Frequency = Defaults->NetUpdateFrequency;
+	if (Tier == ETier::Mid)
+	{
+		Frequency = FMath::Min(Frequency, MidNetUpdateFrequency);
+	}
+	else if (Tier == ETier::Far)
+	{
+		Frequency = FMath::Min(Frequency, FarNetUpdateFrequency);
+	}
+
+	Character.NetUpdateFrequency = Frequency;
+	Character.MinNetUpdateFrequency = FMath::Min(Defaults->MinNetUpdateFrequency, Frequency);
+	USandBoxReplicationGraph::NotifyNetUpdateFrequencyChanged(Character);
+}
@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/ObjectKey.h"
+
+class APawn;
+class AUnrealSandBoxCharacter;
+
+/**
+ * @brief サーバーでキャラクターの送信頻度を最寄りのプレイヤーからの距離で切り替えるクラス
+ *		　自分以外で最も近いプレイヤーのポーンとの距離でNear/Mid/Farに分け、NetUpdateFrequencyを設定します。
+ *		　遠くのキャラクターは更新が少なくなりますが、シミュレートプロキシ側のスムージングで補間されます。
+ */
+class FNetMovementRate final
+{
+public:
+
+	/**
+	 * @brief 距離の段階
+	 */
+	enum class ETier : uint8
+	{
+		Near,
+		Mid,
+		Far,
+
+		Num
+	};
+
+	/**
+	 * @brief 一定間隔で段階を再計算し、変化したキャラクターに送信頻度を設定します
+	 *		　サーバー(リッスンサーバー含む)でのみ呼び出します
+	 */
+	void Update(float DeltaTime, UWorld& World, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters);
+
+	/**
+	 * @brief 有効/無効を切り替えます。無効にすると全キャラクターをデフォルトの送信頻度に戻します
+	 */
+	void SetEnabled(bool bInEnabled, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters);
+
+	bool IsEnabled() const { return bEnabled; }
+
+	/**
+	 * @brief 段階ごとのキャラクター数と送信頻度をログに出力します
+	 */
+	void DumpReport() const;
+
+	// これより近ければNear。デフォルトの送信頻度のまま
+	float NearDistance = 2000.0f;
+
+	// これより近ければMid。遠ければFar
+	float MidDistance = 5000.0f;
+
+	// Midの送信頻度(回/秒)
+	float MidNetUpdateFrequency = 20.0f;
+
+	// Farの送信頻度(回/秒)
+	float FarNetUpdateFrequency = 5.0f;
+
+	// 段階の再計算間隔(秒)
+	float UpdateInterval = 0.5f;
+
+private:
+	ETier ComputeTier(const AUnrealSandBoxCharacter& Character) const;
+	void Apply(AUnrealSandBoxCharacter& Character, ETier Tier) const;
+
+	TMap<TObjectKey<AUnrealSandBoxCharacter>, ETier> CurrentTiers;
+	int32 TierCounts[static_cast<int32>(ETier::Num)] = {};
+
+	// プレイヤーのポーンの位置とポーン
+	TArray<TPair<FVector, const APawn*>> Viewers;
+
+	bool bEnabled = true;
+	float TimeUntilUpdate = 0.0f;
+};
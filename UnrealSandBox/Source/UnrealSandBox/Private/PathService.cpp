@@ -0,0 +1,309 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PathService.h"
+#include "NavigationData.h"
+#include "NavigationSystem.h"
+
+FPathService::FPathService(UWorld* InWorld)
+	: World(InWorld)
+{
+	Stats.StartSec = FPlatformTime::Seconds();
+}
+
+FPathService::~FPathService()
+{
+	if (NavigationDirtyHandle.IsValid())
+	{
+		UNavigationSystemV1::NavigationDirtyEvent.Remove(NavigationDirtyHandle);
+	}
+}
+
+void FPathService::RequestPath(const FVector& Start, const FVector& Goal, FOnPathFound OnFound)
+{
+	++Stats.NumRequests;
+
+	FWaiter Waiter{Start, Goal, FPlatformTime::Seconds(), MoveTemp(OnFound)};
+	const FCellKey Key = MakeKey(Start, Goal);
+
+	// キャッシュにあっても他の要求と同じくTickで返す
+	if (bUseCache)
+	{
+		if (const FCacheEntry* Entry = Cache.Find(Key))
+		{
+			++Stats.NumCacheHits;
+			Complete(MoveTemp(Waiter), *Entry, true);
+			return;
+		}
+	}
+
+	// 同じセルの探索が待機中か探索中であれば相乗りする
+	TArray<FWaiter>* CellWaiters = Waiters.Find(Key);
+	if (CellWaiters != nullptr)
+	{
+		++Stats.NumJoined;
+		CellWaiters->Add(MoveTemp(Waiter));
+		return;
+	}
+
+	Waiters.Add(Key).Add(MoveTemp(Waiter));
+	Queue.Add(Key);
+	Stats.MaxQueued = FMath::Max(Stats.MaxQueued, Queue.Num() - QueueHead);
+}
+
+void FPathService::Tick()
+{
+	SubmitQueries();
+
+	// コールバック内で要求されたものは次のTickで返す
+	Swap(ReadyResults, DeliveringResults);
+	const double NowSec = FPlatformTime::Seconds();
+	for (FReadyResult& Ready : DeliveringResults)
+	{
+		Ready.Result.LatencyMs = (NowSec - Ready.RequestSec) * 1000.0;
+		++Stats.NumCompleted;
+		Stats.TotalLatencyMs += Ready.Result.LatencyMs;
+		Stats.MaxLatencyMs = FMath::Max(Stats.MaxLatencyMs, Ready.Result.LatencyMs);
+		++Stats.LatencyBuckets[GetLatencyBucketIndex(static_cast<uint64>(Ready.Result.LatencyMs * 1000.0))];
+		if (Ready.OnFound)
+		{
+			Ready.OnFound(Ready.Result);
+		}
+	}
+	DeliveringResults.Reset();
+}
+
+void FPathService::InvalidateCache()
+{
+	Cache.Reset();
+	CacheOrder.Reset();
+	CacheOrderHead = 0;
+	++CacheEpoch;
+}
+
+void FPathService::ResetStats()
+{
+	Stats = FStats();
+	Stats.StartSec = FPlatformTime::Seconds();
+}
+
+void FPathService::DumpStats(const TCHAR* Label) const
+{
+	const double ElapsedSec = FMath::Max(FPlatformTime::Seconds() - Stats.StartSec, SMALL_NUMBER);
+	const int32 NumCompleted = Stats.NumCompleted;
+
+	UE_LOG(LogTemp, Log, TEXT("%s Requests:%d Completed:%d PathsPerSec:%.1f NavQueries:%d NavQueriesPerSec:%.1f CacheHits:%d Joined:%d Succeeded:%d Failed:%d MaxQueued:%d CacheEntries:%d"),
+		Label, Stats.NumRequests, NumCompleted, NumCompleted / ElapsedSec, Stats.NumNavQueries, Stats.NumNavQueries / ElapsedSec,
+		Stats.NumCacheHits, Stats.NumJoined, Stats.NumSucceeded, Stats.NumFailed, Stats.MaxQueued, Cache.Num());
+	if (NumCompleted > 0)
+	{
+		UE_LOG(LogTemp, Log, TEXT("  LatencyMs Avg:%.2f P50:%.2f P95:%.2f Max:%.2f"),
+			Stats.TotalLatencyMs / NumCompleted, GetLatencyPercentileMs(0.5), GetLatencyPercentileMs(0.95), Stats.MaxLatencyMs);
+	}
+}
+
+/*static*/
+int32 FPathService::GetLatencyBucketIndex(uint64 LatencyUs)
+{
+	if (LatencyUs < NumLatencyLinearBuckets)
+	{
+		return static_cast<int32>(LatencyUs);
+	}
+
+	// 最上位ビットの位置と、その下の3ビットで分ける。範囲を超えたものは最後のバケットに入れる
+	const int32 Exponent = FMath::Min(static_cast<int32>(FMath::FloorLog2_64(LatencyUs)), 31);
+	const int32 SubBucket = static_cast<int32>((LatencyUs >> (Exponent - 3)) & (NumLatencySubBuckets - 1));
+	return FMath::Min(NumLatencyLinearBuckets + (Exponent - 4) * NumLatencySubBuckets + SubBucket, NumLatencyBuckets - 1);
+}
+
+/*static*/
+uint64 FPathService::GetLatencyBucketUpperBound(int32 BucketIndex)
+{
+	if (BucketIndex < NumLatencyLinearBuckets)
+	{
+		return BucketIndex;
+	}
+
+	const int32 Exponent = 4 + (BucketIndex - NumLatencyLinearBuckets) / NumLatencySubBuckets;
+	const uint64 SubBucket = (BucketIndex - NumLatencyLinearBuckets) % NumLatencySubBuckets;
+	const uint64 Lower = (NumLatencySubBuckets + SubBucket) << (Exponent - 3);
+	return Lower + (1ull << (Exponent - 3)) - 1;
+}
+
+double FPathService::GetLatencyPercentileMs(double Percentile) const
+{
+	const uint64 Target = FMath::Max<uint64>(static_cast<uint64>(FMath::CeilToDouble(Stats.NumCompleted * Percentile)), 1);
+	uint64 Count = 0;
+	for (int32 BucketIndex = 0; BucketIndex < NumLatencyBuckets; ++BucketIndex)
+	{
+		Count += Stats.LatencyBuckets[BucketIndex];
+		if (Count >= Target)
+		{
+			// バケットの上限は実際の最大を超えることがある
+			return FMath::Min(GetLatencyBucketUpperBound(BucketIndex) / 1000.0, Stats.MaxLatencyMs);
+		}
+	}
+	return Stats.MaxLatencyMs;
+}
+
+bool FPathService::HasNavigationData() const
+{
+	UNavigationSystemV1* NavSys = GetNavigationSystem();
+	return NavSys != nullptr && NavSys->GetDefaultNavDataInstance(FNavigationSystem::DontCreate) != nullptr;
+}
+
+FPathService::FCellKey FPathService::MakeKey(const FVector& Start, const FVector& Goal) const
+{
+	const auto Quantize = [this](const FVector& Location)
+	{
+		return FIntVector(FMath::FloorToInt(Location.X / CellSize), FMath::FloorToInt(Location.Y / CellSize), FMath::FloorToInt(Location.Z / CellSize));
+	};
+	return FCellKey{Quantize(Start), Quantize(Goal)};
+}
+
+UNavigationSystemV1* FPathService::GetNavigationSystem() const
+{
+	return FNavigationSystem::GetCurrent<UNavigationSystemV1>(World.Get());
+}
+
+void FPathService::SubmitQueries()
+{
+	UNavigationSystemV1* NavSys = GetNavigationSystem();
+	if (NavSys == nullptr)
+	{
+		return;
+	}
+
+	// コンストラクタではAsSharedが使えないので最初に使うときに登録する
+	if (!NavigationDirtyHandle.IsValid())
+	{
+		NavigationDirtyHandle = UNavigationSystemV1::NavigationDirtyEvent.AddSP(this, &FPathService::HandleNavigationDirty);
+	}
+
+	const ANavigationData* NavData = NavSys->GetDefaultNavDataInstance(FNavigationSystem::DontCreate);
+
+	int32 NumSubmitted = 0;
+	while (QueueHead < Queue.Num() && NumSubmitted < MaxQueriesPerFrame)
+	{
+		const FCellKey Key = Queue[QueueHead++];
+		TArray<FWaiter>* CellWaiters = Waiters.Find(Key);
+		if (CellWaiters == nullptr || CellWaiters->Num() == 0)
+		{
+			continue;
+		}
+
+		// セルの代表として最初の要求の位置で探索する
+		const FWaiter& First = (*CellWaiters)[0];
+		uint32 QueryId = INVALID_NAVQUERYID;
+		if (NavData != nullptr)
+		{
+			FPathFindingQuery Query(nullptr, *NavData, First.Start, First.Goal, NavData->GetDefaultQueryFilter());
+			QueryId = NavSys->FindPathAsync(NavData->GetConfig(), Query, FNavPathQueryDelegate::CreateSP(this, &FPathService::HandlePathFound), EPathFindingMode::Regular);
+		}
+
+		if (QueryId == INVALID_NAVQUERYID)
+		{
+			// ナビメッシュがない場合は失敗として返す
+			FCacheEntry Failed{nullptr, false, false};
+			TArray<FWaiter> Failing = MoveTemp(*CellWaiters);
+			Waiters.Remove(Key);
+			for (FWaiter& Waiter : Failing)
+			{
+				Complete(MoveTemp(Waiter), Failed, false);
+			}
+			continue;
+		}
+
+		InFlightQueries.Add(QueryId, FInFlightQuery{Key, CacheEpoch});
+		++Stats.NumNavQueries;
+		++NumSubmitted;
+	}
+
+	if (QueueHead > 0 && QueueHead * 2 >= Queue.Num())
+	{
+		Queue.RemoveAt(0, QueueHead, false);
+		QueueHead = 0;
+	}
+}
+
+void FPathService::HandlePathFound(uint32 QueryId, ENavigationQueryResult::Type Result, FNavPathSharedPtr Path)
+{
+	FInFlightQuery InFlight;
+	if (!InFlightQueries.RemoveAndCopyValue(QueryId, InFlight))
+	{
+		return;
+	}
+
+	FCacheEntry Entry{nullptr, false, false};
+	if (Result == ENavigationQueryResult::Success && Path.IsValid() && Path->IsValid())
+	{
+		TSharedRef<TArray<FVector>> Points = MakeShared<TArray<FVector>>();
+		Points->Reserve(Path->GetPathPoints().Num());
+		for (const FNavPathPoint& PathPoint : Path->GetPathPoints())
+		{
+			Points->Add(PathPoint.Location);
+		}
+		Entry.Points = Points;
+		Entry.bSuccess = true;
+		Entry.bPartial = Path->IsPartial();
+	}
+
+	// 探索中にナビメッシュが変更された結果と、再生成が終わるまでの結果はキャッシュしない
+	const UNavigationSystemV1* NavSys = GetNavigationSystem();
+	const bool bNavigationStable = InFlight.CacheEpoch == CacheEpoch && NavSys != nullptr && !NavSys->IsNavigationBuildInProgress();
+	if (bUseCache && bNavigationStable)
+	{
+		AddToCache(InFlight.Key, Entry);
+	}
+
+	TArray<FWaiter> CellWaiters;
+	if (Waiters.RemoveAndCopyValue(InFlight.Key, CellWaiters))
+	{
+		for (FWaiter& Waiter : CellWaiters)
+		{
+			Complete(MoveTemp(Waiter), Entry, false);
+		}
+	}
+}
+
+void FPathService::HandleNavigationDirty(const FBox& DirtyBounds)
+{
+	InvalidateCache();
+}
+
+void FPathService::AddToCache(const FCellKey& Key, const FCacheEntry& Entry)
+{
+	Cache.Add(Key, Entry);
+	CacheOrder.Add(Key);
+
+	while (Cache.Num() > MaxCacheEntries && CacheOrderHead < CacheOrder.Num())
+	{
+		Cache.Remove(CacheOrder[CacheOrderHead++]);
+	}
+
+	if (CacheOrderHead > 0 && CacheOrderHead * 2 >= CacheOrder.Num())
+	{
+		CacheOrder.RemoveAt(0, CacheOrderHead, false);
+		CacheOrderHead = 0;
+	}
+}
+
+void FPathService::Complete(FWaiter&& Waiter, const FCacheEntry& Entry, bool bFromCache)
+{
+	FReadyResult& Ready = ReadyResults.AddDefaulted_GetRef();
+	Ready.OnFound = MoveTemp(Waiter.OnFound);
+	Ready.Result.bSuccess = Entry.bSuccess;
+	Ready.Result.bPartial = Entry.bPartial;
+	Ready.Result.bFromCache = bFromCache;
+	Ready.Result.Points = Entry.Points;
+	Ready.RequestSec = Waiter.RequestSec;
+
+	if (Entry.bSuccess)
+	{
+		++Stats.NumSucceeded;
+	}
+	else
+	{
+		++Stats.NumFailed;
+	}
+}
@@ -0,0 +1,182 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "AI/Navigation/NavigationTypes.h"
+
+class UNavigationSystemV1;
+
+/**
+ * @brief 多数のボットからの経路探索要求をまとめて処理するクラス
+ *		　要求は開始・目標位置をセル単位に量子化したキーでまとめ、同じキーの要求は1回の探索に相乗りさせます。
+ *		　探索はナビゲーションシステムの非同期クエリとして発行し、1フレーム分のクエリがワーカースレッドでまとめて処理されます。
+ *		　結果はキャッシュし、ナビメッシュに変更があったときに破棄します。再生成中の結果はキャッシュしません。
+ *		　完了コールバックは全てTick内(ゲームスレッド)で呼び出されます。
+ */
+class FPathService final : public TSharedFromThis<FPathService>
+{
+public:
+	/**
+	 * @brief 経路探索の結果
+	 */
+	struct FPathResult
+	{
+		// 経路が見つかったか
+		bool bSuccess = false;
+
+		// 目標まで届かない部分的な経路か
+		bool bPartial = false;
+
+		// キャッシュから取得したか
+		bool bFromCache = false;
+
+		// 経路の点。同じセルの要求で共有するため、始点と終点は要求した位置と最大でセルの大きさ分ずれます
+		TSharedPtr<const TArray<FVector>> Points;
+
+		// 要求からコールバックまでの時間。キャッシュから返す場合も次のTickまで待つ分を含みます
+		double LatencyMs = 0.0;
+	};
+
+	using FOnPathFound = TFunction<void(const FPathResult&)>;
+
+	explicit FPathService(UWorld* InWorld);
+	~FPathService();
+
+	/**
+	 * @brief 経路探索を要求します
+	 * @param Start 開始位置
+	 * @param Goal 目標位置
+	 * @param OnFound 完了時にゲームスレッドで呼び出す処理
+	 */
+	void RequestPath(const FVector& Start, const FVector& Goal, FOnPathFound OnFound);
+
+	/**
+	 * @brief 毎フレーム呼び出します。待機中の要求の発行と完了したコールバックの呼び出しを行います
+	 */
+	void Tick();
+
+	/**
+	 * @brief キャッシュを破棄します。探索中の結果もキャッシュされなくなります
+	 */
+	void InvalidateCache();
+
+	void ResetStats();
+	void DumpStats(const TCHAR* Label) const;
+
+	/**
+	 * @brief 経路探索に使うナビゲーションデータがあるか
+	 */
+	bool HasNavigationData() const;
+
+	// 開始・目標位置を量子化するセルの大きさ
+	float CellSize = 100.0f;
+
+	// 1フレームに発行する探索の上限
+	int32 MaxQueriesPerFrame = 64;
+
+	// キャッシュする経路数の上限。超えたら古いものから破棄する
+	int32 MaxCacheEntries = 4096;
+
+	// キャッシュを使用するか
+	bool bUseCache = true;
+
+private:
+	/**
+	 * @brief 量子化した開始・目標セル
+	 */
+	struct FCellKey
+	{
+		FIntVector Start;
+		FIntVector Goal;
+
+		bool operator==(const FCellKey& Other) const { return Start == Other.Start && Goal == Other.Goal; }
+		friend uint32 GetTypeHash(const FCellKey& Key) { return HashCombine(GetTypeHash(Key.Start), GetTypeHash(Key.Goal)); }
+	};
+
+	struct FWaiter
+	{
+		FVector Start;
+		FVector Goal;
+		double RequestSec;
+		FOnPathFound OnFound;
+	};
+
+	struct FCacheEntry
+	{
+		TSharedPtr<const TArray<FVector>> Points;
+		bool bSuccess;
+		bool bPartial;
+	};
+
+	struct FInFlightQuery
+	{
+		FCellKey Key;
+		uint32 CacheEpoch;
+	};
+
+	struct FReadyResult
+	{
+		FOnPathFound OnFound;
+		FPathResult Result;
+		double RequestSec;
+	};
+
+	// 待ち時間(マイクロ秒)のヒストグラム。16未満はそのまま、16以上は2のべき乗ごとに8分割する。約70分までを区別できる
+	static constexpr int32 NumLatencyLinearBuckets = 16;
+	static constexpr int32 NumLatencySubBuckets = 8;
+	static constexpr int32 NumLatencyBuckets = NumLatencyLinearBuckets + (32 - 4) * NumLatencySubBuckets;
+
+	struct FStats
+	{
+		int32 NumRequests = 0;
+		int32 NumCacheHits = 0;
+		int32 NumJoined = 0;
+		int32 NumNavQueries = 0;
+		int32 NumSucceeded = 0;
+		int32 NumFailed = 0;
+		int32 MaxQueued = 0;
+		double StartSec = 0.0;
+		// 長時間計測しても増えないよう、個々の待ち時間は残さずヒストグラムに積む
+		int32 NumCompleted = 0;
+		double TotalLatencyMs = 0.0;
+		double MaxLatencyMs = 0.0;
+		uint32 LatencyBuckets[NumLatencyBuckets] = {};
+	};
+
+	static int32 GetLatencyBucketIndex(uint64 LatencyUs);
+	static uint64 GetLatencyBucketUpperBound(int32 BucketIndex);
+	double GetLatencyPercentileMs(double Percentile) const;
+
+	FCellKey MakeKey(const FVector& Start, const FVector& Goal) const;
+	UNavigationSystemV1* GetNavigationSystem() const;
+	void SubmitQueries();
+	void HandlePathFound(uint32 QueryId, ENavigationQueryResult::Type Result, FNavPathSharedPtr Path);
+	void HandleNavigationDirty(const FBox& DirtyBounds);
+	void AddToCache(const FCellKey& Key, const FCacheEntry& Entry);
+	void Complete(FWaiter&& Waiter, const FCacheEntry& Entry, bool bFromCache);
+
+	TWeakObjectPtr<UWorld> World;
+	FDelegateHandle NavigationDirtyHandle;
+
+	// セルごとの待機中の要求。探索の発行前と探索中の両方を含む
+	TMap<FCellKey, TArray<FWaiter>> Waiters;
+
+	// 未発行のセル
+	TArray<FCellKey> Queue;
+	int32 QueueHead = 0;
+
+	// 探索中のクエリ
+	TMap<uint32, FInFlightQuery> InFlightQueries;
+
+	// コールバック待ちの結果
+	TArray<FReadyResult> ReadyResults;
+	TArray<FReadyResult> DeliveringResults;
+
+	TMap<FCellKey, FCacheEntry> Cache;
+	TArray<FCellKey> CacheOrder;
+	int32 CacheOrderHead = 0;
+	uint32 CacheEpoch = 0;
+
+	FStats Stats;
+};
@@ -0,0 +1,151 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PawnPool.h"
+#include "Engine/World.h"
+#include "UnrealSandBox/UnrealSandBoxCharacter.h"
+
+FPawnPool::FPawnPool(UWorld* InWorld, UClass* InCharacterClass)
+	: World(InWorld)
+	, CharacterClass(InCharacterClass)
+{
+	ensureAlwaysMsgf(InCharacterClass != nullptr && InCharacterClass->IsChildOf(AUnrealSandBoxCharacter::StaticClass()), TEXT("AUnrealSandBoxCharacterのクラスを指定してください"));
+}
+
+void FPawnPool::Prewarm(int32 Count)
+{
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	SpawnParameters.ObjectFlags |= RF_Transient;
+
+	Available.Reserve(Count);
+	while (Available.Num() < Count)
+	{
+		// 待機中は非表示でコリジョンも無効なので、位置は重なっていても問題ない
+		AUnrealSandBoxCharacter* Character = Spawn(FTransform::Identity, SpawnParameters);
+		if (Character == nullptr)
+		{
+			break;
+		}
+		Character->DeactivateForPool();
+		Available.Add(Character);
+	}
+	UpdateMemoryUsage();
+}
+
+AUnrealSandBoxCharacter* FPawnPool::Acquire(const FTransform& SpawnTransform, const FActorSpawnParameters& SpawnParameters)
+{
+	const double StartSec = FPlatformTime::Seconds();
+
+	ESpawnActorCollisionHandlingMethod CollisionHandling = SpawnParameters.SpawnCollisionHandlingOverride;
+	if (CollisionHandling == ESpawnActorCollisionHandlingMethod::Undefined && CharacterClass.IsValid())
+	{
+		CollisionHandling = CharacterClass->GetDefaultObject<AActor>()->SpawnCollisionHandlingMethod;
+	}
+	const bool bAlwaysPlace = CollisionHandling == ESpawnActorCollisionHandlingMethod::AlwaysSpawn || CollisionHandling == ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+
+	while (Available.Num() > 0)
+	{
+		AUnrealSandBoxCharacter* Character = Available.Pop(false).Get();
+		if (Character == nullptr || Character->IsPendingKill())
+		{
+			// プール外で破棄されたものは捨てる
+			continue;
+		}
+
+		// 生成時と同じく、重なる場合はずらして配置し、それでも無理なら指定に応じて重なったまま置くか諦める
+		const bool bPlaced = Character->ActivateFromPool(SpawnTransform, CollisionHandling == ESpawnActorCollisionHandlingMethod::AlwaysSpawn)
+			|| (bAlwaysPlace && Character->ActivateFromPool(SpawnTransform, true));
+		if (!bPlaced)
+		{
+			Available.Add(Character);
+			UpdateMemoryUsage();
+			return nullptr;
+		}
+
+		RecordTime(StartSec, Stats.Hits, Stats.HitTotalMs, Stats.HitMaxMs);
+		UpdateMemoryUsage();
+		return Character;
+	}
+	UpdateMemoryUsage();
+
+	AUnrealSandBoxCharacter* Character = Spawn(SpawnTransform, SpawnParameters);
+	if (Character != nullptr)
+	{
+		RecordTime(StartSec, Stats.Misses, Stats.MissTotalMs, Stats.MissMaxMs);
+	}
+	return Character;
+}
+
+void FPawnPool::Release(AUnrealSandBoxCharacter* Character)
+{
+	if (!ensureAlwaysMsgf(Character != nullptr && Character->GetController() == nullptr, TEXT("コントローラーに所持されたままのキャラクターは返却できません")))
+	{
+		return;
+	}
+
+	if (Character->IsInPawnPool())
+	{
+		return;
+	}
+
+	Character->DeactivateForPool();
+	Available.Add(Character);
+	++Stats.Releases;
+	UpdateMemoryUsage();
+}
+
+void FPawnPool::Clear()
+{
+	for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& Character : Available)
+	{
+		if (Character.IsValid())
+		{
+			Character->Destroy();
+		}
+	}
+	Available.Reset();
+	UpdateMemoryUsage();
+}
+
+void FPawnPool::DumpStats() const
+{
+	const int32 NumRequests = Stats.Hits + Stats.Misses;
+	UE_LOG(LogTemp, Log, TEXT("PawnPool Class:%s Available:%d Requests:%d Hits:%d Misses:%d HitRate:%.1f%% Releases:%d"),
+		*GetNameSafe(CharacterClass.Get()), Available.Num(), NumRequests, Stats.Hits, Stats.Misses,
+		NumRequests > 0 ? 100.0 * Stats.Hits / NumRequests : 0.0, Stats.Releases);
+	UE_LOG(LogTemp, Log, TEXT("  Hit  AvgMs:%.3f MaxMs:%.3f"), Stats.Hits > 0 ? Stats.HitTotalMs / Stats.Hits : 0.0, Stats.HitMaxMs);
+	UE_LOG(LogTemp, Log, TEXT("  Miss AvgMs:%.3f MaxMs:%.3f"), Stats.Misses > 0 ? Stats.MissTotalMs / Stats.Misses : 0.0, Stats.MissMaxMs);
+}
+
+AUnrealSandBoxCharacter* FPawnPool::Spawn(const FTransform& SpawnTransform, const FActorSpawnParameters& SpawnParameters)
+{
+	UWorld* SpawnWorld = World.Get();
+	if (SpawnWorld == nullptr || !CharacterClass.IsValid())
+	{
+		return nullptr;
+	}
+	return SpawnWorld->SpawnActor<AUnrealSandBoxCharacter>(CharacterClass.Get(), SpawnTransform, SpawnParameters);
+}
+
+void FPawnPool::RecordTime(double StartSec, int32& Count, double& TotalMs, double& MaxMs)
+{
+	const double ElapsedMs = (FPlatformTime::Seconds() - StartSec) * 1000.0;
+	++Count;
+	TotalMs += ElapsedMs;
+	MaxMs = FMath::Max(MaxMs, ElapsedMs);
+}
+
+void FPawnPool::UpdateMemoryUsage()
+{
+	if (PooledCharacterBytes == 0 && Available.Num() > 0 && Available.Last().IsValid())
+	{
+		const AUnrealSandBoxCharacter* Character = Available.Last().Get();
+		PooledCharacterBytes = FSandBoxMemoryTracker::GetObjectAllocatedSize(*Character);
+		Character->ForEachComponent(false, [this](const UActorComponent* Component)
+		{
+			PooledCharacterBytes += FSandBoxMemoryTracker::GetObjectAllocatedSize(*Component);
+		});
+	}
+	MemoryUsage.Set(Available.GetAllocatedSize() + Available.Num() * PooledCharacterBytes);
+}
@@ -0,0 +1,100 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SandBoxMemoryTracker.h"
+
+class AUnrealSandBoxCharacter;
+
+/**
+ * @brief キャラクターを破棄せずに使い回すためのプール
+ *		　返却されたキャラクターは非表示・コリジョン無効・Tick停止の状態で待機し、
+ *		　取得時に指定位置へテレポートして再度有効にします。
+ *		　カプセル・メッシュ・カメラなどのコンポーネント生成と、破棄によるGCの負荷を避けられます。
+ */
+class FPawnPool final
+{
+public:
+	/**
+	 * @brief プールの統計情報
+	 */
+	struct FStats
+	{
+		// プールから取得できた回数
+		int32 Hits = 0;
+
+		// プールが空で新たに生成した回数
+		int32 Misses = 0;
+
+		// プールに返却された回数
+		int32 Releases = 0;
+
+		// 取得にかかった時間
+		double HitTotalMs = 0.0;
+		double HitMaxMs = 0.0;
+		double MissTotalMs = 0.0;
+		double MissMaxMs = 0.0;
+	};
+
+	/**
+	 * @param InWorld キャラクターを生成するワールド
+	 * @param InCharacterClass プールするキャラクターのクラス
+	 */
+	FPawnPool(UWorld* InWorld, UClass* InCharacterClass);
+
+	/**
+	 * @brief 待機状態のキャラクターが指定数になるまで生成しておきます
+	 */
+	void Prewarm(int32 Count);
+
+	/**
+	 * @brief キャラクターを取得します。プールが空であれば生成します
+	 * @param SpawnTransform 配置する位置と向き
+	 * @param SpawnParameters 生成する場合のパラメーター
+	 * @return 配置できなかった場合はnullptr
+	 */
+	AUnrealSandBoxCharacter* Acquire(const FTransform& SpawnTransform, const struct FActorSpawnParameters& SpawnParameters);
+
+	/**
+	 * @brief キャラクターをプールに返却します。コントローラーの所持は呼び出し側で解除してください
+	 */
+	void Release(AUnrealSandBoxCharacter* Character);
+
+	/**
+	 * @brief 待機中のキャラクターを全て破棄します
+	 */
+	void Clear();
+
+	/**
+	 * @brief 統計情報をリセットします
+	 */
+	void ResetStats() { Stats = FStats(); }
+
+	/**
+	 * @brief 統計情報をログに出力します
+	 */
+	void DumpStats() const;
+
+	UClass* GetCharacterClass() const { return CharacterClass.Get(); }
+	int32 GetNumAvailable() const { return Available.Num(); }
+	const FStats& GetStats() const { return Stats; }
+
+private:
+	AUnrealSandBoxCharacter* Spawn(const FTransform& SpawnTransform, const FActorSpawnParameters& SpawnParameters);
+	static void RecordTime(double StartSec, int32& Count, double& TotalMs, double& MaxMs);
+
+	/**
+	 * @brief 待機中のキャラクターとその配列の使用量を報告します。Availableを変更したら呼び出します
+	 */
+	void UpdateMemoryUsage();
+
+	TWeakObjectPtr<UWorld> World;
+	TWeakObjectPtr<UClass> CharacterClass;
+	TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>> Available;
+	FStats Stats;
+
+	// 待機中のキャラクター1体とそのコンポーネントの使用量。同じクラスなので最初に返却されたキャラクターで測る
+	SIZE_T PooledCharacterBytes = 0;
+	FSandBoxMemoryUsage MemoryUsage{ESandBoxMemoryTag::PawnPool};
+};
@@ -2,7 +2,22 @@
 
 
 #include "SampleSubSystem.h"
+#include "AssetPreloader.h"
 #include "AsyncSample.h"
+#include "CharacterSpatialHash.h"
+#include "JobScheduler.h"
+#include "LoadGenerator.h"
+#include "PawnPool.h"
+#include "RenderCore.h"
+#include "SandBoxBotDriver.h"
+#include "SandBoxCommandRegistry.h"
+#include "SandBoxFrameAllocator.h"
+#include "SandBoxScopedTimer.h"
+#include "SandBoxTelemetry.h"
+#include "SandBoxWorldSubSystem.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "UnrealSandBox/UnrealSandBoxGameMode.h"
 
 //---------------------------------------------------------------------------------
 // SampleSubSystem
@@ -14,7 +29,32 @@ TStatId USampleSubSystem::GetStatId() const
 
 void USampleSubSystem::Tick(float DeltaTime)
 {
+	// 各機能の処理より先にフレームを進め、2フレーム前の一時データを捨てる
+	FSandBoxFrameAllocator::Get().BeginFrame();
+
+	SANDBOX_LLM_SCOPE(ESandBoxMemoryTag::SampleSubSystem);
+	FSandBoxMemoryTracker::Tick(DeltaTime);
+
 	AsyncSample->Update(DeltaTime);
+	LoadGenerator->Tick(DeltaTime);
+	FSandBoxCommandRegistry::Get().Tick();
+	FSandBoxScopedTimers::Get().Tick();
+	if (BotDriver.IsValid())
+	{
+		BotDriver->Tick(DeltaTime, *GetGameInstance());
+	}
+
+	if (!bFirstControllableFrameReported)
+	{
+		ReportFirstControllableFrame();
+	}
+
+	if (Telemetry.IsValid())
+	{
+		PublishTelemetry(DeltaTime);
+	}
+
+	UpdateMemoryUsage();
 }
 
 bool USampleSubSystem::IsTickable() const
@@ -27,6 +67,11 @@ ETickableTickType USampleSubSystem::GetTickableTickType() const
 	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
 }
 
+FSandBoxFrameAllocator& USampleSubSystem::GetFrameAllocator() const
+{
+	return FSandBoxFrameAllocator::Get();
+}
+
 void USampleSubSystem::StartAutoDeleteAsyncSample(float WaitSec)
 {
 	AsyncSample->StartAutoDeleteAsync(WaitSec);
@@ -52,9 +97,162 @@ void USampleSubSystem::CheckAsyncCrash()
 	AsyncSample->CheckCrash();
 }
 
+void USampleSubSystem::CheckSchedulerBehaviour()
+{
+	AsyncSample->CheckSchedulerBehaviour(*JobScheduler);
+}
+
+void USampleSubSystem::StartSchedulerLoad(int32 NumBulkJobs, int32 NumCriticalJobs, float DeadlineMs, int32 NumFrames)
+{
+	AsyncSample->StartSchedulerLoad(*JobScheduler, NumBulkJobs, NumCriticalJobs, DeadlineMs, NumFrames);
+}
+
+void USampleSubSystem::StartCachedGeneration(int32 NumRequests, int32 NumSeeds)
+{
+	AsyncSample->StartCachedGeneration(*JobScheduler, NumRequests, NumSeeds);
+}
+
+void USampleSubSystem::DumpResultCache() const
+{
+	AsyncSample->DumpResultCache();
+}
+
+void USampleSubSystem::InvalidateResultCache(TOptional<int32> Seed)
+{
+	AsyncSample->InvalidateResultCache(Seed);
+}
+
 void USampleSubSystem::Initialize(FSubsystemCollectionBase& Collection)
 {
 	Super::Initialize(Collection);
+	SANDBOX_LLM_SCOPE(ESandBoxMemoryTag::SampleSubSystem);
 
 	AsyncSample = MakeShareable(new FAsyncSample());
+	JobScheduler = MakeShareable(new FJobScheduler());
+	FSandBoxCommandRegistry::Get().SetScheduler(JobScheduler.Get());
+
+	// マップのロードより先にデフォルトポーンとその参照アセットの読み込みを始める
+	AssetPreloader = MakeShareable(new FAssetPreloader());
+	AssetPreloader->Start(GetDefault<AUnrealSandBoxGameMode>()->GetPreloadAssetPaths());
+
+	LoadGenerator = MakeShareable(new FLoadGenerator());
+	BotDriver = FSandBoxBotDriver::CreateFromCommandLine();
+	Telemetry = FSandBoxTelemetry::CreateFromCommandLine();
+	FSandBoxScopedTimers::EnableFromCommandLine();
+
+	UpdateMemoryUsage();
+}
+
+void USampleSubSystem::Deinitialize()
+{
+	// 起動したクライアントを残さない
+	LoadGenerator->Stop();
+	Telemetry.Reset();
+
+	// 実行待ちのコマンドを完了させてから外す。PIEで複数のクライアントを起動しているときは後から作られたスケジューラーが使われている
+	if (FSandBoxCommandRegistry::Get().GetScheduler() == JobScheduler.Get())
+	{
+		FSandBoxCommandRegistry::Get().SetScheduler(nullptr);
+	}
+
+	// 残っているジョブはここで実行し終えてからワーカーを止める
+	AsyncSample->ReleaseScheduler();
+	JobScheduler.Reset();
+	MemoryUsage.Set(0);
+	Super::Deinitialize();
+}
+
+void USampleSubSystem::UpdateMemoryUsage()
+{
+	// スケジューラーはワーカースレッドでも変化するが、ロックを取らずに読める値を使う
+	SIZE_T Bytes = sizeof(FAssetPreloader) + sizeof(FLoadGenerator) + LoadGenerator->GetAllocatedSize();
+	if (JobScheduler.IsValid())
+	{
+		Bytes += sizeof(FJobScheduler) + JobScheduler->GetAllocatedSize();
+	}
+	if (BotDriver.IsValid())
+	{
+		Bytes += sizeof(FSandBoxBotDriver);
+	}
+	if (Telemetry.IsValid())
+	{
+		Bytes += sizeof(FSandBoxTelemetry) + Telemetry->GetAllocatedSize();
+	}
+	MemoryUsage.Set(Bytes);
+}
+
+void USampleSubSystem::ReportFirstControllableFrame()
+{
+	const APlayerController* PlayerController = GetGameInstance()->GetFirstLocalPlayerController();
+	if (PlayerController == nullptr || PlayerController->GetPawn() == nullptr || PlayerController->GetPawn()->InputComponent == nullptr)
+	{
+		return;
+	}
+
+	// GStartTimeはプロセス起動時の時刻
+	bFirstControllableFrameReported = true;
+	UE_LOG(LogTemp, Log, TEXT("TimeToFirstControllableFrame Sec:%.3f AssetPreloadCompleted:%d AssetPreloadMs:%.2f"),
+		FPlatformTime::Seconds() - GStartTime, AssetPreloader->IsCompleted(), AssetPreloader->GetElapsedMs());
+
+	// ヘッドレスでの起動時間計測用
+	if (FParse::Param(FCommandLine::Get(), TEXT("ExitAfterFirstControllableFrame")))
+	{
+		FPlatformMisc::RequestExit(false);
+	}
+}
+
+void USampleSubSystem::StartTelemetry(const FString& Name, int32 NumSlots)
+{
+	// 同じ名前の共有メモリを作り直すため、先に解放する
+	Telemetry.Reset();
+	Telemetry = MakeShareable(new FSandBoxTelemetry(Name.IsEmpty() ? FSandBoxTelemetry::GetDefaultName() : Name, NumSlots));
+	if (!Telemetry->IsValid())
+	{
+		Telemetry.Reset();
+	}
+}
+
+void USampleSubSystem::StopTelemetry()
+{
+	if (Telemetry.IsValid())
+	{
+		Telemetry->DumpStats();
+		Telemetry.Reset();
+	}
+}
+
+void USampleSubSystem::PublishTelemetry(float DeltaTime)
+{
+	// 収集から書き込みまでを1フレームあたりの負荷として集計する
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	FSandBoxTelemetrySample Sample;
+	Sample.FrameNumber = GFrameCounter;
+	Sample.TimeSec = FPlatformTime::Seconds();
+	Sample.FrameMs = DeltaTime * 1000.0f;
+	Sample.GameThreadMs = FPlatformTime::ToMilliseconds(GGameThreadTime);
+	Sample.RenderThreadMs = FPlatformTime::ToMilliseconds(GRenderThreadTime);
+	Sample.NumPendingJobs = JobScheduler->GetNumPendingJobs();
+
+	if (const UWorld* World = GetGameInstance()->GetWorld())
+	{
+		// ポーンプールはサーバーにのみある
+		const AUnrealSandBoxGameMode* GameMode = World->GetAuthGameMode<AUnrealSandBoxGameMode>();
+		if (const FPawnPool* Pool = GameMode != nullptr ? GameMode->GetDefaultPawnPool() : nullptr)
+		{
+			const FPawnPool::FStats& PoolStats = Pool->GetStats();
+			Sample.PoolAvailable = Pool->GetNumAvailable();
+			Sample.PoolHits = PoolStats.Hits;
+			Sample.PoolMisses = PoolStats.Misses;
+			Sample.PoolReleases = PoolStats.Releases;
+		}
+
+		const USandBoxWorldSubSystem* WorldSubSystem = World->GetSubsystem<USandBoxWorldSubSystem>();
+		if (const FCharacterSpatialHash* SpatialHash = WorldSubSystem != nullptr ? WorldSubSystem->GetCharacterSpatialHash() : nullptr)
+		{
+			Sample.NumCharacters = SpatialHash->GetGrid().Num();
+		}
+	}
+
+	Telemetry->Publish(Sample, StartCycles);
 }
@@ -3,9 +3,16 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "SandBoxMemoryTracker.h"
 #include "SampleSubSystem.generated.h"
 
+class FAssetPreloader;
 class FAsyncSample;
+class FJobScheduler;
+class FLoadGenerator;
+class FSandBoxBotDriver;
+class FSandBoxFrameAllocator;
+class FSandBoxTelemetry;
 
 /**
  * 色々試す用のサブシステム
@@ -16,6 +23,7 @@ class USampleSubSystem final : public UGameInstanceSubsystem, public FTickableGa
 	GENERATED_BODY()
 public:
 	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
 	virtual TStatId GetStatId() const override;
 	virtual void Tick(float DeltaTime) override;
 	virtual bool IsTickable() const override;
@@ -26,7 +34,75 @@ public:
 	void CheckAsyncTaskBehaviour();
 	void CancelAsyncSample();
 	void CheckAsyncCrash();
+	void CheckSchedulerBehaviour();
+	void StartSchedulerLoad(int32 NumBulkJobs, int32 NumCriticalJobs, float DeadlineMs, int32 NumFrames);
+	void StartCachedGeneration(int32 NumRequests, int32 NumSeeds);
+	void DumpResultCache() const;
+	void InvalidateResultCache(TOptional<int32> Seed);
+
+	/**
+	 * @brief 優先度と締め切りを考慮してバックグラウンドのジョブを実行するスケジューラーを取得します
+	 */
+	FJobScheduler* GetJobScheduler() const { return JobScheduler.Get(); }
+
+	/**
+	 * @brief フレームの間だけ使う一時データ用のアロケーターを取得します
+	 *		　Tickの先頭でフレームを進めるため、確保した領域は次のフレームの終わりまで有効です。
+	 */
+	FSandBoxFrameAllocator& GetFrameAllocator() const;
+
+	/**
+	 * @brief 起動時に開始したアセットのプリロードを取得します
+	 */
+	FAssetPreloader* GetAssetPreloader() const { return AssetPreloader.Get(); }
+
+	/**
+	 * @brief 負荷試験用のクライアントを起動・集計するクラスを取得します
+	 */
+	FLoadGenerator* GetLoadGenerator() const { return LoadGenerator.Get(); }
+
+	/**
+	 * @brief フレームの計測値の共有メモリへの書き出しを開始します。開始済みであれば作り直します
+	 * @param Name 共有メモリの名前。空であればプロセスIDを含む名前
+	 * @param NumSlots リングバッファの要素数
+	 */
+	void StartTelemetry(const FString& Name, int32 NumSlots);
+
+	void StopTelemetry();
+
+	/**
+	 * @brief 計測値を書き出すクラスを取得します。書き出していなければnullptr
+	 */
+	FSandBoxTelemetry* GetTelemetry() const { return Telemetry.Get(); }
 
 private:
+	/**
+	 * @brief ローカルプレイヤーがポーンを操作できるようになった最初のフレームで起動からの時間をログに出力します
+	 */
+	void ReportFirstControllableFrame();
+
+	/**
+	 * @brief 各機能から計測値を集めてTelemetryに書き込みます
+	 */
+	void PublishTelemetry(float DeltaTime);
+
+	/**
+	 * @brief 持っている機能のオブジェクトの使用量を報告します。毎フレーム呼び出します
+	 */
+	void UpdateMemoryUsage();
+
 	TSharedPtr<FAsyncSample> AsyncSample;
+	TSharedPtr<FJobScheduler> JobScheduler;
+	TSharedPtr<FAssetPreloader> AssetPreloader;
+	TSharedPtr<FLoadGenerator> LoadGenerator;
+
+	// -SandBoxBotで起動したときのみ作成する
+	TSharedPtr<FSandBoxBotDriver> BotDriver;
+
+	// -SandBoxTelemetryで起動するかTelemetryStartで開始したときのみ作成する
+	TSharedPtr<FSandBoxTelemetry> Telemetry;
+	bool bFirstControllableFrameReported = false;
+
+	// 持っている機能のオブジェクトの使用量。FAsyncSampleは自分で報告する
+	FSandBoxMemoryUsage MemoryUsage{ESandBoxMemoryTag::SampleSubSystem};
 };
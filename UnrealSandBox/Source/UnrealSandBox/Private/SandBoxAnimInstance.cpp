@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxAnimInstance.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PawnMovementComponent.h"
+
+//---------------------------------------------------------------------------------
+// FSandBoxAnimInstanceProxy
+//---------------------------------------------------------------------------------
+void FSandBoxAnimInstanceProxy::PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds)
+{
+	Super::PreUpdate(InAnimInstance, DeltaSeconds);
+
+	// ゲームスレッドでしか触れないUObjectの値はここでコピーしておく
+	const APawn* Pawn = InAnimInstance->TryGetPawnOwner();
+	if (Pawn != nullptr)
+	{
+		Velocity = Pawn->GetVelocity();
+		ActorRotation = Pawn->GetActorRotation();
+
+		const UPawnMovementComponent* MovementComponent = Pawn->GetMovementComponent();
+		bIsFalling = MovementComponent != nullptr && MovementComponent->IsFalling();
+	}
+	else
+	{
+		Velocity = FVector::ZeroVector;
+		ActorRotation = FRotator::ZeroRotator;
+		bIsFalling = false;
+	}
+}
+
+void FSandBoxAnimInstanceProxy::Update(float DeltaSeconds)
+{
+	Super::Update(DeltaSeconds);
+
+	// ここからはワーカースレッドで実行されるためコピーした値のみ使用する
+	Speed = Velocity.Size();
+	bIsInAir = bIsFalling;
+	bIsRising = bIsFalling && Velocity.Z > 0.0f;
+
+	// UAnimInstance::CalculateDirectionと同じ計算
+	Direction = 0.0f;
+	if (!Velocity.IsNearlyZero())
+	{
+		const FMatrix RotationMatrix = FRotationMatrix(ActorRotation);
+		const FVector ForwardVector = RotationMatrix.GetScaledAxis(EAxis::X);
+		const FVector RightVector = RotationMatrix.GetScaledAxis(EAxis::Y);
+		const FVector NormalizedVelocity = Velocity.GetSafeNormal2D();
+
+		const float ForwardCosAngle = FVector::DotProduct(ForwardVector, NormalizedVelocity);
+		float ForwardDeltaDegree = FMath::RadiansToDegrees(FMath::Acos(FMath::Clamp(ForwardCosAngle, -1.0f, 1.0f)));
+
+		const float RightCosAngle = FVector::DotProduct(RightVector, NormalizedVelocity);
+		if (RightCosAngle < 0.0f)
+		{
+			ForwardDeltaDegree *= -1.0f;
+		}
+		Direction = ForwardDeltaDegree;
+	}
+}
+
+//---------------------------------------------------------------------------------
+// USandBoxAnimInstance
+//---------------------------------------------------------------------------------
+FAnimInstanceProxy* USandBoxAnimInstance::CreateAnimInstanceProxy()
+{
+	// プロキシはメンバーとして持っているので生成しない
+	return &Proxy;
+}
+
+void USandBoxAnimInstance::DestroyAnimInstanceProxy(FAnimInstanceProxy* InProxy)
+{
+	// メンバーなので削除しない
+}
@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/AnimInstanceProxy.h"
+#include "SandBoxAnimInstance.generated.h"
+
+/**
+ * @brief USandBoxAnimInstanceの更新処理を行うプロキシ
+ *		　PreUpdateでゲームスレッドからキャラクターの状態をコピーし、
+ *		　Updateでワーカースレッド上で速度・移動方向・空中判定を計算します。
+ */
+USTRUCT(BlueprintType)
+struct FSandBoxAnimInstanceProxy : public FAnimInstanceProxy
+{
+	GENERATED_BODY()
+
+	FSandBoxAnimInstanceProxy()
+		: FAnimInstanceProxy()
+	{
+	}
+
+	explicit FSandBoxAnimInstanceProxy(UAnimInstance* InAnimInstance)
+		: FAnimInstanceProxy(InAnimInstance)
+	{
+	}
+
+	// 移動速度。ThirdPerson_IdleRun_2DのSpeedに使用
+	UPROPERTY(Transient, BlueprintReadOnly, Category = "SandBox")
+	float Speed = 0.0f;
+
+	// アクターの向きに対する移動方向(-180～180度)。ThirdPerson_IdleRun_2DのDirectionに使用
+	UPROPERTY(Transient, BlueprintReadOnly, Category = "SandBox")
+	float Direction = 0.0f;
+
+	// 空中にいるか。ジャンプのStart/Loop/Endステートの遷移に使用
+	UPROPERTY(Transient, BlueprintReadOnly, Category = "SandBox")
+	bool bIsInAir = false;
+
+	// 上昇中か。ジャンプ開始とループの切り替えに使用
+	UPROPERTY(Transient, BlueprintReadOnly, Category = "SandBox")
+	bool bIsRising = false;
+
+protected:
+	virtual void PreUpdate(UAnimInstance* InAnimInstance, float DeltaSeconds) override;
+	virtual void Update(float DeltaSeconds) override;
+
+private:
+	// PreUpdateでゲームスレッドからコピーする値
+	FVector Velocity = FVector::ZeroVector;
+	FRotator ActorRotation = FRotator::ZeroRotator;
+	bool bIsFalling = false;
+};
+
+/**
+ * @brief サンドボックスキャラクター用のアニメーションインスタンス
+ *		　ThirdPerson_AnimBPのイベントグラフで行っていた計算をプロキシで行うため、
+ *		　アニメーションの更新がBlueprint VMを通らずワーカースレッドで実行できます。
+ *		　AnimBPの親クラスをこのクラスにし、AnimGraphからはProxyの値を参照してください。
+ */
+UCLASS(Transient, Blueprintable)
+class USandBoxAnimInstance : public UAnimInstance
+{
+	GENERATED_BODY()
+
+protected:
+	virtual FAnimInstanceProxy* CreateAnimInstanceProxy() override;
+	virtual void DestroyAnimInstanceProxy(FAnimInstanceProxy* InProxy) override;
+
+private:
+	UPROPERTY(Transient, BlueprintReadOnly, Category = "SandBox", meta = (AllowPrivateAccess = "true"))
+	FSandBoxAnimInstanceProxy Proxy;
+
+	friend struct FSandBoxAnimInstanceProxy;
+};
@@ -0,0 +1,160 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxBotDriver.h"
+#include "Engine/GameInstance.h"
+#include "Engine/NetConnection.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "InputCoreTypes.h"
+
+FSandBoxBotDriver::FSandBoxBotDriver(int32 InBotId, EPattern InPattern)
+	: BotId(InBotId)
+	, Pattern(InPattern)
+	, Random(InBotId)
+{
+	TimeUntilJump = JumpInterval * Random.FRandRange(0.5f, 1.5f);
+	TimeUntilReport = ReportInterval;
+}
+
+TSharedPtr<FSandBoxBotDriver> FSandBoxBotDriver::CreateFromCommandLine()
+{
+	if (!FParse::Param(FCommandLine::Get(), TEXT("SandBoxBot")))
+	{
+		return nullptr;
+	}
+
+	int32 BotId = 0;
+	FParse::Value(FCommandLine::Get(), TEXT("SandBoxBotId="), BotId);
+
+	EPattern Pattern = EPattern::Random;
+	FString PatternName;
+	if (FParse::Value(FCommandLine::Get(), TEXT("SandBoxBotPattern="), PatternName) && !ParsePattern(PatternName, Pattern))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("不明な入力パターンです:%s"), *PatternName);
+	}
+
+	UE_LOG(LogTemp, Display, TEXT("SandBoxBot Id:%d Pattern:%s"), BotId, GetPatternName(Pattern));
+	return MakeShareable(new FSandBoxBotDriver(BotId, Pattern));
+}
+
+bool FSandBoxBotDriver::ParsePattern(const FString& Name, EPattern& OutPattern)
+{
+	for (const EPattern Candidate : {EPattern::Circle, EPattern::Zigzag, EPattern::Random})
+	{
+		if (Name.Equals(GetPatternName(Candidate), ESearchCase::IgnoreCase))
+		{
+			OutPattern = Candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+const TCHAR* FSandBoxBotDriver::GetPatternName(EPattern Pattern)
+{
+	switch (Pattern)
+	{
+	case EPattern::Circle:
+		return TEXT("Circle");
+	case EPattern::Zigzag:
+		return TEXT("Zigzag");
+	case EPattern::Random:
+		return TEXT("Random");
+	default:
+		ensureAlwaysMsgf(false, TEXT("不正な入力パターンです"));
+		return TEXT("Invalid");
+	}
+}
+
+void FSandBoxBotDriver::Tick(float DeltaTime, UGameInstance& GameInstance)
+{
+	FrameSecTotal += DeltaTime;
+	++NumFrames;
+
+	TimeUntilReport -= DeltaTime;
+	if (TimeUntilReport <= 0.0f)
+	{
+		TimeUntilReport = ReportInterval;
+		ReportStats(GameInstance);
+	}
+
+	APlayerController* PlayerController = GameInstance.GetFirstLocalPlayerController();
+	if (PlayerController == nullptr || PlayerController->GetPawn() == nullptr)
+	{
+		return;
+	}
+
+	Time += DeltaTime;
+	float Forward, Right, Turn;
+	UpdatePattern(DeltaTime, Forward, Right, Turn);
+
+	// 人の操作と同じくゲームパッドの入力として送り、入力バインドからキャラクターの処理を呼び出させる
+	PlayerController->InputAxis(EKeys::Gamepad_LeftY, Forward, DeltaTime, 1, true);
+	PlayerController->InputAxis(EKeys::Gamepad_LeftX, Right, DeltaTime, 1, true);
+	PlayerController->InputAxis(EKeys::Gamepad_RightX, Turn, DeltaTime, 1, true);
+
+	// 押したら次のフレームで離す
+	if (bJumpPressed)
+	{
+		PlayerController->InputKey(EKeys::Gamepad_FaceButton_Bottom, IE_Released, 0.0f, true);
+		bJumpPressed = false;
+	}
+	else
+	{
+		TimeUntilJump -= DeltaTime;
+		if (TimeUntilJump <= 0.0f)
+		{
+			TimeUntilJump = JumpInterval * Random.FRandRange(0.5f, 1.5f);
+			PlayerController->InputKey(EKeys::Gamepad_FaceButton_Bottom, IE_Pressed, 1.0f, true);
+			bJumpPressed = true;
+		}
+	}
+}
+
+void FSandBoxBotDriver::UpdatePattern(float DeltaTime, float& OutForward, float& OutRight, float& OutTurn)
+{
+	switch (Pattern)
+	{
+	case EPattern::Circle:
+		OutForward = 1.0f;
+		OutRight = 0.0f;
+		OutTurn = 0.3f;
+		break;
+	case EPattern::Zigzag:
+		// 2秒ごとに左右を切り替える
+		OutForward = 1.0f;
+		OutRight = FMath::Sin(Time * PI * 0.5f) >= 0.0f ? 0.7f : -0.7f;
+		OutTurn = 0.0f;
+		break;
+	case EPattern::Random:
+	default:
+		TimeUntilRandomChange -= DeltaTime;
+		if (TimeUntilRandomChange <= 0.0f)
+		{
+			TimeUntilRandomChange = Random.FRandRange(1.0f, 3.0f);
+			RandomForward = Random.FRandRange(-1.0f, 1.0f);
+			RandomRight = Random.FRandRange(-1.0f, 1.0f);
+			RandomTurn = Random.FRandRange(-0.5f, 0.5f);
+		}
+		OutForward = RandomForward;
+		OutRight = RandomRight;
+		OutTurn = RandomTurn;
+		break;
+	}
+}
+
+void FSandBoxBotDriver::ReportStats(const UGameInstance& GameInstance)
+{
+	const APlayerController* PlayerController = GameInstance.GetFirstLocalPlayerController();
+	const UNetConnection* Connection = PlayerController != nullptr ? PlayerController->GetNetConnection() : nullptr;
+	const float RttMs = Connection != nullptr ? Connection->AvgLag * 1000.0f : -1.0f;
+	const FCPUTime CPUTime = FPlatformTime::GetCPUTime();
+	const double FrameMs = NumFrames > 0 ? FrameSecTotal * 1000.0 / NumFrames : 0.0;
+	FrameSecTotal = 0.0;
+	NumFrames = 0;
+
+	// FLoadGeneratorが標準出力から読み取る。書式を変える場合はFLoadGenerator::ParseStatsも合わせること
+	UE_LOG(LogTemp, Display, TEXT("SandBoxBotStats Id=%d Connected=%d RttMs=%.2f CpuPct=%.2f FrameMs=%.2f"),
+		BotId, Connection != nullptr && PlayerController->GetPawn() != nullptr, RttMs, CPUTime.CPUTimePctRelative, FrameMs);
+}
@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class UGameInstance;
+
+/**
+ * @brief 負荷試験用のクライアントでローカルプレイヤーの入力を自動で行うクラス
+ *		　-SandBoxBotで起動したクライアントで作成され、プレイヤーコントローラーにゲームパッドの入力を送ります。
+ *		　人が操作するときと同じく入力バインド経由でMoveForward/MoveRight/TurnAtRate/Jumpが呼び出されます。
+ *		　一定間隔でRTT・CPU使用率・フレーム時間を標準出力に出力し、FLoadGeneratorが集計します。
+ */
+class FSandBoxBotDriver final
+{
+public:
+	/**
+	 * @brief 入力パターン
+	 */
+	enum class EPattern : uint8
+	{
+		// 前進しながら一定の速さで旋回する
+		Circle,
+		// 前進しながら左右に切り返す
+		Zigzag,
+		// 一定時間ごとに移動方向と旋回をランダムに変える
+		Random,
+	};
+
+	FSandBoxBotDriver(int32 InBotId, EPattern InPattern);
+
+	/**
+	 * @brief コマンドラインに-SandBoxBotがあれば作成します
+	 *		　-SandBoxBotId=番号 -SandBoxBotPattern=Circle/Zigzag/Random
+	 */
+	static TSharedPtr<FSandBoxBotDriver> CreateFromCommandLine();
+
+	static bool ParsePattern(const FString& Name, EPattern& OutPattern);
+	static const TCHAR* GetPatternName(EPattern Pattern);
+
+	void Tick(float DeltaTime, UGameInstance& GameInstance);
+
+	// 統計を出力する間隔(秒)
+	float ReportInterval = 2.0f;
+
+	// ジャンプする間隔(秒)。ランダムに±50%ずらす
+	float JumpInterval = 4.0f;
+
+private:
+	void UpdatePattern(float DeltaTime, float& OutForward, float& OutRight, float& OutTurn);
+	void ReportStats(const UGameInstance& GameInstance);
+
+	int32 BotId;
+	EPattern Pattern;
+	FRandomStream Random;
+	float Time = 0.0f;
+
+	// Random用の現在の入力
+	float RandomForward = 1.0f;
+	float RandomRight = 0.0f;
+	float RandomTurn = 0.0f;
+	float TimeUntilRandomChange = 0.0f;
+
+	float TimeUntilJump = 0.0f;
+	bool bJumpPressed = false;
+
+	float TimeUntilReport = 0.0f;
+	double FrameSecTotal = 0.0;
+	int32 NumFrames = 0;
+};
@@ -0,0 +1,164 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxCharacterMovementComponent.h"
+#include "Components/CapsuleComponent.h"
+#include "GameFramework/Character.h"
+#include "SandBoxWorldSubSystem.h"
+#include "SceneQueryBatch.h"
+
+void USandBoxCharacterMovementComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (USandBoxWorldSubSystem* SubSystem = GetWorld()->GetSubsystem<USandBoxWorldSubSystem>())
+	{
+		SceneQueryBatch = SubSystem->GetSceneQueryBatch();
+		SceneQuerySlot = SceneQueryBatch->Register(GetWorld());
+	}
+}
+
+void USandBoxCharacterMovementComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (SceneQueryBatch != nullptr)
+	{
+		SceneQueryBatch->Unregister(SceneQuerySlot);
+		SceneQueryBatch = nullptr;
+		SceneQuerySlot = INDEX_NONE;
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void USandBoxCharacterMovementComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	// 移動後の位置で次フレーム用のスイープを要求しておく
+	if (CanUseAsyncFloor() && IsMovingOnGround())
+	{
+		RequestAsyncFloor();
+	}
+}
+
+void USandBoxCharacterMovementComponent::FindFloor(const FVector& CapsuleLocation, FFindFloorResult& OutFloorResult, bool bCanUseCachedLocation, const FHitResult* DownwardSweepResult) const
+{
+	// 前回の床をそのまま使う場合と、移動中のスイープ結果が渡された場合はエンジン側でもクエリが省略されるので任せる
+	const bool bUseCachedFloor = bCanUseCachedLocation && !bForceNextFloorCheck && !bJustTeleported && !bAlwaysCheckFloor;
+	if (bUseCachedFloor || DownwardSweepResult != nullptr || !CanUseAsyncFloor())
+	{
+		Super::FindFloor(CapsuleLocation, OutFloorResult, bCanUseCachedLocation, DownwardSweepResult);
+		return;
+	}
+
+	const uint32 StartCycles = FPlatformTime::Cycles();
+	if (!bJustTeleported && FindFloorFromAsyncResult(CapsuleLocation, OutFloorResult))
+	{
+		SceneQueryBatch->AddAsyncUsed(FPlatformTime::Cycles() - StartCycles);
+		return;
+	}
+
+	Super::FindFloor(CapsuleLocation, OutFloorResult, bCanUseCachedLocation, DownwardSweepResult);
+	SceneQueryBatch->AddSyncFallback(FPlatformTime::Cycles() - StartCycles);
+}
+
+void USandBoxCharacterMovementComponent::OnTeleported()
+{
+	Super::OnTeleported();
+
+	// テレポート前の位置で得た結果は使えない
+	if (SceneQueryBatch != nullptr)
+	{
+		SceneQueryBatch->Invalidate(SceneQuerySlot);
+	}
+}
+
+bool USandBoxCharacterMovementComponent::CanUseAsyncFloor() const
+{
+	if (!bUseAsyncFloorQueries || SceneQueryBatch == nullptr || !SceneQueryBatch->IsEnabled())
+	{
+		return false;
+	}
+
+	if (!HasValidData() || !UpdatedComponent->IsQueryCollisionEnabled())
+	{
+		return false;
+	}
+
+	// クライアント予測の再現が必要なプレイヤーのポーンとプロキシは対象外
+	return CharacterOwner->GetLocalRole() == ROLE_Authority && !CharacterOwner->IsPlayerControlled();
+}
+
+bool USandBoxCharacterMovementComponent::FindFloorFromAsyncResult(const FVector& CapsuleLocation, FFindFloorResult& OutFloorResult) const
+{
+	FHitResult Hit;
+	FVector RequestStart;
+	if (!SceneQueryBatch->GetSweepResult(SceneQuerySlot, Hit, RequestStart))
+	{
+		return false;
+	}
+
+	const FVector Delta = CapsuleLocation - RequestStart;
+	if (Delta.SizeSquared2D() > FMath::Square(MaxAsyncFloorReuseDistance))
+	{
+		return false;
+	}
+
+	// 床がない・めり込んでいる・歩けない・縁にかかっている場合は同期クエリで詳しく調べる
+	if (!Hit.bBlockingHit || Hit.bStartPenetrating || !IsWalkable(Hit))
+	{
+		return false;
+	}
+
+	const float PawnRadius = CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleRadius();
+	if (!IsWithinEdgeTolerance(Hit.Location, Hit.ImpactPoint, PawnRadius))
+	{
+		return false;
+	}
+
+	// 要求時からの水平移動による床の高さの変化を床の平面で補正する
+	const FVector& Normal = Hit.ImpactNormal;
+	const float FloorDeltaZ = -(Normal.X * Delta.X + Normal.Y * Delta.Y) / Normal.Z;
+	const float FloorDist = Hit.Time * AsyncFloorTraceDist - AsyncFloorShrinkHeight + Delta.Z - FloorDeltaZ;
+	if (FloorDist < 0.0f || FloorDist > GetFloorSweepDistance())
+	{
+		return false;
+	}
+
+	const FVector HitOffset(Delta.X, Delta.Y, FloorDeltaZ);
+	Hit.Location += HitOffset;
+	Hit.ImpactPoint += HitOffset;
+	Hit.TraceStart = CapsuleLocation;
+	Hit.TraceEnd = CapsuleLocation + (Hit.TraceEnd - RequestStart);
+
+	OutFloorResult.Clear();
+	OutFloorResult.SetFromSweep(Hit, FloorDist, true);
+	return true;
+}
+
+void USandBoxCharacterMovementComponent::RequestAsyncFloor()
+{
+	float PawnRadius, PawnHalfHeight;
+	CharacterOwner->GetCapsuleComponent()->GetScaledCapsuleSize(PawnRadius, PawnHalfHeight);
+
+	// UCharacterMovementComponent::ComputeFloorDistと同じく、壁に当たらないよう高さを縮めたカプセルで下にスイープする
+	const float ShrinkScale = 0.9f;
+	AsyncFloorShrinkHeight = (PawnHalfHeight - PawnRadius) * (1.0f - ShrinkScale);
+	AsyncFloorTraceDist = GetFloorSweepDistance() + AsyncFloorShrinkHeight;
+
+	FSceneQueryBatch::FSweepRequest Request;
+	Request.Start = UpdatedComponent->GetComponentLocation();
+	Request.End = Request.Start + FVector(0.0f, 0.0f, -AsyncFloorTraceDist);
+	Request.Shape = FCollisionShape::MakeCapsule(PawnRadius, PawnHalfHeight - AsyncFloorShrinkHeight);
+	Request.Channel = UpdatedComponent->GetCollisionObjectType();
+	Request.QueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(SandBoxAsyncFloor), false, CharacterOwner);
+	InitCollisionParams(Request.QueryParams, Request.ResponseParams);
+
+	SceneQueryBatch->RequestSweep(SceneQuerySlot, Request);
+}
+
+float USandBoxCharacterMovementComponent::GetFloorSweepDistance() const
+{
+	const float HeightCheckAdjust = IsMovingOnGround() ? MAX_FLOOR_DIST + KINDA_SMALL_NUMBER : -MAX_FLOOR_DIST;
+	return FMath::Max(MAX_FLOOR_DIST, MaxStepHeight + HeightCheckAdjust);
+}
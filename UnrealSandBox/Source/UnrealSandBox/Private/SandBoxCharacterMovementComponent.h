@@ -0,0 +1,66 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "SandBoxCharacterMovementComponent.generated.h"
+
+class FSceneQueryBatch;
+
+/**
+ * @brief サンドボックスキャラクター用の移動コンポーネント
+ *		　プレイヤーが操作していないポーンの床判定を、FSceneQueryBatchでまとめて発行した前フレームの非同期スイープの結果で行います。
+ *		　前フレームからの移動量は床の法線で補正し、大きく動いた場合・テレポートした場合・段差の縁など判定が難しい場合は同期クエリに戻します。
+ *		　プレイヤーが操作するポーンはクライアントとサーバーで結果を一致させる必要があるため常に同期クエリを行います。
+ */
+UCLASS()
+class USandBoxCharacterMovementComponent final : public UCharacterMovementComponent
+{
+	GENERATED_BODY()
+public:
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+	virtual void FindFloor(const FVector& CapsuleLocation, FFindFloorResult& OutFloorResult, bool bCanUseCachedLocation, const FHitResult* DownwardSweepResult = nullptr) const override;
+	virtual void OnTeleported() override;
+
+	// 非同期の床判定を使用するか
+	UPROPERTY(EditDefaultsOnly, Category = "Character Movement: Async Floor")
+	bool bUseAsyncFloorQueries = true;
+
+	// 前フレームのスイープ結果を使用できる水平方向の移動量の上限。これより動いていたら同期クエリを行う
+	UPROPERTY(EditDefaultsOnly, Category = "Character Movement: Async Floor", meta = (ClampMin = "0", UIMin = "0"))
+	float MaxAsyncFloorReuseDistance = 20.0f;
+
+protected:
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	/**
+	 * @brief 非同期の床判定の対象か
+	 */
+	bool CanUseAsyncFloor() const;
+
+	/**
+	 * @brief 前フレームのスイープ結果から床を求めます
+	 * @return 結果を使用できない場合はfalse
+	 */
+	bool FindFloorFromAsyncResult(const FVector& CapsuleLocation, FFindFloorResult& OutFloorResult) const;
+
+	/**
+	 * @brief 次フレーム用の床判定のスイープを要求します
+	 */
+	void RequestAsyncFloor();
+
+	/**
+	 * @brief 床判定のスイープ距離。UCharacterMovementComponent::FindFloorと同じ計算
+	 */
+	float GetFloorSweepDistance() const;
+
+	FSceneQueryBatch* SceneQueryBatch = nullptr;
+	int32 SceneQuerySlot = INDEX_NONE;
+
+	// 要求したスイープのカプセルを縮めた高さとスイープ距離
+	float AsyncFloorShrinkHeight = 0.0f;
+	float AsyncFloorTraceDist = 0.0f;
+};
@@ -0,0 +1,313 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxCommandRegistry.h"
+
+namespace SandBoxCommandRegistryInternal
+{
+	const TCHAR* GetAffinityName(ESandBoxCommandAffinity Affinity)
+	{
+		switch (Affinity)
+		{
+		case ESandBoxCommandAffinity::GameThread:
+			return TEXT("GameThread");
+		case ESandBoxCommandAffinity::AnyThread:
+			return TEXT("AnyThread");
+		case ESandBoxCommandAffinity::SerialQueue:
+			return TEXT("SerialQueue");
+		default:
+			return TEXT("Unknown");
+		}
+	}
+}
+
+/*static*/
+FSandBoxCommandRegistry& FSandBoxCommandRegistry::Get()
+{
+	static FSandBoxCommandRegistry Instance;
+	return Instance;
+}
+
+void FSandBoxCommandRegistry::Register(const TCHAR* Name, const TCHAR* Help, ESandBoxCommandAffinity Affinity, FName QueueName, FCommandFunction&& Function)
+{
+	check(IsInGameThread());
+
+	if (!ensureAlwaysMsgf(!Commands.Contains(Name), TEXT("すでに登録済みのコマンド名です: %s"), Name))
+	{
+		return;
+	}
+
+	if (!ensureAlwaysMsgf((Affinity == ESandBoxCommandAffinity::SerialQueue) != QueueName.IsNone(), TEXT("キュー名はSerialQueueのときのみ指定してください: %s"), Name))
+	{
+		return;
+	}
+
+	const FCommandRef Command = MakeShareable(new FCommand{Name, Affinity, QueueName, MoveTemp(Function)});
+	Commands.Add(Name, Command);
+
+	IConsoleManager::Get().RegisterConsoleCommand(
+		Name,
+		Help,
+		FConsoleCommandWithArgsDelegate::CreateLambda([this, Command](const TArray<FString>& Args)
+		{
+			OnConsoleCommand(Command, Args);
+		}),
+		ECVF_Default
+	);
+}
+
+void FSandBoxCommandRegistry::SetScheduler(FJobScheduler* InScheduler)
+{
+	check(IsInGameThread());
+
+	// 以前のスケジューラーに投入したジョブを残さない
+	if (Scheduler != nullptr && Scheduler != InScheduler)
+	{
+		Flush();
+	}
+	Scheduler = InScheduler;
+}
+
+int32 FSandBoxCommandRegistry::SubmitBatch(const TArray<FString>& Lines)
+{
+	check(IsInGameThread());
+
+	const double NowSec = FPlatformTime::Seconds();
+	int32 NumSubmitted = 0;
+	for (const FString& Line : Lines)
+	{
+		// 空行と#から始まる行は無視する
+		const FString TrimmedLine = Line.TrimStartAndEnd();
+		if (TrimmedLine.IsEmpty() || TrimmedLine.StartsWith(TEXT("#")))
+		{
+			continue;
+		}
+
+		// コンソールと同じく空白で分割する
+		TArray<FString> Args;
+		TrimmedLine.ParseIntoArrayWS(Args);
+		const FCommandRef* Command = Commands.Find(Args[0]);
+		if (Command == nullptr)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("登録されていないコマンドです: %s"), *Args[0]);
+			continue;
+		}
+
+		Args.RemoveAt(0);
+		Enqueue(FPendingCommand{*Command, MoveTemp(Args), NowSec});
+		++NumSubmitted;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("SandBoxCommandBatch Lines:%d Submitted:%d"), Lines.Num(), NumSubmitted);
+	return NumSubmitted;
+}
+
+void FSandBoxCommandRegistry::Tick()
+{
+	check(IsInGameThread());
+
+	SubmitJobs();
+	RunGameThreadCommands(GameThreadBudgetMs);
+}
+
+void FSandBoxCommandRegistry::Flush()
+{
+	check(IsInGameThread());
+
+	// シリアルキューは前のジョブが完了するまで次を投入せず、ゲームスレッドのコマンドが新たに投入することもあるため、空になるまで繰り返す
+	while (GetNumPendingCommands() > 0)
+	{
+		SubmitJobs();
+		RunGameThreadCommands(0.0);
+		for (const FJobScheduler::FJobHandle& Job : RunningJobs)
+		{
+			Scheduler->Wait(Job);
+		}
+	}
+	SubmitJobs();
+}
+
+int32 FSandBoxCommandRegistry::GetNumPendingCommands() const
+{
+	int32 NumPending = GameThreadQueue.Num() + AnyThreadQueue.Num();
+	for (const TPair<FName, FSerialQueue>& Pair : SerialQueues)
+	{
+		NumPending += Pair.Value.Pending.Num();
+	}
+
+	// 実行中のジョブはシリアルキューでも1件と数える
+	for (const FJobScheduler::FJobHandle& Job : RunningJobs)
+	{
+		NumPending += Job->IsDone() ? 0 : 1;
+	}
+	return NumPending;
+}
+
+void FSandBoxCommandRegistry::DumpStats() const
+{
+	UE_LOG(LogTemp, Log, TEXT("SandBoxCommandRegistry Commands:%d Scheduler:%d BudgetMs:%.2f GameThreadQueue:%d AnyThreadQueue:%d Pending:%d"),
+		Commands.Num(), Scheduler != nullptr, GameThreadBudgetMs, GameThreadQueue.Num(), AnyThreadQueue.Num(), GetNumPendingCommands());
+
+	{
+		FScopeLock ScopeLock(&StatsLock);
+		for (int32 Index = 0; Index < static_cast<int32>(ESandBoxCommandAffinity::Num); ++Index)
+		{
+			const FStats& AffinityStats = Stats[Index];
+			const int32 NumExecuted = FMath::Max(AffinityStats.NumExecuted, 1);
+			UE_LOG(LogTemp, Log, TEXT("  %-11s Executed:%d AvgWaitMs:%.3f MaxWaitMs:%.3f AvgRunMs:%.3f MaxRunMs:%.3f"),
+				SandBoxCommandRegistryInternal::GetAffinityName(static_cast<ESandBoxCommandAffinity>(Index)), AffinityStats.NumExecuted,
+				AffinityStats.TotalWaitMs / NumExecuted, AffinityStats.MaxWaitMs, AffinityStats.TotalRunMs / NumExecuted, AffinityStats.MaxRunMs);
+		}
+	}
+
+	for (const TPair<FName, FSerialQueue>& Pair : SerialQueues)
+	{
+		UE_LOG(LogTemp, Log, TEXT("  Queue:%s Pending:%d Running:%d"),
+			*Pair.Key.ToString(), Pair.Value.Pending.Num(), Pair.Value.Job.IsValid() && !Pair.Value.Job->IsDone());
+	}
+}
+
+void FSandBoxCommandRegistry::ResetStats()
+{
+	FScopeLock ScopeLock(&StatsLock);
+	for (FStats& AffinityStats : Stats)
+	{
+		AffinityStats = FStats();
+	}
+}
+
+void FSandBoxCommandRegistry::OnConsoleCommand(const FCommandRef& Command, const TArray<FString>& Args)
+{
+	FPendingCommand Pending{Command, Args, FPlatformTime::Seconds()};
+
+	// コンソールから呼び出したゲームスレッドのコマンドはこれまで通りその場で実行する
+	if (Command->Affinity == ESandBoxCommandAffinity::GameThread)
+	{
+		Execute(Pending);
+	}
+	else
+	{
+		Enqueue(MoveTemp(Pending));
+	}
+}
+
+void FSandBoxCommandRegistry::Enqueue(FPendingCommand&& Pending)
+{
+	if (Scheduler == nullptr)
+	{
+		Execute(Pending);
+		return;
+	}
+
+	switch (Pending.Command->Affinity)
+	{
+	case ESandBoxCommandAffinity::AnyThread:
+		AnyThreadQueue.Add(MoveTemp(Pending));
+		break;
+	case ESandBoxCommandAffinity::SerialQueue:
+		SerialQueues.FindOrAdd(Pending.Command->QueueName).Pending.Add(MoveTemp(Pending));
+		break;
+	default:
+		GameThreadQueue.Add(MoveTemp(Pending));
+		break;
+	}
+}
+
+void FSandBoxCommandRegistry::SubmitJobs()
+{
+	RunningJobs.RemoveAll([](const FJobScheduler::FJobHandle& Job)
+	{
+		return Job->IsDone();
+	});
+
+	if (Scheduler == nullptr)
+	{
+		return;
+	}
+
+	// まとめて投入された解析などのコマンドがフレーム内で必要な処理を待たせないよう低優先度にする
+	for (FPendingCommand& Pending : AnyThreadQueue)
+	{
+		RunningJobs.Add(Scheduler->Submit(EJobPriority::Low, 0.0f, [this, Pending = MoveTemp(Pending)]()
+		{
+			Execute(Pending);
+		}));
+	}
+	AnyThreadQueue.Reset();
+
+	// キューごとに溜まっている分を1つのジョブで順に実行する。前のジョブが実行中であれば次のフレームに回す
+	for (TPair<FName, FSerialQueue>& Pair : SerialQueues)
+	{
+		FSerialQueue& Queue = Pair.Value;
+		if (Queue.Job.IsValid() && !Queue.Job->IsDone())
+		{
+			continue;
+		}
+
+		Queue.Job.Reset();
+		if (Queue.Pending.Num() == 0)
+		{
+			continue;
+		}
+
+		const FJobScheduler::FJobHandle Job = Scheduler->Submit(EJobPriority::Low, 0.0f, [this, Pending = MoveTemp(Queue.Pending)]()
+		{
+			for (const FPendingCommand& Command : Pending)
+			{
+				Execute(Command);
+			}
+		});
+		Queue.Pending.Reset();
+		Queue.Job = Job;
+		RunningJobs.Add(Job);
+	}
+}
+
+void FSandBoxCommandRegistry::RunGameThreadCommands(double BudgetMs)
+{
+	if (GameThreadQueue.Num() == 0)
+	{
+		return;
+	}
+
+	// 実行中のコマンドが投入したコマンドで配列が再確保されないよう取り出してから実行する
+	TArray<FPendingCommand> Ready = MoveTemp(GameThreadQueue);
+	const double StartSec = FPlatformTime::Seconds();
+	int32 NumRun = 0;
+	while (NumRun < Ready.Num())
+	{
+		// 1件は必ず実行し、進まなくならないようにする
+		if (BudgetMs > 0.0 && NumRun > 0 && (FPlatformTime::Seconds() - StartSec) * 1000.0 >= BudgetMs)
+		{
+			break;
+		}
+		Execute(Ready[NumRun]);
+		++NumRun;
+	}
+
+	// 残りは実行中に投入されたコマンドより前に並べる
+	if (NumRun < Ready.Num())
+	{
+		Ready.RemoveAt(0, NumRun, false);
+		Ready.Append(MoveTemp(GameThreadQueue));
+		GameThreadQueue = MoveTemp(Ready);
+	}
+}
+
+void FSandBoxCommandRegistry::Execute(const FPendingCommand& Pending)
+{
+	const double StartSec = FPlatformTime::Seconds();
+	Pending.Command->Function(Pending.Args);
+	const double EndSec = FPlatformTime::Seconds();
+
+	const double WaitMs = (StartSec - Pending.SubmitSec) * 1000.0;
+	const double RunMs = (EndSec - StartSec) * 1000.0;
+
+	FScopeLock ScopeLock(&StatsLock);
+	FStats& AffinityStats = Stats[static_cast<int32>(Pending.Command->Affinity)];
+	++AffinityStats.NumExecuted;
+	AffinityStats.TotalWaitMs += WaitMs;
+	AffinityStats.MaxWaitMs = FMath::Max(AffinityStats.MaxWaitMs, WaitMs);
+	AffinityStats.TotalRunMs += RunMs;
+	AffinityStats.MaxRunMs = FMath::Max(AffinityStats.MaxRunMs, RunMs);
+}
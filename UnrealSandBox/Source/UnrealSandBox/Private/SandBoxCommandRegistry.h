@@ -0,0 +1,174 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "JobScheduler.h"
+
+/**
+ * @brief コマンドを実行するスレッド
+ */
+enum class ESandBoxCommandAffinity : uint8
+{
+	// ゲームスレッド。UObjectやワールドに触れるコマンド
+	GameThread,
+	// どのワーカースレッドでもよく、他のコマンドと同時に実行してよい。UObjectに触れないコマンドのみ
+	AnyThread,
+	// ワーカースレッドで、同じキュー名のコマンドと投入順に1つずつ実行する。ファイルなどを共有するコマンド
+	SerialQueue,
+	Num
+};
+
+/**
+ * @brief 実行するスレッドを指定してコンソールコマンドを登録するクラス
+ *		　IConsoleManagerに直接登録したコマンドはコンソールのラムダ内でゲームスレッドで同期実行されるため、
+ *		　UObjectに触れない解析・診断のコマンドをまとめて実行するとその間フレームが止まります。
+ *		　このクラスで登録したコマンドは
+ *		　・GameThreadであればコンソールから呼び出したときはその場で実行し、まとめて投入したときはTickで1フレームあたりGameThreadBudgetMsまで投入順に実行する
+ *		　・AnyThreadであればFJobSchedulerのジョブとして同時に実行する
+ *		　・SerialQueueであればキュー名ごとに1つのジョブで投入順に実行し、前のジョブが完了するまで次のジョブは投入しない
+ *		　ことで、ワーカースレッドで実行できるコマンドはフレームを止めず、同じキューのコマンドの順序は保ちます。
+ *		　スケジューラーが設定されていないとき(エディターでPIEを開始していないときなど)は全てその場で実行します。
+ *		　登録・投入・Tickはゲームスレッドから呼び出してください。
+ */
+class FSandBoxCommandRegistry final
+{
+public:
+	using FCommandFunction = TFunction<void(const TArray<FString>&)>;
+
+	static FSandBoxCommandRegistry& Get();
+
+	/**
+	 * @brief コマンドを登録し、IConsoleManagerにも同じ名前で登録します
+	 * @param Name コマンド名
+	 * @param Help ヘルプ
+	 * @param Affinity 実行するスレッド
+	 * @param QueueName SerialQueueのときのキュー名
+	 * @param Function コマンドの処理。引数はコンソールと同じく空白で分割したもの
+	 */
+	void Register(const TCHAR* Name, const TCHAR* Help, ESandBoxCommandAffinity Affinity, FName QueueName, FCommandFunction&& Function);
+
+	/**
+	 * @brief ゲームスレッドかスレッドを問わないコマンドを登録します
+	 */
+	void Register(const TCHAR* Name, const TCHAR* Help, ESandBoxCommandAffinity Affinity, FCommandFunction&& Function)
+	{
+		Register(Name, Help, Affinity, NAME_None, MoveTemp(Function));
+	}
+
+	/**
+	 * @brief ワーカースレッドで実行するコマンドの実行先を設定します。nullptrを設定するとその場で実行します
+	 *		　切り替える前に以前のスケジューラーに投入したコマンドを全て完了させるため、スケジューラーを破棄する前にnullptrを設定してください。
+	 */
+	void SetScheduler(FJobScheduler* InScheduler);
+
+	FJobScheduler* GetScheduler() const { return Scheduler; }
+
+	/**
+	 * @brief "コマンド名 引数..."の形式のコマンドをまとめて投入します
+	 * @return 投入したコマンド数。登録されていないコマンドは投入しません
+	 */
+	int32 SubmitBatch(const TArray<FString>& Lines);
+
+	/**
+	 * @brief 実行待ちのコマンドをジョブとして投入し、ゲームスレッドのコマンドを実行します。毎フレーム呼び出します
+	 */
+	void Tick();
+
+	/**
+	 * @brief 実行待ちと実行中のコマンドを全て完了させます
+	 */
+	void Flush();
+
+	/**
+	 * @brief 実行待ちのコマンド数と実行中のジョブ数の合計
+	 */
+	int32 GetNumPendingCommands() const;
+
+	/**
+	 * @brief スレッドの種類ごとの実行数・待ち時間・実行時間をログに出力します
+	 */
+	void DumpStats() const;
+
+	void ResetStats();
+
+	// ゲームスレッドのコマンドを1フレームで実行する時間の上限。超えた分は次のフレームに回す
+	float GameThreadBudgetMs = 2.0f;
+
+private:
+	struct FCommand
+	{
+		FString Name;
+		ESandBoxCommandAffinity Affinity;
+		FName QueueName;
+		FCommandFunction Function;
+	};
+
+	using FCommandRef = TSharedRef<const FCommand, ESPMode::ThreadSafe>;
+
+	struct FPendingCommand
+	{
+		FCommandRef Command;
+		TArray<FString> Args;
+		double SubmitSec;
+	};
+
+	/**
+	 * @brief 同じキュー名のコマンド
+	 */
+	struct FSerialQueue
+	{
+		TArray<FPendingCommand> Pending;
+		// 実行中のジョブ。完了するまで次のジョブは投入しない
+		TSharedPtr<FJobScheduler::FJobState, ESPMode::ThreadSafe> Job;
+	};
+
+	struct FStats
+	{
+		int32 NumExecuted = 0;
+		double TotalWaitMs = 0.0;
+		double MaxWaitMs = 0.0;
+		double TotalRunMs = 0.0;
+		double MaxRunMs = 0.0;
+	};
+
+	FSandBoxCommandRegistry() = default;
+
+	/**
+	 * @brief コンソールから呼び出されたときの処理
+	 */
+	void OnConsoleCommand(const FCommandRef& Command, const TArray<FString>& Args);
+
+	/**
+	 * @brief 実行するスレッドごとのキューに追加します
+	 */
+	void Enqueue(FPendingCommand&& Pending);
+
+	/**
+	 * @brief ワーカースレッドのコマンドをジョブとして投入します
+	 */
+	void SubmitJobs();
+
+	/**
+	 * @brief ゲームスレッドのコマンドを実行します
+	 * @param BudgetMs 実行時間の上限。0以下であれば全て実行する
+	 */
+	void RunGameThreadCommands(double BudgetMs);
+
+	/**
+	 * @brief コマンドを実行して計測値を集計します。ワーカースレッドからも呼び出されます
+	 */
+	void Execute(const FPendingCommand& Pending);
+
+	TMap<FString, FCommandRef> Commands;
+	FJobScheduler* Scheduler = nullptr;
+
+	// ゲームスレッドのみで更新する
+	TArray<FPendingCommand> GameThreadQueue;
+	TArray<FPendingCommand> AnyThreadQueue;
+	TMap<FName, FSerialQueue> SerialQueues;
+	TArray<FJobScheduler::FJobHandle> RunningJobs;
+
+	mutable FCriticalSection StatsLock;
+	FStats Stats[static_cast<int32>(ESandBoxCommandAffinity::Num)];
+};
@@ -0,0 +1,449 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxFrameAllocator.h"
+#include "SandBoxMemoryTracker.h"
+#include "HAL/ThreadManager.h"
+
+namespace SandBoxFrameAllocatorInternal
+{
+	constexpr uint8 AllocatedPoison = 0xCD;
+	constexpr uint8 FreedPoison = 0xDD;
+	// 最後の確保がないことを表すLastOffset
+	constexpr SIZE_T InvalidOffset = ~static_cast<SIZE_T>(0);
+
+	FORCEINLINE uint32 GetAlignment(uint32 Alignment)
+	{
+		return Alignment == DEFAULT_ALIGNMENT ? 16 : FMath::Max<uint32>(Alignment, 16);
+	}
+}
+
+/**
+ * @brief 1スレッド分のバッファ
+ *		　バッファの中身は持ち主のスレッドのみが触り、集計値は持ち主が更新してゲームスレッドが読みます。
+ */
+class FSandBoxFrameAllocator::FThreadArena final
+{
+public:
+	struct FBuffer
+	{
+		uint8* Memory = nullptr;
+		SIZE_T Used = 0;
+		// 最後に確保した領域の先頭。その場で伸ばせるかの判定に使う
+		SIZE_T LastOffset = SandBoxFrameAllocatorInternal::InvalidOffset;
+		// このバッファを使っているフレーム番号
+		uint64 FrameIndex = 0;
+		// バッファが足りずヒープから確保した領域
+		TArray<TPair<void*, SIZE_T>> Overflows;
+	};
+
+	FThreadArena(uint32 InThreadId, SIZE_T InCapacity)
+		: ThreadId(InThreadId)
+		, Capacity(InCapacity)
+	{
+	}
+
+	~FThreadArena()
+	{
+		for (FBuffer& Buffer : Buffers)
+		{
+			Recycle(Buffer, 0);
+			if (Buffer.Memory != nullptr)
+			{
+				FMemory::Free(Buffer.Memory);
+				FSandBoxMemoryTracker::Update(ESandBoxMemoryTag::FrameAllocator, -static_cast<int64>(Capacity), -1);
+			}
+		}
+	}
+
+	/**
+	 * @brief フレーム番号に対応するバッファを取得します。2フレーム前のものであれば中身を捨てます
+	 */
+	FBuffer& GetBuffer(uint64 FrameIndex)
+	{
+		FBuffer& Buffer = Buffers[FrameIndex & 1];
+		if (Buffer.FrameIndex != FrameIndex)
+		{
+			Recycle(Buffer, FrameIndex);
+		}
+		return Buffer;
+	}
+
+	/**
+	 * @brief 現在のフレームのバッファから確保します
+	 */
+	void* Allocate(FBuffer& Buffer, SIZE_T Size, uint32 Alignment)
+	{
+		using namespace SandBoxFrameAllocatorInternal;
+
+		if (Buffer.Memory == nullptr)
+		{
+			SANDBOX_LLM_SCOPE(ESandBoxMemoryTag::FrameAllocator);
+			Buffer.Memory = static_cast<uint8*>(FMemory::Malloc(Capacity, 64));
+			FSandBoxMemoryTracker::Update(ESandBoxMemoryTag::FrameAllocator, static_cast<int64>(Capacity), 1);
+		}
+
+		NumAllocs.fetch_add(1, std::memory_order_relaxed);
+		AllocatedBytes.fetch_add(Size, std::memory_order_relaxed);
+
+		const SIZE_T Offset = Align(Buffer.Used, Alignment);
+		if (Offset + Size > Capacity)
+		{
+			return AllocateOverflow(Buffer, Size, Alignment);
+		}
+
+		Buffer.LastOffset = Offset;
+		SetUsed(Buffer, Offset + Size);
+		uint8* Ptr = Buffer.Memory + Offset;
+#if SANDBOX_FRAME_ALLOCATOR_POISON
+		FMemory::Memset(Ptr, AllocatedPoison, Size);
+#endif
+		return Ptr;
+	}
+
+	/**
+	 * @brief Ptrが現在のフレームのバッファの最後の確保であれば、その場で大きさを変えます
+	 */
+	bool TryResizeInPlace(FBuffer& Buffer, void* Ptr, SIZE_T OldSize, SIZE_T NewSize)
+	{
+		using namespace SandBoxFrameAllocatorInternal;
+
+		if (Buffer.LastOffset == InvalidOffset || Ptr != Buffer.Memory + Buffer.LastOffset || Buffer.LastOffset + NewSize > Capacity)
+		{
+			return false;
+		}
+
+		NumInPlaceResizes.fetch_add(1, std::memory_order_relaxed);
+		AllocatedBytes.fetch_add(NewSize > OldSize ? NewSize - OldSize : 0, std::memory_order_relaxed);
+#if SANDBOX_FRAME_ALLOCATOR_POISON
+		if (NewSize > OldSize)
+		{
+			FMemory::Memset(Buffer.Memory + Buffer.LastOffset + OldSize, AllocatedPoison, NewSize - OldSize);
+		}
+		else
+		{
+			FMemory::Memset(Buffer.Memory + Buffer.LastOffset + NewSize, FreedPoison, Buffer.Used - (Buffer.LastOffset + NewSize));
+		}
+#endif
+		SetUsed(Buffer, Buffer.LastOffset + NewSize);
+		return true;
+	}
+
+	/**
+	 * @brief FScopeの開始時の位置まで戻します
+	 */
+	void Rewind(FBuffer& Buffer, SIZE_T Used)
+	{
+		using namespace SandBoxFrameAllocatorInternal;
+
+		if (Used >= Buffer.Used)
+		{
+			return;
+		}
+#if SANDBOX_FRAME_ALLOCATOR_POISON
+		FMemory::Memset(Buffer.Memory + Used, FreedPoison, Buffer.Used - Used);
+#endif
+		Buffer.Used = Used;
+		Buffer.LastOffset = InvalidOffset;
+	}
+
+	const uint32 ThreadId;
+	const SIZE_T Capacity;
+	FBuffer Buffers[2];
+
+	// 持ち主のスレッドのみが加算し、ゲームスレッドが読み取り・リセットする
+	std::atomic<uint64> NumAllocs{0};
+	std::atomic<uint64> AllocatedBytes{0};
+	std::atomic<uint64> NumInPlaceResizes{0};
+	std::atomic<uint64> NumOverflows{0};
+	std::atomic<uint64> OverflowBytes{0};
+	std::atomic<uint64> HighWaterBytes{0};
+	// FHeapScope内でヒープから確保した回数
+	std::atomic<uint64> NumHeapScopeAllocs{0};
+
+	// 持ち主のスレッドのみが触る
+	int32 HeapScopeDepth = 0;
+
+private:
+	void* AllocateOverflow(FBuffer& Buffer, SIZE_T Size, uint32 Alignment)
+	{
+		using namespace SandBoxFrameAllocatorInternal;
+
+		SANDBOX_LLM_SCOPE(ESandBoxMemoryTag::FrameAllocator);
+		void* Ptr = FMemory::Malloc(Size, Alignment);
+		Buffer.Overflows.Emplace(Ptr, Size);
+		Buffer.LastOffset = InvalidOffset;
+		NumOverflows.fetch_add(1, std::memory_order_relaxed);
+		OverflowBytes.fetch_add(Size, std::memory_order_relaxed);
+		FSandBoxMemoryTracker::Update(ESandBoxMemoryTag::FrameAllocator, static_cast<int64>(Size), 1);
+#if SANDBOX_FRAME_ALLOCATOR_POISON
+		FMemory::Memset(Ptr, AllocatedPoison, Size);
+#endif
+		return Ptr;
+	}
+
+	void SetUsed(FBuffer& Buffer, SIZE_T Used)
+	{
+		Buffer.Used = Used;
+		if (Used > HighWaterBytes.load(std::memory_order_relaxed))
+		{
+			HighWaterBytes.store(Used, std::memory_order_relaxed);
+		}
+	}
+
+	void Recycle(FBuffer& Buffer, uint64 FrameIndex)
+	{
+		using namespace SandBoxFrameAllocatorInternal;
+
+#if SANDBOX_FRAME_ALLOCATOR_POISON
+		if (Buffer.Memory != nullptr)
+		{
+			FMemory::Memset(Buffer.Memory, FreedPoison, Buffer.Used);
+		}
+#endif
+		for (const TPair<void*, SIZE_T>& Overflow : Buffer.Overflows)
+		{
+#if SANDBOX_FRAME_ALLOCATOR_POISON
+			FMemory::Memset(Overflow.Key, FreedPoison, Overflow.Value);
+#endif
+			FMemory::Free(Overflow.Key);
+			FSandBoxMemoryTracker::Update(ESandBoxMemoryTag::FrameAllocator, -static_cast<int64>(Overflow.Value), -1);
+		}
+		Buffer.Overflows.Reset();
+		Buffer.Used = 0;
+		Buffer.LastOffset = InvalidOffset;
+		Buffer.FrameIndex = FrameIndex;
+	}
+};
+
+//---------------------------------------------------------------------------------
+// FScope
+//---------------------------------------------------------------------------------
+FSandBoxFrameAllocator::FScope::FScope()
+{
+	FSandBoxFrameAllocator& Allocator = FSandBoxFrameAllocator::Get();
+	FrameIndex = Allocator.GetFrameIndex();
+	FThreadArena::FBuffer& Buffer = Allocator.GetThreadArena().GetBuffer(FrameIndex);
+	Used = Buffer.Used;
+
+	// スコープの前に確保した配列がスコープ内でその場で伸びると、戻すときにその配列の末尾を解放してしまうため伸ばせなくする
+	Buffer.LastOffset = SandBoxFrameAllocatorInternal::InvalidOffset;
+}
+
+FSandBoxFrameAllocator::FScope::~FScope()
+{
+	FSandBoxFrameAllocator& Allocator = FSandBoxFrameAllocator::Get();
+	if (Allocator.GetFrameIndex() != FrameIndex)
+	{
+		return;
+	}
+
+	FThreadArena& Arena = Allocator.GetThreadArena();
+	Arena.Rewind(Arena.GetBuffer(FrameIndex), Used);
+}
+
+//---------------------------------------------------------------------------------
+// FHeapScope
+//---------------------------------------------------------------------------------
+FSandBoxFrameAllocator::FHeapScope::FHeapScope()
+{
+	++FSandBoxFrameAllocator::Get().GetThreadArena().HeapScopeDepth;
+}
+
+FSandBoxFrameAllocator::FHeapScope::~FHeapScope()
+{
+	--FSandBoxFrameAllocator::Get().GetThreadArena().HeapScopeDepth;
+}
+
+//---------------------------------------------------------------------------------
+// FSandBoxFrameAllocator
+//---------------------------------------------------------------------------------
+/*static*/
+FSandBoxFrameAllocator& FSandBoxFrameAllocator::Get()
+{
+	static FSandBoxFrameAllocator Instance;
+	return Instance;
+}
+
+void FSandBoxFrameAllocator::BeginFrame()
+{
+	check(IsInGameThread());
+
+	// PIEで複数のクライアントを起動しているときはUSampleSubSystemごとに呼ばれる
+	if (LastFrameCounter == GFrameCounter)
+	{
+		return;
+	}
+	LastFrameCounter = GFrameCounter;
+	++NumFrames;
+
+	FrameIndex.fetch_add(1, std::memory_order_release);
+}
+
+void* FSandBoxFrameAllocator::Allocate(SIZE_T Size, uint32 Alignment)
+{
+	FThreadArena& Arena = GetThreadArena();
+	return Arena.Allocate(Arena.GetBuffer(GetFrameIndex()), Size, SandBoxFrameAllocatorInternal::GetAlignment(Alignment));
+}
+
+void* FSandBoxFrameAllocator::Reallocate(void* Ptr, SIZE_T CopySize, SIZE_T NewSize, uint32 Alignment)
+{
+	if (NewSize == 0)
+	{
+		return nullptr;
+	}
+
+	FThreadArena& Arena = GetThreadArena();
+	FThreadArena::FBuffer& Buffer = Arena.GetBuffer(GetFrameIndex());
+	if (Ptr != nullptr && Arena.TryResizeInPlace(Buffer, Ptr, CopySize, NewSize))
+	{
+		return Ptr;
+	}
+
+	// 古い領域はバッファを使い直すときにまとめて捨てる
+	void* NewPtr = Arena.Allocate(Buffer, NewSize, SandBoxFrameAllocatorInternal::GetAlignment(Alignment));
+	if (Ptr != nullptr && CopySize > 0)
+	{
+		FMemory::Memcpy(NewPtr, Ptr, FMath::Min(CopySize, NewSize));
+	}
+	return NewPtr;
+}
+
+bool FSandBoxFrameAllocator::IsHeapScopeActiveOnCurrentThread()
+{
+	return GetThreadArena().HeapScopeDepth > 0;
+}
+
+void* FSandBoxFrameAllocator::ReallocateHeap(void* Ptr, SIZE_T NewSize)
+{
+	if (NewSize == 0)
+	{
+		FMemory::Free(Ptr);
+		return nullptr;
+	}
+
+	// 通常のTArrayと同じく確保し直すたびに1回と数える
+	GetThreadArena().NumHeapScopeAllocs.fetch_add(1, std::memory_order_relaxed);
+	return FMemory::Realloc(Ptr, NewSize);
+}
+
+uint64 FSandBoxFrameAllocator::GetNumHeapAllocsOnCurrentThread()
+{
+	const FThreadArena& Arena = GetThreadArena();
+	return Arena.NumOverflows.load(std::memory_order_relaxed) + Arena.NumHeapScopeAllocs.load(std::memory_order_relaxed);
+}
+
+FSandBoxFrameAllocator::FStats FSandBoxFrameAllocator::GetStats() const
+{
+	FStats Stats;
+	Stats.NumFrames = NumFrames;
+
+	FScopeLock ScopeLock(&ArenasLock);
+	Stats.NumThreads = Arenas.Num();
+	for (const TUniquePtr<FThreadArena>& Arena : Arenas)
+	{
+		Stats.NumAllocs += Arena->NumAllocs.load(std::memory_order_relaxed);
+		Stats.AllocatedBytes += Arena->AllocatedBytes.load(std::memory_order_relaxed);
+		Stats.NumInPlaceResizes += Arena->NumInPlaceResizes.load(std::memory_order_relaxed);
+		Stats.NumOverflows += Arena->NumOverflows.load(std::memory_order_relaxed);
+		Stats.OverflowBytes += Arena->OverflowBytes.load(std::memory_order_relaxed);
+		Stats.HighWaterBytes = FMath::Max(Stats.HighWaterBytes, Arena->HighWaterBytes.load(std::memory_order_relaxed));
+	}
+	return Stats;
+}
+
+void FSandBoxFrameAllocator::DumpStats() const
+{
+	const FStats Stats = GetStats();
+	const double NumStatFrames = static_cast<double>(FMath::Max<uint64>(Stats.NumFrames, 1));
+	UE_LOG(LogTemp, Log, TEXT("SandBoxFrameAllocator Frames:%llu Threads:%d Poison:%d AllocsPerFrame:%.1f KBPerFrame:%.1f InPlaceResizesPerFrame:%.1f OverflowsPerFrame:%.2f OverflowKB:%.1f HighWaterKB:%.1f"),
+		Stats.NumFrames, Stats.NumThreads, SANDBOX_FRAME_ALLOCATOR_POISON, Stats.NumAllocs / NumStatFrames, Stats.AllocatedBytes / 1024.0 / NumStatFrames,
+		Stats.NumInPlaceResizes / NumStatFrames, Stats.NumOverflows / NumStatFrames, Stats.OverflowBytes / 1024.0, Stats.HighWaterBytes / 1024.0);
+
+	FScopeLock ScopeLock(&ArenasLock);
+	for (const TUniquePtr<FThreadArena>& Arena : Arenas)
+	{
+		UE_LOG(LogTemp, Log, TEXT("  Thread:%-6u %-12s CapacityKB:%.0f HighWaterKB:%.1f Allocs:%llu Overflows:%llu"),
+			Arena->ThreadId, *FThreadManager::GetThreadName(Arena->ThreadId), Arena->Capacity / 1024.0, Arena->HighWaterBytes.load(std::memory_order_relaxed) / 1024.0,
+			Arena->NumAllocs.load(std::memory_order_relaxed), Arena->NumOverflows.load(std::memory_order_relaxed));
+	}
+}
+
+void FSandBoxFrameAllocator::ResetStats()
+{
+	NumFrames = 0;
+
+	FScopeLock ScopeLock(&ArenasLock);
+	for (const TUniquePtr<FThreadArena>& Arena : Arenas)
+	{
+		Arena->NumAllocs.store(0, std::memory_order_relaxed);
+		Arena->AllocatedBytes.store(0, std::memory_order_relaxed);
+		Arena->NumInPlaceResizes.store(0, std::memory_order_relaxed);
+		Arena->NumOverflows.store(0, std::memory_order_relaxed);
+		Arena->NumHeapScopeAllocs.store(0, std::memory_order_relaxed);
+		Arena->OverflowBytes.store(0, std::memory_order_relaxed);
+		Arena->HighWaterBytes.store(0, std::memory_order_relaxed);
+	}
+}
+
+/*static*/
+void FSandBoxFrameAllocator::RunBenchmark(int32 NumArrays, int32 NumElements, int32 NumFrames)
+{
+	NumArrays = FMath::Max(NumArrays, 1);
+	NumElements = FMath::Max(NumElements, 1);
+	NumFrames = FMath::Max(NumFrames, 1);
+
+	// 最適化で消されないよう合計をログに出す
+	int64 HeapSum = 0;
+	const double HeapStartSec = FPlatformTime::Seconds();
+	for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		for (int32 ArrayIndex = 0; ArrayIndex < NumArrays; ++ArrayIndex)
+		{
+			TArray<int32> Values;
+			for (int32 Index = 0; Index < NumElements; ++Index)
+			{
+				Values.Add(Index);
+			}
+			HeapSum += Values.Last();
+		}
+	}
+	const double HeapMs = (FPlatformTime::Seconds() - HeapStartSec) * 1000.0;
+
+	// フレームを進めると他の機能が確保した領域が捨てられるため、フレームごとにFScopeで戻す
+	int64 FrameSum = 0;
+	const FStats StatsBefore = Get().GetStats();
+	const double FrameStartSec = FPlatformTime::Seconds();
+	for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		FScope Scope;
+		for (int32 ArrayIndex = 0; ArrayIndex < NumArrays; ++ArrayIndex)
+		{
+			TSandBoxFrameArray<int32> Values;
+			for (int32 Index = 0; Index < NumElements; ++Index)
+			{
+				Values.Add(Index);
+			}
+			FrameSum += Values.Last();
+		}
+	}
+	const double FrameMs = (FPlatformTime::Seconds() - FrameStartSec) * 1000.0;
+	const FStats StatsAfter = Get().GetStats();
+
+	UE_LOG(LogTemp, Log, TEXT("FrameAllocatorBenchmark Arrays:%d Elements:%d Frames:%d Poison:%d HeapMsPerFrame:%.4f FrameAllocatorMsPerFrame:%.4f Speedup:%.2f InPlaceResizes:%llu Overflows:%llu Sum:%lld"),
+		NumArrays, NumElements, NumFrames, SANDBOX_FRAME_ALLOCATOR_POISON, HeapMs / NumFrames, FrameMs / NumFrames, HeapMs / FMath::Max(FrameMs, 0.0001),
+		StatsAfter.NumInPlaceResizes - StatsBefore.NumInPlaceResizes, StatsAfter.NumOverflows - StatsBefore.NumOverflows, HeapSum + FrameSum);
+}
+
+FSandBoxFrameAllocator::FThreadArena& FSandBoxFrameAllocator::GetThreadArena()
+{
+	// 初回の確保でスレッド専用のバッファを作る。バッファはプロセス終了まで破棄しない
+	static thread_local FThreadArena* ThreadArena = nullptr;
+	if (ThreadArena == nullptr)
+	{
+		FScopeLock ScopeLock(&ArenasLock);
+		const SIZE_T Capacity = IsInGameThread() ? GameThreadBufferSize : WorkerBufferSize;
+		ThreadArena = Arenas.Add_GetRef(MakeUnique<FThreadArena>(FPlatformTLS::GetCurrentThreadId(), Capacity)).Get();
+	}
+	return *ThreadArena;
+}
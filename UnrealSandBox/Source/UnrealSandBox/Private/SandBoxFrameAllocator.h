@@ -0,0 +1,295 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * @brief 確保した領域を塗りつぶしてフレームをまたいだ参照や未初期化の読み取りを見つけやすくするか
+ *		　新しく確保した領域は0xCD、解放した領域は0xDDで塗りつぶします。
+ */
+#ifndef SANDBOX_FRAME_ALLOCATOR_POISON
+#define SANDBOX_FRAME_ALLOCATOR_POISON (!UE_BUILD_SHIPPING && !UE_BUILD_TEST)
+#endif
+
+/**
+ * @brief フレームの間だけ使う一時データ用のスレッドごとの線形アロケーター
+ *		　毎フレーム作って捨てるTArrayなどの一時データを汎用ヒープから確保すると、確保・解放のたびにアロケーターのロックや管理領域の更新が発生します。
+ *		　このアロケーターはスレッドごとに2つのバッファを持ち、フレームごとに交互に使います。
+ *		　・確保はバッファの先頭からずらすだけで、個別の解放はしない
+ *		　・USampleSubSystemのTickの先頭でBeginFrameを呼び出すとフレーム番号が進み、各スレッドは次の確保時に2フレーム前に使ったバッファをまとめて捨てて使い直す
+ *		　ため、確保した領域は次のフレームの終わりまで有効です。それより長く保持しないでください。
+ *		　バッファが足りない場合は汎用ヒープから確保し、そのバッファを使い直すときに解放します。
+ *		　スレッドごとの最大使用量(ハイウォーターマーク)と、ヒープから確保した回数を集計します。
+ *
+ * 使用例
+
+TSandBoxFrameArray<FVector> Locations;
+Locations.Reserve(Characters.Num());
+for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& Character : Characters)
+{
+	Locations.Add(Character->GetActorLocation());
+}
+
+ */
+class FSandBoxFrameAllocator final
+{
+public:
+	// スレッドごとのバッファの大きさ
+	static constexpr SIZE_T GameThreadBufferSize = 1024 * 1024;
+	static constexpr SIZE_T WorkerBufferSize = 256 * 1024;
+
+	/**
+	 * @brief 全スレッドの集計
+	 */
+	struct FStats
+	{
+		uint64 NumFrames = 0;
+		uint64 NumAllocs = 0;
+		uint64 AllocatedBytes = 0;
+		// 末尾の領域をその場で伸ばした回数
+		uint64 NumInPlaceResizes = 0;
+		// バッファが足りずヒープから確保した回数
+		uint64 NumOverflows = 0;
+		uint64 OverflowBytes = 0;
+		// スレッドごとのハイウォーターマークの最大
+		uint64 HighWaterBytes = 0;
+		int32 NumThreads = 0;
+	};
+
+	/**
+	 * @brief スコープを抜けるときに、スコープ内で呼び出したスレッドが確保した領域を解放します
+	 *		　1フレームの中で何度も一時データを作る処理で、バッファを使い切らないようにするために使います。
+	 *		　スコープ内でフレームが進んだ場合は何もしません。
+	 *		　スコープより前に確保した領域はスコープ内ではその場で伸ばさず、新しく確保し直します。
+	 */
+	class FScope final
+	{
+	public:
+		FScope();
+		~FScope();
+
+		FScope(const FScope&) = delete;
+		FScope& operator=(const FScope&) = delete;
+
+	private:
+		uint64 FrameIndex;
+		SIZE_T Used;
+	};
+
+	/**
+	 * @brief スコープ内で呼び出したスレッドが新しく確保を始めたTSandBoxFrameArrayを汎用ヒープから確保させます
+	 *		　同じ処理をこのアロケーターなしで実行した場合のヒープの確保数を計測するために使います。
+	 *		　ヒープから確保した配列は通常のTArrayと同じく破棄時に解放されます。
+	 */
+	class FHeapScope final
+	{
+	public:
+		FHeapScope();
+		~FHeapScope();
+
+		FHeapScope(const FHeapScope&) = delete;
+		FHeapScope& operator=(const FHeapScope&) = delete;
+	};
+
+	static FSandBoxFrameAllocator& Get();
+
+	/**
+	 * @brief フレーム番号を進めます。同じフレームで複数回呼び出しても1回だけ進めます
+	 *		　ゲームスレッドから呼び出してください。
+	 */
+	void BeginFrame();
+
+	/**
+	 * @brief 呼び出したスレッドのバッファから確保します。どのスレッドからでも呼び出せます
+	 * @param Alignment 0であればDEFAULT_ALIGNMENT
+	 */
+	void* Allocate(SIZE_T Size, uint32 Alignment = DEFAULT_ALIGNMENT);
+
+	/**
+	 * @brief 確保し直します。Ptrが呼び出したスレッドの最後の確保であればその場で伸ばします
+	 * @param Ptr 以前にAllocateかReallocateで確保した領域。nullptrであれば新しく確保する
+	 * @param CopySize 新しい領域にコピーする大きさ
+	 * @param NewSize 新しい大きさ。0であればnullptrを返す
+	 */
+	void* Reallocate(void* Ptr, SIZE_T CopySize, SIZE_T NewSize, uint32 Alignment = DEFAULT_ALIGNMENT);
+
+	/**
+	 * @brief 呼び出したスレッドでFHeapScopeが有効か
+	 */
+	bool IsHeapScopeActiveOnCurrentThread();
+
+	/**
+	 * @brief FHeapScope内で確保を始めた配列用に汎用ヒープから確保し直します。確保した回数を集計します
+	 * @param NewSize 新しい大きさ。0であれば解放してnullptrを返す
+	 */
+	void* ReallocateHeap(void* Ptr, SIZE_T NewSize);
+
+	uint64 GetFrameIndex() const { return FrameIndex.load(std::memory_order_relaxed); }
+
+	FStats GetStats() const;
+
+	/**
+	 * @brief 呼び出したスレッドで、バッファが足りずに、またはFHeapScope内でヒープから確保した回数。ResetStatsで0に戻ります
+	 */
+	uint64 GetNumHeapAllocsOnCurrentThread();
+
+	/**
+	 * @brief 1フレームあたりの確保数・確保量とスレッドごとのハイウォーターマークをログに出力します
+	 */
+	void DumpStats() const;
+
+	void ResetStats();
+
+	/**
+	 * @brief 1フレームに作る一時的なTArrayを汎用ヒープとこのアロケーターで確保した場合の時間を比較し、ログに出力します
+	 * @param NumArrays 1フレームに作る配列の数
+	 * @param NumElements 配列ごとに追加する要素数。予約せずに追加するため途中で確保し直す
+	 * @param NumFrames 計測するフレーム数
+	 */
+	static void RunBenchmark(int32 NumArrays, int32 NumElements, int32 NumFrames);
+
+private:
+	class FThreadArena;
+
+	FSandBoxFrameAllocator() = default;
+
+	/**
+	 * @brief 呼び出したスレッドのバッファを取得します。初回はバッファを作ります
+	 */
+	FThreadArena& GetThreadArena();
+
+	std::atomic<uint64> FrameIndex{1};
+	uint64 LastFrameCounter = MAX_uint64;
+	uint64 NumFrames = 0;
+
+	mutable FCriticalSection ArenasLock;
+	TArray<TUniquePtr<FThreadArena>> Arenas;
+};
+
+/**
+ * @brief FSandBoxFrameAllocatorから確保するTArray用のアロケーター
+ *		　要素のデストラクタは通常通り呼ばれますが、領域は解放せずフレームが進むと使い直されます。
+ *		　配列を次のフレームより後まで保持しないでください。
+ */
+class FSandBoxFrameArrayAllocator
+{
+public:
+	using SizeType = int32;
+
+	enum { NeedsElementType = false };
+	enum { RequireRangeCheck = true };
+
+	class ForAnyElementType
+	{
+	public:
+		ForAnyElementType() = default;
+
+		~ForAnyElementType()
+		{
+			if (bHeap && Data != nullptr)
+			{
+				FMemory::Free(Data);
+			}
+		}
+
+		ForAnyElementType(const ForAnyElementType&) = delete;
+		ForAnyElementType& operator=(const ForAnyElementType&) = delete;
+
+		FORCEINLINE void MoveToEmpty(ForAnyElementType& Other)
+		{
+			checkSlow(this != &Other);
+			if (bHeap && Data != nullptr)
+			{
+				FMemory::Free(Data);
+			}
+			Data = Other.Data;
+			bHeap = Other.bHeap;
+			Other.Data = nullptr;
+			Other.bHeap = false;
+		}
+
+		FORCEINLINE FScriptContainerElement* GetAllocation() const
+		{
+			return Data;
+		}
+
+		void ResizeAllocation(SizeType PreviousNumElements, SizeType NumElements, SIZE_T NumBytesPerElement)
+		{
+			// どちらから確保するかは最初の確保時に決める
+			if (Data == nullptr && NumElements > 0)
+			{
+				bHeap = FSandBoxFrameAllocator::Get().IsHeapScopeActiveOnCurrentThread();
+			}
+
+			if (bHeap)
+			{
+				Data = static_cast<FScriptContainerElement*>(FSandBoxFrameAllocator::Get().ReallocateHeap(Data, NumElements * NumBytesPerElement));
+			}
+			else if (Data != nullptr || NumElements > 0)
+			{
+				Data = static_cast<FScriptContainerElement*>(FSandBoxFrameAllocator::Get().Reallocate(Data, PreviousNumElements * NumBytesPerElement, NumElements * NumBytesPerElement));
+			}
+		}
+
+		// 伸ばすたびに古い領域が無駄になるため、ヒープのアロケーターと同じく余裕を持って確保する。量子化はしない
+		FORCEINLINE SizeType CalculateSlackReserve(SizeType NumElements, SIZE_T NumBytesPerElement) const
+		{
+			return DefaultCalculateSlackReserve(NumElements, NumBytesPerElement, false);
+		}
+
+		FORCEINLINE SizeType CalculateSlackShrink(SizeType NumElements, SizeType NumAllocatedElements, SIZE_T NumBytesPerElement) const
+		{
+			return DefaultCalculateSlackShrink(NumElements, NumAllocatedElements, NumBytesPerElement, false);
+		}
+
+		FORCEINLINE SizeType CalculateSlackGrow(SizeType NumElements, SizeType NumAllocatedElements, SIZE_T NumBytesPerElement) const
+		{
+			return DefaultCalculateSlackGrow(NumElements, NumAllocatedElements, NumBytesPerElement, false);
+		}
+
+		SIZE_T GetAllocatedSize(SizeType NumAllocatedElements, SIZE_T NumBytesPerElement) const
+		{
+			return NumAllocatedElements * NumBytesPerElement;
+		}
+
+		bool HasAllocation() const
+		{
+			return Data != nullptr;
+		}
+
+		SizeType GetInitialCapacity() const
+		{
+			return 0;
+		}
+
+	private:
+		FScriptContainerElement* Data = nullptr;
+		// FHeapScope内で確保を始め、汎用ヒープから確保しているか
+		bool bHeap = false;
+	};
+
+	template<typename ElementType>
+	class ForElementType : public ForAnyElementType
+	{
+	public:
+		FORCEINLINE ElementType* GetAllocation() const
+		{
+			return reinterpret_cast<ElementType*>(ForAnyElementType::GetAllocation());
+		}
+	};
+};
+
+template<>
+struct TAllocatorTraits<FSandBoxFrameArrayAllocator> : TAllocatorTraitsBase<FSandBoxFrameArrayAllocator>
+{
+	enum { SupportsMove = true };
+	enum { IsZeroConstruct = true };
+};
+
+/**
+ * @brief フレームの間だけ使う一時的な配列
+ */
+template<typename ElementType>
+using TSandBoxFrameArray = TArray<ElementType, FSandBoxFrameArrayAllocator>;
@@ -0,0 +1,720 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxLog.h"
+#include "Algo/StableSort.h"
+#include "Async/ParallelFor.h"
+#include "HAL/FileManager.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+namespace SandBoxLogInternal
+{
+	// ファイルの先頭の識別子 "SBLG"
+	constexpr uint32 FileMagic = 0x474C4253;
+	constexpr uint32 FileVersion = 1;
+
+	// 書き出しスレッドが回収する間隔
+	constexpr uint32 DrainIntervalMs = 10;
+
+	/**
+	 * @brief ファイル内のチャンクの種類
+	 */
+	enum class EChunkType : uint8
+	{
+		// 書式の定義。Id, Line, File, Format
+		Format = 1,
+		// 1スレッド分のレコード列。ThreadId, Size, レコード
+		Block = 2,
+		// 破棄したレコード数。ThreadId, Count
+		Dropped = 3,
+	};
+
+	/**
+	 * @brief 復元した引数
+	 */
+	struct FDecodedArg
+	{
+		uint8 Type = 0;
+		int64 Int = 0;
+		uint64 UInt = 0;
+		double Double = 0.0;
+		FString String;
+	};
+
+	/**
+	 * @brief 復元したレコード
+	 */
+	struct FDecodedRecord
+	{
+		uint64 Cycles;
+		uint32 ThreadId;
+		FString Text;
+	};
+
+	/**
+	 * @brief printf形式の書式に引数を当てはめて文字列にします
+	 *		　フラグは-と0、幅と精度、変換指定子はd i u x X o c f F e E g G sに対応します。長さ修飾子は無視します。
+	 */
+	FString FormatRecord(const FString& Format, const TArray<FDecodedArg>& Args, uint8 IntType, uint8 UIntType, uint8 DoubleType)
+	{
+		FString Result;
+		int32 ArgIndex = 0;
+		const TCHAR* Cursor = *Format;
+		while (*Cursor != TEXT('\0'))
+		{
+			if (*Cursor != TEXT('%'))
+			{
+				Result.AppendChar(*Cursor++);
+				continue;
+			}
+			if (Cursor[1] == TEXT('%'))
+			{
+				Result.AppendChar(TEXT('%'));
+				Cursor += 2;
+				continue;
+			}
+			++Cursor;
+
+			bool bLeftAlign = false;
+			bool bZeroPad = false;
+			for (; *Cursor == TEXT('-') || *Cursor == TEXT('0') || *Cursor == TEXT('+') || *Cursor == TEXT(' ') || *Cursor == TEXT('#'); ++Cursor)
+			{
+				bLeftAlign |= *Cursor == TEXT('-');
+				bZeroPad |= *Cursor == TEXT('0');
+			}
+			int32 Width = 0;
+			for (; FChar::IsDigit(*Cursor); ++Cursor)
+			{
+				Width = Width * 10 + (*Cursor - TEXT('0'));
+			}
+			int32 Precision = 6;
+			if (*Cursor == TEXT('.'))
+			{
+				Precision = 0;
+				for (++Cursor; FChar::IsDigit(*Cursor); ++Cursor)
+				{
+					Precision = Precision * 10 + (*Cursor - TEXT('0'));
+				}
+			}
+			while (*Cursor == TEXT('h') || *Cursor == TEXT('l') || *Cursor == TEXT('L') || *Cursor == TEXT('z') || *Cursor == TEXT('j') || *Cursor == TEXT('t'))
+			{
+				++Cursor;
+			}
+			const TCHAR Conversion = *Cursor;
+			if (Conversion == TEXT('\0'))
+			{
+				break;
+			}
+			++Cursor;
+
+			if (!Args.IsValidIndex(ArgIndex))
+			{
+				Result += TEXT("<missing>");
+				continue;
+			}
+			const FDecodedArg& Arg = Args[ArgIndex++];
+			const int64 IntValue = Arg.Type == IntType ? Arg.Int : Arg.Type == UIntType ? static_cast<int64>(Arg.UInt) : static_cast<int64>(Arg.Double);
+			const uint64 UIntValue = Arg.Type == UIntType ? Arg.UInt : Arg.Type == IntType ? static_cast<uint64>(Arg.Int) : static_cast<uint64>(Arg.Double);
+			const double DoubleValue = Arg.Type == DoubleType ? Arg.Double : Arg.Type == IntType ? static_cast<double>(Arg.Int) : static_cast<double>(Arg.UInt);
+
+			FString Value;
+			bool bNumeric = true;
+			switch (Conversion)
+			{
+			case TEXT('d'):
+			case TEXT('i'):
+				Value = FString::Printf(TEXT("%lld"), IntValue);
+				break;
+			case TEXT('u'):
+				Value = FString::Printf(TEXT("%llu"), UIntValue);
+				break;
+			case TEXT('x'):
+				Value = FString::Printf(TEXT("%llx"), UIntValue);
+				break;
+			case TEXT('X'):
+				Value = FString::Printf(TEXT("%llX"), UIntValue);
+				break;
+			case TEXT('o'):
+				Value = FString::Printf(TEXT("%llo"), UIntValue);
+				break;
+			case TEXT('c'):
+				Value.AppendChar(static_cast<TCHAR>(UIntValue));
+				bNumeric = false;
+				break;
+			case TEXT('f'):
+			case TEXT('F'):
+				Value = FString::Printf(TEXT("%.*f"), Precision, DoubleValue);
+				break;
+			case TEXT('e'):
+				Value = FString::Printf(TEXT("%.*e"), Precision, DoubleValue);
+				break;
+			case TEXT('E'):
+				Value = FString::Printf(TEXT("%.*E"), Precision, DoubleValue);
+				break;
+			case TEXT('g'):
+				Value = FString::Printf(TEXT("%.*g"), Precision, DoubleValue);
+				break;
+			case TEXT('G'):
+				Value = FString::Printf(TEXT("%.*G"), Precision, DoubleValue);
+				break;
+			default:
+				Value = Arg.Type == IntType ? LexToString(Arg.Int) : Arg.Type == UIntType ? LexToString(Arg.UInt) : Arg.Type == DoubleType ? LexToString(Arg.Double) : Arg.String;
+				bNumeric = false;
+				break;
+			}
+
+			if (Value.Len() < Width)
+			{
+				const int32 NumPadding = Width - Value.Len();
+				if (bLeftAlign)
+				{
+					Value += FString::ChrN(NumPadding, TEXT(' '));
+				}
+				else if (bZeroPad && bNumeric)
+				{
+					const int32 SignLength = Value.StartsWith(TEXT("-")) ? 1 : 0;
+					Value.InsertAt(SignLength, FString::ChrN(NumPadding, TEXT('0')));
+				}
+				else
+				{
+					Value = FString::ChrN(NumPadding, TEXT(' ')) + Value;
+				}
+			}
+			Result += Value;
+		}
+		return Result;
+	}
+}
+
+/**
+ * @brief スレッドごとのリングバッファ
+ *		　書き込みは所有スレッドのみ、読み込みは書き出しスレッドのみが行います。
+ *		　インデックスは折り返さずに増やし続け、バッファ上の位置はCapacityで割った余りで求めます。
+ */
+struct FSandBoxLog::FRing
+{
+	explicit FRing(uint32 InThreadId)
+		: ThreadId(InThreadId)
+	{
+		Buffer.SetNumUninitialized(RingCapacity);
+	}
+
+	const uint32 ThreadId;
+	TArray<uint8> Buffer;
+
+	// 書き込み側と読み込み側で別のキャッシュラインに置く
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> WriteIndex{0};
+	std::atomic<uint64> NumRecords{0};
+	std::atomic<uint64> NumDropped{0};
+	alignas(PLATFORM_CACHE_LINE_SIZE) std::atomic<uint64> ReadIndex{0};
+
+	// 書き出しスレッドのみが触る
+	uint64 NumDroppedWritten = 0;
+};
+
+/**
+ * @brief 一定間隔でリングバッファを回収してファイルに書き出すスレッド
+ */
+class FSandBoxLog::FDrainThread final : public FRunnable
+{
+public:
+	explicit FDrainThread(FSandBoxLog& InLog)
+		: Log(InLog)
+		, WakeEvent(FPlatformProcess::GetSynchEventFromPool())
+	{
+		Thread.Reset(FRunnableThread::Create(this, TEXT("SandBoxLogDrain"), 0, TPri_BelowNormal));
+	}
+
+	virtual ~FDrainThread() override
+	{
+		Stop();
+		Thread->WaitForCompletion();
+		Thread.Reset();
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	}
+
+	virtual uint32 Run() override
+	{
+		while (!bStopRequested.load(std::memory_order_acquire))
+		{
+			Log.Drain();
+			WakeEvent->Wait(SandBoxLogInternal::DrainIntervalMs);
+		}
+		return 0;
+	}
+
+	virtual void Stop() override
+	{
+		bStopRequested.store(true, std::memory_order_release);
+		WakeEvent->Trigger();
+	}
+
+private:
+	FSandBoxLog& Log;
+	FEvent* WakeEvent;
+	TUniquePtr<FRunnableThread> Thread;
+	std::atomic<bool> bStopRequested{false};
+};
+
+//---------------------------------------------------------------------------------
+// FSandBoxLog
+//---------------------------------------------------------------------------------
+FSandBoxLog& FSandBoxLog::Get()
+{
+	static FSandBoxLog Instance;
+	return Instance;
+}
+
+FString FSandBoxLog::GetDefaultFilePath()
+{
+	// 負荷試験で同時に起動したクライアント同士で衝突しないようプロセスIDを付ける
+	return FPaths::ProjectLogDir() / FString::Printf(TEXT("SandBox_%s_%u.sblog"), *FDateTime::Now().ToString(), FPlatformProcess::GetCurrentProcessId());
+}
+
+bool FSandBoxLog::Start(const FString& InFilePath)
+{
+	if (IsRunning())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SandBoxLogは開始済みです:%s"), *FilePath);
+		return false;
+	}
+
+	Writer.Reset(IFileManager::Get().CreateFileWriter(*InFilePath));
+	if (!Writer.IsValid())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SandBoxLogのファイルを開けませんでした:%s"), *InFilePath);
+		return false;
+	}
+	FilePath = InFilePath;
+
+	uint32 Magic = SandBoxLogInternal::FileMagic;
+	uint32 Version = SandBoxLogInternal::FileVersion;
+	uint32 CharSize = sizeof(TCHAR);
+	double SecondsPerCycle = FPlatformTime::GetSecondsPerCycle64();
+	uint64 StartCycles = FPlatformTime::Cycles64();
+	int64 StartTicks = FDateTime::Now().GetTicks();
+	*Writer << Magic << Version << CharSize << SecondsPerCycle << StartCycles << StartTicks;
+
+	NumFormatsWritten = 0;
+	bRunning.store(true, std::memory_order_release);
+	DrainThread = MakeUnique<FDrainThread>(*this);
+
+	UE_LOG(LogTemp, Log, TEXT("SandBoxLogを開始しました:%s"), *FilePath);
+	return true;
+}
+
+void FSandBoxLog::Stop()
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+
+	bRunning.store(false, std::memory_order_release);
+	DrainThread.Reset();
+
+	// スレッドの停止後に残りを回収する
+	Drain();
+	Writer->Close();
+	Writer.Reset();
+	UE_LOG(LogTemp, Log, TEXT("SandBoxLogを停止しました:%s"), *FilePath);
+}
+
+uint16 FSandBoxLog::RegisterFormat(const TCHAR* File, int32 Line, const TCHAR* Format)
+{
+	FSandBoxLog& Log = Get();
+	FScopeLock Lock(&Log.FormatsLock);
+	ensureAlwaysMsgf(Log.Formats.Num() < MAX_uint16, TEXT("SandBoxLogの書式が多すぎます"));
+	const int32 FormatId = Log.Formats.Add(FFormat{FPaths::GetCleanFilename(File), Line, Format});
+	Log.FormatStringBytes += Log.Formats[FormatId].File.GetAllocatedSize() + Log.Formats[FormatId].Format.GetAllocatedSize();
+	Log.FormatsMemory.Set(Log.Formats.GetAllocatedSize() + Log.FormatStringBytes);
+	return static_cast<uint16>(FormatId);
+}
+
+int32 FSandBoxLog::GetArgSize(const TCHAR* Value)
+{
+	const int32 Length = Value != nullptr ? FMath::Min(FCString::Strlen(Value), MaxStringLength) : 0;
+	return sizeof(EArgType) + sizeof(uint16) + Length * sizeof(TCHAR);
+}
+
+uint8* FSandBoxLog::EncodeArg(uint8* Cursor, const TCHAR* Value)
+{
+	const uint16 Length = static_cast<uint16>(Value != nullptr ? FMath::Min(FCString::Strlen(Value), MaxStringLength) : 0);
+	*Cursor++ = static_cast<uint8>(EArgType::String);
+	FMemory::Memcpy(Cursor, &Length, sizeof(uint16));
+	Cursor += sizeof(uint16);
+	if (Length > 0)
+	{
+		FMemory::Memcpy(Cursor, Value, Length * sizeof(TCHAR));
+	}
+	return Cursor + Length * sizeof(TCHAR);
+}
+
+void FSandBoxLog::Push(const uint8* Data, int32 Size)
+{
+	// 初回の書き込みでスレッド専用のリングバッファを作る。リングバッファはプロセス終了まで破棄しない
+	static thread_local FRing* ThreadRing = nullptr;
+	if (ThreadRing == nullptr)
+	{
+		FScopeLock Lock(&RingsLock);
+		ThreadRing = Rings.Add_GetRef(MakeUnique<FRing>(FPlatformTLS::GetCurrentThreadId())).Get();
+		RingsMemory.Set(Rings.GetAllocatedSize() + Rings.Num() * (sizeof(FRing) + RingCapacity));
+	}
+	FRing& Ring = *ThreadRing;
+
+	const uint64 WriteIndex = Ring.WriteIndex.load(std::memory_order_relaxed);
+	const uint64 ReadIndex = Ring.ReadIndex.load(std::memory_order_acquire);
+	if (RingCapacity - (WriteIndex - ReadIndex) < static_cast<uint64>(Size))
+	{
+		Ring.NumDropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	// 末尾で折り返す場合は2回に分けてコピーする
+	const uint32 Offset = static_cast<uint32>(WriteIndex & (RingCapacity - 1));
+	const uint32 FirstSize = FMath::Min(static_cast<uint32>(Size), RingCapacity - Offset);
+	FMemory::Memcpy(Ring.Buffer.GetData() + Offset, Data, FirstSize);
+	if (FirstSize < static_cast<uint32>(Size))
+	{
+		FMemory::Memcpy(Ring.Buffer.GetData(), Data + FirstSize, Size - FirstSize);
+	}
+
+	Ring.WriteIndex.store(WriteIndex + Size, std::memory_order_release);
+	Ring.NumRecords.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FSandBoxLog::Drain()
+{
+	using namespace SandBoxLogInternal;
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	TArray<FRing*, TInlineAllocator<64>> LocalRings;
+	{
+		FScopeLock Lock(&RingsLock);
+		for (const TUniquePtr<FRing>& Ring : Rings)
+		{
+			LocalRings.Add(Ring.Get());
+		}
+	}
+
+	// 先にリングバッファを回収する。回収したレコードの書式はそれより前に登録されているので、
+	// この後に書式を書き出せばレコードより後ろに書式の定義が来ることはない
+	DrainBuffer.Reset();
+	for (FRing* Ring : LocalRings)
+	{
+		const uint64 ReadIndex = Ring->ReadIndex.load(std::memory_order_relaxed);
+		const uint64 WriteIndex = Ring->WriteIndex.load(std::memory_order_acquire);
+		const uint32 Size = static_cast<uint32>(WriteIndex - ReadIndex);
+		if (Size > 0)
+		{
+			FMemoryWriter BlockWriter(DrainBuffer, false, true);
+			uint8 ChunkType = static_cast<uint8>(EChunkType::Block);
+			uint32 ThreadId = Ring->ThreadId;
+			uint32 BlockSize = Size;
+			BlockWriter << ChunkType << ThreadId << BlockSize;
+
+			const uint32 Offset = static_cast<uint32>(ReadIndex & (RingCapacity - 1));
+			const uint32 FirstSize = FMath::Min(Size, RingCapacity - Offset);
+			DrainBuffer.Append(Ring->Buffer.GetData() + Offset, FirstSize);
+			if (FirstSize < Size)
+			{
+				DrainBuffer.Append(Ring->Buffer.GetData(), Size - FirstSize);
+			}
+			Ring->ReadIndex.store(WriteIndex, std::memory_order_release);
+		}
+
+		const uint64 NumDropped = Ring->NumDropped.load(std::memory_order_relaxed);
+		if (NumDropped != Ring->NumDroppedWritten)
+		{
+			FMemoryWriter DroppedWriter(DrainBuffer, false, true);
+			uint8 ChunkType = static_cast<uint8>(EChunkType::Dropped);
+			uint32 ThreadId = Ring->ThreadId;
+			uint64 Count = NumDropped - Ring->NumDroppedWritten;
+			DroppedWriter << ChunkType << ThreadId << Count;
+			Ring->NumDroppedWritten = NumDropped;
+		}
+	}
+
+	{
+		FScopeLock Lock(&FormatsLock);
+		for (; NumFormatsWritten < Formats.Num(); ++NumFormatsWritten)
+		{
+			FFormat& Format = Formats[NumFormatsWritten];
+			uint8 ChunkType = static_cast<uint8>(EChunkType::Format);
+			uint16 Id = static_cast<uint16>(NumFormatsWritten);
+			*Writer << ChunkType << Id << Format.Line << Format.File << Format.Format;
+		}
+	}
+
+	DrainBufferMemory.Set(DrainBuffer.GetAllocatedSize());
+
+	if (DrainBuffer.Num() > 0)
+	{
+		Writer->Serialize(DrainBuffer.GetData(), DrainBuffer.Num());
+		Writer->Flush();
+		NumBytesWritten.fetch_add(DrainBuffer.Num(), std::memory_order_relaxed);
+	}
+
+	NumDrains.fetch_add(1, std::memory_order_relaxed);
+	const uint64 Cycles = FPlatformTime::Cycles64() - StartCycles;
+	if (Cycles > MaxDrainCycles.load(std::memory_order_relaxed))
+	{
+		MaxDrainCycles.store(Cycles, std::memory_order_relaxed);
+	}
+}
+
+/*static*/
+int32 FSandBoxLog::Decode(const FString& InPath, const FString& OutPath)
+{
+	using namespace SandBoxLogInternal;
+
+	TArray<uint8> Data;
+	if (!FFileHelper::LoadFileToArray(Data, *InPath))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("ファイルを読み込めませんでした:%s"), *InPath);
+		return -1;
+	}
+
+	FMemoryReader Reader(Data);
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	uint32 CharSize = 0;
+	double SecondsPerCycle = 0.0;
+	uint64 StartCycles = 0;
+	int64 StartTicks = 0;
+	Reader << Magic << Version << CharSize << SecondsPerCycle << StartCycles << StartTicks;
+	if (Reader.IsError() || Magic != FileMagic || Version != FileVersion)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SandBoxLogのファイルではありません:%s"), *InPath);
+		return -1;
+	}
+	if (CharSize != sizeof(TCHAR))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("TCHARの大きさが異なるプラットフォームで書き出されたファイルです:%s"), *InPath);
+		return -1;
+	}
+
+	TMap<uint16, FFormat> DecodedFormats;
+	TArray<FDecodedRecord> Records;
+	TArray<FDecodedArg> Args;
+	uint64 TotalDropped = 0;
+
+	while (!Reader.AtEnd() && !Reader.IsError())
+	{
+		uint8 ChunkType = 0;
+		Reader << ChunkType;
+
+		if (ChunkType == static_cast<uint8>(EChunkType::Format))
+		{
+			uint16 Id = 0;
+			FFormat Format;
+			Reader << Id << Format.Line << Format.File << Format.Format;
+			DecodedFormats.Add(Id, MoveTemp(Format));
+		}
+		else if (ChunkType == static_cast<uint8>(EChunkType::Dropped))
+		{
+			uint32 ThreadId = 0;
+			uint64 Count = 0;
+			Reader << ThreadId << Count;
+			TotalDropped += Count;
+			Records.Add(FDecodedRecord{Records.Num() > 0 ? Records.Last().Cycles : StartCycles, ThreadId, FString::Printf(TEXT("<%llu records dropped>"), Count)});
+		}
+		else if (ChunkType == static_cast<uint8>(EChunkType::Block))
+		{
+			uint32 ThreadId = 0;
+			uint32 BlockSize = 0;
+			Reader << ThreadId << BlockSize;
+			const int64 BlockEnd = Reader.Tell() + BlockSize;
+			if (BlockEnd > Data.Num())
+			{
+				UE_LOG(LogTemp, Warning, TEXT("ファイルが途中で切れています:%s"), *InPath);
+				break;
+			}
+
+			// ファイルが壊れていても読み込み範囲の外を読まないよう、読み取るたびにブロックの終端を確認する
+			const uint8* Cursor = Data.GetData() + Reader.Tell();
+			const uint8* End = Data.GetData() + BlockEnd;
+			bool bCorrupted = false;
+			while (!bCorrupted && Cursor + sizeof(FRecordHeader) <= End)
+			{
+				FRecordHeader Header;
+				FMemory::Memcpy(&Header, Cursor, sizeof(FRecordHeader));
+				Cursor += sizeof(FRecordHeader);
+				if (Header.PayloadSize > End - Cursor)
+				{
+					bCorrupted = true;
+					break;
+				}
+				const uint8* PayloadEnd = Cursor + Header.PayloadSize;
+
+				Args.Reset();
+				while (Cursor < PayloadEnd)
+				{
+					FDecodedArg& Arg = Args.AddDefaulted_GetRef();
+					Arg.Type = *Cursor++;
+					if (Arg.Type == static_cast<uint8>(EArgType::String))
+					{
+						uint16 Length = 0;
+						if (PayloadEnd - Cursor < static_cast<int64>(sizeof(uint16)))
+						{
+							bCorrupted = true;
+							break;
+						}
+						FMemory::Memcpy(&Length, Cursor, sizeof(uint16));
+						Cursor += sizeof(uint16);
+						if (PayloadEnd - Cursor < static_cast<int64>(Length * sizeof(TCHAR)))
+						{
+							bCorrupted = true;
+							break;
+						}
+						Arg.String = FString(Length, reinterpret_cast<const TCHAR*>(Cursor));
+						Cursor += Length * sizeof(TCHAR);
+					}
+					else if (Arg.Type <= static_cast<uint8>(EArgType::Double))
+					{
+						if (PayloadEnd - Cursor < static_cast<int64>(sizeof(uint64)))
+						{
+							bCorrupted = true;
+							break;
+						}
+						FMemory::Memcpy(Arg.Type == static_cast<uint8>(EArgType::Double) ? static_cast<void*>(&Arg.Double) :
+							Arg.Type == static_cast<uint8>(EArgType::Int) ? static_cast<void*>(&Arg.Int) : static_cast<void*>(&Arg.UInt), Cursor, sizeof(uint64));
+						Cursor += sizeof(uint64);
+					}
+					else
+					{
+						bCorrupted = true;
+						break;
+					}
+				}
+				if (bCorrupted)
+				{
+					break;
+				}
+				Cursor = PayloadEnd;
+
+				const FFormat* Format = DecodedFormats.Find(Header.FormatId);
+				FString Text = Format != nullptr ?
+					FString::Printf(TEXT("%s (%s:%d)"), *FormatRecord(Format->Format, Args, static_cast<uint8>(EArgType::Int), static_cast<uint8>(EArgType::UInt), static_cast<uint8>(EArgType::Double)), *Format->File, Format->Line) :
+					FString::Printf(TEXT("<unknown format %d>"), Header.FormatId);
+				Records.Add(FDecodedRecord{Header.Cycles, ThreadId, MoveTemp(Text)});
+			}
+			if (bCorrupted)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("壊れたレコードがあります。ブロックの残りは読み込みません:%s Thread:%u"), *InPath, ThreadId);
+			}
+			Reader.Seek(BlockEnd);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("不正なチャンクです。以降は読み込みません:%s"), *InPath);
+			break;
+		}
+	}
+
+	// スレッドごとのブロックに分かれているので時刻順に並べ直す
+	Algo::StableSortBy(Records, &FDecodedRecord::Cycles);
+
+	FString Output;
+	const FDateTime StartTime(StartTicks);
+	for (const FDecodedRecord& Record : Records)
+	{
+		const double Seconds = Record.Cycles >= StartCycles ? (Record.Cycles - StartCycles) * SecondsPerCycle : 0.0;
+		const FDateTime Time = StartTime + FTimespan::FromSeconds(Seconds);
+		Output += FString::Printf(TEXT("[%s:%03d][%5u] %s\n"), *Time.ToString(), Time.GetMillisecond(), Record.ThreadId, *Record.Text);
+	}
+	if (!FFileHelper::SaveStringToFile(Output, *OutPath, FFileHelper::EEncodingOptions::ForceUTF8WithoutBOM))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("ファイルを書き出せませんでした:%s"), *OutPath);
+		return -1;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("SandBoxLogDecode Records:%d Formats:%d Dropped:%llu Out:%s"), Records.Num(), DecodedFormats.Num(), TotalDropped, *OutPath);
+	return Records.Num();
+}
+
+/*static*/
+void FSandBoxLog::RunBenchmark(int32 NumCalls, int32 NumThreads)
+{
+	FSandBoxLog& Log = Get();
+	if (!Log.IsRunning())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("SandBoxLogが開始されていません"));
+		return;
+	}
+
+	NumCalls = FMath::Max(NumCalls, 1);
+	NumThreads = FMath::Max(NumThreads, 1);
+
+	// 各スレッドから見た1回あたりの時間。スレッドは同時に動くので経過時間を1スレッドの呼び出し回数で割る
+	const auto Measure = [NumCalls, NumThreads](const TFunctionRef<void(int32, int32)>& Body)
+	{
+		const double StartSec = FPlatformTime::Seconds();
+		ParallelFor(NumThreads, [NumCalls, &Body](int32 ThreadIndex)
+		{
+			for (int32 Index = 0; Index < NumCalls; ++Index)
+			{
+				Body(ThreadIndex, Index);
+			}
+		});
+		return (FPlatformTime::Seconds() - StartSec) * 1000000000.0 / NumCalls;
+	};
+
+	const auto GetTotalDropped = [&Log]()
+	{
+		uint64 Total = 0;
+		FScopeLock Lock(&Log.RingsLock);
+		for (const TUniquePtr<FRing>& Ring : Log.Rings)
+		{
+			Total += Ring->NumDropped.load(std::memory_order_relaxed);
+		}
+		return Total;
+	};
+
+	const uint64 DroppedBefore = GetTotalDropped();
+	const double SandBoxLogNs = Measure([](int32 ThreadIndex, int32 Index)
+	{
+		SANDBOX_LOG(TEXT("SandBoxLogBenchmark Thread:%d Index:%d Value:%.3f"), ThreadIndex, Index, Index * 0.5f);
+	});
+	const uint64 Dropped = GetTotalDropped() - DroppedBefore;
+
+	const double UELogNs = Measure([](int32 ThreadIndex, int32 Index)
+	{
+		UE_LOG(LogTemp, Log, TEXT("SandBoxLogBenchmark Thread:%d Index:%d Value:%.3f"), ThreadIndex, Index, Index * 0.5f);
+	});
+
+	UE_LOG(LogTemp, Log, TEXT("SandBoxLogBenchmark Calls:%d Threads:%d SandBoxLogNs:%.1f UELogNs:%.1f Ratio:%.1f Dropped:%llu"),
+		NumCalls, NumThreads, SandBoxLogNs, UELogNs, UELogNs / FMath::Max(SandBoxLogNs, 0.001), Dropped);
+}
+
+void FSandBoxLog::DumpStats() const
+{
+	uint64 NumRecords = 0;
+	uint64 NumDropped = 0;
+	int32 NumRings = 0;
+	{
+		FScopeLock Lock(&RingsLock);
+		NumRings = Rings.Num();
+		for (const TUniquePtr<FRing>& Ring : Rings)
+		{
+			NumRecords += Ring->NumRecords.load(std::memory_order_relaxed);
+			NumDropped += Ring->NumDropped.load(std::memory_order_relaxed);
+		}
+	}
+	int32 NumFormats = 0;
+	{
+		FScopeLock Lock(&FormatsLock);
+		NumFormats = Formats.Num();
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("SandBoxLog Running:%d Threads:%d Formats:%d Records:%llu Dropped:%llu Oversized:%llu WrittenKB:%.1f Drains:%u MaxDrainMs:%.3f File:%s"),
+		IsRunning(), NumRings, NumFormats, NumRecords, NumDropped, NumOversizedRecords.load(std::memory_order_relaxed),
+		NumBytesWritten.load(std::memory_order_relaxed) / 1024.0, NumDrains.load(std::memory_order_relaxed),
+		FPlatformTime::ToMilliseconds64(MaxDrainCycles.load(std::memory_order_relaxed)), *FilePath);
+}
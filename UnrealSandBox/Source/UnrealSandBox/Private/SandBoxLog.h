@@ -0,0 +1,251 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SandBoxMemoryTracker.h"
+#include "Templates/IsSigned.h"
+#include <atomic>
+
+/**
+ * @brief ワーカースレッドなどのホットパスから低コストでログを出力するマクロ
+ *		　書式はTEXT()の文字列リテラルで指定してください。呼び出し箇所ごとに初回のみ書式を登録し、
+ *		　以降は書式のIDと引数の値だけを記録します。文字列への整形はFSandBoxLog::Decodeで後から行います。
+ *		　引数に使えるのは数値・bool・const TCHAR*・FStringです。書式の%sにはFStringをそのまま渡します。
+ *
+ * 使用例
+
+SANDBOX_LOG(TEXT("Task Start Id:%d SleepSec:%.2f Name:%s"), Id, SleepSec, Name);
+
+ */
+#define SANDBOX_LOG(Format, ...) \
+	do \
+	{ \
+		static const uint16 SandBoxLogFormatId = FSandBoxLog::RegisterFormat(TEXT(__FILE__), __LINE__, Format); \
+		FSandBoxLog::Write(SandBoxLogFormatId, ##__VA_ARGS__); \
+	} while (0)
+
+/**
+ * @brief スレッドごとのリングバッファにバイナリのレコードを書き込むログ
+ *		　UE_LOGは呼び出しのたびに文字列を整形し、ログデバイスのロックを取って出力するため、
+ *		　多数のスレッドから頻繁に呼び出すと整形とロックの競合が負荷になります。このログでは
+ *		　・呼び出したスレッドは自分専用のリングバッファ(単一生産者・単一消費者)にタイムスタンプと引数の値を書き込むだけで、ロックを取らない
+ *		　・バックグラウンドスレッドが定期的に全スレッドのリングバッファを回収してファイルに書き出す
+ *		　・文字列への整形はファイルを読み込むときにFSandBoxLog::Decodeで行う
+ *		　ことで、呼び出し側のコストを数十ナノ秒程度に抑えます。
+ *		　リングバッファが一杯のときは書き込まずに破棄し、破棄数をファイルに記録します。
+ */
+class FSandBoxLog final
+{
+public:
+	static FSandBoxLog& Get();
+
+	/**
+	 * @brief ファイルへの書き出しを開始します
+	 *		　開始するまではSANDBOX_LOGを呼び出しても何も記録されません。
+	 * @param FilePath 書き出すファイルのパス
+	 * @return ファイルを開けなかった場合はfalse
+	 */
+	bool Start(const FString& FilePath);
+
+	/**
+	 * @brief 残っているレコードを書き出してからファイルを閉じます
+	 */
+	void Stop();
+
+	bool IsRunning() const { return bRunning.load(std::memory_order_relaxed); }
+
+	const FString& GetFilePath() const { return FilePath; }
+
+	/**
+	 * @brief 起動ごとのデフォルトの出力先。Saved/Logs/SandBox_<日時>_<プロセスID>.sblog
+	 */
+	static FString GetDefaultFilePath();
+
+	/**
+	 * @brief 書式を登録します。SANDBOX_LOGから呼び出し箇所ごとに一度だけ呼び出されます
+	 * @return 書式のID
+	 */
+	static uint16 RegisterFormat(const TCHAR* File, int32 Line, const TCHAR* Format);
+
+	/**
+	 * @brief レコードを書き込みます。SANDBOX_LOGから呼び出されます
+	 */
+	template<typename... ArgTypes>
+	static void Write(uint16 FormatId, const ArgTypes&... Args);
+
+	/**
+	 * @brief 書き出したファイルを読み込んでテキストに変換します
+	 * @param InPath 読み込むファイル
+	 * @param OutPath 書き出すテキストファイル
+	 * @return 変換したレコード数。ファイルを読み込めなかった場合は-1
+	 */
+	static int32 Decode(const FString& InPath, const FString& OutPath);
+
+	/**
+	 * @brief SANDBOX_LOGとUE_LOGの1回あたりの呼び出し時間を計測してログに出力します
+	 * @param NumCalls スレッドあたりの呼び出し回数
+	 * @param NumThreads 同時に呼び出すスレッド数
+	 */
+	static void RunBenchmark(int32 NumCalls, int32 NumThreads);
+
+	/**
+	 * @brief レコード数・破棄数・書き出し量をログに出力します
+	 */
+	void DumpStats() const;
+
+	// 1レコードの最大サイズ。これを超えるレコードは破棄する
+	static constexpr int32 MaxRecordSize = 1024;
+
+	// 1引数の文字列の最大文字数。超えた分は切り捨てる
+	static constexpr int32 MaxStringLength = 128;
+
+	// スレッドごとのリングバッファの大きさ。2のべき乗
+	static constexpr uint32 RingCapacity = 1024 * 1024;
+
+private:
+	class FDrainThread;
+	struct FRing;
+
+	/**
+	 * @brief 引数の型
+	 */
+	enum class EArgType : uint8
+	{
+		Int,
+		UInt,
+		Double,
+		String,
+	};
+
+	/**
+	 * @brief レコードの先頭
+	 */
+	struct FRecordHeader
+	{
+		uint64 Cycles;
+		uint16 FormatId;
+		uint16 PayloadSize;
+		uint32 Reserved;
+	};
+
+	/**
+	 * @brief 登録された書式
+	 */
+	struct FFormat
+	{
+		FString File;
+		int32 Line;
+		FString Format;
+	};
+
+	FSandBoxLog() = default;
+
+	template<typename T>
+	static typename TEnableIf<TIsArithmetic<T>::Value, int32>::Type GetArgSize(const T&)
+	{
+		return sizeof(EArgType) + sizeof(uint64);
+	}
+	static int32 GetArgSize(const TCHAR* Value);
+	static int32 GetArgSize(const FString& Value) { return GetArgSize(*Value); }
+
+	template<typename T>
+	static typename TEnableIf<TIsArithmetic<T>::Value, uint8*>::Type EncodeArg(uint8* Cursor, const T& Value)
+	{
+		if (TIsFloatingPoint<T>::Value)
+		{
+			*Cursor++ = static_cast<uint8>(EArgType::Double);
+			const double DoubleValue = static_cast<double>(Value);
+			FMemory::Memcpy(Cursor, &DoubleValue, sizeof(double));
+		}
+		else if (TIsSigned<T>::Value)
+		{
+			*Cursor++ = static_cast<uint8>(EArgType::Int);
+			const int64 IntValue = static_cast<int64>(Value);
+			FMemory::Memcpy(Cursor, &IntValue, sizeof(int64));
+		}
+		else
+		{
+			*Cursor++ = static_cast<uint8>(EArgType::UInt);
+			const uint64 UIntValue = static_cast<uint64>(Value);
+			FMemory::Memcpy(Cursor, &UIntValue, sizeof(uint64));
+		}
+		return Cursor + sizeof(uint64);
+	}
+	static uint8* EncodeArg(uint8* Cursor, const TCHAR* Value);
+	static uint8* EncodeArg(uint8* Cursor, const FString& Value) { return EncodeArg(Cursor, *Value); }
+
+	/**
+	 * @brief 呼び出したスレッドのリングバッファにレコードを書き込みます
+	 */
+	void Push(const uint8* Data, int32 Size);
+
+	/**
+	 * @brief 全スレッドのリングバッファを回収してファイルに書き出します。書き出しスレッドでのみ呼び出します
+	 */
+	void Drain();
+
+	std::atomic<bool> bRunning{false};
+	FString FilePath;
+	TUniquePtr<FArchive> Writer;
+	TUniquePtr<FDrainThread> DrainThread;
+
+	mutable FCriticalSection RingsLock;
+	TArray<TUniquePtr<FRing>> Rings;
+	// RingsLockを取って更新する
+	FSandBoxMemoryUsage RingsMemory{ESandBoxMemoryTag::Log};
+
+	mutable FCriticalSection FormatsLock;
+	TArray<FFormat> Formats;
+	// FormatsLockを取って更新する
+	SIZE_T FormatStringBytes = 0;
+	FSandBoxMemoryUsage FormatsMemory{ESandBoxMemoryTag::Log};
+
+	// 書き出しスレッドのみが触る
+	int32 NumFormatsWritten = 0;
+	TArray<uint8> DrainBuffer;
+	FSandBoxMemoryUsage DrainBufferMemory{ESandBoxMemoryTag::Log};
+
+	std::atomic<uint64> NumBytesWritten{0};
+	std::atomic<uint32> NumDrains{0};
+	std::atomic<uint64> MaxDrainCycles{0};
+	std::atomic<uint64> NumOversizedRecords{0};
+};
+
+template<typename... ArgTypes>
+void FSandBoxLog::Write(uint16 FormatId, const ArgTypes&... Args)
+{
+	FSandBoxLog& Log = Get();
+	if (!Log.IsRunning())
+	{
+		return;
+	}
+
+	int32 PayloadSize = 0;
+	const int32 ArgSizes[] = {0, GetArgSize(Args)...};
+	for (const int32 ArgSize : ArgSizes)
+	{
+		PayloadSize += ArgSize;
+	}
+
+	const int32 RecordSize = sizeof(FRecordHeader) + PayloadSize;
+	if (RecordSize > MaxRecordSize)
+	{
+		Log.NumOversizedRecords.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	uint8 Buffer[MaxRecordSize];
+	FRecordHeader Header;
+	Header.Cycles = FPlatformTime::Cycles64();
+	Header.FormatId = FormatId;
+	Header.PayloadSize = static_cast<uint16>(PayloadSize);
+	Header.Reserved = 0;
+	FMemory::Memcpy(Buffer, &Header, sizeof(FRecordHeader));
+
+	uint8* Cursor = Buffer + sizeof(FRecordHeader);
+	const uint8* Encoded[] = {Cursor, (Cursor = EncodeArg(Cursor, Args))...};
+	(void)Encoded;
+
+	Log.Push(Buffer, RecordSize);
+}
@@ -0,0 +1,24 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxLogDecodeCommandlet.h"
+#include "Misc/Paths.h"
+#include "SandBoxLog.h"
+
+int32 USandBoxLogDecodeCommandlet::Main(const FString& Params)
+{
+	FString InPath;
+	if (!FParse::Value(*Params, TEXT("File="), InPath))
+	{
+		UE_LOG(LogTemp, Error, TEXT("-File=で変換するファイルを指定してください"));
+		return 1;
+	}
+
+	FString OutPath;
+	if (!FParse::Value(*Params, TEXT("Out="), OutPath))
+	{
+		OutPath = FPaths::ChangeExtension(InPath, TEXT("txt"));
+	}
+
+	return FSandBoxLog::Decode(InPath, OutPath) >= 0 ? 0 : 1;
+}
@@ -0,0 +1,24 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SandBoxLogDecodeCommandlet.generated.h"
+
+/**
+ * @brief SandBoxLogのファイルをテキストに変換するコマンドレット
+ *
+ * 使用例
+
+UE4Editor-Cmd.exe UnrealSandBox.uproject -run=SandBoxLogDecode -File=Saved/Logs/SandBox_xxx.sblog [-Out=Saved/Logs/SandBox_xxx.txt]
+
+ *		　-Outを省略すると入力ファイルの拡張子を.txtにしたパスに書き出します。
+ */
+UCLASS()
+class USandBoxLogDecodeCommandlet final : public UCommandlet
+{
+	GENERATED_BODY()
+public:
+	virtual int32 Main(const FString& Params) override;
+};
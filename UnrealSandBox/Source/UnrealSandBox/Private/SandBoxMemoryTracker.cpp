@@ -0,0 +1,210 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxMemoryTracker.h"
+#include "Misc/ConfigCacheIni.h"
+#include "Serialization/ArchiveCountMem.h"
+#include <atomic>
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+DECLARE_LLM_MEMORY_STAT(TEXT("SandBoxArgParser"), STAT_SandBoxArgParserLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SandBoxAsyncSample"), STAT_SandBoxAsyncSampleLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SandBoxSampleSubSystem"), STAT_SandBoxSampleSubSystemLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SandBoxCharacterRig"), STAT_SandBoxCharacterRigLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SandBoxFrameAllocator"), STAT_SandBoxFrameAllocatorLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SandBoxPawnPool"), STAT_SandBoxPawnPoolLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SandBoxLog"), STAT_SandBoxLogLLM, STATGROUP_LLMFULL);
+DECLARE_LLM_MEMORY_STAT(TEXT("SandBox"), STAT_SandBoxSummaryLLM, STATGROUP_LLM);
+#endif
+
+namespace SandBoxMemoryTrackerInternal
+{
+	// 予算とレポート間隔を読むiniのセクション
+	const TCHAR* ConfigSection = TEXT("SandBox.MemoryBudgets");
+
+	/**
+	 * @brief タグごとの集計
+	 */
+	struct FTagState
+	{
+		std::atomic<int64> CurrentBytes{0};
+		std::atomic<int64> PeakBytes{0};
+		std::atomic<int32> NumLive{0};
+		std::atomic<int32> NumAllocs{0};
+		// 0であれば予算なし
+		int64 BudgetBytes = 0;
+		std::atomic<bool> bOverBudget{false};
+	};
+
+	FTagState TagStates[static_cast<int32>(ESandBoxMemoryTag::Num)];
+	float ReportIntervalSec = 0.0f;
+	float ReportElapsedSec = 0.0f;
+}
+
+/*static*/
+void FSandBoxMemoryTracker::Initialize()
+{
+	using namespace SandBoxMemoryTrackerInternal;
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	const FName StatNames[] =
+	{
+		GET_STATFNAME(STAT_SandBoxArgParserLLM),
+		GET_STATFNAME(STAT_SandBoxAsyncSampleLLM),
+		GET_STATFNAME(STAT_SandBoxSampleSubSystemLLM),
+		GET_STATFNAME(STAT_SandBoxCharacterRigLLM),
+		GET_STATFNAME(STAT_SandBoxFrameAllocatorLLM),
+		GET_STATFNAME(STAT_SandBoxPawnPoolLLM),
+		GET_STATFNAME(STAT_SandBoxLogLLM),
+	};
+	static_assert(UE_ARRAY_COUNT(StatNames) == static_cast<int32>(ESandBoxMemoryTag::Num), "タグとLLMのstatの数が一致しません");
+	for (int32 Index = 0; Index < static_cast<int32>(ESandBoxMemoryTag::Num); ++Index)
+	{
+		const ESandBoxMemoryTag Tag = static_cast<ESandBoxMemoryTag>(Index);
+		FLowLevelMemTracker::Get().RegisterProjectTag(static_cast<int32>(ToLLMTag(Tag)), GetTagName(Tag), StatNames[Index], GET_STATFNAME(STAT_SandBoxSummaryLLM));
+	}
+#endif
+
+	for (int32 Index = 0; Index < static_cast<int32>(ESandBoxMemoryTag::Num); ++Index)
+	{
+		int32 BudgetKB = 0;
+		GConfig->GetInt(ConfigSection, GetTagName(static_cast<ESandBoxMemoryTag>(Index)), BudgetKB, GGameIni);
+		TagStates[Index].BudgetBytes = static_cast<int64>(BudgetKB) * 1024;
+	}
+
+	GConfig->GetFloat(ConfigSection, TEXT("ReportIntervalSec"), ReportIntervalSec, GGameIni);
+	FParse::Value(FCommandLine::Get(), TEXT("SandBoxMemReportInterval="), ReportIntervalSec);
+}
+
+/*static*/
+void FSandBoxMemoryTracker::Update(ESandBoxMemoryTag Tag, int64 DeltaBytes, int32 DeltaCount)
+{
+	using namespace SandBoxMemoryTrackerInternal;
+
+	FTagState& State = TagStates[static_cast<int32>(Tag)];
+	const int64 CurrentBytes = State.CurrentBytes.fetch_add(DeltaBytes, std::memory_order_relaxed) + DeltaBytes;
+	State.NumLive.fetch_add(DeltaCount, std::memory_order_relaxed);
+	if (DeltaCount > 0)
+	{
+		State.NumAllocs.fetch_add(DeltaCount, std::memory_order_relaxed);
+	}
+
+	int64 PeakBytes = State.PeakBytes.load(std::memory_order_relaxed);
+	while (CurrentBytes > PeakBytes && !State.PeakBytes.compare_exchange_weak(PeakBytes, CurrentBytes, std::memory_order_relaxed))
+	{
+	}
+
+	// 予算を超えたときと下回ったときに1回ずつ出力する
+	if (State.BudgetBytes > 0)
+	{
+		const bool bOverBudget = CurrentBytes > State.BudgetBytes;
+		if (State.bOverBudget.exchange(bOverBudget, std::memory_order_relaxed) != bOverBudget)
+		{
+			if (bOverBudget)
+			{
+				UE_LOG(LogTemp, Warning, TEXT("メモリ予算を超えました Tag:%s CurrentKB:%.1f BudgetKB:%.1f"), GetTagName(Tag), CurrentBytes / 1024.0, State.BudgetBytes / 1024.0);
+			}
+			else
+			{
+				UE_LOG(LogTemp, Log, TEXT("メモリ使用量が予算内に戻りました Tag:%s CurrentKB:%.1f BudgetKB:%.1f"), GetTagName(Tag), CurrentBytes / 1024.0, State.BudgetBytes / 1024.0);
+			}
+		}
+	}
+}
+
+/*static*/
+void FSandBoxMemoryTracker::Tick(float DeltaTime)
+{
+	using namespace SandBoxMemoryTrackerInternal;
+
+	if (ReportIntervalSec <= 0.0f)
+	{
+		return;
+	}
+
+	ReportElapsedSec += DeltaTime;
+	if (ReportElapsedSec >= ReportIntervalSec)
+	{
+		ReportElapsedSec = 0.0f;
+		DumpReport();
+	}
+}
+
+/*static*/
+void FSandBoxMemoryTracker::DumpReport()
+{
+	using namespace SandBoxMemoryTrackerInternal;
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	const bool bLLMEnabled = FLowLevelMemTracker::IsEnabled();
+#else
+	const bool bLLMEnabled = false;
+#endif
+
+	UE_LOG(LogTemp, Log, TEXT("SandBoxMemoryReport LLM:%d"), bLLMEnabled);
+	for (int32 Index = 0; Index < static_cast<int32>(ESandBoxMemoryTag::Num); ++Index)
+	{
+		const ESandBoxMemoryTag Tag = static_cast<ESandBoxMemoryTag>(Index);
+		const FTagState& State = TagStates[Index];
+		const int64 CurrentBytes = State.CurrentBytes.load(std::memory_order_relaxed);
+
+		// LLMが有効であればタグのスコープ内で確保された量も並べる。自前の集計は各機能が報告した量のみ
+		int64 LLMBytes = -1;
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+		if (bLLMEnabled)
+		{
+			LLMBytes = FLowLevelMemTracker::Get().GetTagAmountForTracker(ELLMTracker::Default, ToLLMTag(Tag));
+		}
+#endif
+
+		UE_LOG(LogTemp, Log, TEXT("  %-16s CurrentKB:%10.1f PeakKB:%10.1f Live:%6d Allocs:%8d BudgetKB:%10.1f LLMKB:%10.1f%s"),
+			GetTagName(Tag), CurrentBytes / 1024.0, State.PeakBytes.load(std::memory_order_relaxed) / 1024.0,
+			State.NumLive.load(std::memory_order_relaxed), State.NumAllocs.load(std::memory_order_relaxed),
+			State.BudgetBytes / 1024.0, LLMBytes >= 0 ? LLMBytes / 1024.0 : -1.0,
+			State.BudgetBytes > 0 && CurrentBytes > State.BudgetBytes ? TEXT(" OVER BUDGET") : TEXT(""));
+	}
+}
+
+/*static*/
+void FSandBoxMemoryTracker::ResetPeaks()
+{
+	using namespace SandBoxMemoryTrackerInternal;
+
+	for (FTagState& State : TagStates)
+	{
+		State.PeakBytes.store(State.CurrentBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		State.NumAllocs.store(State.NumLive.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+}
+
+/*static*/
+const TCHAR* FSandBoxMemoryTracker::GetTagName(ESandBoxMemoryTag Tag)
+{
+	switch (Tag)
+	{
+	case ESandBoxMemoryTag::ArgParser:
+		return TEXT("ArgParser");
+	case ESandBoxMemoryTag::AsyncSample:
+		return TEXT("AsyncSample");
+	case ESandBoxMemoryTag::SampleSubSystem:
+		return TEXT("SampleSubSystem");
+	case ESandBoxMemoryTag::CharacterRig:
+		return TEXT("CharacterRig");
+	case ESandBoxMemoryTag::FrameAllocator:
+		return TEXT("FrameAllocator");
+	case ESandBoxMemoryTag::PawnPool:
+		return TEXT("PawnPool");
+	case ESandBoxMemoryTag::Log:
+		return TEXT("Log");
+	default:
+		return TEXT("Invalid");
+	}
+}
+
+/*static*/
+SIZE_T FSandBoxMemoryTracker::GetObjectAllocatedSize(const UObject& Object)
+{
+	// UObject::Serializeはクラスのサイズも数えるため、オブジェクト自体の確保量も含まれる
+	FArchiveCountMem CountMem(const_cast<UObject*>(&Object));
+	return CountMem.GetMax();
+}
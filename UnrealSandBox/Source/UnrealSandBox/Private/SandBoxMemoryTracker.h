@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/LowLevelMemTracker.h"
+
+/**
+ * @brief メモリ使用量を集計する機能の区分
+ */
+enum class ESandBoxMemoryTag : uint8
+{
+	// FArgParserの引数情報とパースした文字列
+	ArgParser,
+	// FAsyncSampleとそのタスク
+	AsyncSample,
+	// USampleSubSystemが持つ機能のオブジェクト
+	SampleSubSystem,
+	// キャラクターのカメラ(スプリングアーム・カメラコンポーネント)
+	CharacterRig,
+	// FSandBoxFrameAllocatorのスレッドごとのバッファと、足りずにヒープから確保した領域
+	FrameAllocator,
+	// FPawnPoolで待機中のキャラクターとそのコンポーネント
+	PawnPool,
+	// FSandBoxLogのスレッドごとのリングバッファと書式
+	Log,
+	Num
+};
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+/**
+ * @brief スコープ内の確保をLow Level Memory Trackerのプロジェクトタグに割り当てます
+ *		　-LLMで起動するとstat LLMFULLやLLMのCSVに機能ごとの使用量が出ます。
+ */
+#define SANDBOX_LLM_SCOPE(Tag) LLM_SCOPE(FSandBoxMemoryTracker::ToLLMTag(Tag))
+#else
+#define SANDBOX_LLM_SCOPE(Tag)
+#endif
+
+/**
+ * @brief 機能ごとのメモリ使用量を集計し、予算と比較するクラス
+ *		　LLMは-LLMで起動した開発ビルドでしか使えないため、サーバーでも常に使える集計を別に持ちます。
+ *		　各機能はFSandBoxMemoryUsageで自分が持つコンテナやキャッシュのGetAllocatedSizeなど実際の確保量を報告し、
+ *		　タグごとに現在量・最大量・確保数を集計します。
+ *		　予算はDefaultGame.iniの[SandBox.MemoryBudgets]にタグ名=KBで設定し、超えたときに警告を出します。
+ *		　ReportIntervalSecを設定するか-SandBoxMemReportInterval=で起動すると、その間隔でレポートをログに出力します。
+ */
+class FSandBoxMemoryTracker final
+{
+public:
+	/**
+	 * @brief LLMのタグ登録と予算の読み込みを行います。モジュールの開始時に呼び出します
+	 */
+	static void Initialize();
+
+	/**
+	 * @brief 使用量の増減を報告します。どのスレッドからでも呼び出せます
+	 * @param DeltaBytes 増減量
+	 * @param DeltaCount 確保数の増減。新しく確保したら1、解放したら-1
+	 */
+	static void Update(ESandBoxMemoryTag Tag, int64 DeltaBytes, int32 DeltaCount);
+
+	/**
+	 * @brief 定期レポートを出力します。ReportIntervalSecが0より大きい場合のみ出力します
+	 */
+	static void Tick(float DeltaTime);
+
+	/**
+	 * @brief タグごとの現在量・最大量・確保数・予算をログに出力します
+	 */
+	static void DumpReport();
+
+	/**
+	 * @brief 最大量と累計の確保数を現在の値にリセットします
+	 */
+	static void ResetPeaks();
+
+	static const TCHAR* GetTagName(ESandBoxMemoryTag Tag);
+
+	/**
+	 * @brief オブジェクト自体と、そのプロパティのコンテナが確保している量を求めます
+	 *		　FArchiveCountMemでシリアライズするため、毎フレーム呼び出すような使い方はしないでください。
+	 */
+	static SIZE_T GetObjectAllocatedSize(const UObject& Object);
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER
+	static ELLMTag ToLLMTag(ESandBoxMemoryTag Tag)
+	{
+		return static_cast<ELLMTag>(static_cast<int32>(ELLMTag::ProjectTagStart) + static_cast<int32>(Tag));
+	}
+#endif
+};
+
+/**
+ * @brief 機能のオブジェクトが自分の使用量を報告するためのメンバー
+ *		　Setで使用量を更新し、破棄時に解放として報告します。コピーすると同じ使用量の確保として報告します。
+ */
+class FSandBoxMemoryUsage final
+{
+public:
+	explicit FSandBoxMemoryUsage(ESandBoxMemoryTag InTag, SIZE_T InBytes = 0)
+		: Tag(InTag)
+	{
+		Set(InBytes);
+	}
+
+	FSandBoxMemoryUsage(const FSandBoxMemoryUsage& Other)
+		: Tag(Other.Tag)
+	{
+		Set(Other.Bytes);
+	}
+
+	FSandBoxMemoryUsage& operator=(const FSandBoxMemoryUsage& Other)
+	{
+		Set(Other.Bytes);
+		return *this;
+	}
+
+	~FSandBoxMemoryUsage()
+	{
+		Set(0);
+	}
+
+	void Set(SIZE_T NewBytes)
+	{
+		if (static_cast<int64>(NewBytes) != Bytes)
+		{
+			const int32 DeltaCount = Bytes == 0 ? 1 : NewBytes == 0 ? -1 : 0;
+			FSandBoxMemoryTracker::Update(Tag, static_cast<int64>(NewBytes) - Bytes, DeltaCount);
+			Bytes = static_cast<int64>(NewBytes);
+		}
+	}
+
+	int64 Get() const { return Bytes; }
+
+private:
+	const ESandBoxMemoryTag Tag;
+	int64 Bytes = 0;
+};
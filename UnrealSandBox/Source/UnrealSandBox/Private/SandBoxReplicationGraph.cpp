@@ -0,0 +1,234 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxReplicationGraph.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/Info.h"
+#include "ReplicationGraphTypes.h"
+#include "UnrealSandBox/UnrealSandBoxCharacter.h"
+#include "UnrealSandBox/UnrealSandBoxGameMode.h"
+
+USandBoxReplicationGraph::USandBoxReplicationGraph()
+{
+	GridCellSize = 10000.0f;
+	GridSpatialBias = FVector2D(-WORLD_MAX, -WORLD_MAX);
+}
+
+UReplicationDriver* USandBoxReplicationGraph::CreateForSandBoxSession(UNetDriver* ForNetDriver, const FURL& URL, UWorld* InWorld)
+{
+	if (ForNetDriver == nullptr || InWorld == nullptr || ForNetDriver->NetDriverName != NAME_GameNetDriver)
+	{
+		return nullptr;
+	}
+
+	// ネットドライバーはゲームモードの生成後にListenで作られるので、ここでセッションのゲームモードを判定できる
+	if (InWorld->GetAuthGameMode<AUnrealSandBoxGameMode>() == nullptr || FParse::Param(FCommandLine::Get(), TEXT("NoSandBoxRepGraph")))
+	{
+		return nullptr;
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("USandBoxReplicationGraphを使用します"));
+	return NewObject<USandBoxReplicationGraph>(GetTransientPackage());
+}
+
+USandBoxReplicationGraph* USandBoxReplicationGraph::Get(const UWorld* InWorld)
+{
+	const UNetDriver* WorldNetDriver = InWorld != nullptr ? InWorld->GetNetDriver() : nullptr;
+	return WorldNetDriver != nullptr ? Cast<USandBoxReplicationGraph>(WorldNetDriver->GetReplicationDriver()) : nullptr;
+}
+
+void USandBoxReplicationGraph::NotifyNetUpdateFrequencyChanged(AActor& Actor)
+{
+	USandBoxReplicationGraph* Graph = Get(Actor.GetWorld());
+	if (Graph == nullptr)
+	{
+		return;
+	}
+
+	if (FGlobalActorReplicationInfo* GlobalInfo = Graph->GlobalActorReplicationInfoMap.Find(&Actor))
+	{
+		GlobalInfo->Settings.ReplicationPeriodFrame = Graph->ComputeReplicationPeriodFrame(Actor.NetUpdateFrequency);
+	}
+}
+
+void USandBoxReplicationGraph::InitGlobalActorClassSettings()
+{
+	Super::InitGlobalActorClassSettings();
+
+	// レプリケートされるアクターのクラスごとに、送信間隔と関連距離をCDOの設定から決める
+	for (TObjectIterator<UClass> It; It; ++It)
+	{
+		UClass* Class = *It;
+		if (!Class->IsChildOf(AActor::StaticClass()) || Class->HasAnyClassFlags(CLASS_Abstract | CLASS_Deprecated | CLASS_NewerVersionExists))
+		{
+			continue;
+		}
+
+		// Blueprintの再コンパイル中にできる一時クラスは対象外
+		const FString ClassName = Class->GetName();
+		if (ClassName.StartsWith(TEXT("SKEL_")) || ClassName.StartsWith(TEXT("REINST_")))
+		{
+			continue;
+		}
+
+		const AActor* ActorCDO = Class->GetDefaultObject<AActor>();
+		if (ActorCDO == nullptr || !ActorCDO->GetIsReplicated())
+		{
+			continue;
+		}
+
+		const ENodeMapping Mapping = GetNodeMapping(Class);
+		NodeMappings.Add(Class, Mapping);
+
+		FClassReplicationInfo ClassInfo;
+		ClassInfo.ReplicationPeriodFrame = ComputeReplicationPeriodFrame(ActorCDO->NetUpdateFrequency);
+		if (Mapping == ENodeMapping::SpatializeStatic || Mapping == ENodeMapping::SpatializeDynamic || Mapping == ENodeMapping::SpatializeDormancy)
+		{
+			ClassInfo.SetCullDistanceSquared(ActorCDO->NetCullDistanceSquared);
+		}
+		GlobalActorReplicationInfoMap.SetClassInfo(Class, ClassInfo);
+	}
+}
+
+void USandBoxReplicationGraph::InitGlobalGraphNodes()
+{
+	Super::InitGlobalGraphNodes();
+
+	GridNode = CreateNewNode<UReplicationGraphNode_GridSpatialization2D>();
+	GridNode->CellSize = GridCellSize;
+	GridNode->SpatialBias = GridSpatialBias;
+	AddGlobalGraphNode(GridNode);
+
+	AlwaysRelevantNode = CreateNewNode<UReplicationGraphNode_ActorList>();
+	AddGlobalGraphNode(AlwaysRelevantNode);
+}
+
+void USandBoxReplicationGraph::InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection)
+{
+	Super::InitConnectionGraphNodes(RepGraphConnection);
+
+	// 接続のプレイヤーコントローラー・ポーン・ビューターゲットを常に送る
+	UReplicationGraphNode_AlwaysRelevant_ForConnection* AlwaysRelevantForConnectionNode = CreateNewNode<UReplicationGraphNode_AlwaysRelevant_ForConnection>();
+	AddConnectionGraphNode(AlwaysRelevantForConnectionNode, RepGraphConnection);
+}
+
+void USandBoxReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo)
+{
+	switch (GetNodeMapping(ActorInfo.Class))
+	{
+	case ENodeMapping::NotRouted:
+		break;
+	case ENodeMapping::AlwaysRelevant:
+		AlwaysRelevantNode->NotifyAddNetworkActor(ActorInfo);
+		break;
+	case ENodeMapping::SpatializeStatic:
+		GridNode->AddActor_Static(ActorInfo, GlobalInfo);
+		break;
+	case ENodeMapping::SpatializeDynamic:
+		GridNode->AddActor_Dynamic(ActorInfo, GlobalInfo);
+		break;
+	case ENodeMapping::SpatializeDormancy:
+		GridNode->AddActor_Dormancy(ActorInfo, GlobalInfo);
+		break;
+	default:
+		ensureAlwaysMsgf(false, TEXT("不正なノードの割り当てです"));
+		break;
+	}
+}
+
+void USandBoxReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
+{
+	switch (GetNodeMapping(ActorInfo.Class))
+	{
+	case ENodeMapping::NotRouted:
+		break;
+	case ENodeMapping::AlwaysRelevant:
+		AlwaysRelevantNode->NotifyRemoveNetworkActor(ActorInfo);
+		break;
+	case ENodeMapping::SpatializeStatic:
+		GridNode->RemoveActor_Static(ActorInfo);
+		break;
+	case ENodeMapping::SpatializeDynamic:
+		GridNode->RemoveActor_Dynamic(ActorInfo);
+		break;
+	case ENodeMapping::SpatializeDormancy:
+		GridNode->RemoveActor_Dormancy(ActorInfo);
+		break;
+	default:
+		ensureAlwaysMsgf(false, TEXT("不正なノードの割り当てです"));
+		break;
+	}
+}
+
+int32 USandBoxReplicationGraph::ServerReplicateActors(float DeltaSeconds)
+{
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	const int32 Result = Super::ServerReplicateActors(DeltaSeconds);
+	const uint64 Cycles = FPlatformTime::Cycles64() - StartCycles;
+
+	FNetTickStats& Stats = NetTickStats.FindOrAdd(NetDriver->ClientConnections.Num());
+	++Stats.NumFrames;
+	Stats.TotalCycles += Cycles;
+	Stats.MaxCycles = FMath::Max(Stats.MaxCycles, Cycles);
+
+	return Result;
+}
+
+void USandBoxReplicationGraph::DumpNetTickStats() const
+{
+	TArray<int32> ConnectionCounts;
+	NetTickStats.GetKeys(ConnectionCounts);
+	ConnectionCounts.Sort();
+
+	UE_LOG(LogTemp, Log, TEXT("SandBoxReplicationGraph NetTick GridCellSize:%.0f"), GridCellSize);
+	for (const int32 ConnectionCount : ConnectionCounts)
+	{
+		const FNetTickStats& Stats = NetTickStats[ConnectionCount];
+		const double AvgMs = FPlatformTime::ToMilliseconds64(Stats.TotalCycles) / FMath::Max(Stats.NumFrames, 1);
+		UE_LOG(LogTemp, Log, TEXT("  Connections:%4d Frames:%6d AvgMs:%.3f MaxMs:%.3f AvgMsPerConnection:%.4f"),
+			ConnectionCount, Stats.NumFrames, AvgMs, FPlatformTime::ToMilliseconds64(Stats.MaxCycles), AvgMs / FMath::Max(ConnectionCount, 1));
+	}
+}
+
+void USandBoxReplicationGraph::ResetNetTickStats()
+{
+	NetTickStats.Reset();
+}
+
+USandBoxReplicationGraph::ENodeMapping USandBoxReplicationGraph::GetNodeMapping(UClass* Class) const
+{
+	if (const ENodeMapping* Mapping = NodeMappings.Find(Class))
+	{
+		return *Mapping;
+	}
+
+	const AActor* ActorCDO = Class->GetDefaultObject<AActor>();
+	if (ActorCDO->bOnlyRelevantToOwner)
+	{
+		return ENodeMapping::NotRouted;
+	}
+	if (ActorCDO->bAlwaysRelevant || Class->IsChildOf(AInfo::StaticClass()))
+	{
+		return ENodeMapping::AlwaysRelevant;
+	}
+
+	// プールされたキャラクターは休止させるので、休止中はグリッドの更新対象から外す
+	if (Class->IsChildOf(AUnrealSandBoxCharacter::StaticClass()) || ActorCDO->NetDormancy > DORM_Awake)
+	{
+		return ENodeMapping::SpatializeDormancy;
+	}
+
+	const USceneComponent* RootComponent = ActorCDO->GetRootComponent();
+	if (RootComponent != nullptr && RootComponent->Mobility != EComponentMobility::Movable)
+	{
+		return ENodeMapping::SpatializeStatic;
+	}
+	return ENodeMapping::SpatializeDynamic;
+}
+
+uint32 USandBoxReplicationGraph::ComputeReplicationPeriodFrame(float NetUpdateFrequency) const
+{
+	const float ServerMaxTickRate = NetDriver != nullptr ? NetDriver->NetServerMaxTickRate : 30.0f;
+	return static_cast<uint32>(FMath::Max(FMath::RoundToInt(ServerMaxTickRate / FMath::Max(NetUpdateFrequency, KINDA_SMALL_NUMBER)), 1));
+}
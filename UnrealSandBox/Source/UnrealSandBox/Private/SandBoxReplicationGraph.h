@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicationGraph.h"
+#include "SandBoxReplicationGraph.generated.h"
+
+class UReplicationGraphNode_ActorList;
+class UReplicationGraphNode_GridSpatialization2D;
+
+/**
+ * @brief AUnrealSandBoxGameModeのセッション用のレプリケーショングラフ
+ *		　デフォルトのレプリケーションドライバーは毎ネットTickで全アクター×全接続の関連性判定と優先度付けを行うため、
+ *		　プレイヤー数とアクター数の積で負荷が増えます。このグラフでは
+ *		　・キャラクターなど位置を持つアクターは2Dグリッドに登録し、接続の視点があるセルのアクターだけを対象にする
+ *		　・ゲームステートなど常に関連するアクターは全接続共通のリストにまとめる
+ *		　・プレイヤーコントローラーなど所有者にだけ関連するアクターは接続ごとのノードで扱う
+ *		　・休止状態(ドーマンシー)のアクターは接続ごとに休止を送り終えたら以降の判定から外す
+ *		　ことで、接続ごとの処理を周囲のアクター数に比例する量に抑えます。
+ *		　ServerReplicateActorsの処理時間を接続数ごとに集計し、1プロセスで扱える接続数の見積もりに使えます。
+ */
+UCLASS(Transient, Config = Engine)
+class USandBoxReplicationGraph final : public UReplicationGraph
+{
+	GENERATED_BODY()
+public:
+	USandBoxReplicationGraph();
+
+	virtual void InitGlobalActorClassSettings() override;
+	virtual void InitGlobalGraphNodes() override;
+	virtual void InitConnectionGraphNodes(UNetReplicationGraphConnection* RepGraphConnection) override;
+	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
+	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+	virtual int32 ServerReplicateActors(float DeltaSeconds) override;
+
+	/**
+	 * @brief UReplicationDriver::CreateReplicationDriverDelegateに登録する生成関数
+	 *		　AUnrealSandBoxGameModeのワールドのゲーム用ネットドライバーにのみグラフを作成します。
+	 *		　-NoSandBoxRepGraphで起動するとデフォルトのレプリケーションドライバーを使用します。
+	 */
+	static UReplicationDriver* CreateForSandBoxSession(UNetDriver* ForNetDriver, const FURL& URL, UWorld* InWorld);
+
+	/**
+	 * @brief ワールドで使用中のグラフを取得します。使用していなければnullptr
+	 */
+	static USandBoxReplicationGraph* Get(const UWorld* InWorld);
+
+	/**
+	 * @brief アクターのNetUpdateFrequencyの変更をグラフの送信間隔に反映します
+	 *		　グラフは登録時のクラスの設定で送信間隔を決めるため、実行中に変更した場合に呼び出します
+	 */
+	static void NotifyNetUpdateFrequencyChanged(AActor& Actor);
+
+	/**
+	 * @brief 接続数ごとのServerReplicateActorsの処理時間をログに出力します
+	 */
+	void DumpNetTickStats() const;
+
+	void ResetNetTickStats();
+
+	// グリッドのセルの大きさ
+	UPROPERTY(Config)
+	float GridCellSize;
+
+	// グリッドの原点。ここより負の位置のアクターは端のセルに入る
+	UPROPERTY(Config)
+	FVector2D GridSpatialBias;
+
+private:
+	/**
+	 * @brief アクターをどのノードに登録するか
+	 */
+	enum class ENodeMapping : uint8
+	{
+		// どのノードにも登録しない。所有者の接続ごとのノードで扱う
+		NotRouted,
+		// 全接続に常に関連する
+		AlwaysRelevant,
+		// 動かないアクター。登録時のセルに固定する
+		SpatializeStatic,
+		// 動くアクター。毎フレームセルを更新する
+		SpatializeDynamic,
+		// 休止中は動かないアクター、起きている間は動くアクターとして扱う
+		SpatializeDormancy,
+	};
+
+	/**
+	 * @brief ServerReplicateActorsの処理時間の集計
+	 */
+	struct FNetTickStats
+	{
+		int32 NumFrames = 0;
+		uint64 TotalCycles = 0;
+		uint64 MaxCycles = 0;
+	};
+
+	ENodeMapping GetNodeMapping(UClass* Class) const;
+	uint32 ComputeReplicationPeriodFrame(float NetUpdateFrequency) const;
+
+	UPROPERTY()
+	UReplicationGraphNode_GridSpatialization2D* GridNode;
+
+	UPROPERTY()
+	UReplicationGraphNode_ActorList* AlwaysRelevantNode;
+
+	TMap<UClass*, ENodeMapping> NodeMappings;
+
+	// 接続数ごとの集計
+	TMap<int32, FNetTickStats> NetTickStats;
+};
@@ -0,0 +1,396 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxScopedTimer.h"
+
+namespace SandBoxScopedTimerInternal
+{
+	// リングバッファの1件の下位に入れる経過カウントのビット数
+	constexpr uint32 TicksBits = 48;
+	constexpr uint64 TicksMask = (1ull << TicksBits) - 1;
+}
+
+std::atomic<uint32> FSandBoxScopedTimers::EnabledCategories{0};
+
+FSandBoxScopedTimers::FRing::FRing()
+{
+	Buffer.SetNumUninitialized(RingCapacity);
+}
+
+/*static*/
+FSandBoxScopedTimers& FSandBoxScopedTimers::Get()
+{
+	static FSandBoxScopedTimers Instance;
+	return Instance;
+}
+
+FSandBoxScopedTimers::FSandBoxScopedTimers()
+	: CalibrationTimestamp(ReadTimestamp())
+	, CalibrationSeconds(FPlatformTime::Seconds())
+{
+}
+
+/*static*/
+uint16 FSandBoxScopedTimers::RegisterSite(ESandBoxTimerCategory Category, const TCHAR* Name, const TCHAR* File, int32 Line)
+{
+	FSandBoxScopedTimers& Timers = Get();
+	FScopeLock Lock(&Timers.SitesLock);
+	ensureAlwaysMsgf(Timers.Sites.Num() < MAX_uint16, TEXT("SandBoxScopedTimerの呼び出し箇所が多すぎます"));
+	return static_cast<uint16>(Timers.Sites.Add(FSite{Category, Name, FPaths::GetCleanFilename(File), Line}));
+}
+
+/*static*/
+void FSandBoxScopedTimers::SetCategoryEnabled(ESandBoxTimerCategory Category, bool bEnable)
+{
+	const uint32 Bit = 1u << static_cast<uint32>(Category);
+	if (bEnable)
+	{
+		EnabledCategories.fetch_or(Bit, std::memory_order_relaxed);
+	}
+	else
+	{
+		EnabledCategories.fetch_and(~Bit, std::memory_order_relaxed);
+	}
+}
+
+/*static*/
+bool FSandBoxScopedTimers::FindCategory(const FString& Name, ESandBoxTimerCategory& OutCategory)
+{
+	for (int32 Index = 0; Index < static_cast<int32>(ESandBoxTimerCategory::Num); ++Index)
+	{
+		const ESandBoxTimerCategory Category = static_cast<ESandBoxTimerCategory>(Index);
+		if (Name.Equals(GetCategoryName(Category), ESearchCase::IgnoreCase))
+		{
+			OutCategory = Category;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*static*/
+const TCHAR* FSandBoxScopedTimers::GetCategoryName(ESandBoxTimerCategory Category)
+{
+	switch (Category)
+	{
+	case ESandBoxTimerCategory::Character:
+		return TEXT("Character");
+	case ESandBoxTimerCategory::CharacterInput:
+		return TEXT("CharacterInput");
+	case ESandBoxTimerCategory::GameMode:
+		return TEXT("GameMode");
+	case ESandBoxTimerCategory::Benchmark:
+		return TEXT("Benchmark");
+	default:
+		return TEXT("Unknown");
+	}
+}
+
+/*static*/
+void FSandBoxScopedTimers::EnableFromCommandLine()
+{
+	FString CategoryNames;
+	if (!FParse::Value(FCommandLine::Get(), TEXT("SandBoxScopedTimers="), CategoryNames, false))
+	{
+		return;
+	}
+
+	TArray<FString> Names;
+	CategoryNames.ParseIntoArray(Names, TEXT(","));
+	for (const FString& Name : Names)
+	{
+		ESandBoxTimerCategory Category;
+		if (Name.Equals(TEXT("All"), ESearchCase::IgnoreCase))
+		{
+			EnabledCategories.store((1u << static_cast<uint32>(ESandBoxTimerCategory::Num)) - 1, std::memory_order_relaxed);
+		}
+		else if (FindCategory(Name, Category))
+		{
+			SetCategoryEnabled(Category, true);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("SandBoxScopedTimersのカテゴリが不正です: %s"), *Name);
+		}
+	}
+}
+
+void FSandBoxScopedTimers::Tick()
+{
+	FScopeLock Lock(&StatsLock);
+	Drain();
+}
+
+void FSandBoxScopedTimers::DumpReport()
+{
+	FScopeLock Lock(&StatsLock);
+	Drain();
+
+	TArray<FSite> LocalSites;
+	{
+		FScopeLock SitesScopeLock(&SitesLock);
+		LocalSites = Sites;
+	}
+
+	int32 NumThreads = 0;
+	{
+		FScopeLock RingsScopeLock(&RingsLock);
+		NumThreads = Rings.Num();
+	}
+
+	FString EnabledNames;
+	for (int32 Index = 0; Index < static_cast<int32>(ESandBoxTimerCategory::Num); ++Index)
+	{
+		const ESandBoxTimerCategory Category = static_cast<ESandBoxTimerCategory>(Index);
+		if (IsCategoryEnabled(Category))
+		{
+			EnabledNames += EnabledNames.IsEmpty() ? TEXT("") : TEXT(",");
+			EnabledNames += GetCategoryName(Category);
+		}
+	}
+
+	const double TicksPerSecond = GetTicksPerSecond();
+	UE_LOG(LogTemp, Log, TEXT("ScopedTimerReport Sites:%d Threads:%d Dropped:%llu Rdtsc:%d TicksPerUs:%.1f Enabled:%s"),
+		LocalSites.Num(), NumThreads, NumDropped, SANDBOX_SCOPED_TIMER_USE_RDTSC, TicksPerSecond / 1000000.0, EnabledNames.IsEmpty() ? TEXT("None") : *EnabledNames);
+
+	// 合計時間の多い順に出す
+	TArray<int32> SortedSiteIds;
+	for (int32 SiteId = 0; SiteId < SiteStats.Num(); ++SiteId)
+	{
+		if (SiteStats[SiteId].NumCalls > 0)
+		{
+			SortedSiteIds.Add(SiteId);
+		}
+	}
+	SortedSiteIds.Sort([this](int32 A, int32 B)
+	{
+		return SiteStats[A].TotalTicks > SiteStats[B].TotalTicks;
+	});
+
+	const double UsPerTick = 1000000.0 / TicksPerSecond;
+	for (const int32 SiteId : SortedSiteIds)
+	{
+		const FSite& Site = LocalSites[SiteId];
+		const FSiteStats& Stats = SiteStats[SiteId];
+		UE_LOG(LogTemp, Log, TEXT("  %-14s %-36s Calls:%llu TotalMs:%.3f AvgUs:%.3f P50Us:%.3f P90Us:%.3f P99Us:%.3f MaxUs:%.3f (%s:%d)"),
+			GetCategoryName(Site.Category), *Site.Name, Stats.NumCalls, Stats.TotalTicks * UsPerTick / 1000.0,
+			Stats.TotalTicks * UsPerTick / Stats.NumCalls,
+			GetPercentileTicks(Stats, 0.5) * UsPerTick, GetPercentileTicks(Stats, 0.9) * UsPerTick, GetPercentileTicks(Stats, 0.99) * UsPerTick,
+			Stats.MaxTicks * UsPerTick, *Site.File, Site.Line);
+	}
+}
+
+void FSandBoxScopedTimers::ResetStats()
+{
+	FScopeLock Lock(&StatsLock);
+
+	// 集計前の計測も捨てる
+	Drain();
+	SiteStats.Reset();
+	NumDropped = 0;
+}
+
+/*static*/
+void FSandBoxScopedTimers::RunBenchmark(int32 NumIterations)
+{
+	NumIterations = FMath::Max(NumIterations, 1);
+
+	FSandBoxScopedTimers& Timers = Get();
+	const bool bWasEnabled = IsCategoryEnabled(ESandBoxTimerCategory::Benchmark);
+	static const uint16 SiteId = RegisterSite(ESandBoxTimerCategory::Benchmark, TEXT("ScopedTimerBenchmark"), TEXT(__FILE__), __LINE__);
+
+	// リングバッファが一杯になると書き込まずに戻るため、半分ごとに回収する。回収の時間は含めない
+	const int32 ChunkSize = RingCapacity / 2;
+
+	// 最適化で消されないよう、ループごとに値を書き込む
+	volatile int32 Sink = 0;
+	auto Measure = [&](auto&& Body)
+	{
+		double TotalSec = 0.0;
+		for (int32 Start = 0; Start < NumIterations; Start += ChunkSize)
+		{
+			const int32 End = FMath::Min(Start + ChunkSize, NumIterations);
+			const double StartSec = FPlatformTime::Seconds();
+			for (int32 Index = Start; Index < End; ++Index)
+			{
+				Body(Index);
+			}
+			TotalSec += FPlatformTime::Seconds() - StartSec;
+
+			FScopeLock Lock(&Timers.StatsLock);
+			Timers.Drain();
+		}
+		return TotalSec * 1000000000.0 / NumIterations;
+	};
+
+	const double EmptyNs = Measure([&](int32 Index)
+	{
+		Sink = Index;
+	});
+
+	SetCategoryEnabled(ESandBoxTimerCategory::Benchmark, false);
+	const double DisabledNs = Measure([&](int32 Index)
+	{
+		const FScope Scope(ESandBoxTimerCategory::Benchmark, SiteId);
+		Sink = Index;
+	});
+
+	SetCategoryEnabled(ESandBoxTimerCategory::Benchmark, true);
+	const double EnabledNs = Measure([&](int32 Index)
+	{
+		const FScope Scope(ESandBoxTimerCategory::Benchmark, SiteId);
+		Sink = Index;
+	});
+	SetCategoryEnabled(ESandBoxTimerCategory::Benchmark, bWasEnabled);
+
+	// 比較のためタイムスタンプの読み取りだけの時間も出す
+	volatile uint64 TimestampSink = 0;
+	const double ReadTimestampNs = Measure([&](int32 Index)
+	{
+		TimestampSink = ReadTimestamp();
+	});
+	const double Cycles64Ns = Measure([&](int32 Index)
+	{
+		TimestampSink = FPlatformTime::Cycles64();
+	});
+
+	UE_LOG(LogTemp, Log, TEXT("ScopedTimerBenchmark Iterations:%d Rdtsc:%d EmptyNs:%.2f DisabledNs:%.2f EnabledNs:%.2f DisabledOverheadNs:%.2f EnabledOverheadNs:%.2f ReadTimestampNs:%.2f Cycles64Ns:%.2f"),
+		NumIterations, SANDBOX_SCOPED_TIMER_USE_RDTSC, EmptyNs, DisabledNs, EnabledNs, DisabledNs - EmptyNs, EnabledNs - EmptyNs,
+		ReadTimestampNs - EmptyNs, Cycles64Ns - EmptyNs);
+}
+
+/*static*/
+void FSandBoxScopedTimers::Record(uint16 SiteId, uint64 Ticks)
+{
+	using namespace SandBoxScopedTimerInternal;
+
+	// 初回の計測でスレッド専用のリングバッファを作る。リングバッファはプロセス終了まで破棄しない
+	static thread_local FRing* ThreadRing = nullptr;
+	if (ThreadRing == nullptr)
+	{
+		FSandBoxScopedTimers& Timers = Get();
+		FScopeLock Lock(&Timers.RingsLock);
+		ThreadRing = Timers.Rings.Add_GetRef(MakeUnique<FRing>()).Get();
+	}
+	FRing& Ring = *ThreadRing;
+
+	const uint64 WriteIndex = Ring.WriteIndex.load(std::memory_order_relaxed);
+	const uint64 ReadIndex = Ring.ReadIndex.load(std::memory_order_acquire);
+	if (WriteIndex - ReadIndex >= RingCapacity)
+	{
+		Ring.NumDropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	Ring.Buffer[WriteIndex & (RingCapacity - 1)] = (static_cast<uint64>(SiteId) << TicksBits) | FMath::Min(Ticks, TicksMask);
+	Ring.WriteIndex.store(WriteIndex + 1, std::memory_order_release);
+}
+
+/*static*/
+int32 FSandBoxScopedTimers::GetBucketIndex(uint64 Ticks)
+{
+	if (Ticks < NumLinearBuckets)
+	{
+		return static_cast<int32>(Ticks);
+	}
+
+	// 最上位ビットの位置と、その下の3ビットで分ける
+	const int32 Exponent = static_cast<int32>(FMath::FloorLog2_64(Ticks));
+	const int32 SubBucket = static_cast<int32>((Ticks >> (Exponent - 3)) & (NumSubBuckets - 1));
+	return NumLinearBuckets + (Exponent - 4) * NumSubBuckets + SubBucket;
+}
+
+/*static*/
+uint64 FSandBoxScopedTimers::GetBucketUpperBound(int32 BucketIndex)
+{
+	if (BucketIndex < NumLinearBuckets)
+	{
+		return BucketIndex;
+	}
+
+	const int32 Exponent = 4 + (BucketIndex - NumLinearBuckets) / NumSubBuckets;
+	const uint64 SubBucket = (BucketIndex - NumLinearBuckets) % NumSubBuckets;
+	const uint64 Lower = (NumSubBuckets + SubBucket) << (Exponent - 3);
+	return Lower + (1ull << (Exponent - 3)) - 1;
+}
+
+/*static*/
+uint64 FSandBoxScopedTimers::GetPercentileTicks(const FSiteStats& Stats, double Percentile)
+{
+	const uint64 Target = FMath::Max<uint64>(static_cast<uint64>(FMath::CeilToDouble(Stats.NumCalls * Percentile)), 1);
+	uint64 Count = 0;
+	for (int32 BucketIndex = 0; BucketIndex < Stats.Buckets.Num(); ++BucketIndex)
+	{
+		Count += Stats.Buckets[BucketIndex];
+		if (Count >= Target)
+		{
+			// バケットの上限は実際の最大を超えることがある
+			return FMath::Min(GetBucketUpperBound(BucketIndex), Stats.MaxTicks);
+		}
+	}
+	return Stats.MaxTicks;
+}
+
+void FSandBoxScopedTimers::Drain()
+{
+	using namespace SandBoxScopedTimerInternal;
+
+	TArray<FRing*, TInlineAllocator<64>> LocalRings;
+	{
+		FScopeLock Lock(&RingsLock);
+		for (const TUniquePtr<FRing>& Ring : Rings)
+		{
+			LocalRings.Add(Ring.Get());
+		}
+	}
+
+	// 先に全リングバッファの書き込み位置を読む。ここまでに書き込まれた計測の呼び出し箇所は、書き込みより前に登録されている
+	TArray<uint64, TInlineAllocator<64>> WriteIndices;
+	for (FRing* Ring : LocalRings)
+	{
+		WriteIndices.Add(Ring->WriteIndex.load(std::memory_order_acquire));
+	}
+
+	// 書き込み位置を読んだ後に呼び出し箇所の数を読むので、回収する計測の呼び出し箇所は全てSiteStatsに入る
+	{
+		FScopeLock Lock(&SitesLock);
+		while (SiteStats.Num() < Sites.Num())
+		{
+			SiteStats.AddDefaulted_GetRef().Buckets.SetNumZeroed(NumBuckets);
+		}
+	}
+
+	for (int32 RingIndex = 0; RingIndex < LocalRings.Num(); ++RingIndex)
+	{
+		FRing* Ring = LocalRings[RingIndex];
+		const uint64 ReadIndex = Ring->ReadIndex.load(std::memory_order_relaxed);
+		const uint64 WriteIndex = WriteIndices[RingIndex];
+		for (uint64 Index = ReadIndex; Index < WriteIndex; ++Index)
+		{
+			const uint64 Entry = Ring->Buffer[Index & (RingCapacity - 1)];
+			const uint64 Ticks = Entry & TicksMask;
+			FSiteStats& Stats = SiteStats[static_cast<int32>(Entry >> TicksBits)];
+			++Stats.NumCalls;
+			Stats.TotalTicks += Ticks;
+			Stats.MaxTicks = FMath::Max(Stats.MaxTicks, Ticks);
+			++Stats.Buckets[GetBucketIndex(Ticks)];
+		}
+		Ring->ReadIndex.store(WriteIndex, std::memory_order_release);
+		NumDropped += Ring->NumDropped.exchange(0, std::memory_order_relaxed);
+	}
+}
+
+double FSandBoxScopedTimers::GetTicksPerSecond() const
+{
+#if SANDBOX_SCOPED_TIMER_USE_RDTSC
+	// TSCの周波数はOSから取れないため、生成時からのカウントと経過時間の比で求める。経過が短いうちは誤差が大きい
+	const double ElapsedSec = FPlatformTime::Seconds() - CalibrationSeconds;
+	if (ElapsedSec > 0.0)
+	{
+		return (ReadTimestamp() - CalibrationTimestamp) / ElapsedSec;
+	}
+	return 1000000000.0;
+#else
+	return 1.0 / FPlatformTime::GetSecondsPerCycle64();
+#endif
+}
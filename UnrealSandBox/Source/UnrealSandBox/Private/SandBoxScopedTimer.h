@@ -0,0 +1,259 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * @brief SANDBOX_SCOPED_TIMERを有効にするか
+ *		　無効のときはマクロが空になり、呼び出し箇所には何も残りません。
+ */
+#ifndef SANDBOX_ENABLE_SCOPED_TIMERS
+#define SANDBOX_ENABLE_SCOPED_TIMERS (!UE_BUILD_SHIPPING)
+#endif
+
+/**
+ * @brief タイムスタンプにCPUのタイムスタンプカウンタ(rdtsc)を直接読むか
+ *		　FPlatformTime::Cycles64はWindowsではQueryPerformanceCounter、Linuxではclock_gettimeを呼び出すため、
+ *		　1回あたり数十ナノ秒かかることがあります。x86ではrdtscで数ナノ秒に抑えます。
+ */
+#ifndef SANDBOX_SCOPED_TIMER_USE_RDTSC
+#define SANDBOX_SCOPED_TIMER_USE_RDTSC (PLATFORM_CPU_X86_FAMILY && (PLATFORM_WINDOWS || PLATFORM_LINUX || PLATFORM_MAC))
+#endif
+
+#if SANDBOX_SCOPED_TIMER_USE_RDTSC
+#if PLATFORM_WINDOWS
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+/**
+ * @brief 計測のカテゴリ。カテゴリごとに実行時に計測の有効・無効を切り替えます
+ */
+enum class ESandBoxTimerCategory : uint8
+{
+	// キャラクターの生成・破棄・プールなど
+	Character,
+	// キャラクターの入力処理
+	CharacterInput,
+	// ゲームモードのスポーン処理
+	GameMode,
+	// FSandBoxScopedTimers::RunBenchmark
+	Benchmark,
+	Num
+};
+
+#if SANDBOX_ENABLE_SCOPED_TIMERS
+/**
+ * @brief スコープの実行時間を計測するマクロ
+ *		　呼び出し箇所ごとに初回のみ名前を登録し、カテゴリが有効なときだけスコープの開始と終了のタイムスタンプを読んで
+ *		　差分を呼び出したスレッドのバッファに書き込みます。カテゴリが無効なときはフラグを1回読むだけです。
+ *		　名前はTEXT()の文字列リテラルで指定してください。
+ *
+ * 使用例
+
+void AUnrealSandBoxCharacter::MoveForward(float Value)
+{
+	SANDBOX_SCOPED_TIMER(CharacterInput, TEXT("Character.MoveForward"));
+	...
+}
+
+ */
+#define SANDBOX_SCOPED_TIMER(Category, Name) \
+	static const uint16 PREPROCESSOR_JOIN(SandBoxTimerSiteId, __LINE__) = FSandBoxScopedTimers::RegisterSite(ESandBoxTimerCategory::Category, Name, TEXT(__FILE__), __LINE__); \
+	const FSandBoxScopedTimers::FScope PREPROCESSOR_JOIN(SandBoxTimerScope, __LINE__)(ESandBoxTimerCategory::Category, PREPROCESSOR_JOIN(SandBoxTimerSiteId, __LINE__))
+#else
+#define SANDBOX_SCOPED_TIMER(Category, Name)
+#endif
+
+/**
+ * @brief SANDBOX_SCOPED_TIMERの計測値を集計するクラス
+ *		　SCOPE_CYCLE_COUNTERはstatsの有効なビルドでスレッドごとのstatsメッセージを積むため、細かい関数に多数置くと製品に近いビルドでも負荷になります。
+ *		　このクラスでは
+ *		　・計測したスレッドは自分専用のリングバッファ(単一生産者・単一消費者)に呼び出し箇所のIDと経過カウントを書き込むだけで、ロックを取らない
+ *		　・USampleSubSystemのTickで全スレッドのリングバッファを回収し、呼び出し箇所ごとの呼び出し数と経過時間のヒストグラムに集計する
+ *		　・カテゴリごとに実行時に有効・無効を切り替えられ、無効のときはタイムスタンプも読まない
+ *		　ことで計測のコストを抑えます。Shippingではマクロごと消えます。
+ *		　百分位はヒストグラムから求めるため、誤差は最大で12.5%です。
+ *		　リングバッファが一杯のときは書き込まずに破棄し、破棄数を数えます。
+ *		　カテゴリは全て無効の状態で始まるため、ScopedTimerEnableコマンドか-SandBoxScopedTimers=で有効にしてください。
+ */
+class FSandBoxScopedTimers final
+{
+public:
+	/**
+	 * @brief 生成から破棄までの経過カウントを記録します。SANDBOX_SCOPED_TIMERから使います
+	 */
+	class FScope final
+	{
+	public:
+		FORCEINLINE FScope(ESandBoxTimerCategory Category, uint16 InSiteId)
+			: SiteId(InSiteId)
+			, StartTimestamp(IsCategoryEnabled(Category) ? ReadTimestamp() : 0)
+		{
+		}
+
+		FORCEINLINE ~FScope()
+		{
+			if (StartTimestamp != 0)
+			{
+				Record(SiteId, ReadTimestamp() - StartTimestamp);
+			}
+		}
+
+		FScope(const FScope&) = delete;
+		FScope& operator=(const FScope&) = delete;
+
+	private:
+		uint16 SiteId;
+		uint64 StartTimestamp;
+	};
+
+	static FSandBoxScopedTimers& Get();
+
+	/**
+	 * @brief 呼び出し箇所を登録します。どのスレッドからでも呼び出せます
+	 * @return 呼び出し箇所のID
+	 */
+	static uint16 RegisterSite(ESandBoxTimerCategory Category, const TCHAR* Name, const TCHAR* File, int32 Line);
+
+	static FORCEINLINE bool IsCategoryEnabled(ESandBoxTimerCategory Category)
+	{
+		return (EnabledCategories.load(std::memory_order_relaxed) & (1u << static_cast<uint32>(Category))) != 0;
+	}
+
+	static void SetCategoryEnabled(ESandBoxTimerCategory Category, bool bEnable);
+
+	/**
+	 * @brief 名前からカテゴリを取得します。大文字小文字は区別しません
+	 * @return 該当するカテゴリがなければfalse
+	 */
+	static bool FindCategory(const FString& Name, ESandBoxTimerCategory& OutCategory);
+
+	static const TCHAR* GetCategoryName(ESandBoxTimerCategory Category);
+
+	/**
+	 * @brief -SandBoxScopedTimers=Character,GameModeのように起動時に指定したカテゴリを有効にします。Allで全て有効にします
+	 */
+	static void EnableFromCommandLine();
+
+	/**
+	 * @brief タイムスタンプを読みます。単位はrdtscであればTSCのカウント、そうでなければFPlatformTime::Cycles64のサイクルです
+	 */
+	static FORCEINLINE uint64 ReadTimestamp()
+	{
+#if SANDBOX_SCOPED_TIMER_USE_RDTSC
+		return __rdtsc();
+#else
+		return FPlatformTime::Cycles64();
+#endif
+	}
+
+	/**
+	 * @brief 全スレッドのリングバッファを回収して集計します。毎フレーム呼び出します
+	 */
+	void Tick();
+
+	/**
+	 * @brief 呼び出し箇所ごとの呼び出し数・合計時間・百分位を合計時間の多い順にログに出力します
+	 */
+	void DumpReport();
+
+	void ResetStats();
+
+	/**
+	 * @brief 計測なし・カテゴリ無効・カテゴリ有効のスコープと、タイムスタンプの読み取りにかかる時間を比較し、ログに出力します
+	 * @param NumIterations 計測する回数
+	 */
+	static void RunBenchmark(int32 NumIterations);
+
+private:
+	// 1スレッドあたりのリングバッファに溜められる計測数
+	static constexpr uint32 RingCapacity = 16 * 1024;
+
+	// 経過時間のヒストグラム。16未満はそのまま、16以上は2のべき乗ごとに8分割する
+	static constexpr int32 NumLinearBuckets = 16;
+	static constexpr int32 NumSubBuckets = 8;
+	static constexpr int32 NumBuckets = NumLinearBuckets + (64 - 4) * NumSubBuckets;
+
+	/**
+	 * @brief スレッドごとのリングバッファ。1件は上位16bitが呼び出し箇所のID、下位48bitが経過カウント
+	 */
+	struct FRing
+	{
+		FRing();
+
+		TArray<uint64> Buffer;
+		std::atomic<uint64> WriteIndex{0};
+		std::atomic<uint64> ReadIndex{0};
+		std::atomic<uint64> NumDropped{0};
+	};
+
+	/**
+	 * @brief 呼び出し箇所
+	 */
+	struct FSite
+	{
+		ESandBoxTimerCategory Category;
+		FString Name;
+		FString File;
+		int32 Line;
+	};
+
+	/**
+	 * @brief 呼び出し箇所ごとの集計
+	 */
+	struct FSiteStats
+	{
+		uint64 NumCalls = 0;
+		uint64 TotalTicks = 0;
+		uint64 MaxTicks = 0;
+		TArray<uint32> Buckets;
+	};
+
+	FSandBoxScopedTimers();
+
+	static void Record(uint16 SiteId, uint64 Ticks);
+
+	static int32 GetBucketIndex(uint64 Ticks);
+
+	/**
+	 * @brief バケットに入る経過カウントの上限
+	 */
+	static uint64 GetBucketUpperBound(int32 BucketIndex);
+
+	/**
+	 * @brief ヒストグラムから百分位の経過カウントを求めます
+	 * @param Percentile 0～1
+	 */
+	static uint64 GetPercentileTicks(const FSiteStats& Stats, double Percentile);
+
+	/**
+	 * @brief リングバッファを回収します。StatsLockを取ってから呼び出してください
+	 */
+	void Drain();
+
+	/**
+	 * @brief 1秒あたりのタイムスタンプのカウント数。rdtscのときは生成時からの経過で較正する
+	 */
+	double GetTicksPerSecond() const;
+
+	static std::atomic<uint32> EnabledCategories;
+
+	mutable FCriticalSection SitesLock;
+	TArray<FSite> Sites;
+
+	FCriticalSection RingsLock;
+	TArray<TUniquePtr<FRing>> Rings;
+
+	FCriticalSection StatsLock;
+	TArray<FSiteStats> SiteStats;
+	uint64 NumDropped = 0;
+
+	// rdtscの較正の基準
+	uint64 CalibrationTimestamp;
+	double CalibrationSeconds;
+};
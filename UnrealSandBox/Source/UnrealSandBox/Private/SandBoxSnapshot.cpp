@@ -0,0 +1,411 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxSnapshot.h"
+#include "Async/MappedFileHandle.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/Controller.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFilemanager.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/BufferReader.h"
+#include "UnrealSandBox/UnrealSandBoxCharacter.h"
+#include "UnrealSandBox/UnrealSandBoxGameMode.h"
+
+FSandBoxSnapshot::FSandBoxSnapshot(FJobScheduler& InScheduler)
+	: Scheduler(InScheduler)
+{
+}
+
+FSandBoxSnapshot::~FSandBoxSnapshot()
+{
+	// ジョブがメンバーを参照しているため、完了を待ってから解放する
+	if (SaveJob.IsValid())
+	{
+		Scheduler.Wait(SaveJob.ToSharedRef());
+	}
+	if (LoadJob.IsValid())
+	{
+		Scheduler.Wait(LoadJob.ToSharedRef());
+	}
+	FinishLoad();
+}
+
+/*static*/
+int32 FSandBoxSnapshot::CaptureCharacters(FArchive& Ar, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters, const TSet<const AActor*>& Exclude)
+{
+	// 数とテーブルの位置は走査後に書き戻す
+	const int64 CountOffset = Ar.Tell();
+	int32 NumCharacters = 0;
+	int64 TableOffset = 0;
+	Ar << NumCharacters;
+	Ar << TableOffset;
+
+	// 名前は番号を除いた部分をテーブルにまとめる。同じクラスのキャラクターは番号だけが異なる
+	TMap<FName, int32> NameIndices;
+	TArray<FName> Names;
+	TMap<UClass*, int32> ClassIndices;
+	TArray<UClass*> Classes;
+
+	FCharacterRecord Record;
+	for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& WeakCharacter : Characters)
+	{
+		const AUnrealSandBoxCharacter* Character = WeakCharacter.Get();
+		if (Character == nullptr || Character->IsInPawnPool() || Exclude.Contains(Character))
+		{
+			continue;
+		}
+
+		const FName Name = Character->GetFName();
+		const FName BaseName(Name, NAME_NO_NUMBER_INTERNAL);
+		const int32* NameIndex = NameIndices.Find(BaseName);
+		Record.NameIndex = NameIndex != nullptr ? *NameIndex : NameIndices.Add(BaseName, Names.Add(BaseName));
+		Record.NameNumber = Name.GetNumber();
+
+		UClass* Class = Character->GetClass();
+		const int32* ClassIndex = ClassIndices.Find(Class);
+		Record.ClassIndex = ClassIndex != nullptr ? *ClassIndex : ClassIndices.Add(Class, Classes.Add(Class));
+
+		const UCharacterMovementComponent* Movement = Character->GetCharacterMovement();
+		Record.MovementMode = Movement->MovementMode;
+		Record.CustomMovementMode = Movement->CustomMovementMode;
+		Record.Location = Character->GetActorLocation();
+		Record.Rotation = Character->GetActorRotation();
+		Record.Velocity = Movement->Velocity;
+		Ar << Record;
+		++NumCharacters;
+	}
+
+	TableOffset = Ar.Tell();
+	int32 NumNames = Names.Num();
+	Ar << NumNames;
+	for (const FName& Name : Names)
+	{
+		FString PlainName = Name.GetPlainNameString();
+		Ar << PlainName;
+	}
+	int32 NumClasses = Classes.Num();
+	Ar << NumClasses;
+	for (const UClass* Class : Classes)
+	{
+		FString ClassPath = Class->GetPathName();
+		Ar << ClassPath;
+	}
+
+	const int64 EndOffset = Ar.Tell();
+	Ar.Seek(CountOffset);
+	Ar << NumCharacters;
+	Ar << TableOffset;
+	Ar.Seek(EndOffset);
+	return NumCharacters;
+}
+
+bool FSandBoxSnapshot::StartSave(const FString& Path, TArray<uint8>&& Payload, int32 NumCharacters, bool bCompress, double CaptureMs)
+{
+	if (IsSaving() || IsLoading())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("スナップショットの保存中または読み込み中です"));
+		return false;
+	}
+
+	Stats = FStats();
+	Stats.NumCharacters = NumCharacters;
+	Stats.RawBytes = Payload.Num();
+	Stats.CaptureMs = CaptureMs;
+	SaveResult = MakeShared<FStats, ESPMode::ThreadSafe>(Stats);
+
+	SaveJob = Scheduler.Submit(EJobPriority::Low, 0.0f, [Path, Payload = MoveTemp(Payload), NumCharacters, bCompress, Result = SaveResult]()
+	{
+		FFileHeader Header;
+		Header.Magic = Magic;
+		Header.Version = Version;
+		Header.NumCharacters = NumCharacters;
+		Header.RawBytes = Payload.Num();
+
+		const uint8* Data = Payload.GetData();
+		int32 DataSize = Payload.Num();
+		TArray<uint8> Compressed;
+		if (bCompress)
+		{
+			const double CompressStartSec = FPlatformTime::Seconds();
+			int32 CompressedSize = FCompression::CompressMemoryBound(NAME_LZ4, Payload.Num());
+			Compressed.SetNumUninitialized(CompressedSize);
+			if (FCompression::CompressMemory(NAME_LZ4, Compressed.GetData(), CompressedSize, Payload.GetData(), Payload.Num()))
+			{
+				Header.bCompressed = 1;
+				Data = Compressed.GetData();
+				DataSize = CompressedSize;
+			}
+			Result->CompressMs = (FPlatformTime::Seconds() - CompressStartSec) * 1000.0;
+		}
+		Header.StoredBytes = DataSize;
+
+		// 書き込み途中のファイルを読まれないよう、一時ファイルに書いてから置き換える
+		const double WriteStartSec = FPlatformTime::Seconds();
+		const FString TempPath = Path + TEXT(".tmp");
+		bool bSuccess = false;
+		if (TUniquePtr<FArchive> Writer = TUniquePtr<FArchive>(IFileManager::Get().CreateFileWriter(*TempPath)))
+		{
+			Writer->Serialize(&Header, sizeof(Header));
+			Writer->Serialize(const_cast<uint8*>(Data), DataSize);
+			bSuccess = Writer->Close();
+		}
+		bSuccess = bSuccess && IFileManager::Get().Move(*Path, *TempPath, true, true);
+
+		Result->WriteMs = (FPlatformTime::Seconds() - WriteStartSec) * 1000.0;
+		Result->StoredBytes = bSuccess ? sizeof(Header) + DataSize : -1;
+	});
+	return true;
+}
+
+bool FSandBoxSnapshot::StartLoad(const FString& Path)
+{
+	if (IsSaving() || IsLoading())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("スナップショットの保存中または読み込み中です"));
+		return false;
+	}
+
+	Stats = FStats();
+	bLoading = true;
+	const double MapStartSec = FPlatformTime::Seconds();
+
+	// メモリマップに対応していないプラットフォームではファイルを読み込む
+	const uint8* FileData = nullptr;
+	int64 FileSize = 0;
+	MappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*Path));
+	if (MappedFile.IsValid())
+	{
+		MappedRegion.Reset(MappedFile->MapRegion(0, MappedFile->GetFileSize()));
+	}
+	if (MappedRegion.IsValid())
+	{
+		FileData = MappedRegion->GetMappedPtr();
+		FileSize = MappedRegion->GetMappedSize();
+	}
+	else if (FFileHelper::LoadFileToArray(FileBuffer, *Path, FILEREAD_Silent))
+	{
+		MappedFile.Reset();
+		FileData = FileBuffer.GetData();
+		FileSize = FileBuffer.Num();
+	}
+	else
+	{
+		UE_LOG(LogTemp, Warning, TEXT("スナップショットを開けませんでした Path:%s"), *Path);
+		FinishLoad();
+		return false;
+	}
+
+	FFileHeader Header;
+	if (FileSize >= static_cast<int64>(sizeof(Header)))
+	{
+		FMemory::Memcpy(&Header, FileData, sizeof(Header));
+	}
+	if (Header.Magic != Magic || Header.Version != Version || Header.StoredBytes != FileSize - static_cast<int64>(sizeof(Header)))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("スナップショットの形式が一致しません Path:%s Version:%u"), *Path, Header.Version);
+		FinishLoad();
+		return false;
+	}
+
+	// 圧縮していなければ保存されたデータがそのまま本体なので、サイズが一致しなければファイルの外を読むことになる
+	if (Header.RawBytes < 0 || Header.RawBytes > MaxRawBytes || Header.NumCharacters < 0 || (Header.bCompressed == 0 && Header.RawBytes != Header.StoredBytes))
+	{
+		UE_LOG(LogTemp, Warning, TEXT("スナップショットのサイズが不正です Path:%s RawBytes:%lld StoredBytes:%lld Compressed:%u"), *Path, Header.RawBytes, Header.StoredBytes, Header.bCompressed);
+		FinishLoad();
+		return false;
+	}
+
+	Stats.NumCharacters = Header.NumCharacters;
+	Stats.RawBytes = Header.RawBytes;
+	Stats.StoredBytes = FileSize;
+	Stats.MapMs = (FPlatformTime::Seconds() - MapStartSec) * 1000.0;
+
+	const uint8* StoredData = FileData + sizeof(Header);
+	if (Header.bCompressed == 0)
+	{
+		PayloadReader = MakeUnique<FBufferReader>(const_cast<uint8*>(StoredData), Header.RawBytes, false);
+		return true;
+	}
+
+	// 復元を待っている間なので、バッチ処理より優先して展開する
+	LoadResult = MakeShared<FStats, ESPMode::ThreadSafe>();
+	LoadJob = Scheduler.Submit(EJobPriority::High, 0.0f, [this, StoredData, Header, Result = LoadResult]()
+	{
+		const double DecompressStartSec = FPlatformTime::Seconds();
+		LoadedPayload.SetNumUninitialized(Header.RawBytes);
+		const bool bSuccess = FCompression::UncompressMemory(NAME_LZ4, LoadedPayload.GetData(), Header.RawBytes, StoredData, Header.StoredBytes);
+		Result->DecompressMs = (FPlatformTime::Seconds() - DecompressStartSec) * 1000.0;
+		Result->RawBytes = bSuccess ? Header.RawBytes : -1;
+	});
+	return true;
+}
+
+FArchive* FSandBoxSnapshot::GetPayloadReader()
+{
+	return PayloadReader.Get();
+}
+
+bool FSandBoxSnapshot::RestoreCharacters(UWorld& World, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters, int32 MaxCount)
+{
+	if (!PayloadReader.IsValid())
+	{
+		return true;
+	}
+
+	const double StartSec = FPlatformTime::Seconds();
+	FArchive& Ar = *PayloadReader;
+	if (!RestoreState.bStarted)
+	{
+		RestoreState.bStarted = true;
+		int64 TableOffset = 0;
+		Ar << RestoreState.NumLeft;
+		Ar << TableOffset;
+		const int64 RecordOffset = Ar.Tell();
+
+		Ar.Seek(TableOffset);
+		int32 NumNames = 0;
+		Ar << NumNames;
+		for (int32 Index = 0; Index < NumNames && !Ar.IsError(); ++Index)
+		{
+			FString PlainName;
+			Ar << PlainName;
+			RestoreState.Names.Add(FName(*PlainName));
+		}
+		int32 NumClasses = 0;
+		Ar << NumClasses;
+		for (int32 Index = 0; Index < NumClasses && !Ar.IsError(); ++Index)
+		{
+			FString ClassPath;
+			Ar << ClassPath;
+			RestoreState.Classes.Add(StaticLoadClass(AUnrealSandBoxCharacter::StaticClass(), nullptr, *ClassPath));
+		}
+		Ar.Seek(RecordOffset);
+
+		RestoreState.CharactersByName.Reserve(Characters.Num());
+		for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& Character : Characters)
+		{
+			if (Character.IsValid() && !Character->IsInPawnPool())
+			{
+				RestoreState.CharactersByName.Add(Character->GetFName(), Character);
+			}
+		}
+	}
+
+	AUnrealSandBoxGameMode* GameMode = World.GetAuthGameMode<AUnrealSandBoxGameMode>();
+	const int32 NumBatch = FMath::Min(MaxCount, RestoreState.NumLeft);
+	FCharacterRecord Record;
+	for (int32 Count = 0; Count < NumBatch; ++Count)
+	{
+		Ar << Record;
+		if (!ensureAlwaysMsgf(!Ar.IsError() && RestoreState.Names.IsValidIndex(Record.NameIndex) && RestoreState.Classes.IsValidIndex(Record.ClassIndex), TEXT("スナップショットが壊れています")))
+		{
+			RestoreState.NumLeft = 0;
+			break;
+		}
+		--RestoreState.NumLeft;
+
+		const FName Name(RestoreState.Names[Record.NameIndex], Record.NameNumber);
+		const TWeakObjectPtr<AUnrealSandBoxCharacter>* Found = RestoreState.CharactersByName.Find(Name);
+		AUnrealSandBoxCharacter* Character = Found != nullptr ? Found->Get() : nullptr;
+		if (Character != nullptr)
+		{
+			Character->SetActorLocationAndRotation(Record.Location, Record.Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+			++Stats.NumRestored;
+		}
+		else if (GameMode != nullptr && RestoreState.Classes[Record.ClassIndex] != nullptr)
+		{
+			// 保存時にいなかったキャラクターはボットとして生成する。名前は一致しない
+			const FTransform SpawnTransform(Record.Rotation, Record.Location);
+			Character = Cast<AUnrealSandBoxCharacter>(GameMode->SpawnBot(RestoreState.Classes[Record.ClassIndex], SpawnTransform, ESpawnActorCollisionHandlingMethod::AlwaysSpawn));
+			Stats.NumSpawned += Character != nullptr ? 1 : 0;
+		}
+
+		if (Character == nullptr)
+		{
+			++Stats.NumMissing;
+			continue;
+		}
+
+		if (AController* Controller = Character->GetController())
+		{
+			Controller->SetControlRotation(Record.Rotation);
+		}
+		UCharacterMovementComponent* Movement = Character->GetCharacterMovement();
+		Movement->SetMovementMode(static_cast<EMovementMode>(Record.MovementMode), Record.CustomMovementMode);
+		Movement->Velocity = Record.Velocity;
+	}
+
+	const double FrameMs = (FPlatformTime::Seconds() - StartSec) * 1000.0;
+	Stats.RestoreMs += FrameMs;
+	Stats.RestoreMaxFrameMs = FMath::Max(Stats.RestoreMaxFrameMs, FrameMs);
+	++Stats.RestoreFrames;
+
+	if (RestoreState.NumLeft > 0)
+	{
+		return false;
+	}
+
+	FinishLoad();
+	return true;
+}
+
+void FSandBoxSnapshot::Tick()
+{
+	if (SaveJob.IsValid() && SaveJob->IsDone())
+	{
+		SaveJob.Reset();
+		Stats = *SaveResult;
+		SaveResult.Reset();
+		if (Stats.StoredBytes < 0)
+		{
+			UE_LOG(LogTemp, Warning, TEXT("スナップショットを書き込めませんでした"));
+		}
+		else
+		{
+			DumpStats(TEXT("SnapshotSave"));
+		}
+	}
+
+	if (LoadJob.IsValid() && LoadJob->IsDone())
+	{
+		LoadJob.Reset();
+		Stats.DecompressMs = LoadResult->DecompressMs;
+		const bool bSuccess = LoadResult->RawBytes >= 0;
+		LoadResult.Reset();
+
+		// 展開し終えたらファイルは不要
+		MappedRegion.Reset();
+		MappedFile.Reset();
+		FileBuffer.Empty();
+
+		if (bSuccess)
+		{
+			PayloadReader = MakeUnique<FBufferReader>(LoadedPayload.GetData(), LoadedPayload.Num(), false);
+		}
+		else
+		{
+			UE_LOG(LogTemp, Warning, TEXT("スナップショットを展開できませんでした"));
+			FinishLoad();
+		}
+	}
+}
+
+void FSandBoxSnapshot::DumpStats(const TCHAR* Label) const
+{
+	UE_LOG(LogTemp, Log, TEXT("%s Characters:%d RawKB:%.1f StoredKB:%.1f CaptureMs:%.3f CompressMs:%.3f WriteMs:%.3f MapMs:%.3f DecompressMs:%.3f RestoreMs:%.3f RestoreFrames:%d RestoreMaxFrameMs:%.3f Restored:%d Spawned:%d Missing:%d"),
+		Label, Stats.NumCharacters, Stats.RawBytes / 1024.0, Stats.StoredBytes / 1024.0, Stats.CaptureMs, Stats.CompressMs, Stats.WriteMs,
+		Stats.MapMs, Stats.DecompressMs, Stats.RestoreMs, Stats.RestoreFrames, Stats.RestoreMaxFrameMs, Stats.NumRestored, Stats.NumSpawned, Stats.NumMissing);
+}
+
+void FSandBoxSnapshot::FinishLoad()
+{
+	PayloadReader.Reset();
+	LoadedPayload.Empty();
+	MappedRegion.Reset();
+	MappedFile.Reset();
+	FileBuffer.Empty();
+	RestoreState = FRestoreState();
+	bLoading = false;
+}
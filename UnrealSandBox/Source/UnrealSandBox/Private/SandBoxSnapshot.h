@@ -0,0 +1,193 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "JobScheduler.h"
+
+class AUnrealSandBoxCharacter;
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * @brief ワールドの状態をファイルに保存・復元するスナップショット
+ *		　保存はゲームスレッドで状態をバイナリのバッファに1回の走査でコピーするだけにし、
+ *		　圧縮とファイルへの書き込みはFJobSchedulerのワーカースレッドで行うため、ゲームスレッドが止まりません。
+ *		　読み込みはファイルをメモリマップし、圧縮されていればワーカースレッドで展開してから、
+ *		　キャラクターを1フレームあたりRestoreCharactersの件数ずつ復元します。
+ *
+ * ファイルの構成
+ *		　ヘッダー(FFileHeader、非圧縮)
+ *		　ペイロード(圧縮時はLZ4)
+ *		　　呼び出し側の状態(USandBoxWorldSubSystemの設定と群衆)
+ *		　　キャラクター数・テーブルの位置・キャラクターごとのFCharacterRecord
+ *		　　名前のテーブル・クラスのテーブル
+ *		　テーブルは走査中に作るため、レコードの後ろに置いて位置を書き戻します。
+ */
+class FSandBoxSnapshot final
+{
+public:
+	static constexpr uint32 Magic = 0x53534253; // "SBSS"
+	static constexpr uint32 Version = 1;
+	// 展開後のサイズの上限。展開先はint32で確保するため、壊れたヘッダーで巨大な確保をしないよう制限する
+	static constexpr int64 MaxRawBytes = 1024 * 1024 * 1024;
+
+	/**
+	 * @brief 保存・読み込みの計測値
+	 */
+	struct FStats
+	{
+		int32 NumCharacters = 0;
+		int64 RawBytes = 0;
+		int64 StoredBytes = 0;
+		double CaptureMs = 0.0;
+		double CompressMs = 0.0;
+		double WriteMs = 0.0;
+		// メモリマップと展開
+		double MapMs = 0.0;
+		double DecompressMs = 0.0;
+		// 最初のバッチから最後のバッチまでのゲームスレッドでの処理時間の合計
+		double RestoreMs = 0.0;
+		double RestoreMaxFrameMs = 0.0;
+		int32 RestoreFrames = 0;
+		int32 NumRestored = 0;
+		int32 NumSpawned = 0;
+		int32 NumMissing = 0;
+	};
+
+	explicit FSandBoxSnapshot(FJobScheduler& InScheduler);
+
+	/**
+	 * @brief 保存・展開中のジョブの完了を待ってから破棄します
+	 */
+	~FSandBoxSnapshot();
+
+	/**
+	 * @brief キャラクターの状態をペイロードに書き込みます
+	 * @param Ar 書き込み先
+	 * @param Characters 保存するキャラクター。プールで待機中のものとExcludeに含まれるものは除きます
+	 * @param Exclude 呼び出し側の状態から復元されるキャラクター
+	 * @return 書き込んだキャラクター数
+	 */
+	static int32 CaptureCharacters(FArchive& Ar, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters, const TSet<const AActor*>& Exclude);
+
+	/**
+	 * @brief ペイロードを圧縮してファイルに書き込む処理をワーカースレッドで開始します
+	 * @param Path 保存先
+	 * @param Payload ペイロード
+	 * @param NumCharacters ペイロードに含まれるキャラクター数
+	 * @param bCompress 圧縮するか
+	 * @param CaptureMs ペイロードの作成にかかった時間
+	 * @return 保存中・読み込み中であればfalse
+	 */
+	bool StartSave(const FString& Path, TArray<uint8>&& Payload, int32 NumCharacters, bool bCompress, double CaptureMs);
+
+	/**
+	 * @brief ファイルをメモリマップし、圧縮されていれば展開をワーカースレッドで開始します
+	 * @return 開けなかった場合と保存中・読み込み中であればfalse
+	 */
+	bool StartLoad(const FString& Path);
+
+	/**
+	 * @brief 読み込んだペイロードのリーダーを取得します。展開中であればnullptr
+	 *		　呼び出し側の状態を読んでからRestoreCharactersを呼び出してください。
+	 */
+	FArchive* GetPayloadReader();
+
+	/**
+	 * @brief CaptureCharactersで書き込んだキャラクターを最大MaxCount件復元します
+	 *		　名前が一致するキャラクターを移動させ、見つからなければサーバーではボットとして生成します。
+	 * @return 全て復元し終えたらtrue。以降はファイルを閉じます
+	 */
+	bool RestoreCharacters(UWorld& World, const TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>>& Characters, int32 MaxCount);
+
+	/**
+	 * @brief 保存の完了を確認します。毎フレーム呼び出します
+	 */
+	void Tick();
+
+	bool IsSaving() const { return SaveJob.IsValid(); }
+	bool IsLoading() const { return bLoading; }
+
+	const FStats& GetStats() const { return Stats; }
+	void DumpStats(const TCHAR* Label) const;
+
+private:
+	/**
+	 * @brief ファイルの先頭に置くヘッダー
+	 */
+	struct FFileHeader
+	{
+		uint32 Magic = 0;
+		uint32 Version = 0;
+		uint32 bCompressed = 0;
+		int32 NumCharacters = 0;
+		int64 RawBytes = 0;
+		int64 StoredBytes = 0;
+	};
+
+	/**
+	 * @brief 1キャラクター分の状態
+	 */
+	struct FCharacterRecord
+	{
+		int32 NameIndex = 0;
+		// FNameの番号部分
+		int32 NameNumber = 0;
+		int32 ClassIndex = 0;
+		uint8 MovementMode = 0;
+		uint8 CustomMovementMode = 0;
+		FVector Location = FVector::ZeroVector;
+		FRotator Rotation = FRotator::ZeroRotator;
+		FVector Velocity = FVector::ZeroVector;
+
+		friend FArchive& operator<<(FArchive& Ar, FCharacterRecord& Record)
+		{
+			Ar << Record.NameIndex;
+			Ar << Record.NameNumber;
+			Ar << Record.ClassIndex;
+			Ar << Record.MovementMode;
+			Ar << Record.CustomMovementMode;
+			Ar << Record.Location;
+			Ar << Record.Rotation;
+			Ar << Record.Velocity;
+			return Ar;
+		}
+	};
+
+	/**
+	 * @brief 復元の途中の状態
+	 */
+	struct FRestoreState
+	{
+		bool bStarted = false;
+		int32 NumLeft = 0;
+		TArray<FName> Names;
+		TArray<UClass*> Classes;
+		TMap<FName, TWeakObjectPtr<AUnrealSandBoxCharacter>> CharactersByName;
+	};
+
+	/**
+	 * @brief 読み込みに使ったファイルとバッファを解放します
+	 */
+	void FinishLoad();
+
+	FJobScheduler& Scheduler;
+	FStats Stats;
+
+	// ワーカースレッドでの保存。完了後にゲームスレッドで計測値を取り込む
+	TSharedPtr<FJobScheduler::FJobState, ESPMode::ThreadSafe> SaveJob;
+	TSharedPtr<FStats, ESPMode::ThreadSafe> SaveResult;
+
+	TUniquePtr<IMappedFileHandle> MappedFile;
+	TUniquePtr<IMappedFileRegion> MappedRegion;
+	// メモリマップできなかった場合に読み込んだファイル
+	TArray<uint8> FileBuffer;
+	// 展開したペイロード。非圧縮であればファイルを直接読む
+	TArray<uint8> LoadedPayload;
+	TSharedPtr<FJobScheduler::FJobState, ESPMode::ThreadSafe> LoadJob;
+	TSharedPtr<FStats, ESPMode::ThreadSafe> LoadResult;
+	TUniquePtr<FArchive> PayloadReader;
+	FRestoreState RestoreState;
+	bool bLoading = false;
+};
@@ -0,0 +1,149 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxTelemetry.h"
+
+namespace SandBoxTelemetryInternal
+{
+	// 60fpsで約1分。読み取りが止まっても直近の分は残る
+	constexpr int32 DefaultNumSlots = 4096;
+}
+
+/*static*/
+TSharedPtr<FSandBoxTelemetry> FSandBoxTelemetry::CreateFromCommandLine()
+{
+	if (!FParse::Param(FCommandLine::Get(), TEXT("SandBoxTelemetry")))
+	{
+		return nullptr;
+	}
+
+	FString TelemetryName = GetDefaultName();
+	FParse::Value(FCommandLine::Get(), TEXT("SandBoxTelemetryName="), TelemetryName);
+
+	int32 NumSlots = SandBoxTelemetryInternal::DefaultNumSlots;
+	FParse::Value(FCommandLine::Get(), TEXT("SandBoxTelemetrySlots="), NumSlots);
+
+	TSharedPtr<FSandBoxTelemetry> Telemetry = MakeShareable(new FSandBoxTelemetry(TelemetryName, NumSlots));
+	return Telemetry->IsValid() ? Telemetry : nullptr;
+}
+
+/*static*/
+FString FSandBoxTelemetry::GetDefaultName()
+{
+	return FString::Printf(TEXT("SandBoxTelemetry_%u"), FPlatformProcess::GetCurrentProcessId());
+}
+
+FSandBoxTelemetry::FSandBoxTelemetry(const FString& InName, int32 InNumSlots)
+	: Name(InName)
+{
+	if (!ensureAlwaysMsgf(InNumSlots > 0, TEXT("スロット数は1以上を指定してください NumSlots:%d"), InNumSlots))
+	{
+		return;
+	}
+
+	const SIZE_T Size = sizeof(FHeader) + sizeof(FSlot) * InNumSlots;
+	Region = FPlatformMemory::MapNamedSharedMemoryRegion(Name, true, FPlatformMemory::ESharedMemoryAccess::Read | FPlatformMemory::ESharedMemoryAccess::Write, Size);
+	if (!ensureAlwaysMsgf(Region != nullptr, TEXT("共有メモリを作成できませんでした Name:%s Size:%llu"), *Name, static_cast<uint64>(Size)))
+	{
+		return;
+	}
+
+	NumSlots = static_cast<uint32>(InNumSlots);
+	Header = new(Region->GetAddress()) FHeader();
+	Slots = reinterpret_cast<FSlot*>(Header + 1);
+	for (uint32 Index = 0; Index < NumSlots; ++Index)
+	{
+		new(&Slots[Index]) FSlot();
+		Slots[Index].Sequence.store(0, std::memory_order_relaxed);
+	}
+
+	Header->HeaderSize = sizeof(FHeader);
+	Header->SlotSize = sizeof(FSlot);
+	Header->NumSlots = NumSlots;
+	Header->ProcessId = FPlatformProcess::GetCurrentProcessId();
+	Header->NumWritten.store(0, std::memory_order_relaxed);
+	Header->Version = Version;
+
+	// 読み取り側はMagicを見てから他の値を読むため最後に書く
+	std::atomic_thread_fence(std::memory_order_release);
+	Header->Magic = Magic;
+
+	UE_LOG(LogTemp, Display, TEXT("SandBoxTelemetry Name:%s Slots:%u KB:%.1f"), *Name, NumSlots, Size / 1024.0);
+}
+
+FSandBoxTelemetry::~FSandBoxTelemetry()
+{
+	if (Region != nullptr)
+	{
+		Header->Magic = 0;
+		FPlatformMemory::UnmapNamedSharedMemoryRegion(Region);
+	}
+}
+
+void FSandBoxTelemetry::Publish(const FSandBoxTelemetrySample& Sample, uint64 StartCycles)
+{
+	if (Region == nullptr)
+	{
+		return;
+	}
+
+	const uint64 Index = NextIndex++;
+	FSlot& Slot = Slots[Index % NumSlots];
+
+	// 奇数にしてから書き込み、書き終わったら偶数にする。読み取り側は値が変わっていれば読み直す
+	Slot.Sequence.store(Index * 2 + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	FMemory::Memcpy(&Slot.Sample, &Sample, sizeof(FSandBoxTelemetrySample));
+	Slot.Sequence.store(Index * 2 + 2, std::memory_order_release);
+	Header->NumWritten.store(Index + 1, std::memory_order_release);
+
+	const uint64 Cycles = FPlatformTime::Cycles64() - StartCycles;
+	++NumPublished;
+	TotalCycles += Cycles;
+	MaxCycles = FMath::Max(MaxCycles, Cycles);
+}
+
+void FSandBoxTelemetry::DumpStats() const
+{
+	UE_LOG(LogTemp, Log, TEXT("SandBoxTelemetry Name:%s Valid:%d Slots:%u Written:%llu Published:%d AvgUs:%.3f MaxUs:%.3f"),
+		*Name, IsValid(), NumSlots, NextIndex, NumPublished,
+		NumPublished > 0 ? FPlatformTime::ToMilliseconds64(TotalCycles) * 1000.0 / NumPublished : 0.0,
+		FPlatformTime::ToMilliseconds64(MaxCycles) * 1000.0);
+}
+
+void FSandBoxTelemetry::ResetStats()
+{
+	NumPublished = 0;
+	TotalCycles = 0;
+	MaxCycles = 0;
+}
+
+void FSandBoxTelemetry::RunBenchmark(int32 NumSamples)
+{
+	if (Region == nullptr || NumSamples <= 0)
+	{
+		return;
+	}
+
+	// 集計を汚さないよう退避しておく
+	const int32 SavedNumPublished = NumPublished;
+	const uint64 SavedTotalCycles = TotalCycles;
+	const uint64 SavedMaxCycles = MaxCycles;
+	ResetStats();
+
+	FSandBoxTelemetrySample Sample;
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	for (int32 Count = 0; Count < NumSamples; ++Count)
+	{
+		Sample.TimeSec = Count;
+		Publish(Sample, FPlatformTime::Cycles64());
+	}
+	const double TotalMs = FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles);
+
+	UE_LOG(LogTemp, Log, TEXT("SandBoxTelemetryBenchmark Samples:%d TotalMs:%.3f AvgUs:%.4f MaxUs:%.3f"),
+		NumSamples, TotalMs, TotalMs * 1000.0 / NumSamples, FPlatformTime::ToMilliseconds64(MaxCycles) * 1000.0);
+
+	NumPublished = SavedNumPublished;
+	TotalCycles = SavedTotalCycles;
+	MaxCycles = SavedMaxCycles;
+}
@@ -0,0 +1,142 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+/**
+ * @brief 1フレーム分の計測値
+ *		　外部の読み取りツール(Tools/SandBoxTelemetryReader.py)と同じレイアウトにするため、メンバーの追加・並べ替えをしたらVersionを上げてツールも合わせてください。
+ */
+struct FSandBoxTelemetrySample
+{
+	uint64 FrameNumber = 0;
+	// FPlatformTime::Seconds()
+	double TimeSec = 0.0;
+	float FrameMs = 0.0f;
+	float GameThreadMs = 0.0f;
+	float RenderThreadMs = 0.0f;
+	// FJobSchedulerの実行待ちと実行中のジョブ数
+	int32 NumPendingJobs = 0;
+	// ポーンプールの待機数。プールがなければ-1
+	int32 PoolAvailable = -1;
+	// ポーンプールの累計の取得・生成・返却数
+	int32 PoolHits = 0;
+	int32 PoolMisses = 0;
+	int32 PoolReleases = 0;
+	// 空間ハッシュに登録されたキャラクター数
+	int32 NumCharacters = 0;
+	uint32 Reserved = 0;
+};
+
+static_assert(sizeof(FSandBoxTelemetrySample) == 56, "読み取りツールとレイアウトを合わせてください");
+
+/**
+ * @brief フレームの計測値を共有メモリのリングバッファに書き出すクラス
+ *		　ログやCSVを後から解析するのでは長時間の負荷試験を実行中に監視できないため、外部のプロセスが直接読める場所に毎フレーム書き出します。
+ *		　共有メモリはFPlatformMemory::MapNamedSharedMemoryRegionで作成します(LinuxではPOSIXの共有メモリ /dev/shm/名前)。
+ *		　各スロットはシーケンス番号で保護し(seqlock)、書き込み中は奇数、書き終わると偶数にします。
+ *		　読み取り側は前後でシーケンス番号を読み、一致した偶数であれば有効な値として扱います。
+ *		　書き込み側は読み取り側を一切待たず、システムコールもロックも使いません。読み取りが遅れると古いスロットは上書きされます。
+ *		　書き込みはゲームスレッドからのみ行ってください。
+ */
+class FSandBoxTelemetry final
+{
+public:
+	static constexpr uint32 Magic = 0x4D544253; // "SBTM"
+	static constexpr uint32 Version = 1;
+
+	/**
+	 * @brief 共有メモリの先頭に置くヘッダー
+	 */
+	struct alignas(64) FHeader
+	{
+		uint32 Magic;
+		uint32 Version;
+		uint32 HeaderSize;
+		uint32 SlotSize;
+		uint32 NumSlots;
+		uint32 ProcessId;
+		// 書き込んだサンプル数。N番目のサンプルはスロットN % NumSlotsに入る
+		std::atomic<uint64> NumWritten;
+	};
+
+	/**
+	 * @brief リングバッファの1要素
+	 */
+	struct alignas(64) FSlot
+	{
+		// N番目のサンプルを書き込み中は2N+1、書き終わると2N+2
+		std::atomic<uint64> Sequence;
+		FSandBoxTelemetrySample Sample;
+	};
+
+	static_assert(sizeof(FHeader) == 64 && sizeof(FSlot) == 64, "読み取りツールとレイアウトを合わせてください");
+
+	/**
+	 * @brief コマンドラインに-SandBoxTelemetryがあれば作成します
+	 *		　-SandBoxTelemetryName=名前 -SandBoxTelemetrySlots=スロット数
+	 */
+	static TSharedPtr<FSandBoxTelemetry> CreateFromCommandLine();
+
+	/**
+	 * @brief 名前を省略したときの共有メモリの名前。プロセスIDを含めるため、負荷試験で複数起動しても衝突しません
+	 */
+	static FString GetDefaultName();
+
+	/**
+	 * @param InName 共有メモリの名前
+	 * @param InNumSlots リングバッファの要素数
+	 */
+	FSandBoxTelemetry(const FString& InName, int32 InNumSlots);
+
+	/**
+	 * @brief 共有メモリを解放します
+	 */
+	~FSandBoxTelemetry();
+
+	/**
+	 * @brief 共有メモリを作成できたか
+	 */
+	bool IsValid() const { return Region != nullptr; }
+
+	const FString& GetName() const { return Name; }
+
+	/**
+	 * @brief 共有メモリと名前に使っているメモリの量
+	 */
+	SIZE_T GetAllocatedSize() const { return Name.GetAllocatedSize() + (Region != nullptr ? Region->GetSize() : 0); }
+
+	/**
+	 * @brief サンプルを書き込みます
+	 * @param StartCycles 計測値の収集を始めたときのFPlatformTime::Cycles64()。書き込みまでの時間を負荷として集計します
+	 */
+	void Publish(const FSandBoxTelemetrySample& Sample, uint64 StartCycles);
+
+	/**
+	 * @brief 書き込み数と1フレームあたりの負荷をログに出力します
+	 */
+	void DumpStats() const;
+
+	void ResetStats();
+
+	/**
+	 * @brief 書き込みだけを指定回数繰り返し、1回あたりの時間をログに出力します
+	 *		　書き込んだサンプルは読み取り側からも見えるため、FrameNumberを0にしておきます。
+	 */
+	void RunBenchmark(int32 NumSamples);
+
+private:
+	FString Name;
+	FPlatformMemory::FSharedMemoryRegion* Region = nullptr;
+	FHeader* Header = nullptr;
+	FSlot* Slots = nullptr;
+	uint32 NumSlots = 0;
+
+	// 読み取り側とは共有しないため、ゲームスレッドのみで更新する
+	uint64 NextIndex = 0;
+	int32 NumPublished = 0;
+	uint64 TotalCycles = 0;
+	uint64 MaxCycles = 0;
+};
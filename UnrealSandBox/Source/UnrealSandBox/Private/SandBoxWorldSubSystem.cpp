@@ -0,0 +1,1185 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SandBoxWorldSubSystem.h"
+#include "Async/ParallelFor.h"
+#include "CharacterSignificance.h"
+#include "CharacterSpatialHash.h"
+#include "Camera/CameraComponent.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "CrowdSimulation.h"
+#include "FixedStepSimulation.h"
+#include "FrameTimeSampler.h"
+#include "MovementIntentBatch.h"
+#include "NavigationSystem.h"
+#include "NetMovementRate.h"
+#include "PathService.h"
+#include "SampleSubSystem.h"
+#include "SandBoxReplicationGraph.h"
+#include "SandBoxAnimInstance.h"
+#include "SandBoxMemoryTracker.h"
+#include "SandBoxSnapshot.h"
+#include "SceneQueryBatch.h"
+#include "GameFramework/CharacterMovementComponent.h"
+#include "GameFramework/GameModeBase.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/SpringArmComponent.h"
+#include "Engine/NetConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/TargetPoint.h"
+#include "EngineUtils.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryWriter.h"
+#include "UnrealSandBox/UnrealSandBoxCharacter.h"
+#include "UnrealSandBox/UnrealSandBoxGameMode.h"
+
+//---------------------------------------------------------------------------------
+// SandBoxWorldSubSystem
+//---------------------------------------------------------------------------------
+bool USandBoxWorldSubSystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	const UWorld* World = Cast<UWorld>(Outer);
+	return World != nullptr && World->IsGameWorld();
+}
+
+void USandBoxWorldSubSystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	CharacterSignificance = MakeShareable(new FCharacterSignificance());
+	MovementIntentBatch = MakeShareable(new FMovementIntentBatch());
+	SceneQueryBatch = MakeShareable(new FSceneQueryBatch());
+	PathService = MakeShareable(new FPathService(GetWorld()));
+	CharacterSpatialHash = MakeShareable(new FCharacterSpatialHash());
+	NetMovementRate = MakeShareable(new FNetMovementRate());
+	FrameTimeSampler = MakeShareable(new FFrameTimeSampler());
+	FixedStepSimulation = FFixedStepSimulation::CreateFromCommandLine();
+}
+
+void USandBoxWorldSubSystem::Deinitialize()
+{
+	// 書き込み中のジョブはここで待つ
+	Snapshot.Reset();
+
+	// ワールドの破棄中なのでアクターは削除せず参照だけ手放す
+	PromotedAgents.Reset();
+	Crowd.Reset();
+	FixedStepSimulation.Reset();
+	MovementIntentBatch->UnregisterTickFunction();
+	SceneQueryBatch->UnregisterTickFunction();
+	Super::Deinitialize();
+}
+
+TStatId USandBoxWorldSubSystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(SandBoxWorldSubSystem, STATGROUP_Tickables);
+}
+
+void USandBoxWorldSubSystem::Tick(float DeltaTime)
+{
+	GatherViewerLocations(ViewerLocations);
+
+	UpdateCrowd(DeltaTime);
+	if (bDriveBenchmarkCharacters)
+	{
+		DriveBenchmarkCharacters();
+	}
+
+	// このフレームに追加された移動入力を使うため、入力を与える処理より後に進める
+	FixedStepSimulation->Tick(*GetWorld(), DeltaTime);
+	PathService->Tick();
+	CharacterSignificance->Update(DeltaTime, ViewerLocations, Characters, GetWorld()->GetNetMode() != NM_DedicatedServer);
+
+	const ENetMode NetMode = GetWorld()->GetNetMode();
+	if (NetMode == NM_DedicatedServer || NetMode == NM_ListenServer)
+	{
+		NetMovementRate->Update(DeltaTime, *GetWorld(), Characters);
+	}
+
+	FrameTimeSampler->Tick();
+	UpdateSnapshot();
+}
+
+bool USandBoxWorldSubSystem::IsTickable() const
+{
+	return true;
+}
+
+ETickableTickType USandBoxWorldSubSystem::GetTickableTickType() const
+{
+	return IsTemplate() ? ETickableTickType::Never : ETickableTickType::Conditional;
+}
+
+UWorld* USandBoxWorldSubSystem::GetTickableGameObjectWorld() const
+{
+	return GetWorld();
+}
+
+void USandBoxWorldSubSystem::RegisterCharacter(AUnrealSandBoxCharacter* Character)
+{
+	Characters.AddUnique(Character);
+	if (FixedStepSimulation.IsValid())
+	{
+		FixedStepSimulation->AddCharacter(Character);
+	}
+
+	if (CompactMovementOverride.IsSet())
+	{
+		Character->SetUseCompactMovement(CompactMovementOverride.GetValue());
+	}
+}
+
+void USandBoxWorldSubSystem::UnregisterCharacter(AUnrealSandBoxCharacter* Character)
+{
+	Characters.RemoveSwap(Character);
+
+	// ワールドの破棄中はDeinitializeの後にEndPlayが呼ばれることがある
+	if (FixedStepSimulation.IsValid())
+	{
+		FixedStepSimulation->RemoveCharacter(Character);
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Significance
+//---------------------------------------------------------------------------------
+void USandBoxWorldSubSystem::SetSignificanceEnabled(bool bEnabled)
+{
+	CharacterSignificance->SetEnabled(bEnabled, Characters);
+}
+
+void USandBoxWorldSubSystem::DumpSignificance() const
+{
+	CharacterSignificance->DumpReport();
+}
+
+void USandBoxWorldSubSystem::DumpCameraRigs() const
+{
+	int32 NumCharacters = 0;
+	int32 NumWithRig = 0;
+	SIZE_T TotalRigBytes = 0;
+	int32 NumRigComponents = 0;
+	int32 NumRigTicks = 0;
+	int32 NumRigSweeps = 0;
+	for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& Character : Characters)
+	{
+		if (!Character.IsValid())
+		{
+			continue;
+		}
+
+		++NumCharacters;
+		const USpringArmComponent* CameraBoom = Character->GetCameraBoom();
+		const UCameraComponent* FollowCamera = Character->GetFollowCamera();
+		if (CameraBoom == nullptr)
+		{
+			continue;
+		}
+
+		// 実際に作られているリグから、メモリ・登録済みコンポーネント・Tick・スイープの数を数える
+		// スプリングアームはTickの中でコリジョンテストが有効なときだけスイープを行う
+		++NumWithRig;
+		TotalRigBytes += FSandBoxMemoryTracker::GetObjectAllocatedSize(*CameraBoom);
+		NumRigComponents += CameraBoom->IsRegistered() ? 1 : 0;
+		NumRigTicks += CameraBoom->IsComponentTickEnabled() ? 1 : 0;
+		NumRigSweeps += CameraBoom->IsComponentTickEnabled() && CameraBoom->bDoCollisionTest ? 1 : 0;
+		if (FollowCamera != nullptr)
+		{
+			TotalRigBytes += FSandBoxMemoryTracker::GetObjectAllocatedSize(*FollowCamera);
+			NumRigComponents += FollowCamera->IsRegistered() ? 1 : 0;
+			NumRigTicks += FollowCamera->IsComponentTickEnabled() ? 1 : 0;
+		}
+	}
+
+	// リグを持つキャラクターがいない場合はクラスのデフォルトオブジェクトから見積もる
+	double BytesPerRig = 0.0;
+	double ComponentsPerRig = 0.0;
+	double TicksPerRig = 0.0;
+	double SweepsPerRig = 0.0;
+	if (NumWithRig > 0)
+	{
+		BytesPerRig = static_cast<double>(TotalRigBytes) / NumWithRig;
+		ComponentsPerRig = static_cast<double>(NumRigComponents) / NumWithRig;
+		TicksPerRig = static_cast<double>(NumRigTicks) / NumWithRig;
+		SweepsPerRig = static_cast<double>(NumRigSweeps) / NumWithRig;
+	}
+	else
+	{
+		const USpringArmComponent* DefaultBoom = GetDefault<USpringArmComponent>();
+		const UCameraComponent* DefaultCamera = GetDefault<UCameraComponent>();
+		BytesPerRig = FSandBoxMemoryTracker::GetObjectAllocatedSize(*DefaultBoom) + FSandBoxMemoryTracker::GetObjectAllocatedSize(*DefaultCamera);
+		ComponentsPerRig = 2.0;
+		TicksPerRig = (DefaultBoom->PrimaryComponentTick.bCanEverTick ? 1.0 : 0.0) + (DefaultCamera->PrimaryComponentTick.bCanEverTick ? 1.0 : 0.0);
+		SweepsPerRig = DefaultBoom->PrimaryComponentTick.bCanEverTick && DefaultBoom->bDoCollisionTest ? 1.0 : 0.0;
+	}
+
+	const int32 NumWithoutRig = NumCharacters - NumWithRig;
+	UE_LOG(LogTemp, Log, TEXT("CameraRig Characters:%d WithRig:%d WithoutRig:%d Measured:%d"), NumCharacters, NumWithRig, NumWithoutRig, NumWithRig > 0);
+	UE_LOG(LogTemp, Log, TEXT("  PerRig Bytes:%.0f Components:%.2f TicksPerFrame:%.2f SweepsPerFrame:%.2f"), BytesPerRig, ComponentsPerRig, TicksPerRig, SweepsPerRig);
+	UE_LOG(LogTemp, Log, TEXT("  Per1kPawns SavedKB:%.1f SavedComponents:%.0f SavedTicksPerFrame:%.0f SavedSweepsPerFrame:%.0f"),
+		BytesPerRig * 1000 / 1024.0, ComponentsPerRig * 1000, TicksPerRig * 1000, SweepsPerRig * 1000);
+	UE_LOG(LogTemp, Log, TEXT("  Current SavedKB:%.1f SavedComponents:%.0f SavedTicksPerFrame:%.0f SavedSweepsPerFrame:%.0f"),
+		BytesPerRig * NumWithoutRig / 1024.0, ComponentsPerRig * NumWithoutRig, TicksPerRig * NumWithoutRig, SweepsPerRig * NumWithoutRig);
+}
+
+//---------------------------------------------------------------------------------
+// Net movement
+//---------------------------------------------------------------------------------
+void USandBoxWorldSubSystem::SetCompactMovementEnabled(bool bEnabled)
+{
+	CompactMovementOverride = bEnabled;
+	for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& Character : Characters)
+	{
+		if (Character.IsValid())
+		{
+			Character->SetUseCompactMovement(bEnabled);
+		}
+	}
+}
+
+void USandBoxWorldSubSystem::SetNetMovementRateEnabled(bool bEnabled)
+{
+	NetMovementRate->SetEnabled(bEnabled, Characters);
+}
+
+void USandBoxWorldSubSystem::StartNetMovementReport(int32 NumFrames)
+{
+	if (NumFrames <= 0)
+	{
+		DumpNetMovement(TEXT("NetMovementReport"));
+		return;
+	}
+
+	if (FrameTimeSampler->IsRunning())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("計測中です"));
+		return;
+	}
+
+	// 計測開始時点の値でラベルを作っておく
+	int32 NumCompact = 0;
+	for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& Character : Characters)
+	{
+		NumCompact += Character.IsValid() && Character->bUseCompactMovement ? 1 : 0;
+	}
+	const FString Label = FString::Printf(TEXT("NetMovementReport Characters:%d Compact:%d Rate:%d"), Characters.Num(), NumCompact, NetMovementRate->IsEnabled());
+	FrameTimeSampler->Start(Label, NumFrames, 10, [this, Label]()
+	{
+		DumpNetMovement(Label);
+	});
+}
+
+void USandBoxWorldSubSystem::DumpNetTick(bool bReset)
+{
+	USandBoxReplicationGraph* Graph = USandBoxReplicationGraph::Get(GetWorld());
+	if (Graph == nullptr)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("レプリケーショングラフを使用していません。サーバーで実行してください"));
+		return;
+	}
+
+	Graph->DumpNetTickStats();
+	if (bReset)
+	{
+		Graph->ResetNetTickStats();
+	}
+}
+
+void USandBoxWorldSubSystem::DumpNetMovement(const FString& Label) const
+{
+	const UNetDriver* NetDriver = GetWorld()->GetNetDriver();
+	if (NetDriver == nullptr || !NetDriver->IsServer())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("サーバーで実行してください"));
+		return;
+	}
+
+	int32 NumCompact = 0;
+	for (const TWeakObjectPtr<AUnrealSandBoxCharacter>& Character : Characters)
+	{
+		NumCompact += Character.IsValid() && Character->bUseCompactMovement ? 1 : 0;
+	}
+
+	// 送信量は接続ごとに直近1秒で集計されている
+	int64 TotalOutBytesPerSec = 0;
+	for (const UNetConnection* Connection : NetDriver->ClientConnections)
+	{
+		TotalOutBytesPerSec += Connection->OutBytesPerSecond;
+	}
+	const int32 NumClients = NetDriver->ClientConnections.Num();
+	const FCPUTime CPUTime = FPlatformTime::GetCPUTime();
+
+	UE_LOG(LogTemp, Log, TEXT("%s Clients:%d Characters:%d Compact:%d OutBytesPerSec Total:%lld PerClient:%.0f ServerCPU:%.1f%% (%.1f%% of all cores)"),
+		*Label, NumClients, Characters.Num(), NumCompact, TotalOutBytesPerSec, NumClients > 0 ? static_cast<double>(TotalOutBytesPerSec) / NumClients : 0.0,
+		CPUTime.CPUTimePctRelative, CPUTime.CPUTimePct);
+	for (const UNetConnection* Connection : NetDriver->ClientConnections)
+	{
+		UE_LOG(LogTemp, Log, TEXT("  %s OutBytesPerSec:%d OutPacketsPerSec:%d InBytesPerSec:%d"),
+			*Connection->LowLevelGetRemoteAddress(true), Connection->OutBytesPerSecond, Connection->OutPacketsPerSecond, Connection->InBytesPerSecond);
+	}
+	NetMovementRate->DumpReport();
+}
+
+//---------------------------------------------------------------------------------
+// Benchmark
+//---------------------------------------------------------------------------------
+void USandBoxWorldSubSystem::StartAnimBenchmark(int32 Count, int32 NumFrames, bool bNativeAnimInstance)
+{
+	if (FrameTimeSampler->IsRunning())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("計測中です"));
+		return;
+	}
+
+	// USandBoxAnimInstanceそのものはAnimGraphを持たずポーズを計算しないため、同じAnimGraphを持つ子クラスのAnimBPと比較する
+	UClass* AnimClass = nullptr;
+	if (bNativeAnimInstance)
+	{
+		// アセットはリポジトリに含まれないため、エディタで作成してDefaultGame.iniに設定する必要がある
+		if (NativeAnimClass.IsNull())
+		{
+			UE_LOG(LogTemp, Warning, TEXT("NativeAnimClassが設定されていません。DefaultGame.iniの[/Script/UnrealSandBox.SandBoxWorldSubSystem]を参照してください"));
+			return;
+		}
+
+		AnimClass = NativeAnimClass.LoadSynchronous();
+		if (!ensureAlwaysMsgf(AnimClass != nullptr && AnimClass->IsChildOf(USandBoxAnimInstance::StaticClass()),
+			TEXT("NativeAnimClass %s がUSandBoxAnimInstanceの子クラスのAnimBPではありません"), *NativeAnimClass.ToString()))
+		{
+			return;
+		}
+	}
+
+	SpawnBenchmarkCharacters(Count);
+
+	// 描画状況でアニメーションの更新が止まらないよう計測中は重要度による調整を止めて常に更新させる
+	const bool bSignificanceEnabled = CharacterSignificance->IsEnabled();
+	SetSignificanceEnabled(false);
+	for (const TWeakObjectPtr<ACharacter>& Character : BenchmarkCharacters)
+	{
+		USkeletalMeshComponent* Mesh = Character->GetMesh();
+		Mesh->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::AlwaysTickPoseAndRefreshBones;
+		if (AnimClass != nullptr)
+		{
+			Mesh->SetAnimInstanceClass(AnimClass);
+		}
+	}
+
+	const FString Label = FString::Printf(TEXT("AnimBenchmark Characters:%d Native:%d AnimClass:%s"), BenchmarkCharacters.Num(), bNativeAnimInstance,
+		BenchmarkCharacters.Num() > 0 ? *GetNameSafe(BenchmarkCharacters[0]->GetMesh()->GetAnimClass()) : TEXT("None"));
+	FrameTimeSampler->Start(Label, NumFrames, 10, [this, bSignificanceEnabled]()
+	{
+		DestroyBenchmarkCharacters();
+		SetSignificanceEnabled(bSignificanceEnabled);
+	});
+}
+
+void USandBoxWorldSubSystem::StartFloorQueryBenchmark(int32 Count, int32 NumFrames, bool bAsync)
+{
+	if (FrameTimeSampler->IsRunning())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("計測中です"));
+		return;
+	}
+
+	SpawnBenchmarkCharacters(Count);
+
+	// 床判定を省略させないよう計測中は重要度による調整を止める
+	const bool bSignificanceEnabled = CharacterSignificance->IsEnabled();
+	const bool bSceneQueryBatchEnabled = SceneQueryBatch->IsEnabled();
+	SetSignificanceEnabled(false);
+	SceneQueryBatch->SetEnabled(bAsync);
+	SceneQueryBatch->ResetStats();
+
+	for (const TWeakObjectPtr<ACharacter>& Character : BenchmarkCharacters)
+	{
+		Character->SpawnDefaultController();
+	}
+	bDriveBenchmarkCharacters = true;
+
+	const FString Label = FString::Printf(TEXT("FloorQueryBenchmark Characters:%d Async:%d"), BenchmarkCharacters.Num(), bAsync);
+	FrameTimeSampler->Start(Label, NumFrames, 10, [this, Label, bSignificanceEnabled, bSceneQueryBatchEnabled]()
+	{
+		SceneQueryBatch->DumpStats(*Label);
+		bDriveBenchmarkCharacters = false;
+		DestroyBenchmarkCharacters();
+		SceneQueryBatch->SetEnabled(bSceneQueryBatchEnabled);
+		SetSignificanceEnabled(bSignificanceEnabled);
+	});
+}
+
+void USandBoxWorldSubSystem::DriveBenchmarkCharacters()
+{
+	// キャラクターごとに異なる向きからゆっくり旋回させ、マップ中央の地形の上を広く歩かせる
+	const float Time = GetWorld()->GetTimeSeconds();
+	for (int32 i = 0; i < BenchmarkCharacters.Num(); ++i)
+	{
+		if (ACharacter* Character = BenchmarkCharacters[i].Get())
+		{
+			const float Angle = i * 2.39996f + Time * 0.3f;
+			Character->AddMovementInput(FVector(FMath::Cos(Angle), FMath::Sin(Angle), 0.0f));
+		}
+	}
+}
+
+void USandBoxWorldSubSystem::StartPathBenchmark(int32 NumBots, int32 NumFrames, bool bUseCache)
+{
+	if (FrameTimeSampler->IsRunning())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("計測中です"));
+		return;
+	}
+
+	UNavigationSystemV1* NavSys = FNavigationSystem::GetCurrent<UNavigationSystemV1>(GetWorld());
+	if (NavSys == nullptr || !PathService->HasNavigationData())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("ナビメッシュがありません。マップにNavMeshBoundsVolumeを配置してください"));
+		return;
+	}
+
+	// プレイヤーの周りのナビメッシュ上から経路の端点の候補を選んでおく
+	const FVector Origin = ViewerLocations.Num() > 0 ? ViewerLocations[0] : FVector::ZeroVector;
+	PathBenchmarkPoints.Reset();
+	for (int32 i = 0; i < 256; ++i)
+	{
+		FNavLocation NavLocation;
+		if (NavSys->GetRandomReachablePointInRadius(Origin, 3000.0f, NavLocation))
+		{
+			PathBenchmarkPoints.Add(NavLocation.Location);
+		}
+	}
+	if (PathBenchmarkPoints.Num() < 2)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("経路の端点を選べませんでした"));
+		return;
+	}
+
+	const bool bPreviousUseCache = PathService->bUseCache;
+	PathService->bUseCache = bUseCache;
+	PathService->InvalidateCache();
+	PathService->ResetStats();
+	PathBenchmarkRandom.Initialize(NumBots);
+
+	bPathBenchmarkRunning = true;
+	for (int32 i = 0; i < NumBots; ++i)
+	{
+		RequestBenchmarkPath();
+	}
+
+	const FString Label = FString::Printf(TEXT("PathBenchmark Bots:%d Cache:%d"), NumBots, bUseCache);
+	FrameTimeSampler->Start(Label, NumFrames, 10, [this, Label, bPreviousUseCache]()
+	{
+		bPathBenchmarkRunning = false;
+		PathService->DumpStats(*Label);
+		PathService->bUseCache = bPreviousUseCache;
+	});
+}
+
+void USandBoxWorldSubSystem::RequestBenchmarkPath()
+{
+	const FVector& Start = PathBenchmarkPoints[PathBenchmarkRandom.RandHelper(PathBenchmarkPoints.Num())];
+	const FVector& Goal = PathBenchmarkPoints[PathBenchmarkRandom.RandHelper(PathBenchmarkPoints.Num())];
+
+	// 結果が返ったボットは次の経路を要求する
+	PathService->RequestPath(Start, Goal, [this](const FPathService::FPathResult& Result)
+	{
+		if (bPathBenchmarkRunning)
+		{
+			RequestBenchmarkPath();
+		}
+	});
+}
+
+void USandBoxWorldSubSystem::SpawnBenchmarkCharacters(int32 Count)
+{
+	DestroyBenchmarkCharacters();
+
+	// プレイヤーの周りに格子状に並べる
+	FVector Origin = FVector::ZeroVector;
+	if (ViewerLocations.Num() > 0)
+	{
+		Origin = ViewerLocations[0];
+	}
+
+	constexpr float Spacing = 200.0f;
+	const int32 NumColumns = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(Count)));
+	const FVector GridOffset(-Spacing * NumColumns * 0.5f, -Spacing * NumColumns * 0.5f, 0.0f);
+
+	FActorSpawnParameters SpawnParameters;
+	SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	UClass* CharacterClass = GetCrowdCharacterClass();
+	BenchmarkCharacters.Reserve(Count);
+	for (int32 i = 0; i < Count; ++i)
+	{
+		const FVector Location = Origin + GridOffset + FVector((i % NumColumns) * Spacing, (i / NumColumns) * Spacing, 0.0f);
+		ACharacter* Character = GetWorld()->SpawnActor<ACharacter>(CharacterClass, Location, FRotator::ZeroRotator, SpawnParameters);
+		if (Character != nullptr)
+		{
+			BenchmarkCharacters.Add(Character);
+		}
+	}
+}
+
+void USandBoxWorldSubSystem::DestroyBenchmarkCharacters()
+{
+	for (const TWeakObjectPtr<ACharacter>& Character : BenchmarkCharacters)
+	{
+		if (Character.IsValid())
+		{
+			if (AController* Controller = Character->GetController())
+			{
+				Controller->Destroy();
+			}
+			Character->Destroy();
+		}
+	}
+	BenchmarkCharacters.Reset();
+}
+
+//---------------------------------------------------------------------------------
+// Crowd
+//---------------------------------------------------------------------------------
+void USandBoxWorldSubSystem::SpawnCrowd(int32 Count, const FVector& Center, float Radius)
+{
+	if (GetWorld()->GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("群衆はサーバーでのみ生成できます"));
+		return;
+	}
+
+	FCrowdSimulation& CrowdSimulation = GetOrCreateCrowd();
+	CrowdSimulation.AddAgents(Count, Center, Radius, CrowdSimulation.Num());
+	DumpCrowd();
+}
+
+void USandBoxWorldSubSystem::ClearCrowd()
+{
+	for (FPromotedAgent& Promoted : PromotedAgents)
+	{
+		if (Promoted.Character.IsValid())
+		{
+			DemoteCrowdAgent(Promoted);
+		}
+	}
+	PromotedAgents.Reset();
+	Crowd.Reset();
+}
+
+void USandBoxWorldSubSystem::DumpCrowd() const
+{
+	if (Crowd.IsValid())
+	{
+		UE_LOG(LogTemp, Log, TEXT("Crowd Agents:%d Promoted:%d"), Crowd->Num(), Crowd->GetNumPromoted());
+	}
+	else
+	{
+		UE_LOG(LogTemp, Log, TEXT("Crowd Agents:0 Promoted:0"));
+	}
+}
+
+/*static*/
+void USandBoxWorldSubSystem::RunCrowdBenchmark(const TArray<int32>& AgentCounts, int32 NumFrames)
+{
+	constexpr float DeltaTime = 1.0f / 60.0f;
+	constexpr int32 NumWarmupFrames = 5;
+
+	const FCrowdSimulation::FParams Params = FCrowdSimulation::MakeParamsFromCharacter(*GetDefault<AUnrealSandBoxCharacter>());
+	const TArray<FVector> ViewerLocations = {FVector::ZeroVector};
+
+	for (const int32 AgentCount : AgentCounts)
+	{
+		FCrowdSimulation Simulation(Params);
+		Simulation.AddAgents(AgentCount, FVector::ZeroVector, 50000.0f);
+
+		for (int32 Frame = 0; Frame < NumWarmupFrames; ++Frame)
+		{
+			Simulation.Update(DeltaTime, ViewerLocations, 2500.0f);
+		}
+
+		double TotalSec = 0.0;
+		double MaxSec = 0.0;
+		for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+		{
+			const double StartSec = FPlatformTime::Seconds();
+			Simulation.Update(DeltaTime, ViewerLocations, 2500.0f);
+			const double ElapsedSec = FPlatformTime::Seconds() - StartSec;
+			TotalSec += ElapsedSec;
+			MaxSec = FMath::Max(MaxSec, ElapsedSec);
+		}
+
+		UE_LOG(LogTemp, Log, TEXT("CrowdBenchmark Agents:%d Frames:%d AvgMs:%.3f MaxMs:%.3f"),
+			AgentCount, NumFrames, TotalSec * 1000.0 / FMath::Max(NumFrames, 1), MaxSec * 1000.0);
+	}
+}
+
+void USandBoxWorldSubSystem::DumpCharactersAround(const FVector& Center, float Radius, int32 K) const
+{
+	TArray<FCharacterSpatialHash::FHit> Hits;
+	if (K > 0)
+	{
+		CharacterSpatialHash->GetGrid().QueryNearest(Center, K, Radius, Hits);
+	}
+	else
+	{
+		CharacterSpatialHash->GetGrid().QueryRadius(Center, Radius, Hits);
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("CharactersAround Center:%s Radius:%.0f Hits:%d"), *Center.ToString(), Radius, Hits.Num());
+	for (const FCharacterSpatialHash::FHit& Hit : Hits)
+	{
+		const AActor* Actor = CharacterSpatialHash->GetActor(Hit.Id);
+		UE_LOG(LogTemp, Log, TEXT("  %s Distance:%.0f"), Actor != nullptr ? *Actor->GetName() : TEXT("None"), FMath::Sqrt(Hit.DistanceSquared));
+	}
+	CharacterSpatialHash->DumpStats();
+}
+
+void USandBoxWorldSubSystem::RunSpatialHashBenchmark(const TArray<int32>& Counts, int32 NumQueries, float Radius, bool bSpawnActors)
+{
+	// エントリ数によらず1セルあたりの数がほぼ同じになるよう、配置範囲をエントリ数に合わせて広げる
+	constexpr float AreaPerEntry = 500.0f * 500.0f;
+	constexpr int32 NearestK = 8;
+	constexpr float MoveDistance = 300.0f;
+
+	NumQueries = FMath::Max(NumQueries, 1);
+	FRandomStream Random(Counts.Num());
+
+	for (const int32 Count : Counts)
+	{
+		const float HalfExtent = FMath::Sqrt(Count * AreaPerEntry) * 0.5f;
+		TArray<FVector> Locations;
+		Locations.SetNumUninitialized(Count);
+		for (FVector& Location : Locations)
+		{
+			Location = FVector(Random.FRandRange(-HalfExtent, HalfExtent), Random.FRandRange(-HalfExtent, HalfExtent), Random.FRandRange(0.0f, 500.0f));
+		}
+		TArray<FVector> QueryCenters;
+		QueryCenters.SetNumUninitialized(NumQueries);
+		for (FVector& Center : QueryCenters)
+		{
+			Center = Locations[Random.RandHelper(Count)];
+		}
+
+		FCharacterSpatialHash Hash;
+		TArray<int32> Ids;
+		Ids.SetNumUninitialized(Count);
+		double StartSec = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			Ids[Index] = Hash.Add(nullptr, Locations[Index]);
+		}
+		const double BuildMs = (FPlatformTime::Seconds() - StartSec) * 1000.0;
+
+		// 全エントリを1フレーム分動かした場合の更新時間
+		for (FVector& Location : Locations)
+		{
+			Location += FVector(Random.FRandRange(-MoveDistance, MoveDistance), Random.FRandRange(-MoveDistance, MoveDistance), 0.0f);
+		}
+		StartSec = FPlatformTime::Seconds();
+		for (int32 Index = 0; Index < Count; ++Index)
+		{
+			Hash.Update(Ids[Index], Locations[Index]);
+		}
+		const double UpdateMs = (FPlatformTime::Seconds() - StartSec) * 1000.0;
+
+		TArray<FCharacterSpatialHash::FHit> Hits;
+		int64 TotalHits = 0;
+		StartSec = FPlatformTime::Seconds();
+		for (const FVector& Center : QueryCenters)
+		{
+			Hash.GetGrid().QueryRadius(Center, Radius, Hits);
+			TotalHits += Hits.Num();
+		}
+		const double RadiusUs = (FPlatformTime::Seconds() - StartSec) * 1000000.0 / NumQueries;
+
+		StartSec = FPlatformTime::Seconds();
+		for (const FVector& Center : QueryCenters)
+		{
+			Hash.GetGrid().QueryBox(FBox(Center - FVector(Radius), Center + FVector(Radius)), Hits);
+		}
+		const double BoxUs = (FPlatformTime::Seconds() - StartSec) * 1000000.0 / NumQueries;
+
+		StartSec = FPlatformTime::Seconds();
+		for (const FVector& Center : QueryCenters)
+		{
+			Hash.GetGrid().QueryNearest(Center, NearestK, HalfExtent * 2.0f, Hits);
+		}
+		const double NearestUs = (FPlatformTime::Seconds() - StartSec) * 1000000.0 / NumQueries;
+
+		// スナップショットを取ってワーカースレッドで並列に検索する
+		StartSec = FPlatformTime::Seconds();
+		const FCharacterSpatialHash::FSnapshot Snapshot = Hash.GetSnapshot();
+		const double SnapshotMs = (FPlatformTime::Seconds() - StartSec) * 1000.0;
+		StartSec = FPlatformTime::Seconds();
+		ParallelFor(NumQueries, [&Snapshot, &QueryCenters, Radius](int32 Index)
+		{
+			TArray<FCharacterSpatialHash::FHit> WorkerHits;
+			Snapshot->QueryRadius(QueryCenters[Index], Radius, WorkerHits);
+		});
+		const double ParallelRadiusMs = (FPlatformTime::Seconds() - StartSec) * 1000.0;
+
+		// 比較用に全件を走査する
+		const float RadiusSq = FMath::Square(Radius);
+		int64 TotalScanHits = 0;
+		StartSec = FPlatformTime::Seconds();
+		for (const FVector& Center : QueryCenters)
+		{
+			for (const FVector& Location : Locations)
+			{
+				TotalScanHits += FVector::DistSquared(Location, Center) <= RadiusSq ? 1 : 0;
+			}
+		}
+		const double ScanUs = (FPlatformTime::Seconds() - StartSec) * 1000000.0 / NumQueries;
+
+		// SIMD 版は FMA で距離を計算するため、半径ちょうど付近の点はスカラー版と丸めが異なり判定が分かれることがある
+		// 半径付近の点は計測対象外のループで数え、その数までの差は許容する
+		const float BoundaryToleranceSq = RadiusSq * 1.e-4f;
+		int64 NumBoundaryHits = 0;
+		for (const FVector& Center : QueryCenters)
+		{
+			for (const FVector& Location : Locations)
+			{
+				NumBoundaryHits += FMath::Abs(FVector::DistSquared(Location, Center) - RadiusSq) <= BoundaryToleranceSq ? 1 : 0;
+			}
+		}
+		ensureAlwaysMsgf(FMath::Abs(TotalHits - TotalScanHits) <= NumBoundaryHits, TEXT("空間ハッシュと全件走査で検索結果の数が一致しません Hash:%lld Scan:%lld Boundary:%lld"), TotalHits, TotalScanHits, NumBoundaryHits);
+
+		double ActorIteratorUs = -1.0;
+		if (bSpawnActors)
+		{
+			FActorSpawnParameters SpawnParams;
+			SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+			TArray<AActor*> Actors;
+			Actors.Reserve(Count);
+			for (const FVector& Location : Locations)
+			{
+				Actors.Add(GetWorld()->SpawnActor<ATargetPoint>(Location, FRotator::ZeroRotator, SpawnParams));
+			}
+
+			// アクターの走査は重いので検索回数を抑える
+			const int32 NumActorQueries = FMath::Min(NumQueries, 100);
+			StartSec = FPlatformTime::Seconds();
+			for (int32 Index = 0; Index < NumActorQueries; ++Index)
+			{
+				int32 NumActorHits = 0;
+				for (TActorIterator<ATargetPoint> It(GetWorld()); It; ++It)
+				{
+					NumActorHits += FVector::DistSquared(It->GetActorLocation(), QueryCenters[Index]) <= RadiusSq ? 1 : 0;
+				}
+			}
+			ActorIteratorUs = (FPlatformTime::Seconds() - StartSec) * 1000000.0 / NumActorQueries;
+
+			for (AActor* Actor : Actors)
+			{
+				if (Actor != nullptr)
+				{
+					Actor->Destroy();
+				}
+			}
+		}
+
+		UE_LOG(LogTemp, Log, TEXT("SpatialHashBenchmark Entries:%d Queries:%d Radius:%.0f AvgHits:%.1f BuildMs:%.3f UpdateMs:%.3f RadiusUs:%.2f BoxUs:%.2f NearestUs:%.2f SnapshotMs:%.3f ParallelRadiusMs:%.3f ScanUs:%.2f ActorIteratorUs:%.2f"),
+			Count, NumQueries, Radius, static_cast<double>(TotalHits) / NumQueries, BuildMs, UpdateMs, RadiusUs, BoxUs, NearestUs,
+			SnapshotMs, ParallelRadiusMs, ScanUs, ActorIteratorUs);
+		Hash.DumpStats();
+	}
+}
+
+void USandBoxWorldSubSystem::UpdateCrowd(float DeltaTime)
+{
+	if (!Crowd.IsValid())
+	{
+		return;
+	}
+
+	Crowd->Update(DeltaTime, ViewerLocations, CrowdPromoteDistance);
+
+	// 昇格中のアクターを動かし、視点から離れたものはエージェントに戻す
+	const float DemoteDistanceSq = FMath::Square(CrowdDemoteDistance);
+	for (int32 i = PromotedAgents.Num() - 1; i >= 0; --i)
+	{
+		FPromotedAgent& Promoted = PromotedAgents[i];
+		ACharacter* Character = Promoted.Character.Get();
+		const AUnrealSandBoxCharacter* SandBoxCharacter = Cast<AUnrealSandBoxCharacter>(Character);
+		if (Character == nullptr || (SandBoxCharacter != nullptr && SandBoxCharacter->IsInPawnPool()))
+		{
+			// 外部で削除またはプールに返却された場合は最後の状態のまま戻す
+			Crowd->Demote(Promoted.AgentIndex, Crowd->GetPosition(Promoted.AgentIndex), FVector::ZeroVector, Crowd->GetYaw(Promoted.AgentIndex));
+			PromotedAgents.RemoveAtSwap(i);
+			continue;
+		}
+
+		const FVector Location = Character->GetActorLocation();
+		const bool bNearViewer = ViewerLocations.ContainsByPredicate([&Location, DemoteDistanceSq](const FVector& ViewerLocation)
+		{
+			return FVector::DistSquared(ViewerLocation, Location) < DemoteDistanceSq;
+		});
+
+		if (bNearViewer)
+		{
+			Character->AddMovementInput(Crowd->GetDesiredDirection(Promoted.AgentIndex, Location));
+		}
+		else
+		{
+			DemoteCrowdAgent(Promoted);
+			PromotedAgents.RemoveAtSwap(i);
+		}
+	}
+
+	Crowd->GetPromotionCandidates(PromotionCandidates);
+	for (const int32 AgentIndex : PromotionCandidates)
+	{
+		if (PromotedAgents.Num() >= MaxPromotedCrowdAgents)
+		{
+			break;
+		}
+		PromoteCrowdAgent(AgentIndex);
+	}
+}
+
+void USandBoxWorldSubSystem::GatherViewerLocations(TArray<FVector>& OutLocations) const
+{
+	OutLocations.Reset();
+	for (FConstPlayerControllerIterator It = GetWorld()->GetPlayerControllerIterator(); It; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if (PlayerController != nullptr && PlayerController->GetPawn() != nullptr)
+		{
+			OutLocations.Add(PlayerController->GetPawn()->GetActorLocation());
+		}
+	}
+}
+
+UClass* USandBoxWorldSubSystem::GetCrowdCharacterClass() const
+{
+	// メッシュとアニメーションが設定されているゲームモードのデフォルトポーンを優先する
+	const AGameModeBase* GameMode = GetWorld()->GetAuthGameMode();
+	if (GameMode != nullptr && GameMode->DefaultPawnClass != nullptr && GameMode->DefaultPawnClass->IsChildOf<AUnrealSandBoxCharacter>())
+	{
+		return GameMode->DefaultPawnClass;
+	}
+	return AUnrealSandBoxCharacter::StaticClass();
+}
+
+void USandBoxWorldSubSystem::PromoteCrowdAgent(int32 AgentIndex)
+{
+	const FTransform SpawnTransform(FRotator(0.0f, Crowd->GetYaw(AgentIndex), 0.0f), Crowd->GetPosition(AgentIndex));
+	const ESpawnActorCollisionHandlingMethod CollisionHandling = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButDontSpawnIfColliding;
+
+	// ゲームモードがあればポーンプールから取得する
+	ACharacter* Character = nullptr;
+	if (AUnrealSandBoxGameMode* GameMode = GetWorld()->GetAuthGameMode<AUnrealSandBoxGameMode>())
+	{
+		Character = Cast<ACharacter>(GameMode->SpawnBot(GetCrowdCharacterClass(), SpawnTransform, CollisionHandling));
+	}
+	else
+	{
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = CollisionHandling;
+		Character = GetWorld()->SpawnActor<ACharacter>(GetCrowdCharacterClass(), SpawnTransform, SpawnParameters);
+		if (Character != nullptr)
+		{
+			Character->SpawnDefaultController();
+		}
+	}
+
+	if (Character == nullptr)
+	{
+		// 他のアクターと重なっている場合は次のフレームで再挑戦する
+		return;
+	}
+
+	Character->GetCharacterMovement()->Velocity = Crowd->GetVelocity(AgentIndex);
+
+	Crowd->MarkPromoted(AgentIndex);
+	PromotedAgents.Add(FPromotedAgent{AgentIndex, Character});
+}
+
+FCrowdSimulation& USandBoxWorldSubSystem::GetOrCreateCrowd()
+{
+	if (!Crowd.IsValid())
+	{
+		const ACharacter* Template = GetCrowdCharacterClass()->GetDefaultObject<ACharacter>();
+		Crowd = MakeShareable(new FCrowdSimulation(FCrowdSimulation::MakeParamsFromCharacter(*Template)));
+	}
+	return *Crowd;
+}
+
+void USandBoxWorldSubSystem::DemoteCrowdAgent(FPromotedAgent& Promoted)
+{
+	ACharacter* Character = Promoted.Character.Get();
+	Crowd->Demote(Promoted.AgentIndex, Character->GetActorLocation(), Character->GetVelocity(), Character->GetActorRotation().Yaw);
+
+	AUnrealSandBoxGameMode* GameMode = GetWorld()->GetAuthGameMode<AUnrealSandBoxGameMode>();
+	if (GameMode != nullptr && GameMode->ReleasePawn(Character))
+	{
+		return;
+	}
+
+	if (AController* Controller = Character->GetController())
+	{
+		Controller->Destroy();
+	}
+	Character->Destroy();
+}
+
+//---------------------------------------------------------------------------------
+// Fixed step
+//---------------------------------------------------------------------------------
+void USandBoxWorldSubSystem::SetFixedStepEnabled(bool bEnabled, float StepHz, int32 MaxSubSteps, int32 BatchSize)
+{
+	if (bEnabled && GetWorld()->GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("固定タイムステップはサーバーでのみ有効にできます"));
+		return;
+	}
+
+	FFixedStepSimulation::FSettings Settings;
+	Settings.StepHz = StepHz;
+	Settings.MaxSubSteps = MaxSubSteps;
+	Settings.BatchSize = BatchSize;
+	FixedStepSimulation->SetEnabled(bEnabled, Settings);
+}
+
+void USandBoxWorldSubSystem::DumpFixedStep(bool bReset)
+{
+	FixedStepSimulation->DumpStats();
+	if (bReset)
+	{
+		FixedStepSimulation->ResetStats();
+	}
+}
+
+void USandBoxWorldSubSystem::RunFixedStepBenchmark(int32 Count, const TArray<int32>& ThreadCounts, int32 NumSteps)
+{
+	if (FrameTimeSampler->IsRunning())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("計測中です"));
+		return;
+	}
+
+	TArray<int32> LocalThreadCounts = ThreadCounts;
+	if (LocalThreadCounts.Num() == 0)
+	{
+		const int32 NumThreads = FFixedStepSimulation::GetNumParallelThreads();
+		for (int32 ThreadCount = 1; ThreadCount < NumThreads; ThreadCount *= 2)
+		{
+			LocalThreadCounts.Add(ThreadCount);
+		}
+		LocalThreadCounts.Add(NumThreads);
+	}
+
+	// 生成したキャラクターはBeginPlayで登録される
+	if (Count > 0)
+	{
+		SpawnBenchmarkCharacters(Count);
+	}
+	FixedStepSimulation->RunScalingBenchmark(*GetWorld(), LocalThreadCounts, NumSteps);
+	if (Count > 0)
+	{
+		DestroyBenchmarkCharacters();
+	}
+}
+
+//---------------------------------------------------------------------------------
+// Snapshot
+//---------------------------------------------------------------------------------
+bool USandBoxWorldSubSystem::SaveSnapshot(const FString& Path, bool bCompress)
+{
+	FSandBoxSnapshot* SnapshotPtr = GetOrCreateSnapshot();
+	if (SnapshotPtr == nullptr)
+	{
+		return false;
+	}
+
+	if (SnapshotPtr->IsSaving() || SnapshotPtr->IsLoading())
+	{
+		UE_LOG(LogTemp, Warning, TEXT("スナップショットの保存中または読み込み中です"));
+		return false;
+	}
+
+	// ゲームスレッドでは1回の走査でバッファにコピーするだけにする
+	const double StartSec = FPlatformTime::Seconds();
+	TArray<uint8> Payload;
+	Payload.Reserve(Characters.Num() * 64 + 1024);
+	FMemoryWriter Writer(Payload);
+	TSet<const AActor*> Exclude;
+	CaptureSnapshotState(Writer, Exclude);
+	const int32 NumCharacters = FSandBoxSnapshot::CaptureCharacters(Writer, Characters, Exclude);
+	const double CaptureMs = (FPlatformTime::Seconds() - StartSec) * 1000.0;
+
+	return SnapshotPtr->StartSave(Path.IsEmpty() ? GetSnapshotPath(TEXT("Snapshot.sbss")) : Path, MoveTemp(Payload), NumCharacters, bCompress, CaptureMs);
+}
+
+bool USandBoxWorldSubSystem::LoadSnapshot(const FString& Path)
+{
+	if (GetWorld()->GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("スナップショットはサーバーでのみ読み込めます"));
+		return false;
+	}
+
+	FSandBoxSnapshot* SnapshotPtr = GetOrCreateSnapshot();
+	if (SnapshotPtr == nullptr || !SnapshotPtr->StartLoad(Path.IsEmpty() ? GetSnapshotPath(TEXT("Snapshot.sbss")) : Path))
+	{
+		return false;
+	}
+
+	bSnapshotStateRestored = false;
+	return true;
+}
+
+void USandBoxWorldSubSystem::StartSnapshotBenchmark(int32 Count, bool bCompress)
+{
+	if (GetWorld()->GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("スナップショットはサーバーでのみ読み込めます"));
+		return;
+	}
+
+	if (bSnapshotBenchmarkSaving || bSnapshotBenchmarkLoading)
+	{
+		UE_LOG(LogTemp, Warning, TEXT("計測中です"));
+		return;
+	}
+
+	SpawnBenchmarkCharacters(Count);
+	bSnapshotBenchmarkSaving = SaveSnapshot(GetSnapshotPath(TEXT("SnapshotBenchmark.sbss")), bCompress);
+	if (!bSnapshotBenchmarkSaving)
+	{
+		DestroyBenchmarkCharacters();
+	}
+}
+
+void USandBoxWorldSubSystem::DumpSnapshotStats() const
+{
+	if (Snapshot.IsValid())
+	{
+		Snapshot->DumpStats(TEXT("Snapshot"));
+	}
+	else
+	{
+		UE_LOG(LogTemp, Log, TEXT("Snapshot is not used yet"));
+	}
+}
+
+FSandBoxSnapshot* USandBoxWorldSubSystem::GetOrCreateSnapshot()
+{
+	if (!Snapshot.IsValid())
+	{
+		const USampleSubSystem* SampleSubSystem = GetWorld()->GetGameInstance()->GetSubsystem<USampleSubSystem>();
+		FJobScheduler* Scheduler = SampleSubSystem != nullptr ? SampleSubSystem->GetJobScheduler() : nullptr;
+		if (!ensureAlwaysMsgf(Scheduler != nullptr, TEXT("圧縮と書き込みに使うジョブスケジューラーがありません")))
+		{
+			return nullptr;
+		}
+		Snapshot = MakeShareable(new FSandBoxSnapshot(*Scheduler));
+	}
+	return Snapshot.Get();
+}
+
+void USandBoxWorldSubSystem::UpdateSnapshot()
+{
+	if (!Snapshot.IsValid())
+	{
+		return;
+	}
+
+	Snapshot->Tick();
+
+	if (bSnapshotBenchmarkSaving && !Snapshot->IsSaving())
+	{
+		bSnapshotBenchmarkSaving = false;
+
+		// 復元で元の位置に戻ることを確認できるよう、全員をずらしておく
+		for (const TWeakObjectPtr<ACharacter>& Character : BenchmarkCharacters)
+		{
+			if (Character.IsValid())
+			{
+				Character->SetActorLocation(Character->GetActorLocation() + FVector(0.0f, 0.0f, 500.0f), false, nullptr, ETeleportType::TeleportPhysics);
+			}
+		}
+
+		bSnapshotBenchmarkLoading = Snapshot->GetStats().StoredBytes > 0 && LoadSnapshot(GetSnapshotPath(TEXT("SnapshotBenchmark.sbss")));
+		if (!bSnapshotBenchmarkLoading)
+		{
+			DestroyBenchmarkCharacters();
+		}
+	}
+
+	FArchive* Reader = Snapshot->GetPayloadReader();
+	if (Reader == nullptr)
+	{
+		return;
+	}
+
+	if (!bSnapshotStateRestored)
+	{
+		bSnapshotStateRestored = true;
+		RestoreSnapshotState(*Reader);
+	}
+
+	if (Snapshot->RestoreCharacters(*GetWorld(), Characters, SnapshotRestoreBatchSize))
+	{
+		Snapshot->DumpStats(bSnapshotBenchmarkLoading ? TEXT("SnapshotBenchmark") : TEXT("SnapshotLoad"));
+		if (bSnapshotBenchmarkLoading)
+		{
+			bSnapshotBenchmarkLoading = false;
+			DestroyBenchmarkCharacters();
+		}
+	}
+}
+
+/*static*/
+FString USandBoxWorldSubSystem::GetSnapshotPath(const TCHAR* FileName)
+{
+	return FPaths::ProjectSavedDir() / TEXT("SandBox") / FileName;
+}
+
+void USandBoxWorldSubSystem::CaptureSnapshotState(FArchive& Ar, TSet<const AActor*>& OutExclude)
+{
+	int8 CompactMovement = CompactMovementOverride.IsSet() ? (CompactMovementOverride.GetValue() ? 1 : 0) : -1;
+	bool bSignificanceEnabled = CharacterSignificance->IsEnabled();
+	bool bNetMovementRateEnabled = NetMovementRate->IsEnabled();
+	bool bHasCrowd = Crowd.IsValid();
+	Ar << CompactMovement;
+	Ar << bSignificanceEnabled;
+	Ar << bNetMovementRateEnabled;
+	Ar << bHasCrowd;
+	if (bHasCrowd)
+	{
+		Crowd->Serialize(Ar);
+	}
+
+	// 昇格中のアクターは復元時に群衆のエージェントとして戻る
+	for (const FPromotedAgent& Promoted : PromotedAgents)
+	{
+		OutExclude.Add(Promoted.Character.Get());
+	}
+}
+
+void USandBoxWorldSubSystem::RestoreSnapshotState(FArchive& Ar)
+{
+	int8 CompactMovement = -1;
+	bool bSignificanceEnabled = false;
+	bool bNetMovementRateEnabled = false;
+	bool bHasCrowd = false;
+	Ar << CompactMovement;
+	Ar << bSignificanceEnabled;
+	Ar << bNetMovementRateEnabled;
+	Ar << bHasCrowd;
+
+	if (CompactMovement >= 0)
+	{
+		SetCompactMovementEnabled(CompactMovement != 0);
+	}
+	SetSignificanceEnabled(bSignificanceEnabled);
+	SetNetMovementRateEnabled(bNetMovementRateEnabled);
+
+	// 昇格中のアクターを戻してから群衆を置き換える
+	ClearCrowd();
+	if (bHasCrowd)
+	{
+		GetOrCreateCrowd().Serialize(Ar);
+	}
+}
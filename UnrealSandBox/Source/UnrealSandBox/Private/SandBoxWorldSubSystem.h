@@ -0,0 +1,319 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Animation/AnimInstance.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SandBoxWorldSubSystem.generated.h"
+
+class ACharacter;
+class AUnrealSandBoxCharacter;
+class FCharacterSpatialHash;
+class FCharacterSignificance;
+class FCrowdSimulation;
+class FFixedStepSimulation;
+class FFrameTimeSampler;
+class FMovementIntentBatch;
+class FNetMovementRate;
+class FPathService;
+class FSandBoxSnapshot;
+class FSceneQueryBatch;
+
+/**
+ * ワールド単位で色々試す用のサブシステム
+ * ゲームワールドにのみ作成されます
+ */
+UCLASS(config=Game)
+class USandBoxWorldSubSystem final : public UWorldSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+public:
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual TStatId GetStatId() const override;
+	virtual void Tick(float DeltaTime) override;
+	virtual bool IsTickable() const override;
+	virtual ETickableTickType GetTickableTickType() const override;
+	virtual UWorld* GetTickableGameObjectWorld() const override;
+
+	/**
+	 * @brief キャラクターを登録します。BeginPlayで呼び出されます
+	 */
+	void RegisterCharacter(AUnrealSandBoxCharacter* Character);
+
+	/**
+	 * @brief キャラクターの登録を解除します。EndPlayで呼び出されます
+	 */
+	void UnregisterCharacter(AUnrealSandBoxCharacter* Character);
+
+	/**
+	 * @brief 距離と描画状況によるTick頻度の調整を有効/無効にします
+	 */
+	void SetSignificanceEnabled(bool bEnabled);
+
+	/**
+	 * @brief 重要度バケットごとのキャラクター数と削減量をログに出力します
+	 */
+	void DumpSignificance() const;
+
+	/**
+	 * @brief カメラ(スプリングアーム・カメラコンポーネント)を持つキャラクター数と、持たないことによる削減量をログに出力します
+	 */
+	void DumpCameraRigs() const;
+
+	/**
+	 * @brief キャラクターの移動のレプリケーションを量子化した形式にするかを切り替えます
+	 *		　登録済みのキャラクターと、以降に登録されるキャラクターに適用します。サーバーでのみ効果があります
+	 */
+	void SetCompactMovementEnabled(bool bEnabled);
+
+	/**
+	 * @brief 距離による送信頻度の調整を有効/無効にします
+	 */
+	void SetNetMovementRateEnabled(bool bEnabled);
+
+	/**
+	 * @brief クライアントごとの送信量とサーバーのCPU使用率をログに出力します
+	 *		　NumFramesが0より大きければそのフレーム数のフレーム時間を計測してから出力します
+	 * @param NumFrames 計測フレーム数
+	 */
+	void StartNetMovementReport(int32 NumFrames);
+
+	/**
+	 * @brief レプリケーショングラフの接続数ごとのネットTick時間をログに出力します
+	 * @param bReset 出力後に集計をリセットするか
+	 */
+	void DumpNetTick(bool bReset);
+
+	/**
+	 * @brief ポーンの移動意図をまとめて処理するバッチを取得します
+	 */
+	FMovementIntentBatch* GetMovementIntentBatch() const { return MovementIntentBatch.Get(); }
+
+	/**
+	 * @brief 床判定などのスイープをまとめて非同期で発行するバッチを取得します
+	 */
+	FSceneQueryBatch* GetSceneQueryBatch() const { return SceneQueryBatch.Get(); }
+
+	/**
+	 * @brief ボット用の経路探索サービスを取得します
+	 */
+	FPathService* GetPathService() const { return PathService.Get(); }
+
+	/**
+	 * @brief キャラクターの近傍検索用の空間ハッシュを取得します
+	 */
+	FCharacterSpatialHash* GetCharacterSpatialHash() const { return CharacterSpatialHash.Get(); }
+
+	/**
+	 * @brief 指定位置の周囲のキャラクターを空間ハッシュで検索してログに出力します
+	 * @param Center 検索の中心
+	 * @param Radius 検索半径
+	 * @param K 0より大きければ近い順にK件だけ出力します
+	 */
+	void DumpCharactersAround(const FVector& Center, float Radius, int32 K) const;
+
+	/**
+	 * @brief 空間ハッシュの構築・更新・検索の時間を計測してログに出力します
+	 *		　エントリ数ごとに同じ密度で配置した位置を登録し、半径・ボックス・近傍K件の検索と
+	 *		　スナップショットに対するワーカースレッドでの並列検索、全件走査との比較を行います。
+	 *		　bSpawnActorsがtrueであれば同数のアクターを生成し、TActorIteratorで走査した場合の時間も計測します。
+	 * @param Counts 計測するエントリ数
+	 * @param NumQueries エントリ数ごとの検索回数
+	 * @param Radius 検索半径
+	 * @param bSpawnActors TActorIteratorとの比較用にアクターを生成するか
+	 */
+	void RunSpatialHashBenchmark(const TArray<int32>& Counts, int32 NumQueries, float Radius, bool bSpawnActors);
+
+	/**
+	 * @brief 群衆エージェントを追加します
+	 *		　サーバー(スタンドアロン含む)でのみ動作します
+	 * @param Count 追加数
+	 * @param Center 配置の中心
+	 * @param Radius 配置と徘徊の半径
+	 */
+	void SpawnCrowd(int32 Count, const FVector& Center, float Radius);
+
+	/**
+	 * @brief 群衆エージェントと昇格中のアクターを全て削除します
+	 */
+	void ClearCrowd();
+
+	/**
+	 * @brief エージェント数と昇格数をログに出力します
+	 */
+	void DumpCrowd() const;
+
+	/**
+	 * @brief 群衆シミュレーションのエージェント数ごとの更新時間を計測してログに出力します
+	 *		　アクターは生成せずシミュレーション単体の時間を計測します
+	 * @param AgentCounts 計測するエージェント数
+	 * @param NumFrames 計測フレーム数
+	 */
+	static void RunCrowdBenchmark(const TArray<int32>& AgentCounts, int32 NumFrames);
+
+	/**
+	 * @brief プレイヤーが操作していないキャラクターの移動を固定タイムステップで並列に進めるモードを切り替えます
+	 *		　サーバー(スタンドアロン含む)でのみ動作します
+	 * @param bEnabled 有効にするか
+	 * @param StepHz 1秒あたりのステップ数
+	 * @param MaxSubSteps 遅れているときに1フレームで進める最大ステップ数
+	 * @param BatchSize 1バッチで進めるキャラクター数
+	 */
+	void SetFixedStepEnabled(bool bEnabled, float StepHz, int32 MaxSubSteps, int32 BatchSize);
+
+	/**
+	 * @brief 固定タイムステップのステップ数と、CPUのコア数に対する1秒あたりのステップ数をログに出力します
+	 * @param bReset 出力後に集計をリセットするか
+	 */
+	void DumpFixedStep(bool bReset);
+
+	/**
+	 * @brief 固定タイムステップの移動を並列に進めるスレッド数ごとの1秒あたりのステップ数を計測します
+	 *		　Countが0より大きければその数のキャラクターを並べて生成して計測し、削除します。0であれば登録済みのキャラクターで計測します
+	 * @param Count 生成するキャラクター数
+	 * @param ThreadCounts 計測するスレッド数。空であれば1から並列に使えるスレッド数まで2倍ずつ
+	 * @param NumSteps スレッド数ごとに進めるステップ数
+	 */
+	void RunFixedStepBenchmark(int32 Count, const TArray<int32>& ThreadCounts, int32 NumSteps);
+
+	/**
+	 * @brief アニメーション更新の負荷を計測します
+	 *		　キャラクターを並べて生成し、指定フレーム数のフレーム時間をログに出力してから削除します。
+	 *		　描画されていなくてもアニメーションを更新するため、-nullrhiのヘッドレス実行でも計測できます。
+	 *		　フレーム時間のほかにゲームスレッドの時間を出力するので、描画やGPU待ちを除いた負荷を比較できます。
+	 * @param Count 生成するキャラクター数
+	 * @param NumFrames 計測フレーム数
+	 * @param bNativeAnimInstance trueであればAnimBPの代わりにNativeAnimClassを使用します
+	 */
+	void StartAnimBenchmark(int32 Count, int32 NumFrames, bool bNativeAnimInstance);
+
+	/**
+	 * @brief 床判定のシーンクエリの負荷を計測します
+	 *		　AIで操作するキャラクターを並べて生成し、ゆっくり向きを変えながら歩かせて
+	 *		　マップのスロープ・階段・段差の上を通らせます。フレーム時間と床判定にかかった時間をログに出力してから削除します。
+	 * @param Count 生成するキャラクター数
+	 * @param NumFrames 計測フレーム数
+	 * @param bAsync trueであれば非同期の床判定を使用します
+	 */
+	void StartFloorQueryBenchmark(int32 Count, int32 NumFrames, bool bAsync);
+
+	/**
+	 * @brief 経路探索サービスの処理量と遅延を計測します
+	 *		　アクターは生成せず、指定数のボットがナビメッシュ上のランダムな2点間の経路を要求し、
+	 *		　結果が返るたびに次の経路を要求し続けます。計測フレーム数が経過したら統計をログに出力します。
+	 * @param NumBots ボット数
+	 * @param NumFrames 計測フレーム数
+	 * @param bUseCache キャッシュを使用するか
+	 */
+	void StartPathBenchmark(int32 NumBots, int32 NumFrames, bool bUseCache);
+
+	/**
+	 * @brief キャラクターの位置・移動状態と、このサブシステムの設定・群衆をファイルに保存します
+	 *		　ゲームスレッドでは状態をバッファにコピーするだけで、圧縮と書き込みはワーカースレッドで行います。
+	 * @param Path 保存先。空であればSaved/SandBox/Snapshot.sbss
+	 * @param bCompress LZ4で圧縮するか
+	 * @return 保存を開始できたか
+	 */
+	bool SaveSnapshot(const FString& Path, bool bCompress);
+
+	/**
+	 * @brief SaveSnapshotで保存したファイルから状態を復元します
+	 *		　ファイルをメモリマップし、キャラクターはSnapshotRestoreBatchSize件ずつ複数フレームに分けて復元します。
+	 *		　サーバー(スタンドアロン含む)でのみ動作します
+	 * @param Path 読み込むファイル。空であればSaved/SandBox/Snapshot.sbss
+	 * @return 読み込みを開始できたか
+	 */
+	bool LoadSnapshot(const FString& Path);
+
+	/**
+	 * @brief スナップショットの保存と復元の時間とサイズを計測します
+	 *		　キャラクターを並べて生成して保存し、全員を移動させてから復元して、計測値をログに出力してから削除します。
+	 * @param Count 生成するキャラクター数
+	 * @param bCompress LZ4で圧縮するか
+	 */
+	void StartSnapshotBenchmark(int32 Count, bool bCompress);
+
+	/**
+	 * @brief 直近の保存・読み込みの計測値をログに出力します
+	 */
+	void DumpSnapshotStats() const;
+
+	// スナップショットの復元で1フレームに処理するキャラクター数
+	int32 SnapshotRestoreBatchSize = 500;
+
+	// 視点からこの距離以内に入ったエージェントをアクターに昇格させる
+	float CrowdPromoteDistance = 2500.0f;
+
+	// 昇格中のアクターが視点からこの距離より離れたらエージェントへ戻す。昇格距離との差でばたつきを防ぐ
+	float CrowdDemoteDistance = 3000.0f;
+
+	// 同時に昇格させる最大数
+	int32 MaxPromotedCrowdAgents = 64;
+
+private:
+	/**
+	 * @brief 昇格中のエージェント
+	 */
+	struct FPromotedAgent
+	{
+		int32 AgentIndex;
+		TWeakObjectPtr<ACharacter> Character;
+	};
+
+	void SpawnBenchmarkCharacters(int32 Count);
+	void DestroyBenchmarkCharacters();
+	void DriveBenchmarkCharacters();
+	void RequestBenchmarkPath();
+	void UpdateCrowd(float DeltaTime);
+	void GatherViewerLocations(TArray<FVector>& OutLocations) const;
+	void DumpNetMovement(const FString& Label) const;
+	UClass* GetCrowdCharacterClass() const;
+	void PromoteCrowdAgent(int32 AgentIndex);
+	void DemoteCrowdAgent(FPromotedAgent& Promoted);
+	FCrowdSimulation& GetOrCreateCrowd();
+	FSandBoxSnapshot* GetOrCreateSnapshot();
+	void UpdateSnapshot();
+	static FString GetSnapshotPath(const TCHAR* FileName);
+
+	/**
+	 * @brief スナップショットにこのサブシステムの設定と群衆を書き込みます
+	 * @param OutExclude キャラクターとしては保存しないアクター。昇格中のエージェントは群衆として保存する
+	 */
+	void CaptureSnapshotState(FArchive& Ar, TSet<const AActor*>& OutExclude);
+
+	void RestoreSnapshotState(FArchive& Ar);
+
+	TArray<TWeakObjectPtr<AUnrealSandBoxCharacter>> Characters;
+	TSharedPtr<FCharacterSignificance> CharacterSignificance;
+	TSharedPtr<FMovementIntentBatch> MovementIntentBatch;
+	TSharedPtr<FSceneQueryBatch> SceneQueryBatch;
+	TSharedPtr<FPathService> PathService;
+	TSharedPtr<FCharacterSpatialHash> CharacterSpatialHash;
+	TSharedPtr<FNetMovementRate> NetMovementRate;
+	TOptional<bool> CompactMovementOverride;
+	TSharedPtr<FCrowdSimulation> Crowd;
+	TSharedPtr<FFixedStepSimulation> FixedStepSimulation;
+	TArray<FPromotedAgent> PromotedAgents;
+	TArray<FVector> ViewerLocations;
+	TArray<int32> PromotionCandidates;
+
+	TSharedPtr<FFrameTimeSampler> FrameTimeSampler;
+	TArray<TWeakObjectPtr<ACharacter>> BenchmarkCharacters;
+
+	// AnimBenchmark -nativeで使うAnimBP。AnimBPと同じAnimGraphを持ち、イベントグラフを持たないUSandBoxAnimInstanceの子クラスを指定する
+	UPROPERTY(Config)
+	TSoftClassPtr<UAnimInstance> NativeAnimClass;
+	bool bDriveBenchmarkCharacters = false;
+	TArray<FVector> PathBenchmarkPoints;
+	FRandomStream PathBenchmarkRandom;
+	bool bPathBenchmarkRunning = false;
+
+	// 最初に保存・読み込みしたときに作成する
+	TSharedPtr<FSandBoxSnapshot> Snapshot;
+	bool bSnapshotStateRestored = false;
+	bool bSnapshotBenchmarkSaving = false;
+	bool bSnapshotBenchmarkLoading = false;
+};
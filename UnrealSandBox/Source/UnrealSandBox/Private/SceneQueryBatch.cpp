@@ -0,0 +1,207 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SceneQueryBatch.h"
+#include "Engine/World.h"
+
+FSceneQueryBatch::FSceneQueryBatch()
+{
+	TickFunction.Batch = this;
+	TickFunction.TickGroup = TG_PostPhysics;
+	TickFunction.bCanEverTick = true;
+	TickFunction.bStartWithTickEnabled = true;
+}
+
+FSceneQueryBatch::~FSceneQueryBatch()
+{
+	UnregisterTickFunction();
+}
+
+int32 FSceneQueryBatch::Register(UWorld* InWorld)
+{
+	check(InWorld != nullptr);
+
+	// ティック関数は最初のスロットが登録されたときにワールドへ登録する
+	if (!TickFunction.IsTickFunctionRegistered())
+	{
+		World = InWorld;
+		TickFunction.RegisterTickFunction(InWorld->PersistentLevel);
+	}
+
+	int32 Index;
+	if (FreeSlots.Num() > 0)
+	{
+		Index = FreeSlots.Pop(false);
+		Slots[Index] = FSlot();
+	}
+	else
+	{
+		Index = Slots.AddDefaulted();
+	}
+	Slots[Index].bInUse = true;
+
+	return Index;
+}
+
+void FSceneQueryBatch::Unregister(int32 Slot)
+{
+	if (!ensureAlways(Slots.IsValidIndex(Slot) && Slots[Slot].bInUse))
+	{
+		return;
+	}
+
+	// RequestedSlotsに残っていてもbInUseを見て読み飛ばす
+	Slots[Slot] = FSlot();
+	FreeSlots.Add(Slot);
+}
+
+void FSceneQueryBatch::RequestSweep(int32 Slot, const FSweepRequest& Request)
+{
+	if (!Slots.IsValidIndex(Slot) || !Slots[Slot].bInUse)
+	{
+		return;
+	}
+
+	FSlot& Target = Slots[Slot];
+	Target.Request = Request;
+	if (!Target.bRequested)
+	{
+		Target.bRequested = true;
+		RequestedSlots.Add(Slot);
+	}
+}
+
+bool FSceneQueryBatch::GetSweepResult(int32 Slot, FHitResult& OutHit, FVector& OutStart)
+{
+	if (!Slots.IsValidIndex(Slot) || !Slots[Slot].bInUse)
+	{
+		return false;
+	}
+
+	FSlot& Target = Slots[Slot];
+	Harvest(Target);
+	if (!Target.bHasResult)
+	{
+		return false;
+	}
+
+	OutHit = Target.Result;
+	OutStart = Target.ResultStart;
+	return true;
+}
+
+void FSceneQueryBatch::Invalidate(int32 Slot)
+{
+	if (!Slots.IsValidIndex(Slot) || !Slots[Slot].bInUse)
+	{
+		return;
+	}
+
+	FSlot& Target = Slots[Slot];
+	Target.PendingHandle = FTraceHandle();
+	Target.bHasResult = false;
+}
+
+void FSceneQueryBatch::Flush()
+{
+	UWorld* QueryWorld = World.Get();
+	if (QueryWorld == nullptr)
+	{
+		RequestedSlots.Reset();
+		return;
+	}
+
+	// 前フレームの結果は今フレーム中しか取得できないので、使われていなくてもここで取り込んでおく
+	for (FSlot& Slot : Slots)
+	{
+		if (Slot.bInUse && Slot.PendingHandle.IsValid())
+		{
+			Harvest(Slot);
+			Slot.PendingHandle = FTraceHandle();
+		}
+	}
+
+	// 非同期トレースはワールドがまとめてタスクで実行し、次フレームに結果を取得できる
+	for (const int32 Index : RequestedSlots)
+	{
+		FSlot& Slot = Slots[Index];
+		if (!Slot.bInUse || !Slot.bRequested)
+		{
+			continue;
+		}
+		Slot.bRequested = false;
+
+		const FSweepRequest& Request = Slot.Request;
+		Slot.PendingHandle = QueryWorld->AsyncSweepByChannel(EAsyncTraceType::Single, Request.Start, Request.End, FQuat::Identity, Request.Channel, Request.Shape, Request.QueryParams, Request.ResponseParams);
+		Slot.PendingStart = Request.Start;
+		++Stats.NumSubmitted;
+	}
+	RequestedSlots.Reset();
+}
+
+void FSceneQueryBatch::UnregisterTickFunction()
+{
+	if (TickFunction.IsTickFunctionRegistered())
+	{
+		TickFunction.UnRegisterTickFunction();
+	}
+}
+
+void FSceneQueryBatch::SetEnabled(bool bInEnabled)
+{
+	bEnabled = bInEnabled;
+	if (!bEnabled)
+	{
+		for (int32 Index = 0; Index < Slots.Num(); ++Index)
+		{
+			Invalidate(Index);
+		}
+	}
+}
+
+void FSceneQueryBatch::ResetStats()
+{
+	Stats = FStats();
+	Stats.StartFrame = GFrameCounter;
+}
+
+void FSceneQueryBatch::DumpStats(const TCHAR* Label) const
+{
+	const uint64 NumFrames = FMath::Max<uint64>(GFrameCounter - Stats.StartFrame, 1);
+	const int32 NumQueries = Stats.NumAsyncUsed + Stats.NumSyncFallbacks;
+	UE_LOG(LogTemp, Log, TEXT("%s Enabled:%d Frames:%llu Submitted:%d AsyncUsed:%d SyncFallbacks:%d AsyncRate:%.1f%% QueryMsPerFrame:%.3f"),
+		Label, bEnabled, NumFrames, Stats.NumSubmitted, Stats.NumAsyncUsed, Stats.NumSyncFallbacks,
+		NumQueries > 0 ? 100.0 * Stats.NumAsyncUsed / NumQueries : 0.0,
+		FPlatformTime::ToMilliseconds64(Stats.QueryCycles) / NumFrames);
+}
+
+void FSceneQueryBatch::Harvest(FSlot& Slot)
+{
+	UWorld* QueryWorld = World.Get();
+	if (QueryWorld == nullptr || !Slot.PendingHandle.IsValid())
+	{
+		return;
+	}
+
+	// 発行したフレームの次のフレームでのみ取得できる
+	FTraceDatum Datum;
+	if (!QueryWorld->QueryTraceData(Slot.PendingHandle, Datum))
+	{
+		return;
+	}
+
+	Slot.Result = Datum.OutHits.Num() > 0 ? Datum.OutHits[0] : FHitResult(1.0f);
+	Slot.ResultStart = Slot.PendingStart;
+	Slot.bHasResult = true;
+	Slot.PendingHandle = FTraceHandle();
+}
+
+void FSceneQueryBatch::FFlushTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	Batch->Flush();
+}
+
+FString FSceneQueryBatch::FFlushTickFunction::DiagnosticMessage()
+{
+	return TEXT("FSceneQueryBatch::FFlushTickFunction");
+}
@@ -0,0 +1,145 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "CollisionQueryParams.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Engine/EngineTypes.h"
+#include "WorldCollision.h"
+
+/**
+ * @brief シーンクエリ(スイープ)をフレーム単位にまとめて非同期で発行するクラス
+ *		　各コンポーネントはTick中にスロットへスイープを要求しておき、
+ *		　TG_PostPhysicsでまとめてワールドの非同期トレースとして発行します。
+ *		　結果は次フレーム以降に取得でき、新しい結果が届くまで保持されます。
+ */
+class FSceneQueryBatch final
+{
+public:
+	/**
+	 * @brief スイープの要求
+	 */
+	struct FSweepRequest
+	{
+		FVector Start = FVector::ZeroVector;
+		FVector End = FVector::ZeroVector;
+		FCollisionShape Shape;
+		ECollisionChannel Channel = ECC_Pawn;
+		FCollisionQueryParams QueryParams;
+		FCollisionResponseParams ResponseParams;
+	};
+
+	/**
+	 * @brief 統計情報
+	 */
+	struct FStats
+	{
+		// 非同期で発行したスイープ数
+		int32 NumSubmitted = 0;
+
+		// 非同期の結果を使用できた回数
+		int32 NumAsyncUsed = 0;
+
+		// 非同期の結果を使用できず同期クエリを行った回数
+		int32 NumSyncFallbacks = 0;
+
+		// 利用側でクエリ(非同期の結果の利用も含む)にかかったサイクル数
+		uint64 QueryCycles = 0;
+
+		// 計測開始からのフレーム数
+		uint64 StartFrame = 0;
+	};
+
+	FSceneQueryBatch();
+	~FSceneQueryBatch();
+
+	/**
+	 * @brief スロットを登録します
+	 * @param World クエリを発行するワールド
+	 * @return スイープを要求するスロット
+	 */
+	int32 Register(UWorld* World);
+
+	/**
+	 * @brief スロットの登録を解除します
+	 */
+	void Unregister(int32 Slot);
+
+	/**
+	 * @brief 今フレームのスイープを要求します。同じフレームに複数回要求した場合は最後の要求のみ発行されます
+	 */
+	void RequestSweep(int32 Slot, const FSweepRequest& Request);
+
+	/**
+	 * @brief 最後に届いたスイープの結果を取得します
+	 * @param Slot Registerで取得したスロット
+	 * @param OutHit 結果。何にも当たらなかった場合はbBlockingHitがfalse
+	 * @param OutStart 結果を得たスイープの開始位置
+	 * @return 結果がない場合はfalse
+	 */
+	bool GetSweepResult(int32 Slot, FHitResult& OutHit, FVector& OutStart);
+
+	/**
+	 * @brief 発行済みの要求と保持している結果を破棄します。テレポート時などに使用します
+	 */
+	void Invalidate(int32 Slot);
+
+	/**
+	 * @brief 要求されているスイープをまとめて非同期トレースとして発行します
+	 */
+	void Flush();
+
+	/**
+	 * @brief ティック関数をワールドから外します
+	 */
+	void UnregisterTickFunction();
+
+	/**
+	 * @brief 無効にすると利用側は常に同期クエリを行います
+	 */
+	void SetEnabled(bool bInEnabled);
+	bool IsEnabled() const { return bEnabled; }
+
+	void AddAsyncUsed(uint64 Cycles) { ++Stats.NumAsyncUsed; Stats.QueryCycles += Cycles; }
+	void AddSyncFallback(uint64 Cycles) { ++Stats.NumSyncFallbacks; Stats.QueryCycles += Cycles; }
+	void ResetStats();
+	void DumpStats(const TCHAR* Label) const;
+
+private:
+	/**
+	 * @brief TG_PostPhysicsで要求をまとめて発行するティック関数
+	 */
+	struct FFlushTickFunction final : public FTickFunction
+	{
+		FSceneQueryBatch* Batch = nullptr;
+
+		virtual void ExecuteTick(float DeltaTime, ELevelTick TickType, ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent) override;
+		virtual FString DiagnosticMessage() override;
+	};
+
+	struct FSlot
+	{
+		FSweepRequest Request;
+		FTraceHandle PendingHandle;
+		FVector PendingStart = FVector::ZeroVector;
+		FHitResult Result;
+		FVector ResultStart = FVector::ZeroVector;
+		bool bInUse = false;
+		bool bRequested = false;
+		bool bHasResult = false;
+	};
+
+	/**
+	 * @brief 前フレームに発行したスイープの結果が届いていれば取り込みます
+	 */
+	void Harvest(FSlot& Slot);
+
+	FFlushTickFunction TickFunction;
+	TWeakObjectPtr<UWorld> World;
+	TArray<FSlot> Slots;
+	TArray<int32> FreeSlots;
+	TArray<int32> RequestedSlots;
+	FStats Stats;
+	bool bEnabled = true;
+};
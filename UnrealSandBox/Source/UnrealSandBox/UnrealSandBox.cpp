@@ -2,20 +2,47 @@
 
 #include "UnrealSandBox.h"
 #include "Modules/ModuleManager.h"
+#include "Misc/ConfigCacheIni.h"
 #include "ConsoleCommands.h"
+#include "ReplicationDriver.h"
+#include "SandBoxLog.h"
+#include "SandBoxMemoryTracker.h"
+#include "SandBoxReplicationGraph.h"
 
 class FUnrealSandBoxModule final : public FDefaultGameModuleImpl
 {
 public:
 	virtual void StartupModule() override;
+	virtual void ShutdownModule() override;
 };
 
 void FUnrealSandBoxModule::StartupModule()
 {
+	// register the memory tags before any feature reports its usage
+	FSandBoxMemoryTracker::Initialize();
+
 	if (!IsRunningCommandlet())
 	{
 		RegisterSandBoxConsoleCommand();
+
+		// opt in with -SandBoxLog or bEnabled under [SandBox.Log] in the game ini; never in the editor.
+		// SANDBOX_LOG calls are discarded while the logger is not running
+		bool bSandBoxLogEnabled = false;
+		GConfig->GetBool(TEXT("SandBox.Log"), TEXT("bEnabled"), bSandBoxLogEnabled, GGameIni);
+		bSandBoxLogEnabled |= FParse::Param(FCommandLine::Get(), TEXT("SandBoxLog"));
+		if (bSandBoxLogEnabled && !GIsEditor)
+		{
+			FSandBoxLog::Get().Start(FSandBoxLog::GetDefaultFilePath());
+		}
 	}
+
+	UReplicationDriver::CreateReplicationDriverDelegate().BindStatic(&USandBoxReplicationGraph::CreateForSandBoxSession);
+}
+
+void FUnrealSandBoxModule::ShutdownModule()
+{
+	UReplicationDriver::CreateReplicationDriverDelegate().Unbind();
+	FSandBoxLog::Get().Stop();
 }
 
 
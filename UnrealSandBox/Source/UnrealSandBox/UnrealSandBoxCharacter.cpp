@@ -3,16 +3,24 @@
 #include "UnrealSandBoxCharacter.h"
 #include "HeadMountedDisplayFunctionLibrary.h"
 #include "Camera/CameraComponent.h"
+#include "CharacterSpatialHash.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "GameFramework/Controller.h"
 #include "GameFramework/SpringArmComponent.h"
+#include "MovementIntentBatch.h"
+#include "Net/UnrealNetwork.h"
+#include "SandBoxCharacterMovementComponent.h"
+#include "SandBoxScopedTimer.h"
+#include "SandBoxWorldSubSystem.h"
+#include "UnrealSandBoxGameMode.h"
 
 //////////////////////////////////////////////////////////////////////////
 // AUnrealSandBoxCharacter
 
-AUnrealSandBoxCharacter::AUnrealSandBoxCharacter()
+AUnrealSandBoxCharacter::AUnrealSandBoxCharacter(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer.SetDefaultSubobjectClass<USandBoxCharacterMovementComponent>(ACharacter::CharacterMovementComponentName))
 {
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(42.f, 96.0f);
@@ -32,16 +40,15 @@ AUnrealSandBoxCharacter::AUnrealSandBoxCharacter()
 	GetCharacterMovement()->JumpZVelocity = 600.f;
 	GetCharacterMovement()->AirControl = 0.2f;
 
-	// Create a camera boom (pulls in towards the player if there is a collision)
-	CameraBoom = CreateDefaultSubobject<USpringArmComponent>(TEXT("CameraBoom"));
-	CameraBoom->SetupAttachment(RootComponent);
-	CameraBoom->TargetArmLength = 300.0f; // The camera follows at this distance behind the character	
-	CameraBoom->bUsePawnControlRotation = true; // Rotate the arm based on the controller
+	// The camera boom and follow camera are created in UpdateCameraRig once a local player possesses us
+	CameraBoom = nullptr;
+	FollowCamera = nullptr;
+	CameraBoomLength = 300.0f;
+	CameraBoomSocketOffset = FVector::ZeroVector;
+	bCameraBoomDoCollisionTest = true;
+	FollowCameraFieldOfView = 90.0f;
 
-	// Create a follow camera
-	FollowCamera = CreateDefaultSubobject<UCameraComponent>(TEXT("FollowCamera"));
-	FollowCamera->SetupAttachment(CameraBoom, USpringArmComponent::SocketName); // Attach the camera to the end of the boom and let the boom adjust to match the controller orientation
-	FollowCamera->bUsePawnControlRotation = false; // Camera does not rotate relative to arm
+	bUseCompactMovement = true;
 
 	// Note: The skeletal mesh and anim blueprint references on the Mesh component (inherited from Character) 
 	// are set in the derived blueprint asset named MyCharacter (to avoid direct content references in C++)
@@ -77,6 +84,312 @@ void AUnrealSandBoxCharacter::SetupPlayerInputComponent(class UInputComponent* P
 }
 
 
+void AUnrealSandBoxCharacter::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (USandBoxWorldSubSystem* SubSystem = GetWorld()->GetSubsystem<USandBoxWorldSubSystem>())
+	{
+		SubSystem->RegisterCharacter(this);
+
+		MovementIntentBatch = SubSystem->GetMovementIntentBatch();
+		MovementIntentSlot = MovementIntentBatch->Register(this, SubSystem);
+		MovementIntentController = GetController();
+
+		SpatialHash = SubSystem->GetCharacterSpatialHash();
+		AddToSpatialHash();
+		GetCapsuleComponent()->TransformUpdated.AddUObject(this, &AUnrealSandBoxCharacter::OnCapsuleTransformUpdated);
+	}
+
+	UpdateCameraRig();
+}
+
+void AUnrealSandBoxCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (USandBoxWorldSubSystem* SubSystem = GetWorld()->GetSubsystem<USandBoxWorldSubSystem>())
+	{
+		SubSystem->UnregisterCharacter(this);
+	}
+
+	if (MovementIntentBatch != nullptr)
+	{
+		MovementIntentBatch->RemoveControllerPrerequisite(MovementIntentController.Get());
+		MovementIntentBatch->Unregister(MovementIntentSlot);
+		MovementIntentBatch = nullptr;
+		MovementIntentSlot = INDEX_NONE;
+	}
+
+	if (SpatialHash != nullptr)
+	{
+		GetCapsuleComponent()->TransformUpdated.RemoveAll(this);
+		RemoveFromSpatialHash();
+		SpatialHash = nullptr;
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AUnrealSandBoxCharacter::PossessedBy(AController* NewController)
+{
+	Super::PossessedBy(NewController);
+	UpdateMovementIntentController();
+	UpdateCameraRig();
+}
+
+void AUnrealSandBoxCharacter::UnPossessed()
+{
+	Super::UnPossessed();
+	UpdateMovementIntentController();
+	UpdateCameraRig();
+}
+
+void AUnrealSandBoxCharacter::OnRep_Controller()
+{
+	Super::OnRep_Controller();
+	UpdateMovementIntentController();
+	UpdateCameraRig();
+}
+
+void AUnrealSandBoxCharacter::FellOutOfWorld(const UDamageType& DamageType)
+{
+	// hand the character back to the pool and respawn the player instead of destroying it
+	AUnrealSandBoxGameMode* GameMode = GetWorld()->GetAuthGameMode<AUnrealSandBoxGameMode>();
+	AController* OldController = GetController();
+	if (GameMode != nullptr && GameMode->ReleasePawn(this))
+	{
+		if (OldController != nullptr && OldController->IsPlayerController())
+		{
+			GameMode->RestartPlayer(OldController);
+		}
+		return;
+	}
+
+	Super::FellOutOfWorld(DamageType);
+}
+
+void AUnrealSandBoxCharacter::DeactivateForPool()
+{
+	SANDBOX_SCOPED_TIMER(Character, TEXT("Character.DeactivateForPool"));
+
+	if (bInPawnPool)
+	{
+		return;
+	}
+	bInPawnPool = true;
+
+	StopJumping();
+	ResetJumpState();
+	ConsumeMovementInputVector();
+
+	UCharacterMovementComponent* Movement = GetCharacterMovement();
+	Movement->StopMovementImmediately();
+	Movement->DisableMovement();
+	Movement->SetComponentTickEnabled(false);
+	GetMesh()->SetComponentTickEnabled(false);
+
+	SetActorTickEnabled(false);
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+
+	// the hidden state is sent once more, then the replication graph skips us until we are woken up
+	SetNetDormancy(DORM_DormantAll);
+
+	if (USandBoxWorldSubSystem* SubSystem = GetWorld()->GetSubsystem<USandBoxWorldSubSystem>())
+	{
+		SubSystem->UnregisterCharacter(this);
+	}
+	RemoveFromSpatialHash();
+}
+
+bool AUnrealSandBoxCharacter::ActivateFromPool(const FTransform& SpawnTransform, bool bNoCheck)
+{
+	SANDBOX_SCOPED_TIMER(Character, TEXT("Character.ActivateFromPool"));
+
+	if (!bInPawnPool)
+	{
+		return false;
+	}
+
+	// collision has to be on for the encroachment check in TeleportTo
+	SetActorEnableCollision(true);
+	if (!TeleportTo(SpawnTransform.GetLocation(), SpawnTransform.Rotator(), false, bNoCheck))
+	{
+		SetActorEnableCollision(false);
+		return false;
+	}
+	bInPawnPool = false;
+
+	SetNetDormancy(DORM_Awake);
+	SetActorHiddenInGame(false);
+	SetActorTickEnabled(true);
+
+	UCharacterMovementComponent* Movement = GetCharacterMovement();
+	Movement->SetComponentTickEnabled(true);
+	Movement->SetDefaultMovementMode();
+	GetMesh()->SetComponentTickEnabled(true);
+
+	if (USandBoxWorldSubSystem* SubSystem = GetWorld()->GetSubsystem<USandBoxWorldSubSystem>())
+	{
+		SubSystem->RegisterCharacter(this);
+	}
+	AddToSpatialHash();
+
+	ForceNetUpdate();
+	return true;
+}
+
+void AUnrealSandBoxCharacter::SetUseCompactMovement(bool bEnable)
+{
+	if (bUseCompactMovement != bEnable)
+	{
+		bUseCompactMovement = bEnable;
+		ForceNetUpdate();
+	}
+}
+
+void AUnrealSandBoxCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	// same audience as ReplicatedMovement; the owner is corrected through the movement component instead
+	DOREPLIFETIME_CONDITION(AUnrealSandBoxCharacter, CompactMovement, COND_SimulatedOnly);
+}
+
+void AUnrealSandBoxCharacter::PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker)
+{
+	// gathers ReplicatedMovement, which we quantise below
+	Super::PreReplication(ChangedPropertyTracker);
+
+	// physics and attached movement need the full FRepMovement
+	const FRepMovement& RepMovement = GetReplicatedMovement();
+	const bool bCompact = bUseCompactMovement && IsReplicatingMovement() && !RepMovement.bRepPhysics && GetAttachParentActor() == nullptr;
+	if (bCompact)
+	{
+		SandBoxCompactMovement::Pack(RepMovement.Location, RepMovement.Rotation.Yaw, RepMovement.LinearVelocity, CompactMovement);
+	}
+
+	DOREPLIFETIME_ACTIVE_OVERRIDE_PRIVATE_PROPERTY(AActor, ReplicatedMovement, IsReplicatingMovement() && !bCompact, ChangedPropertyTracker);
+	DOREPLIFETIME_ACTIVE_OVERRIDE(AUnrealSandBoxCharacter, CompactMovement, bCompact);
+}
+
+void AUnrealSandBoxCharacter::OnRep_CompactMovement()
+{
+	bCompactMovementReceived = true;
+}
+
+void AUnrealSandBoxCharacter::PostRepNotifies()
+{
+	Super::PostRepNotifies();
+
+	if (!bCompactMovementReceived)
+	{
+		return;
+	}
+	bCompactMovementReceived = false;
+
+	// feed the decoded state through the regular ReplicatedMovement path so the movement component smooths it as usual
+	FVector Location;
+	float Yaw;
+	FVector Velocity;
+	SandBoxCompactMovement::Unpack(CompactMovement, Location, Yaw, Velocity);
+
+	FRepMovement& RepMovement = GetReplicatedMovement_Mutable();
+	RepMovement.Location = Location;
+	RepMovement.Rotation = FRotator(0.0f, Yaw, 0.0f);
+	RepMovement.LinearVelocity = Velocity;
+	RepMovement.AngularVelocity = FVector::ZeroVector;
+	RepMovement.bRepPhysics = false;
+	OnRep_ReplicatedMovement();
+}
+
+void AUnrealSandBoxCharacter::PawnClientRestart()
+{
+	Super::PawnClientRestart();
+	UpdateCameraRig();
+}
+
+void AUnrealSandBoxCharacter::UpdateCameraRig()
+{
+	SANDBOX_SCOPED_TIMER(Character, TEXT("Character.UpdateCameraRig"));
+
+	// AI controllers are local too, so only a local player controller gets a camera
+	const bool bNeedsCameraRig = IsLocallyControlled() && IsPlayerControlled();
+	if (bNeedsCameraRig == (CameraBoom != nullptr))
+	{
+		return;
+	}
+
+	if (bNeedsCameraRig)
+	{
+		SANDBOX_LLM_SCOPE(ESandBoxMemoryTag::CharacterRig);
+
+		// Create a camera boom (pulls in towards the player if there is a collision)
+		CameraBoom = NewObject<USpringArmComponent>(this, MakeUniqueObjectName(this, USpringArmComponent::StaticClass(), TEXT("CameraBoom")));
+		CameraBoom->SetupAttachment(RootComponent);
+		CameraBoom->TargetArmLength = CameraBoomLength; // The camera follows at this distance behind the character
+		CameraBoom->bUsePawnControlRotation = true; // Rotate the arm based on the controller
+		CameraBoom->SocketOffset = CameraBoomSocketOffset;
+		CameraBoom->bDoCollisionTest = bCameraBoomDoCollisionTest;
+		CameraBoom->RegisterComponent();
+
+		// Create a follow camera
+		FollowCamera = NewObject<UCameraComponent>(this, MakeUniqueObjectName(this, UCameraComponent::StaticClass(), TEXT("FollowCamera")));
+		FollowCamera->SetupAttachment(CameraBoom, USpringArmComponent::SocketName); // Attach the camera to the end of the boom and let the boom adjust to match the controller orientation
+		FollowCamera->bUsePawnControlRotation = false; // Camera does not rotate relative to arm
+		FollowCamera->FieldOfView = FollowCameraFieldOfView;
+		FollowCamera->RegisterComponent();
+
+		CameraRigMemory.Set(FSandBoxMemoryTracker::GetObjectAllocatedSize(*CameraBoom) + FSandBoxMemoryTracker::GetObjectAllocatedSize(*FollowCamera));
+	}
+	else
+	{
+		FollowCamera->DestroyComponent();
+		CameraBoom->DestroyComponent();
+		FollowCamera = nullptr;
+		CameraBoom = nullptr;
+
+		CameraRigMemory.Set(0);
+	}
+}
+
+void AUnrealSandBoxCharacter::AddToSpatialHash()
+{
+	if (SpatialHash != nullptr && SpatialHashId == INDEX_NONE)
+	{
+		SpatialHashId = SpatialHash->Add(this, GetActorLocation());
+	}
+}
+
+void AUnrealSandBoxCharacter::RemoveFromSpatialHash()
+{
+	if (SpatialHash != nullptr && SpatialHashId != INDEX_NONE)
+	{
+		SpatialHash->Remove(SpatialHashId);
+		SpatialHashId = INDEX_NONE;
+	}
+}
+
+void AUnrealSandBoxCharacter::OnCapsuleTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	// pooled characters are removed from the hash, so this is a no-op for them
+	if (SpatialHash != nullptr && SpatialHashId != INDEX_NONE)
+	{
+		SpatialHash->Update(SpatialHashId, UpdatedComponent->GetComponentLocation());
+	}
+}
+
+void AUnrealSandBoxCharacter::UpdateMovementIntentController()
+{
+	if (MovementIntentBatch == nullptr || MovementIntentController.Get() == GetController())
+	{
+		return;
+	}
+
+	MovementIntentBatch->RemoveControllerPrerequisite(MovementIntentController.Get());
+	MovementIntentBatch->AddControllerPrerequisite(GetController());
+	MovementIntentController = GetController();
+}
+
 void AUnrealSandBoxCharacter::OnResetVR()
 {
 	// If UnrealSandBox is added to a project via 'Add Feature' in the Unreal Editor the dependency on HeadMountedDisplay in UnrealSandBox.Build.cs is not automatically propagated
@@ -100,41 +413,53 @@ void AUnrealSandBoxCharacter::TouchStopped(ETouchIndex::Type FingerIndex, FVecto
 
 void AUnrealSandBoxCharacter::TurnAtRate(float Rate)
 {
+	SANDBOX_SCOPED_TIMER(CharacterInput, TEXT("Character.TurnAtRate"));
+
 	// calculate delta for this frame from the rate information
 	AddControllerYawInput(Rate * BaseTurnRate * GetWorld()->GetDeltaSeconds());
 }
 
 void AUnrealSandBoxCharacter::LookUpAtRate(float Rate)
 {
+	SANDBOX_SCOPED_TIMER(CharacterInput, TEXT("Character.LookUpAtRate"));
+
 	// calculate delta for this frame from the rate information
 	AddControllerPitchInput(Rate * BaseLookUpRate * GetWorld()->GetDeltaSeconds());
 }
 
 void AUnrealSandBoxCharacter::MoveForward(float Value)
 {
+	SANDBOX_SCOPED_TIMER(CharacterInput, TEXT("Character.MoveForward"));
+
 	if ((Controller != nullptr) && (Value != 0.0f))
 	{
-		// find out which way is forward
-		const FRotator Rotation = Controller->GetControlRotation();
-		const FRotator YawRotation(0, Rotation.Yaw, 0);
-
-		// get forward vector
-		const FVector Direction = FRotationMatrix(YawRotation).GetUnitAxis(EAxis::X);
-		AddMovementInput(Direction, Value);
+		AddMovementIntent(Value, 0.0f);
 	}
 }
 
 void AUnrealSandBoxCharacter::MoveRight(float Value)
 {
+	SANDBOX_SCOPED_TIMER(CharacterInput, TEXT("Character.MoveRight"));
+
 	if ( (Controller != nullptr) && (Value != 0.0f) )
 	{
-		// find out which way is right
-		const FRotator Rotation = Controller->GetControlRotation();
-		const FRotator YawRotation(0, Rotation.Yaw, 0);
-	
-		// get right vector 
-		const FVector Direction = FRotationMatrix(YawRotation).GetUnitAxis(EAxis::Y);
-		// add movement in that direction
-		AddMovementInput(Direction, Value);
+		AddMovementIntent(0.0f, Value);
+	}
+}
+
+void AUnrealSandBoxCharacter::AddMovementIntent(float Forward, float Right)
+{
+	SANDBOX_SCOPED_TIMER(CharacterInput, TEXT("Character.AddMovementIntent"));
+
+	// batched: direction is computed once per frame from a single sin/cos of the control yaw
+	if (MovementIntentBatch != nullptr && MovementIntentBatch->AddInput(MovementIntentSlot, Forward, Right))
+	{
+		return;
+	}
+
+	// the batch has already run this frame (or there is none), so apply the input right away
+	if (Controller != nullptr)
+	{
+		AddMovementInput(FMovementIntentBatch::ComputeDirection(Controller->GetControlRotation().Yaw, Forward, Right));
 	}
 }
@@ -4,6 +4,8 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
+#include "CompactMovement.h"
+#include "SandBoxMemoryTracker.h"
 #include "UnrealSandBoxCharacter.generated.h"
 
 UCLASS(config=Game)
@@ -11,15 +13,15 @@ class AUnrealSandBoxCharacter : public ACharacter
 {
 	GENERATED_BODY()
 
-	/** Camera boom positioning the camera behind the character */
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
+	/** Camera boom positioning the camera behind the character. Only exists while a local player controls this character. */
+	UPROPERTY(Transient, VisibleInstanceOnly, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class USpringArmComponent* CameraBoom;
 
-	/** Follow camera */
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
+	/** Follow camera. Only exists while a local player controls this character. */
+	UPROPERTY(Transient, VisibleInstanceOnly, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class UCameraComponent* FollowCamera;
 public:
-	AUnrealSandBoxCharacter();
+	AUnrealSandBoxCharacter(const FObjectInitializer& ObjectInitializer);
 
 	/** Base turn rate, in deg/sec. Other scaling may affect final turn rate. */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
@@ -29,6 +31,32 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category=Camera)
 	float BaseLookUpRate;
 
+	/** The camera follows at this distance behind the character. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category=Camera)
+	float CameraBoomLength;
+
+	/** Offset of the camera at the end of the boom, applied when the rig is created. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category=Camera)
+	FVector CameraBoomSocketOffset;
+
+	/** Whether the boom sweeps to keep the camera out of geometry, applied when the rig is created. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category=Camera)
+	bool bCameraBoomDoCollisionTest;
+
+	/** Horizontal field of view of the follow camera, applied when the rig is created. */
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly, Category=Camera)
+	float FollowCameraFieldOfView;
+
+	/**
+	 * If true, simulated proxies receive a single quantised CompactMovement property (cell, offset, yaw, velocity) instead of ReplicatedMovement.
+	 * The owning client is unaffected; it keeps receiving the character movement component's corrections.
+	 */
+	UPROPERTY(EditDefaultsOnly, Config, Category=Replication)
+	bool bUseCompactMovement;
+
+	/** Switches between compact and default movement replication at runtime. Server only. */
+	void SetUseCompactMovement(bool bEnable);
+
 protected:
 
 	/** Resets HMD orientation in VR. */
@@ -58,15 +86,107 @@ protected:
 	/** Handler for when a touch input stops. */
 	void TouchStopped(ETouchIndex::Type FingerIndex, FVector Location);
 
+	/**
+	 * Accumulates forward/right input into this frame's movement intent.
+	 * The intent is turned into a single movement input by the world's FMovementIntentBatch before movement ticks.
+	 */
+	void AddMovementIntent(float Forward, float Right);
+
+public:
+	/**
+	 * Parks this character in the game mode's pawn pool: hides it, disables collision, ticking and movement.
+	 * Hidden actors without collision are not net relevant, so clients drop their copy until it is reused.
+	 * It is also made dormant, which the replication graph uses to stop considering it for every connection.
+	 * The caller is responsible for unpossessing it first.
+	 */
+	void DeactivateForPool();
+
+	/**
+	 * Takes this character out of the pawn pool and teleports it to SpawnTransform.
+	 * @param bNoCheck	If true the character is placed even when it would encroach on blocking geometry
+	 * @return false if it could not be placed, in which case it stays in the pool
+	 */
+	bool ActivateFromPool(const FTransform& SpawnTransform, bool bNoCheck);
+
+	/** Returns true while this character is parked in the pawn pool. */
+	bool IsInPawnPool() const { return bInPawnPool; }
+
 protected:
 	// APawn interface
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
+	virtual void PossessedBy(AController* NewController) override;
+	virtual void UnPossessed() override;
+	virtual void OnRep_Controller() override;
+	virtual void PawnClientRestart() override;
 	// End of APawn interface
 
+	// AActor interface
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+	virtual void PreReplication(IRepChangedPropertyTracker& ChangedPropertyTracker) override;
+	virtual void PostRepNotifies() override;
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void FellOutOfWorld(const class UDamageType& DamageType) override;
+	// End of AActor interface
+
+private:
+	/**
+	 * Creates the camera rig when a local player controls this character and destroys it otherwise,
+	 * so AI, remote and server-side pawns carry no camera components at all.
+	 */
+	void UpdateCameraRig();
+
+	/** Marks the compact movement as received so PostRepNotifies applies it once the whole update is in. */
+	UFUNCTION()
+	void OnRep_CompactMovement();
+
+	/** Keeps the movement intent batch ticking after our current controller. */
+	void UpdateMovementIntentController();
+
+	/** Adds us to the world's character spatial hash. */
+	void AddToSpatialHash();
+
+	/** Removes us from the world's character spatial hash. */
+	void RemoveFromSpatialHash();
+
+	/** Moves our spatial hash entry whenever the capsule moves. */
+	void OnCapsuleTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
+	/** Batch that resolves our movement intent, null outside game worlds. */
+	class FMovementIntentBatch* MovementIntentBatch = nullptr;
+
+	/** Slot in MovementIntentBatch. */
+	int32 MovementIntentSlot = INDEX_NONE;
+
+	/** Controller the batch currently depends on. */
+	TWeakObjectPtr<AController> MovementIntentController;
+
+	/** Spatial hash indexing our location, null outside game worlds. */
+	class FCharacterSpatialHash* SpatialHash = nullptr;
+
+	/** Entry in SpatialHash, INDEX_NONE while not indexed. */
+	int32 SpatialHashId = INDEX_NONE;
+
+	/** Memory reported for the camera rig while it exists. */
+	FSandBoxMemoryUsage CameraRigMemory{ESandBoxMemoryTag::CharacterRig};
+
+	/** True while parked in the pawn pool. */
+	bool bInPawnPool = false;
+
+	/**
+	 * Quantised location, yaw and velocity. Delta-serialized per connection against the last acknowledged state,
+	 * so only changed fields go out and the cell is only sent when the character crosses into a new cell.
+	 */
+	UPROPERTY(Transient, ReplicatedUsing=OnRep_CompactMovement)
+	FSandBoxMovementState CompactMovement;
+
+	/** True when compact movement arrived in the current update. */
+	bool bCompactMovementReceived = false;
+
 public:
-	/** Returns CameraBoom subobject **/
+	/** Returns CameraBoom component, null unless a local player controls this character **/
 	FORCEINLINE class USpringArmComponent* GetCameraBoom() const { return CameraBoom; }
-	/** Returns FollowCamera subobject **/
+	/** Returns FollowCamera component, null unless a local player controls this character **/
 	FORCEINLINE class UCameraComponent* GetFollowCamera() const { return FollowCamera; }
 };
 
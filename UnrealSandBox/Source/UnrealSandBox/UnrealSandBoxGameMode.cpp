@@ -2,14 +2,262 @@
 
 #include "UnrealSandBoxGameMode.h"
 #include "UnrealSandBoxCharacter.h"
-#include "UObject/ConstructorHelpers.h"
+#include "GameFramework/PlayerController.h"
+#include "AssetPreloader.h"
+#include "PawnPool.h"
+#include "SampleSubSystem.h"
+#include "SandBoxScopedTimer.h"
 
 AUnrealSandBoxGameMode::AUnrealSandBoxGameMode()
 {
-	// set default pawn class to our Blueprinted character
-	static ConstructorHelpers::FClassFinder<APawn> PlayerPawnBPClass(TEXT("/Game/ThirdPersonCPP/Blueprints/ThirdPersonCharacter"));
-	if (PlayerPawnBPClass.Class != NULL)
+	// our Blueprinted character is streamed in asynchronously at startup and set as the default pawn class once loaded
+	PreloadPawnClass = FSoftClassPath(TEXT("/Game/ThirdPersonCPP/Blueprints/ThirdPersonCharacter.ThirdPersonCharacter_C"));
+	bPreloadCompleted = false;
+
+	PawnPoolPrewarmCount = 0;
+	bUsePawnPool = true;
+}
+
+void AUnrealSandBoxGameMode::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage)
+{
+	Super::InitGame(MapName, Options, ErrorMessage);
+
+	FAssetPreloader* Preloader = nullptr;
+	if (USampleSubSystem* SubSystem = GetGameInstance()->GetSubsystem<USampleSubSystem>())
+	{
+		Preloader = SubSystem->GetAssetPreloader();
+	}
+
+	if (Preloader != nullptr && !Preloader->IsCompleted())
+	{
+		Preloader->OnCompleted().AddUObject(this, &AUnrealSandBoxGameMode::OnPreloadCompleted);
+	}
+	else
+	{
+		OnPreloadCompleted();
+	}
+}
+
+void AUnrealSandBoxGameMode::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (bPreloadCompleted)
+	{
+		InitPawnPool();
+	}
+}
+
+void AUnrealSandBoxGameMode::OnPreloadCompleted()
+{
+	if (bPreloadCompleted)
+	{
+		return;
+	}
+	bPreloadCompleted = true;
+
+	// already resident when the preload succeeded; the synchronous load is only a fallback
+	if (UClass* PawnClass = PreloadPawnClass.LoadSynchronous())
+	{
+		DefaultPawnClass = PawnClass;
+	}
+
+	if (!HasActorBegunPlay())
+	{
+		return;
+	}
+
+	InitPawnPool();
+
+	// spawn the players that joined while the preload was still running
+	for (FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		APlayerController* PlayerController = Iterator->Get();
+		if (PlayerController != nullptr && PlayerController->GetPawn() == nullptr && PlayerCanRestart(PlayerController))
+		{
+			RestartPlayer(PlayerController);
+		}
+	}
+}
+
+void AUnrealSandBoxGameMode::InitPawnPool()
+{
+	// only the default pawn class is pooled; it has to be one of our characters to support the pool reset
+	if (bUsePawnPool && DefaultPawnClass != nullptr && DefaultPawnClass->IsChildOf(AUnrealSandBoxCharacter::StaticClass()))
+	{
+		PawnPool = MakeShareable(new FPawnPool(GetWorld(), DefaultPawnClass));
+
+		const double StartSec = FPlatformTime::Seconds();
+		PawnPool->Prewarm(PawnPoolPrewarmCount);
+		UE_LOG(LogTemp, Log, TEXT("PawnPool prewarmed %d pawns in %.2fms"), PawnPool->GetNumAvailable(), (FPlatformTime::Seconds() - StartSec) * 1000.0);
+	}
+}
+
+bool AUnrealSandBoxGameMode::PlayerCanRestart_Implementation(APlayerController* Player)
+{
+	// hold players back until the pawn class and its assets are in memory; OnPreloadCompleted spawns them
+	return bPreloadCompleted && Super::PlayerCanRestart_Implementation(Player);
+}
+
+void AUnrealSandBoxGameMode::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (PawnPool.IsValid())
+	{
+		PawnPool->DumpStats();
+		PawnPool.Reset();
+	}
+	WaveBots.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+APawn* AUnrealSandBoxGameMode::SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform)
+{
+	SANDBOX_SCOPED_TIMER(GameMode, TEXT("GameMode.SpawnDefaultPawnAtTransform"));
+
+	FPawnPool* Pool = GetPawnPool(GetDefaultPawnClassForController(NewPlayer));
+	if (Pool == nullptr)
 	{
-		DefaultPawnClass = PlayerPawnBPClass.Class;
+		return Super::SpawnDefaultPawnAtTransform_Implementation(NewPlayer, SpawnTransform);
 	}
+
+	// same parameters as the base implementation, only the pawn may come from the pool
+	FActorSpawnParameters SpawnInfo;
+	SpawnInfo.Instigator = GetInstigator();
+	SpawnInfo.ObjectFlags |= RF_Transient;
+	return Pool->Acquire(SpawnTransform, SpawnInfo);
+}
+
+void AUnrealSandBoxGameMode::Logout(AController* Exiting)
+{
+	// keep the leaving player's pawn for the next one to join
+	if (APawn* Pawn = Exiting->GetPawn())
+	{
+		ReleasePawn(Pawn);
+	}
+
+	Super::Logout(Exiting);
+}
+
+APawn* AUnrealSandBoxGameMode::SpawnBot(UClass* PawnClass, const FTransform& SpawnTransform, ESpawnActorCollisionHandlingMethod CollisionHandling)
+{
+	SANDBOX_SCOPED_TIMER(GameMode, TEXT("GameMode.SpawnBot"));
+
+	FActorSpawnParameters SpawnInfo;
+	SpawnInfo.SpawnCollisionHandlingOverride = CollisionHandling;
+
+	APawn* Pawn = nullptr;
+	if (FPawnPool* Pool = GetPawnPool(PawnClass))
+	{
+		Pawn = Pool->Acquire(SpawnTransform, SpawnInfo);
+	}
+	else
+	{
+		Pawn = GetWorld()->SpawnActor<APawn>(PawnClass, SpawnTransform, SpawnInfo);
+	}
+
+	if (Pawn != nullptr)
+	{
+		Pawn->SpawnDefaultController();
+	}
+	return Pawn;
+}
+
+bool AUnrealSandBoxGameMode::ReleasePawn(APawn* Pawn)
+{
+	SANDBOX_SCOPED_TIMER(GameMode, TEXT("GameMode.ReleasePawn"));
+
+	FPawnPool* Pool = Pawn != nullptr ? GetPawnPool(Pawn->GetClass()) : nullptr;
+	if (Pool == nullptr)
+	{
+		return false;
+	}
+
+	if (AController* Controller = Pawn->GetController())
+	{
+		Controller->UnPossess();
+		if (!Controller->IsPlayerController())
+		{
+			Controller->Destroy();
+		}
+	}
+
+	Pool->Release(CastChecked<AUnrealSandBoxCharacter>(Pawn));
+	return true;
+}
+
+void AUnrealSandBoxGameMode::SpawnBotWave(int32 Count)
+{
+	SANDBOX_SCOPED_TIMER(GameMode, TEXT("GameMode.SpawnBotWave"));
+
+	FVector Origin = FVector::ZeroVector;
+	if (APlayerController* PlayerController = GetWorld()->GetFirstPlayerController())
+	{
+		if (APawn* PlayerPawn = PlayerController->GetPawn())
+		{
+			Origin = PlayerPawn->GetActorLocation();
+		}
+	}
+
+	// lay the wave out on a grid in front of the player
+	const int32 NumColumns = FMath::Max(FMath::CeilToInt(FMath::Sqrt(static_cast<float>(Count))), 1);
+	const float Spacing = 200.0f;
+
+	const double StartSec = FPlatformTime::Seconds();
+	int32 NumSpawned = 0;
+	for (int32 i = 0; i < Count; ++i)
+	{
+		const FVector Location = Origin + FVector(Spacing + (i / NumColumns) * Spacing, ((i % NumColumns) - NumColumns / 2) * Spacing, 0.0f);
+		APawn* Bot = SpawnBot(DefaultPawnClass, FTransform(Location), ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn);
+		if (Bot != nullptr)
+		{
+			WaveBots.Add(Bot);
+			++NumSpawned;
+		}
+	}
+
+	UE_LOG(LogTemp, Log, TEXT("SpawnBotWave Spawned:%d TotalMs:%.2f"), NumSpawned, (FPlatformTime::Seconds() - StartSec) * 1000.0);
+}
+
+void AUnrealSandBoxGameMode::ReleaseBotWave()
+{
+	SANDBOX_SCOPED_TIMER(GameMode, TEXT("GameMode.ReleaseBotWave"));
+
+	for (const TWeakObjectPtr<APawn>& Bot : WaveBots)
+	{
+		APawn* Pawn = Bot.Get();
+		if (Pawn != nullptr && !ReleasePawn(Pawn))
+		{
+			if (AController* Controller = Pawn->GetController())
+			{
+				Controller->Destroy();
+			}
+			Pawn->Destroy();
+		}
+	}
+	WaveBots.Reset();
+}
+
+void AUnrealSandBoxGameMode::DumpPawnPoolStats() const
+{
+	if (PawnPool.IsValid())
+	{
+		PawnPool->DumpStats();
+	}
+	else
+	{
+		UE_LOG(LogTemp, Log, TEXT("PawnPool is disabled"));
+	}
+}
+
+FPawnPool* AUnrealSandBoxGameMode::GetPawnPool(UClass* PawnClass) const
+{
+	return PawnPool.IsValid() && PawnClass == PawnPool->GetCharacterClass() ? PawnPool.Get() : nullptr;
+}
+
+TArray<FSoftObjectPath> AUnrealSandBoxGameMode::GetPreloadAssetPaths() const
+{
+	TArray<FSoftObjectPath> Paths = PreloadAssets;
+	Paths.Add(PreloadPawnClass.ToSoftObjectPath());
+	return Paths;
 }
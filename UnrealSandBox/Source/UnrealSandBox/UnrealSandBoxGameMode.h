@@ -13,6 +13,83 @@ class AUnrealSandBoxGameMode : public AGameModeBase
 
 public:
 	AUnrealSandBoxGameMode();
+
+	// AGameModeBase interface
+	virtual void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) override;
+	virtual bool PlayerCanRestart_Implementation(APlayerController* Player) override;
+	virtual APawn* SpawnDefaultPawnAtTransform_Implementation(AController* NewPlayer, const FTransform& SpawnTransform) override;
+	virtual void Logout(AController* Exiting) override;
+	// End of AGameModeBase interface
+
+	/**
+	 * Takes a character from the pawn pool (spawning one if the pool is empty) and gives it a default AI controller.
+	 * Falls back to a regular spawn when pooling is disabled or PawnClass is not the pooled class.
+	 */
+	APawn* SpawnBot(UClass* PawnClass, const FTransform& SpawnTransform, ESpawnActorCollisionHandlingMethod CollisionHandling);
+
+	/**
+	 * Unpossesses Pawn and parks it in the pawn pool instead of destroying it. Non-player controllers are destroyed.
+	 * @return false if the pawn can't be pooled, in which case it is left untouched
+	 */
+	bool ReleasePawn(APawn* Pawn);
+
+	/** Spawns Count bots around the first player at once and logs how long the wave took. */
+	void SpawnBotWave(int32 Count);
+
+	/** Returns every bot spawned by SpawnBotWave to the pool. */
+	void ReleaseBotWave();
+
+	/** Logs pool hit/miss counts and spawn times. */
+	void DumpPawnPoolStats() const;
+
+	/** Returns the pool for DefaultPawnClass, or null if pooling is disabled. */
+	class FPawnPool* GetDefaultPawnPool() const { return PawnPool.Get(); }
+
+	/** Returns PreloadPawnClass and PreloadAssets, the assets streamed in at startup. */
+	TArray<FSoftObjectPath> GetPreloadAssetPaths() const;
+
+	/**
+	 * Pawn class streamed in by the startup preload. It becomes DefaultPawnClass once loaded,
+	 * and players are not spawned until then.
+	 */
+	UPROPERTY(Config, EditDefaultsOnly, Category = Preload)
+	TSoftClassPtr<APawn> PreloadPawnClass;
+
+	/** Assets streamed in alongside PreloadPawnClass so the first spawn doesn't load anything synchronously. */
+	UPROPERTY(Config, EditDefaultsOnly, Category = Preload)
+	TArray<FSoftObjectPath> PreloadAssets;
+
+	/** Number of pawns spawned and parked in the pool in BeginPlay. */
+	UPROPERTY(Config, EditDefaultsOnly, Category = PawnPool)
+	int32 PawnPoolPrewarmCount;
+
+	/** If false, pawns are spawned and destroyed as usual. */
+	UPROPERTY(Config, EditDefaultsOnly, Category = PawnPool)
+	bool bUsePawnPool;
+
+protected:
+	// AActor interface
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	// End of AActor interface
+
+private:
+	/** Switches to the preloaded pawn class and spawns the players that were held back. */
+	void OnPreloadCompleted();
+
+	/** Creates and pre-warms the pawn pool for DefaultPawnClass. */
+	void InitPawnPool();
+
+	/** Returns the pool for PawnClass, or null if that class isn't pooled. */
+	class FPawnPool* GetPawnPool(UClass* PawnClass) const;
+
+	TSharedPtr<class FPawnPool> PawnPool;
+
+	/** True once the startup preload has finished and DefaultPawnClass is usable. */
+	bool bPreloadCompleted;
+
+	/** Bots spawned by SpawnBotWave. */
+	TArray<TWeakObjectPtr<APawn>> WaveBots;
 };
 
 
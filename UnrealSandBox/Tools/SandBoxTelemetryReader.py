@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+# Reads the frame telemetry that FSandBoxTelemetry publishes to shared memory.
+#
+#   UnrealSandBoxServer -SandBoxTelemetry -SandBoxTelemetryName=Soak
+#   python3 SandBoxTelemetryReader.py Soak            # summary every second
+#   python3 SandBoxTelemetryReader.py Soak --csv      # every sample as CSV
+#
+# The layout must match Private/SandBoxTelemetry.h. Each slot is guarded by a
+# sequence number (odd while the game writes it), so the reader never blocks
+# the game; a slot whose sequence changes while being copied is read again.
+
+import argparse
+import mmap
+import os
+import struct
+import sys
+import time
+
+MAGIC = 0x4D544253
+VERSION = 1
+
+HEADER = struct.Struct('<IIIIIIQ')
+HEADER_SIZE = 64
+SEQUENCE = struct.Struct('<Q')
+SAMPLE = struct.Struct('<QdfffiiiiiiI')
+SAMPLE_FIELDS = ('FrameNumber', 'TimeSec', 'FrameMs', 'GameThreadMs', 'RenderThreadMs', 'NumPendingJobs',
+                 'PoolAvailable', 'PoolHits', 'PoolMisses', 'PoolReleases', 'NumCharacters')
+NUM_WRITTEN_OFFSET = 24
+
+
+def open_region(name):
+    if sys.platform == 'win32':
+        # FWindowsPlatformMemory prefixes the name with Global\
+        header = mmap.mmap(-1, HEADER_SIZE, tagname='Global\\' + name, access=mmap.ACCESS_READ)
+        magic, version, header_size, slot_size, num_slots, pid, _ = HEADER.unpack_from(header, 0)
+        header.close()
+        return mmap.mmap(-1, header_size + slot_size * num_slots, tagname='Global\\' + name, access=mmap.ACCESS_READ)
+    fd = os.open('/dev/shm/' + name, os.O_RDONLY)
+    try:
+        return mmap.mmap(fd, 0, access=mmap.ACCESS_READ)
+    finally:
+        os.close(fd)
+
+
+def read_header(region):
+    magic, version, header_size, slot_size, num_slots, pid, _ = HEADER.unpack_from(region, 0)
+    if magic != MAGIC:
+        raise RuntimeError('not a SandBoxTelemetry region (or the game has not finished creating it)')
+    if version != VERSION or header_size != HEADER_SIZE or slot_size != SEQUENCE.size + SAMPLE.size:
+        raise RuntimeError('layout mismatch: version %d header %d slot %d' % (version, header_size, slot_size))
+    return num_slots, pid
+
+
+def read_sample(region, num_slots, index):
+    """Returns the sample with the given index, None if it was overwritten."""
+    offset = HEADER_SIZE + (index % num_slots) * (SEQUENCE.size + SAMPLE.size)
+    expected = index * 2 + 2
+    while True:
+        before, = SEQUENCE.unpack_from(region, offset)
+        if before != expected:
+            # odd: being written right now, larger: already lapped by the writer
+            if before == expected - 1:
+                continue
+            return None
+        values = SAMPLE.unpack_from(region, offset + SEQUENCE.size)
+        after, = SEQUENCE.unpack_from(region, offset)
+        if after == before:
+            return values
+
+
+class Summary:
+    def __init__(self):
+        self.reset()
+
+    def reset(self):
+        self.count = 0
+        self.lost = 0
+        self.frame_total = 0.0
+        self.frame_max = 0.0
+        self.game_max = 0.0
+        self.jobs_max = 0
+        self.last = None
+
+    def add(self, sample):
+        self.count += 1
+        self.frame_total += sample[2]
+        self.frame_max = max(self.frame_max, sample[2])
+        self.game_max = max(self.game_max, sample[3])
+        self.jobs_max = max(self.jobs_max, sample[5])
+        self.last = sample
+
+    def line(self):
+        if self.count == 0:
+            return 'no samples lost:%d' % self.lost
+        last = dict(zip(SAMPLE_FIELDS, self.last))
+        pool = 'off'
+        if last['PoolAvailable'] >= 0:
+            in_use = last['PoolHits'] + last['PoolMisses'] - last['PoolReleases']
+            total = in_use + last['PoolAvailable']
+            pool = '%d/%d (%.0f%%) spawned:%d' % (in_use, total, 100.0 * in_use / total if total > 0 else 0.0, last['PoolMisses'])
+        return ('frame:%d samples:%d lost:%d frameMs avg:%.2f max:%.2f gameMs max:%.2f jobs max:%d pool:%s chars:%d'
+                % (last['FrameNumber'], self.count, self.lost, self.frame_total / self.count, self.frame_max,
+                   self.game_max, self.jobs_max, pool, last['NumCharacters']))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('name', help='shared memory name (-SandBoxTelemetryName, default SandBoxTelemetry_<pid>)')
+    parser.add_argument('--hz', type=float, default=1000.0, help='polling frequency')
+    parser.add_argument('--interval', type=float, default=1.0, help='seconds between summary lines')
+    parser.add_argument('--csv', action='store_true', help='print every sample as CSV instead of summaries')
+    args = parser.parse_args()
+
+    region = open_region(args.name)
+    num_slots, pid = read_header(region)
+    print('# %s pid:%d slots:%d' % (args.name, pid, num_slots), file=sys.stderr)
+    if args.csv:
+        print(','.join(SAMPLE_FIELDS))
+
+    # start from the newest sample instead of replaying the whole ring
+    next_index, = SEQUENCE.unpack_from(region, NUM_WRITTEN_OFFSET)
+    summary = Summary()
+    next_report = time.monotonic() + args.interval
+    try:
+        while True:
+            num_written, = SEQUENCE.unpack_from(region, NUM_WRITTEN_OFFSET)
+            if num_written - next_index > num_slots:
+                summary.lost += num_written - num_slots - next_index
+                next_index = num_written - num_slots
+            while next_index < num_written:
+                sample = read_sample(region, num_slots, next_index)
+                next_index += 1
+                if sample is None:
+                    summary.lost += 1
+                elif args.csv:
+                    print(','.join(str(value) for value in sample[:len(SAMPLE_FIELDS)]))
+                else:
+                    summary.add(sample)
+
+            now = time.monotonic()
+            if not args.csv and now >= next_report:
+                print(summary.line(), flush=True)
+                summary.reset()
+                next_report = now + args.interval
+            time.sleep(1.0 / args.hz)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == '__main__':
+    main()